@@ -21,12 +21,16 @@
 #define GUAC_COMMON_SSH_SFTP_H
 
 #include "common/json.h"
+#include "common/read_ahead.h"
+#include "common/transfer.h"
+#include "common/write_queue.h"
 #include "ssh.h"
 
 #include <guacamole/object.h>
 #include <guacamole/user.h>
 #include <libssh2.h>
 #include <libssh2_sftp.h>
+#include <pthread.h>
 
 /**
  * Maximum number of bytes per path.
@@ -59,6 +63,14 @@ typedef struct guac_common_ssh_sftp_filesystem {
      */
     LIBSSH2_SFTP* sftp_session;
 
+    /**
+     * Lock which must be held while the SFTP session is in use. Uploaded
+     * data is written from the thread of each upload's write queue, rather
+     * than from the thread handling the user's instructions, so use of the
+     * session is not otherwise serialized.
+     */
+    pthread_mutex_t lock;
+
     /**
      * The path to the directory to expose to the user as a filesystem object.
      */
@@ -108,8 +120,86 @@ typedef struct guac_common_ssh_sftp_ls_state {
      */
     guac_common_json_state json_state;
 
+    /**
+     * Non-zero if all directory entries have been written and the directory
+     * has been closed, such that the stream only remains open until all
+     * blobs sent have been acknowledged, zero otherwise.
+     */
+    int complete;
+
 } guac_common_ssh_sftp_ls_state;
 
+/**
+ * The current state of a file download.
+ */
+typedef struct guac_common_ssh_sftp_download_state {
+
+    /**
+     * The SFTP filesystem containing the file being downloaded.
+     */
+    guac_common_ssh_sftp_filesystem* filesystem;
+
+    /**
+     * The file being downloaded. This file must already be open from a call
+     * to libssh2_sftp_open().
+     */
+    LIBSSH2_SFTP_HANDLE* file;
+
+    /**
+     * The state of the outbound transfer of the file's contents.
+     */
+    guac_common_transfer* transfer;
+
+    /**
+     * The contents of the file which have been read over SFTP but not yet
+     * sent. Reads are performed in the background, ahead of the transfer.
+     */
+    guac_common_read_ahead* read_ahead;
+
+} guac_common_ssh_sftp_download_state;
+
+/**
+ * The current state of a file upload.
+ */
+typedef struct guac_common_ssh_sftp_upload_state {
+
+    /**
+     * The SFTP filesystem containing the file being uploaded.
+     */
+    guac_common_ssh_sftp_filesystem* filesystem;
+
+    /**
+     * The file being uploaded. This file must already be open from a call to
+     * libssh2_sftp_open().
+     */
+    LIBSSH2_SFTP_HANDLE* file;
+
+    /**
+     * The user uploading the file.
+     */
+    guac_user* user;
+
+    /**
+     * The stream over which the file is being uploaded.
+     */
+    guac_stream* stream;
+
+    /**
+     * Whether the deferred ack currently being sent reports a failed write.
+     * This is only accessed by the thread of the write queue.
+     */
+    int ack_error;
+
+    /**
+     * The queue of received data not yet written to the file. Data is
+     * written to the file in the background, such that each blob can be
+     * acknowledged as soon as it has been queued, or, if the queue is full,
+     * as soon as it has room.
+     */
+    guac_common_write_queue* queue;
+
+} guac_common_ssh_sftp_upload_state;
+
 /**
  * Creates a new Guacamole filesystem object which provides access to files
  * and directories via SFTP using the given SSH session. When the filesystem
@@ -30,6 +30,8 @@
 
 #include <fcntl.h>
 #include <libgen.h>
+#include <pthread.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 
@@ -283,11 +285,185 @@ static int guac_ssh_append_path(char* fullpath, const char* path_a,
 
 }
 
+/**
+ * Write handler for the guac_common_write_queue of a file upload, writing
+ * sequentially to the uploaded file over SFTP. This handler is invoked only
+ * from the thread of the write queue.
+ *
+ * @param data
+ *     The guac_common_ssh_sftp_upload_state of the upload.
+ *
+ * @param offset
+ *     The offset within the file to write to, in bytes. As SFTP file handles
+ *     track their own position, and writes are always sequential, this is
+ *     ignored.
+ *
+ * @param buffer
+ *     The data to write.
+ *
+ * @param length
+ *     The number of bytes to write.
+ *
+ * @return
+ *     The number of bytes written, or a negative value on error.
+ */
+static int guac_common_ssh_sftp_upload_write(void* data, uint64_t offset,
+        const char* buffer, int length) {
+
+    guac_common_ssh_sftp_upload_state* upload_state =
+        (guac_common_ssh_sftp_upload_state*) data;
+
+    guac_common_ssh_sftp_filesystem* filesystem = upload_state->filesystem;
+
+    pthread_mutex_lock(&(filesystem->lock));
+    int bytes_written = libssh2_sftp_write(upload_state->file, buffer, length);
+    pthread_mutex_unlock(&(filesystem->lock));
+
+    return bytes_written;
+
+}
+
+/**
+ * Callback for guac_client_for_user() which sends the deferred
+ * acknowledgement of a blob of a file upload to the uploading user, if that
+ * user is still connected.
+ *
+ * @param user
+ *     The user uploading the file, or NULL if that user has left.
+ *
+ * @param data
+ *     The guac_common_ssh_sftp_upload_state of the upload.
+ *
+ * @return
+ *     Always NULL.
+ */
+static void* guac_common_ssh_sftp_upload_send_ack(guac_user* user,
+        void* data) {
+
+    guac_common_ssh_sftp_upload_state* upload_state =
+        (guac_common_ssh_sftp_upload_state*) data;
+
+    if (user == NULL)
+        return NULL;
+
+    if (upload_state->ack_error)
+        guac_protocol_send_ack(user->socket, upload_state->stream,
+                "SFTP: Write failed", GUAC_PROTOCOL_STATUS_SERVER_ERROR);
+    else
+        guac_protocol_send_ack(user->socket, upload_state->stream,
+                "SFTP: OK", GUAC_PROTOCOL_STATUS_SUCCESS);
+
+    guac_socket_flush(user->socket);
+    return NULL;
+
+}
+
+/**
+ * Ack handler for the guac_common_write_queue of a file upload, sending the
+ * acknowledgement of a blob which was deferred because the queue was full.
+ * This handler is invoked only from the thread of the write queue.
+ *
+ * @param data
+ *     The guac_common_ssh_sftp_upload_state of the upload.
+ *
+ * @param error
+ *     Non-zero if a write has failed, zero otherwise.
+ */
+static void guac_common_ssh_sftp_upload_ack(void* data, int error) {
+
+    guac_common_ssh_sftp_upload_state* upload_state =
+        (guac_common_ssh_sftp_upload_state*) data;
+
+    /* The user may have left while the ack was deferred */
+    upload_state->ack_error = error;
+    guac_client_for_user(upload_state->user->client, upload_state->user,
+            guac_common_ssh_sftp_upload_send_ack, upload_state);
+
+}
+
+/**
+ * Opens the file at the given path over SFTP for writing, creating or
+ * truncating the file as necessary, and allocates the state of a new upload
+ * to that file.
+ *
+ * @param filesystem
+ *     The SFTP filesystem containing the file.
+ *
+ * @param path
+ *     The absolute path of the file to upload to.
+ *
+ * @param user
+ *     The user uploading the file.
+ *
+ * @param stream
+ *     The stream over which the file is being uploaded.
+ *
+ * @param status
+ *     A pointer to the guac_protocol_status which should receive the status
+ *     describing why the upload could not be started, if it fails.
+ *
+ * @return
+ *     The state of a new upload, or NULL if the file cannot be opened or the
+ *     upload state cannot be allocated.
+ */
+static guac_common_ssh_sftp_upload_state* guac_common_ssh_sftp_upload_open(
+        guac_common_ssh_sftp_filesystem* filesystem, const char* path,
+        guac_user* user, guac_stream* stream, guac_protocol_status* status) {
+
+    /* Open file via SFTP */
+    pthread_mutex_lock(&(filesystem->lock));
+    LIBSSH2_SFTP_HANDLE* file = libssh2_sftp_open(filesystem->sftp_session,
+            path, LIBSSH2_FXF_WRITE | LIBSSH2_FXF_CREAT | LIBSSH2_FXF_TRUNC,
+            S_IRUSR | S_IWUSR);
+
+    if (file == NULL) {
+        *status = guac_sftp_get_status(filesystem);
+        pthread_mutex_unlock(&(filesystem->lock));
+        return NULL;
+    }
+
+    pthread_mutex_unlock(&(filesystem->lock));
+
+    guac_common_ssh_sftp_upload_state* upload_state =
+        malloc(sizeof(guac_common_ssh_sftp_upload_state));
+    if (upload_state == NULL)
+        goto fail;
+
+    upload_state->filesystem = filesystem;
+    upload_state->file = file;
+    upload_state->user = user;
+    upload_state->stream = stream;
+    upload_state->ack_error = 0;
+    upload_state->queue = guac_common_write_queue_alloc(
+            guac_common_ssh_sftp_upload_write,
+            guac_common_ssh_sftp_upload_ack, upload_state);
+
+    if (upload_state->queue == NULL) {
+        free(upload_state);
+        goto fail;
+    }
+
+    return upload_state;
+
+fail:
+    pthread_mutex_lock(&(filesystem->lock));
+    libssh2_sftp_close(file);
+    pthread_mutex_unlock(&(filesystem->lock));
+
+    *status = GUAC_PROTOCOL_STATUS_SERVER_ERROR;
+    return NULL;
+
+}
+
 /**
  * Handler for blob messages which continue an inbound SFTP data transfer
  * (upload). The data associated with the given stream is expected to be a
- * pointer to an open LIBSSH2_SFTP_HANDLE for the file to which the data
- * should be written.
+ * pointer to the guac_common_ssh_sftp_upload_state of the upload, or NULL if
+ * the file could not be opened. Received data is queued and acknowledged
+ * immediately, with any failure to write previously-queued data reported in
+ * the ack. If the queue is full, the ack is instead sent by the thread of the
+ * queue once there is room, such that the user stops sending data without
+ * this handler waiting for any write.
  *
  * @param user
  *     The user receiving the blob message.
@@ -307,17 +483,28 @@ static int guac_ssh_append_path(char* fullpath, const char* path_a,
 static int guac_common_ssh_sftp_blob_handler(guac_user* user,
         guac_stream* stream, void* data, int length) {
 
-    /* Pull file from stream */
-    LIBSSH2_SFTP_HANDLE* file = (LIBSSH2_SFTP_HANDLE*) stream->data;
+    /* Pull upload state from stream */
+    guac_common_ssh_sftp_upload_state* upload_state =
+        (guac_common_ssh_sftp_upload_state*) stream->data;
+
+    /* Attempt to queue write */
+    guac_common_write_queue_status status = GUAC_COMMON_WRITE_QUEUE_FAILED;
+    if (upload_state != NULL)
+        status = guac_common_write_queue_write(upload_state->queue, data,
+                length);
 
-    /* Attempt write */
-    if (libssh2_sftp_write(file, data, length) == length) {
-        guac_user_log(user, GUAC_LOG_DEBUG, "%i bytes written", length);
+    if (status == GUAC_COMMON_WRITE_QUEUE_QUEUED) {
+        guac_user_log(user, GUAC_LOG_DEBUG, "%i bytes queued", length);
         guac_protocol_send_ack(user->socket, stream, "SFTP: OK",
                 GUAC_PROTOCOL_STATUS_SUCCESS);
         guac_socket_flush(user->socket);
     }
 
+    /* Ack will be sent by the queue once it has room */
+    else if (status == GUAC_COMMON_WRITE_QUEUE_DEFERRED)
+        guac_user_log(user, GUAC_LOG_DEBUG, "%i bytes queued (ack "
+                "deferred)", length);
+
     /* Inform of any errors */
     else {
         guac_user_log(user, GUAC_LOG_INFO, "Unable to write to file");
@@ -333,8 +520,9 @@ static int guac_common_ssh_sftp_blob_handler(guac_user* user,
 /**
  * Handler for end messages which terminate an inbound SFTP data transfer
  * (upload). The data associated with the given stream is expected to be a
- * pointer to an open LIBSSH2_SFTP_HANDLE for the file to which the data
- * has been written and which should now be closed.
+ * pointer to the guac_common_ssh_sftp_upload_state of the upload, or NULL if
+ * the file could not be opened. All queued data is written before the file is
+ * closed and the upload state freed.
  *
  * @param user
  *     The user receiving the end message.
@@ -348,11 +536,38 @@ static int guac_common_ssh_sftp_blob_handler(guac_user* user,
 static int guac_common_ssh_sftp_end_handler(guac_user* user,
         guac_stream* stream) {
 
-    /* Pull file from stream */
-    LIBSSH2_SFTP_HANDLE* file = (LIBSSH2_SFTP_HANDLE*) stream->data;
+    /* Pull upload state from stream */
+    guac_common_ssh_sftp_upload_state* upload_state =
+        (guac_common_ssh_sftp_upload_state*) stream->data;
+
+    /* Nothing to close if the file could not be opened */
+    if (upload_state == NULL) {
+        guac_user_log(user, GUAC_LOG_INFO, "Unable to close file");
+        guac_protocol_send_ack(user->socket, stream, "SFTP: Close failed",
+                GUAC_PROTOCOL_STATUS_SERVER_ERROR);
+        guac_socket_flush(user->socket);
+        return 0;
+    }
+
+    guac_common_ssh_sftp_filesystem* filesystem = upload_state->filesystem;
+
+    /* Finish writing all queued data */
+    int write_error = guac_common_write_queue_free(upload_state->queue);
 
     /* Attempt to close file */
-    if (libssh2_sftp_close(file) == 0) {
+    pthread_mutex_lock(&(filesystem->lock));
+    int close_error = libssh2_sftp_close(upload_state->file);
+    pthread_mutex_unlock(&(filesystem->lock));
+
+    free(upload_state);
+
+    if (write_error) {
+        guac_user_log(user, GUAC_LOG_INFO, "Unable to write to file");
+        guac_protocol_send_ack(user->socket, stream, "SFTP: Write failed",
+                GUAC_PROTOCOL_STATUS_SERVER_ERROR);
+        guac_socket_flush(user->socket);
+    }
+    else if (close_error == 0) {
         guac_user_log(user, GUAC_LOG_DEBUG, "File closed");
         guac_protocol_send_ack(user->socket, stream, "SFTP: OK",
                 GUAC_PROTOCOL_STATUS_SUCCESS);
@@ -374,7 +589,8 @@ int guac_common_ssh_sftp_handle_file_stream(
         guac_stream* stream, char* mimetype, char* filename) {
 
     char fullpath[GUAC_COMMON_SSH_SFTP_MAX_PATH];
-    LIBSSH2_SFTP_HANDLE* file;
+    guac_common_ssh_sftp_upload_state* upload_state;
+    guac_protocol_status status;
 
     /* Ignore upload if uploads have been disabled */
     if (filesystem->disable_upload) {
@@ -406,12 +622,11 @@ int guac_common_ssh_sftp_handle_file_stream(
     }
 
     /* Open file via SFTP */
-    file = libssh2_sftp_open(filesystem->sftp_session, fullpath,
-            LIBSSH2_FXF_WRITE | LIBSSH2_FXF_CREAT | LIBSSH2_FXF_TRUNC,
-            S_IRUSR | S_IWUSR);
+    upload_state = guac_common_ssh_sftp_upload_open(filesystem, fullpath,
+            user, stream, &status);
 
     /* Inform of status */
-    if (file != NULL) {
+    if (upload_state != NULL) {
 
         guac_user_log(user, GUAC_LOG_DEBUG,
                 "File \"%s\" opened",
@@ -425,7 +640,7 @@ int guac_common_ssh_sftp_handle_file_stream(
         guac_user_log(user, GUAC_LOG_INFO,
                 "Unable to open file \"%s\"", fullpath);
         guac_protocol_send_ack(user->socket, stream, "SFTP: Open failed",
-                guac_sftp_get_status(filesystem));
+                status);
         guac_socket_flush(user->socket);
     }
 
@@ -433,8 +648,8 @@ int guac_common_ssh_sftp_handle_file_stream(
     stream->blob_handler = guac_common_ssh_sftp_blob_handler;
     stream->end_handler = guac_common_ssh_sftp_end_handler;
 
-    /* Store file within stream */
-    stream->data = file;
+    /* Store upload state within stream */
+    stream->data = upload_state;
     return 0;
 
 }
@@ -442,8 +657,10 @@ int guac_common_ssh_sftp_handle_file_stream(
 /**
  * Handler for ack messages which continue an outbound SFTP data transfer
  * (download), signaling the current status and requesting additional data.
- * The data associated with the given stream is expected to be a pointer to an
- * open LIBSSH2_SFTP_HANDLE for the file from which the data is to be read.
+ * The data associated with the given stream is expected to be a pointer to
+ * the guac_common_ssh_sftp_download_state of the download. Several blobs of
+ * data are kept in flight at once, as allowed by the transfer window, with
+ * the file itself read ahead of the transfer in the background.
  *
  * @param user
  *     The user receiving the ack message.
@@ -465,60 +682,170 @@ int guac_common_ssh_sftp_handle_file_stream(
 static int guac_common_ssh_sftp_ack_handler(guac_user* user,
         guac_stream* stream, char* message, guac_protocol_status status) {
 
-    /* Pull file from stream */
-    LIBSSH2_SFTP_HANDLE* file = (LIBSSH2_SFTP_HANDLE*) stream->data;
+    /* Pull download state from stream */
+    guac_common_ssh_sftp_download_state* download_state =
+        (guac_common_ssh_sftp_download_state*) stream->data;
 
-    /* If successful, read data */
-    if (status == GUAC_PROTOCOL_STATUS_SUCCESS) {
+    /* Send further data, cleaning up once the transfer is over */
+    int result = guac_common_transfer_ack(download_state->transfer, user,
+            stream, status);
 
-        /* Attempt read into buffer */
-        char buffer[4096];
-        int bytes_read = libssh2_sftp_read(file, buffer, sizeof(buffer)); 
+    if (result != GUAC_COMMON_TRANSFER_IN_PROGRESS) {
 
-        /* If bytes read, send as blob */
-        if (bytes_read > 0) {
-            guac_protocol_send_blob(user->socket, stream,
-                    buffer, bytes_read);
+        if (result == GUAC_COMMON_TRANSFER_COMPLETE)
+            guac_user_log(user, GUAC_LOG_DEBUG, "File sent");
 
-            guac_user_log(user, GUAC_LOG_DEBUG, "%i bytes sent to user",
-                    bytes_read);
+        guac_user_free_stream(user, stream);
 
-        }
+        /* Stop reading ahead before closing file */
+        guac_common_read_ahead_free(download_state->read_ahead);
 
-        /* If bytes could not be read, handle EOF or error condition */
-        else {
+        /* Close file */
+        guac_common_ssh_sftp_filesystem* filesystem =
+            download_state->filesystem;
 
-            /* If EOF, send end */
-            if (bytes_read == 0) {
-                guac_user_log(user, GUAC_LOG_DEBUG, "File sent");
-                guac_protocol_send_end(user->socket, stream);
-                guac_user_free_stream(user, stream);
-            }
+        pthread_mutex_lock(&(filesystem->lock));
+        int close_error = libssh2_sftp_close(download_state->file);
+        pthread_mutex_unlock(&(filesystem->lock));
 
-            /* Otherwise, fail stream */
-            else {
-                guac_user_log(user, GUAC_LOG_INFO, "Error reading file");
-                guac_protocol_send_end(user->socket, stream);
-                guac_user_free_stream(user, stream);
-            }
+        if (close_error == 0)
+            guac_user_log(user, GUAC_LOG_DEBUG, "File closed");
+        else
+            guac_user_log(user, GUAC_LOG_INFO, "Unable to close file");
 
-            /* Close file */
-            if (libssh2_sftp_close(file) == 0)
-                guac_user_log(user, GUAC_LOG_DEBUG, "File closed");
-            else
-                guac_user_log(user, GUAC_LOG_INFO, "Unable to close file");
+        guac_common_transfer_free(download_state->transfer);
+        free(download_state);
 
-        }
+    }
 
-        guac_socket_flush(user->socket);
+    guac_socket_flush(user->socket);
+    return 0;
+}
+
+/**
+ * Read handler for the guac_common_read_ahead of a file download, reading
+ * sequentially from the downloaded file over SFTP. This handler is invoked
+ * only from the thread of the read-ahead buffer. As each read is much larger
+ * than a single SFTP read request, libssh2 keeps several requests in flight
+ * at once.
+ *
+ * @param data
+ *     The guac_common_ssh_sftp_download_state of the download.
+ *
+ * @param offset
+ *     The offset within the file to read from, in bytes. As SFTP file
+ *     handles track their own position, and reads are always sequential,
+ *     this is ignored.
+ *
+ * @param buffer
+ *     The buffer to read data into.
+ *
+ * @param length
+ *     The maximum number of bytes to read.
+ *
+ * @return
+ *     The number of bytes read, zero on EOF, or a negative value on error.
+ */
+static int guac_common_ssh_sftp_download_prefetch(void* data,
+        uint64_t offset, char* buffer, int length) {
+
+    guac_common_ssh_sftp_download_state* download_state =
+        (guac_common_ssh_sftp_download_state*) data;
+
+    guac_common_ssh_sftp_filesystem* filesystem = download_state->filesystem;
+
+    pthread_mutex_lock(&(filesystem->lock));
+    int bytes_read = libssh2_sftp_read(download_state->file, buffer, length);
+    pthread_mutex_unlock(&(filesystem->lock));
+
+    return bytes_read;
+
+}
+
+/**
+ * Read handler for the guac_common_transfer of a file download, consuming
+ * data which has already been read from the downloaded file by its
+ * read-ahead buffer.
+ *
+ * @param data
+ *     The guac_common_ssh_sftp_download_state of the download.
+ *
+ * @param offset
+ *     The offset within the file to read from, in bytes. As reads are always
+ *     sequential, this is ignored.
+ *
+ * @param buffer
+ *     The buffer to read data into.
+ *
+ * @param length
+ *     The maximum number of bytes to read.
+ *
+ * @return
+ *     The number of bytes read, zero on EOF, or a negative value on error.
+ */
+static int guac_common_ssh_sftp_download_read(void* data, uint64_t offset,
+        char* buffer, int length) {
+
+    guac_common_ssh_sftp_download_state* download_state =
+        (guac_common_ssh_sftp_download_state*) data;
 
+    return guac_common_read_ahead_read(download_state->read_ahead, buffer,
+            length);
+
+}
+
+/**
+ * Allocates the state of a new download of the given open file, and
+ * associates that state with the given stream, such that acks received along
+ * the stream continue the download.
+ *
+ * @param filesystem
+ *     The SFTP filesystem containing the file.
+ *
+ * @param stream
+ *     The stream over which the file will be sent.
+ *
+ * @param file
+ *     The open file to download.
+ *
+ * @return
+ *     Zero if the download state was allocated successfully, non-zero
+ *     otherwise.
+ */
+static int guac_common_ssh_sftp_download_begin(
+        guac_common_ssh_sftp_filesystem* filesystem, guac_stream* stream,
+        LIBSSH2_SFTP_HANDLE* file) {
+
+    guac_common_ssh_sftp_download_state* download_state =
+        malloc(sizeof(guac_common_ssh_sftp_download_state));
+    if (download_state == NULL)
+        return 1;
+
+    download_state->filesystem = filesystem;
+    download_state->file = file;
+    download_state->transfer = guac_common_transfer_alloc(
+            guac_common_ssh_sftp_download_read, download_state,
+            GUAC_COMMON_TRANSFER_DEFAULT_WINDOW);
+
+    if (download_state->transfer == NULL) {
+        free(download_state);
+        return 1;
     }
 
-    /* Otherwise, return stream to user */
-    else
-        guac_user_free_stream(user, stream);
+    /* Begin reading the file ahead of the transfer */
+    download_state->read_ahead = guac_common_read_ahead_alloc(
+            guac_common_ssh_sftp_download_prefetch, download_state);
+
+    if (download_state->read_ahead == NULL) {
+        guac_common_transfer_free(download_state->transfer);
+        free(download_state);
+        return 1;
+    }
 
+    stream->ack_handler = guac_common_ssh_sftp_ack_handler;
+    stream->data = download_state;
     return 0;
+
 }
 
 guac_stream* guac_common_ssh_sftp_download_file(
@@ -538,8 +865,11 @@ guac_stream* guac_common_ssh_sftp_download_file(
     }
 
     /* Attempt to open file for reading */
+    pthread_mutex_lock(&(filesystem->lock));
     file = libssh2_sftp_open(filesystem->sftp_session, filename,
             LIBSSH2_FXF_READ, 0);
+    pthread_mutex_unlock(&(filesystem->lock));
+
     if (file == NULL) {
         guac_user_log(user, GUAC_LOG_INFO, 
                 "Unable to read file \"%s\"", filename);
@@ -548,8 +878,13 @@ guac_stream* guac_common_ssh_sftp_download_file(
 
     /* Allocate stream */
     stream = guac_user_alloc_stream(user);
-    stream->ack_handler = guac_common_ssh_sftp_ack_handler;
-    stream->data = file;
+    if (guac_common_ssh_sftp_download_begin(filesystem, stream, file)) {
+        guac_user_free_stream(user, stream);
+        pthread_mutex_lock(&(filesystem->lock));
+        libssh2_sftp_close(file);
+        pthread_mutex_unlock(&(filesystem->lock));
+        return NULL;
+    }
 
     /* Send stream start, strip name */
     filename = basename(filename);
@@ -620,18 +955,42 @@ static int guac_common_ssh_sftp_ls_ack_handler(guac_user* user,
 
     /* If unsuccessful, free stream and abort */
     if (status != GUAC_PROTOCOL_STATUS_SUCCESS) {
-        libssh2_sftp_closedir(list_state->directory);
+        if (!list_state->complete) {
+            pthread_mutex_lock(&(filesystem->lock));
+            libssh2_sftp_closedir(list_state->directory);
+            pthread_mutex_unlock(&(filesystem->lock));
+        }
         guac_user_free_stream(user, stream);
         free(list_state);
         return 0;
     }
 
-    /* While directory entries remain */
-    while ((bytes_read = libssh2_sftp_readdir(list_state->directory,
-                filename, sizeof(filename), &attributes)) > 0) {
+    /* Each ack after the first acknowledges one blob */
+    guac_common_json_ack(&list_state->json_state);
+
+    /* Write entries until the window of blobs in flight is full */
+    while (!list_state->complete
+            && !guac_common_json_window_full(&list_state->json_state)) {
 
         char absolute_path[GUAC_COMMON_SSH_SFTP_MAX_PATH];
 
+        /* Read next directory entry */
+        pthread_mutex_lock(&(filesystem->lock));
+        bytes_read = libssh2_sftp_readdir(list_state->directory,
+                filename, sizeof(filename), &attributes);
+        pthread_mutex_unlock(&(filesystem->lock));
+
+        /* Complete JSON and close directory once no entries remain */
+        if (bytes_read <= 0) {
+            guac_common_json_end_object(user, stream, &list_state->json_state);
+            guac_common_json_flush(user, stream, &list_state->json_state);
+            pthread_mutex_lock(&(filesystem->lock));
+            libssh2_sftp_closedir(list_state->directory);
+            pthread_mutex_unlock(&(filesystem->lock));
+            list_state->complete = 1;
+            break;
+        }
+
         /* Skip current and parent directory entries */
         if (strcmp(filename, ".") == 0 || strcmp(filename, "..") == 0)
             continue;
@@ -648,8 +1007,11 @@ static int guac_common_ssh_sftp_ls_ack_handler(guac_user* user,
         }
 
         /* Stat explicitly if symbolic link (might point to directory) */
-        if (LIBSSH2_SFTP_S_ISLNK(attributes.permissions))
+        if (LIBSSH2_SFTP_S_ISLNK(attributes.permissions)) {
+            pthread_mutex_lock(&(filesystem->lock));
             libssh2_sftp_stat(sftp, absolute_path, &attributes);
+            pthread_mutex_unlock(&(filesystem->lock));
+        }
 
         /* Determine mimetype */
         const char* mimetype;
@@ -658,28 +1020,18 @@ static int guac_common_ssh_sftp_ls_ack_handler(guac_user* user,
         else
             mimetype = "application/octet-stream";
 
-        /* Write entry, waiting for next ack if a blob is written */
-        if (guac_common_json_write_property(user, stream,
-                    &list_state->json_state, absolute_path, mimetype))
-            break;
+        /* Write entry */
+        guac_common_json_write_property(user, stream,
+                &list_state->json_state, absolute_path, mimetype);
 
     }
 
-    /* Complete JSON and cleanup at end of directory */
-    if (bytes_read <= 0) {
-
-        /* Complete JSON object */
-        guac_common_json_end_object(user, stream, &list_state->json_state);
-        guac_common_json_flush(user, stream, &list_state->json_state);
-
-        /* Clean up resources */
-        libssh2_sftp_closedir(list_state->directory);
+    /* End stream only once all blobs have been acknowledged, such that no
+     * acks are received for a stream which has since been freed */
+    if (list_state->complete && list_state->json_state.blobs_in_flight == 0) {
         free(list_state);
-
-        /* Signal of stream */
         guac_protocol_send_end(user->socket, stream);
         guac_user_free_stream(user, stream);
-
     }
 
     guac_socket_flush(user->socket);
@@ -755,7 +1107,11 @@ static int guac_common_ssh_sftp_get_handler(guac_user* user,
     }
 
     /* Attempt to read file information */
-    if (libssh2_sftp_stat(sftp, fullpath, &attributes)) {
+    pthread_mutex_lock(&(filesystem->lock));
+    int stat_error = libssh2_sftp_stat(sftp, fullpath, &attributes);
+    pthread_mutex_unlock(&(filesystem->lock));
+
+    if (stat_error) {
         guac_user_log(user, GUAC_LOG_INFO, "Unable to read file \"%s\"",
                 fullpath);
         return 0;
@@ -765,7 +1121,10 @@ static int guac_common_ssh_sftp_get_handler(guac_user* user,
     if (LIBSSH2_SFTP_S_ISDIR(attributes.permissions)) {
 
         /* Open as directory */
+        pthread_mutex_lock(&(filesystem->lock));
         LIBSSH2_SFTP_HANDLE* dir = libssh2_sftp_opendir(sftp, fullpath);
+        pthread_mutex_unlock(&(filesystem->lock));
+
         if (dir == NULL) {
             guac_user_log(user, GUAC_LOG_INFO,
                     "Unable to read directory \"%s\"", fullpath);
@@ -778,6 +1137,7 @@ static int guac_common_ssh_sftp_get_handler(guac_user* user,
 
         list_state->directory = dir;
         list_state->filesystem = filesystem;
+        list_state->complete = 0;
 
         int length = guac_strlcpy(list_state->directory_name, name,
                 sizeof(list_state->directory_name));
@@ -816,8 +1176,11 @@ static int guac_common_ssh_sftp_get_handler(guac_user* user,
         }
         
         /* Open as normal file */
+        pthread_mutex_lock(&(filesystem->lock));
         LIBSSH2_SFTP_HANDLE* file = libssh2_sftp_open(sftp, fullpath,
             LIBSSH2_FXF_READ, 0);
+        pthread_mutex_unlock(&(filesystem->lock));
+
         if (file == NULL) {
             guac_user_log(user, GUAC_LOG_INFO,
                     "Unable to read file \"%s\"", fullpath);
@@ -826,8 +1189,13 @@ static int guac_common_ssh_sftp_get_handler(guac_user* user,
 
         /* Allocate stream for body */
         guac_stream* stream = guac_user_alloc_stream(user);
-        stream->ack_handler = guac_common_ssh_sftp_ack_handler;
-        stream->data = file;
+        if (guac_common_ssh_sftp_download_begin(filesystem, stream, file)) {
+            guac_user_free_stream(user, stream);
+            pthread_mutex_lock(&(filesystem->lock));
+            libssh2_sftp_close(file);
+            pthread_mutex_unlock(&(filesystem->lock));
+            return 0;
+        }
 
         /* Associate new stream with get request */
         guac_protocol_send_body(user->socket, object, stream,
@@ -883,8 +1251,6 @@ static int guac_common_ssh_sftp_put_handler(guac_user* user,
         return 0;
     }
 
-    LIBSSH2_SFTP* sftp = filesystem->sftp_session;
-
     /* Translate stream name into filesystem path */
     if (!guac_common_ssh_sftp_translate_name(fullpath, object, name)) {
         guac_user_log(user, GUAC_LOG_INFO, "Unable to generate real path "
@@ -893,12 +1259,13 @@ static int guac_common_ssh_sftp_put_handler(guac_user* user,
     }
 
     /* Open file via SFTP */
-    LIBSSH2_SFTP_HANDLE* file = libssh2_sftp_open(sftp, fullpath,
-            LIBSSH2_FXF_WRITE | LIBSSH2_FXF_CREAT | LIBSSH2_FXF_TRUNC,
-            S_IRUSR | S_IWUSR);
+    guac_protocol_status status;
+    guac_common_ssh_sftp_upload_state* upload_state =
+        guac_common_ssh_sftp_upload_open(filesystem, fullpath, user, stream,
+                &status);
 
     /* Acknowledge stream if successful */
-    if (file != NULL) {
+    if (upload_state != NULL) {
         guac_user_log(user, GUAC_LOG_DEBUG, "File \"%s\" opened", fullpath);
         guac_protocol_send_ack(user->socket, stream, "SFTP: File opened",
                 GUAC_PROTOCOL_STATUS_SUCCESS);
@@ -909,15 +1276,15 @@ static int guac_common_ssh_sftp_put_handler(guac_user* user,
         guac_user_log(user, GUAC_LOG_INFO,
                 "Unable to open file \"%s\"", fullpath);
         guac_protocol_send_ack(user->socket, stream, "SFTP: Open failed",
-                guac_sftp_get_status(filesystem));
+                status);
     }
 
     /* Set handlers for file stream */
     stream->blob_handler = guac_common_ssh_sftp_blob_handler;
     stream->end_handler = guac_common_ssh_sftp_end_handler;
 
-    /* Store file within stream */
-    stream->data = file;
+    /* Store upload state within stream */
+    stream->data = upload_state;
 
     guac_socket_flush(user->socket);
     return 0;
@@ -975,6 +1342,8 @@ guac_common_ssh_sftp_filesystem* guac_common_ssh_create_sftp_filesystem(
     filesystem->ssh_session = session;
     filesystem->sftp_session = sftp_session;
     
+    pthread_mutex_init(&(filesystem->lock), NULL);
+
     /* Copy over disable flags */
     filesystem->disable_download = disable_download;
     filesystem->disable_upload = disable_upload;
@@ -984,6 +1353,7 @@ guac_common_ssh_sftp_filesystem* guac_common_ssh_create_sftp_filesystem(
                 root_path)) {
         guac_client_log(session->client, GUAC_LOG_WARNING, "Cannot create "
                 "SFTP filesystem - \"%s\" is not a valid path.", root_path);
+        pthread_mutex_destroy(&(filesystem->lock));
         free(filesystem);
         return NULL;
     }
@@ -1009,6 +1379,7 @@ void guac_common_ssh_destroy_sftp_filesystem(
     libssh2_sftp_shutdown(filesystem->sftp_session);
 
     /* Free associated memory */
+    pthread_mutex_destroy(&(filesystem->lock));
     free(filesystem->name);
     free(filesystem);
 
@@ -21,7 +21,9 @@
 #define GUAC_COMMON_DISPLAY_H
 
 #include "cursor.h"
+#include "encoder.h"
 #include "surface.h"
+#include "tile_cache.h"
 
 #include <guacamole/client.h>
 #include <guacamole/socket.h>
@@ -85,6 +87,18 @@ typedef struct guac_common_display {
      */
     guac_common_cursor* cursor;
 
+    /**
+     * Cache of previously-sent tiles of image data, shared by all surfaces
+     * of the display.
+     */
+    guac_common_tile_cache* tile_cache;
+
+    /**
+     * Pool of threads used to encode the updates of all surfaces of the
+     * display in parallel, or NULL if updates are encoded serially.
+     */
+    guac_common_encoder* encoder;
+
     /**
      * The first element within a linked list of all currently-allocated
      * layers, or NULL if no layers are currently allocated. The default layer,
@@ -0,0 +1,343 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef GUAC_COMMON_ENCODER_H
+#define GUAC_COMMON_ENCODER_H
+
+#include "config.h"
+
+#include <cairo/cairo.h>
+#include <guacamole/client.h>
+#include <guacamole/layer.h>
+#include <guacamole/protocol-types.h>
+#include <guacamole/socket.h>
+#include <guacamole/stream.h>
+
+#include <pthread.h>
+
+/**
+ * The maximum number of worker threads used by any one encoder, regardless
+ * of the number of available processors.
+ */
+#define GUAC_COMMON_ENCODER_MAX_THREADS 16
+
+/**
+ * The maximum number of in-memory segment sockets which will be retained by
+ * an encoder for reuse by later batches.
+ */
+#define GUAC_COMMON_ENCODER_MAX_SPARE_SEGMENTS 64
+
+/**
+ * The maximum number of image streams which may be held by a single batch at
+ * any one time. The streams of a batch are shared with all other users of
+ * the client's stream pool (audio, file transfers, etc.), and must remain
+ * allocated until the images of the batch are actually written, thus the
+ * contents of any batch reaching this limit are written early.
+ */
+#define GUAC_COMMON_ENCODER_MAX_BATCH_STREAMS 16
+
+/**
+ * The image formats which may be produced by an encoder.
+ */
+typedef enum guac_common_encoder_format {
+
+    /**
+     * Lossless PNG, as produced by guac_client_write_png().
+     */
+    GUAC_COMMON_ENCODER_PNG,
+
+    /**
+     * Lossy JPEG, as produced by guac_client_write_jpeg().
+     */
+    GUAC_COMMON_ENCODER_JPEG,
+
+    /**
+     * Lossy or lossless WebP, as produced by guac_client_write_webp().
+     */
+    GUAC_COMMON_ENCODER_WEBP
+
+} guac_common_encoder_format;
+
+typedef struct guac_common_encoder_batch guac_common_encoder_batch;
+
+/**
+ * A single image which has been submitted to an encoder as part of a batch
+ * and which has not yet been encoded.
+ */
+typedef struct guac_common_encoder_job {
+
+    /**
+     * The batch which this image is part of.
+     */
+    guac_common_encoder_batch* batch;
+
+    /**
+     * The in-memory socket which will receive the "img" instruction and
+     * image data, and which will be written to the socket of the batch in
+     * order once the batch ends.
+     */
+    guac_socket* socket;
+
+    /**
+     * The image stream which the image data will be sent along. This stream
+     * is allocated when the job is submitted and remains allocated until the
+     * segment containing the image has been written to the socket of the
+     * batch, such that its index cannot be reused by another thread while
+     * the image is still buffered.
+     */
+    guac_stream* stream;
+
+    /**
+     * The format to encode the image as.
+     */
+    guac_common_encoder_format format;
+
+    /**
+     * The composite mode to use when drawing the image.
+     */
+    guac_composite_mode mode;
+
+    /**
+     * The layer to draw the image on.
+     */
+    const guac_layer* layer;
+
+    /**
+     * The X coordinate of the upper-left corner of the destination rectangle.
+     */
+    int x;
+
+    /**
+     * The Y coordinate of the upper-left corner of the destination rectangle.
+     */
+    int y;
+
+    /**
+     * The image to encode. This surface is owned by the job and is destroyed
+     * once encoding completes.
+     */
+    cairo_surface_t* surface;
+
+    /**
+     * The JPEG or WebP image quality, between 0 and 100 inclusive.
+     */
+    int quality;
+
+    /**
+     * Whether WebP images should be encoded losslessly.
+     */
+    int lossless;
+
+    /**
+     * The job submitted immediately after this job, or NULL if this is the
+     * most recently submitted job.
+     */
+    struct guac_common_encoder_job* next;
+
+} guac_common_encoder_job;
+
+/**
+ * A pool of worker threads which encode images concurrently, such that large
+ * or numerous updates can be compressed using all available processors. The
+ * images of each batch are written to the socket of that batch in the order
+ * they were submitted, interleaved correctly with any other instructions of
+ * the batch.
+ */
+typedef struct guac_common_encoder {
+
+    /**
+     * The client whose streams will be used to send encoded images.
+     */
+    guac_client* client;
+
+    /**
+     * All worker threads. Only the first thread_count threads are running.
+     */
+    pthread_t threads[GUAC_COMMON_ENCODER_MAX_THREADS];
+
+    /**
+     * The number of worker threads running.
+     */
+    int thread_count;
+
+    /**
+     * The oldest job which has not yet been claimed by any thread, or NULL if
+     * no jobs are waiting.
+     */
+    guac_common_encoder_job* first_job;
+
+    /**
+     * The newest job which has not yet been claimed by any thread, or NULL if
+     * no jobs are waiting.
+     */
+    guac_common_encoder_job* last_job;
+
+    /**
+     * Non-zero if the worker threads should stop, zero otherwise.
+     */
+    int stopping;
+
+    /**
+     * In-memory segment sockets of previous batches which may be reused by
+     * later batches, rather than allocating new sockets for each batch.
+     */
+    guac_socket* spare_segments[GUAC_COMMON_ENCODER_MAX_SPARE_SEGMENTS];
+
+    /**
+     * The number of sockets currently stored within spare_segments.
+     */
+    int spare_segment_count;
+
+    /**
+     * Mutex which guards the job queue, the spare segments, and the state of
+     * all batches.
+     */
+    pthread_mutex_t _lock;
+
+    /**
+     * Condition which is signalled whenever a job is submitted or the worker
+     * threads should stop.
+     */
+    pthread_cond_t _job_available;
+
+    /**
+     * Condition which is signalled whenever a job completes.
+     */
+    pthread_cond_t _job_complete;
+
+} guac_common_encoder;
+
+/**
+ * Allocates a new encoder, starting one worker thread for each available
+ * processor beyond the first. The thread which ends each batch assists with
+ * encoding, so no worker thread is needed for the first processor.
+ *
+ * @param client
+ *     The client whose streams will be used to send encoded images.
+ *
+ * @return
+ *     A newly-allocated encoder, or NULL if allocation fails or if only a
+ *     single processor is available, in which case images should simply be
+ *     encoded directly.
+ */
+guac_common_encoder* guac_common_encoder_alloc(guac_client* client);
+
+/**
+ * Stops all worker threads of the given encoder and frees the encoder. No
+ * batches of the encoder may be in progress.
+ *
+ * @param encoder
+ *     The encoder to free.
+ */
+void guac_common_encoder_free(guac_common_encoder* encoder);
+
+/**
+ * Begins a new batch of instructions and images. All instructions and images
+ * of the batch are written to the given socket, in order, only once the batch
+ * ends with guac_common_encoder_batch_end(). Batches are independent and may
+ * be used concurrently by different threads, but each batch must only be used
+ * by one thread at a time.
+ *
+ * @param encoder
+ *     The encoder which should encode the images of the batch.
+ *
+ * @param socket
+ *     The socket which should receive the instructions and images of the
+ *     batch.
+ *
+ * @return
+ *     A newly-allocated batch, or NULL if allocation fails.
+ */
+guac_common_encoder_batch* guac_common_encoder_batch_alloc(
+        guac_common_encoder* encoder, guac_socket* socket);
+
+/**
+ * Returns a socket which receives instructions in order with the images of
+ * the given batch. Instructions written to this socket will be sent after all
+ * images submitted thus far and before any images submitted later. The
+ * returned socket is only valid until the next image is submitted.
+ *
+ * @param batch
+ *     The batch to which instructions will be added.
+ *
+ * @return
+ *     A socket which adds written instructions to the given batch.
+ */
+guac_socket* guac_common_encoder_batch_socket(guac_common_encoder_batch* batch);
+
+/**
+ * Submits the given image for encoding as part of the given batch. The
+ * resulting "img" instruction and image data are equivalent to those produced
+ * by guac_client_write_png(), guac_client_write_jpeg(), or
+ * guac_client_write_webp(), depending on the requested format, along a
+ * stream which is allocated here and freed only once the image has been
+ * written to the socket of the batch. If the batch already holds
+ * GUAC_COMMON_ENCODER_MAX_BATCH_STREAMS streams, or no stream is available,
+ * the contents of the batch thus far are first written to its socket. The
+ * image data referenced by the given surface must not change until the batch
+ * ends.
+ *
+ * @param batch
+ *     The batch to add the image to.
+ *
+ * @param format
+ *     The format to encode the image as.
+ *
+ * @param mode
+ *     The composite mode to use when drawing the image.
+ *
+ * @param layer
+ *     The layer to draw the image on.
+ *
+ * @param x
+ *     The X coordinate of the upper-left corner of the destination rectangle.
+ *
+ * @param y
+ *     The Y coordinate of the upper-left corner of the destination rectangle.
+ *
+ * @param surface
+ *     The image to encode. Ownership of this surface is transferred to the
+ *     batch, and the surface will be destroyed once encoded.
+ *
+ * @param quality
+ *     The JPEG or WebP image quality, between 0 and 100 inclusive. This is
+ *     ignored for PNG.
+ *
+ * @param lossless
+ *     Non-zero if a WebP image should be encoded losslessly, zero otherwise.
+ *     This is ignored for JPEG and PNG.
+ */
+void guac_common_encoder_batch_submit(guac_common_encoder_batch* batch,
+        guac_common_encoder_format format, guac_composite_mode mode,
+        const guac_layer* layer, int x, int y, cairo_surface_t* surface,
+        int quality, int lossless);
+
+/**
+ * Ends the given batch, waiting for all of its images to be encoded and
+ * writing all of its instructions and images to its socket in order. The
+ * calling thread assists with encoding while waiting. The batch is freed and
+ * must not be used after this function returns.
+ *
+ * @param batch
+ *     The batch to end.
+ */
+void guac_common_encoder_batch_end(guac_common_encoder_batch* batch);
+
+#endif
+
@@ -25,6 +25,12 @@
 #include <guacamole/stream.h>
 #include <guacamole/user.h>
 
+/**
+ * The maximum number of blobs of JSON data which may be sent along a stream
+ * without yet having been acknowledged.
+ */
+#define GUAC_COMMON_JSON_WINDOW 16
+
 /**
  * The current streaming state of an arbitrary JSON object, consisting of
  * any number of property name/value pairs.
@@ -49,6 +55,12 @@ typedef struct guac_common_json_state {
      */
     int properties_written;
 
+    /**
+     * The number of blobs of JSON data which have been sent but not yet
+     * acknowledged.
+     */
+    int blobs_in_flight;
+
 } guac_common_json_state;
 
 /**
@@ -192,5 +204,30 @@ void guac_common_json_begin_object(guac_user* user, guac_stream* stream,
 int guac_common_json_end_object(guac_user* user, guac_stream* stream,
         guac_common_json_state* json_state);
 
+/**
+ * Records that an ack has been received along the stream of the given JSON
+ * state, acknowledging one blob of JSON data. Acks received while no blobs
+ * are in flight, such as the ack acknowledging creation of the stream, are
+ * ignored.
+ *
+ * @param json_state
+ *     The state of the JSON object being sent along the stream which
+ *     received the ack.
+ */
+void guac_common_json_ack(guac_common_json_state* json_state);
+
+/**
+ * Returns whether GUAC_COMMON_JSON_WINDOW blobs of JSON data have been sent
+ * without yet having been acknowledged, in which case no further data should
+ * be written until more acks are received.
+ *
+ * @param json_state
+ *     The state of the JSON object being sent.
+ *
+ * @return
+ *     Non-zero if the window of blobs in flight is full, zero otherwise.
+ */
+int guac_common_json_window_full(guac_common_json_state* json_state);
+
 #endif
 
@@ -0,0 +1,186 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef GUAC_COMMON_READ_AHEAD_H
+#define GUAC_COMMON_READ_AHEAD_H
+
+#include "config.h"
+
+#include <pthread.h>
+#include <stdint.h>
+
+/**
+ * The maximum number of bytes of data which may be read ahead of the
+ * consumer of any single read-ahead buffer. Once this many bytes have been
+ * read but not yet consumed, reading pauses until space is available.
+ */
+#define GUAC_COMMON_READ_AHEAD_BUFFER_SIZE 1048576
+
+/**
+ * The number of bytes requested from the read handler of a read-ahead
+ * buffer with each read. Requests this large allow sources which support
+ * pipelining, such as SFTP, to keep several requests in flight at once.
+ * Reads may return fewer bytes.
+ */
+#define GUAC_COMMON_READ_AHEAD_READ_SIZE 262144
+
+/**
+ * Handler which reads data from the source of a read-ahead buffer, such as a
+ * file. Reads are always sequential.
+ *
+ * @param data
+ *     The arbitrary data associated with the read-ahead buffer.
+ *
+ * @param offset
+ *     The offset of the data to read, in bytes from the start of the source.
+ *
+ * @param buffer
+ *     The buffer to read data into.
+ *
+ * @param length
+ *     The maximum number of bytes to read.
+ *
+ * @return
+ *     The number of bytes read, zero if the end of the source has been
+ *     reached, or a negative value if an error occurs.
+ */
+typedef int guac_common_read_ahead_read_handler(void* data, uint64_t offset,
+        char* buffer, int length);
+
+/**
+ * A buffer of data read from a source (such as a file being downloaded)
+ * ahead of the point at which it will be needed. Data is read by a dedicated
+ * thread into a bounded ring buffer using large reads, such that the latency
+ * of each read overlaps with the consumption of previously-read data.
+ */
+typedef struct guac_common_read_ahead {
+
+    /**
+     * The handler invoked to read data from the source.
+     */
+    guac_common_read_ahead_read_handler* read_handler;
+
+    /**
+     * Arbitrary data passed to read_handler.
+     */
+    void* data;
+
+    /**
+     * The thread reading data ahead of the consumer.
+     */
+    pthread_t thread;
+
+    /**
+     * Lock which must be held while accessing the state of the buffer, with
+     * the exception of the space currently being read into.
+     */
+    pthread_mutex_t lock;
+
+    /**
+     * Condition which is signalled whenever data is added to or removed from
+     * the buffer, or the state of the buffer otherwise changes.
+     */
+    pthread_cond_t modified;
+
+    /**
+     * Ring buffer of data which has been read but not yet consumed.
+     */
+    char buffer[GUAC_COMMON_READ_AHEAD_BUFFER_SIZE];
+
+    /**
+     * The offset within the buffer of the first byte not yet consumed.
+     */
+    int start;
+
+    /**
+     * The number of bytes within the buffer not yet consumed.
+     */
+    int length;
+
+    /**
+     * Non-zero if the end of the source has been reached, zero otherwise.
+     */
+    int eof;
+
+    /**
+     * Non-zero if a read has failed, zero otherwise. No further data is read
+     * once a read has failed.
+     */
+    int error;
+
+    /**
+     * Non-zero if no further data will be consumed, in which case the
+     * reading thread exits as soon as possible.
+     */
+    int closing;
+
+} guac_common_read_ahead;
+
+/**
+ * Allocates a new read-ahead buffer, starting the thread which reads its
+ * data.
+ *
+ * @param read_handler
+ *     The handler to invoke to read data from the source. This handler is
+ *     invoked only from the thread of the read-ahead buffer.
+ *
+ * @param data
+ *     Arbitrary data to pass to the read handler.
+ *
+ * @return
+ *     A new read-ahead buffer, or NULL if the buffer cannot be allocated or
+ *     its thread cannot be started.
+ */
+guac_common_read_ahead* guac_common_read_ahead_alloc(
+        guac_common_read_ahead_read_handler* read_handler, void* data);
+
+/**
+ * Copies data which has been read ahead into the given buffer, waiting for
+ * data to be read only if none is available yet. Data is consumed in the
+ * order it was read.
+ *
+ * @param read_ahead
+ *     The read-ahead buffer to consume data from.
+ *
+ * @param buffer
+ *     The buffer to copy data into.
+ *
+ * @param length
+ *     The maximum number of bytes to copy.
+ *
+ * @return
+ *     The number of bytes copied, zero if the end of the source has been
+ *     reached and all data has been consumed, or a negative value if a read
+ *     has failed and all data read prior to the failure has been consumed.
+ */
+int guac_common_read_ahead_read(guac_common_read_ahead* read_ahead,
+        char* buffer, int length);
+
+/**
+ * Stops the thread of the given read-ahead buffer, waiting for any read in
+ * progress to complete, and frees the buffer. Any data not yet consumed is
+ * discarded. The source of the buffer is not affected.
+ *
+ * @param read_ahead
+ *     The read-ahead buffer to free.
+ */
+void guac_common_read_ahead_free(guac_common_read_ahead* read_ahead);
+
+#endif
+
@@ -21,7 +21,9 @@
 #define __GUAC_COMMON_SURFACE_H
 
 #include "config.h"
+#include "encoder.h"
 #include "rect.h"
+#include "tile_cache.h"
 
 #include <cairo/cairo.h>
 #include <guacamole/client.h>
@@ -30,6 +32,8 @@
 #include <guacamole/socket.h>
 
 #include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
 
 /**
  * The maximum number of updates to allow within the bitmap queue.
@@ -241,6 +245,67 @@ typedef struct guac_common_surface {
      */
     guac_common_surface_heat_cell* heat_map;
 
+    /**
+     * The cache of previously-sent tiles shared by all surfaces of the
+     * associated client, or NULL if tiles should not be cached. Opaque tiles
+     * sent losslessly more than once are stored within this cache, and later
+     * updates whose tiles match a cached tile are drawn by copying that tile.
+     */
+    guac_common_tile_cache* tile_cache;
+
+    /**
+     * The encoder which should be used to encode updates in parallel, or NULL
+     * if updates should be encoded by the flushing thread alone.
+     */
+    guac_common_encoder* encoder;
+
+    /**
+     * The batch of instructions and images currently being flushed using the
+     * encoder, or NULL if no parallel flush is in progress.
+     */
+    guac_common_encoder_batch* batch;
+
+    /**
+     * Hashes of the contents of each fixed-width segment of each row of the
+     * surface, matching the contents of the remote display as of the last
+     * flush, or NULL if not yet needed. These hashes allow content shifted by
+     * updates written directly to the surface buffer to be detected (see
+     * guac_common_surface_invalidate()), as the previous contents of the
+     * buffer are already lost by the time such updates are reported. A hash
+     * of zero denotes a segment whose contents may have changed since the
+     * last flush.
+     */
+    uint64_t* shift_hashes;
+
+    /**
+     * The number of segments within each row of shift_hashes.
+     */
+    int shift_segments;
+
+    /**
+     * Non-zero if any hashes within shift_hashes are zero and must be
+     * recalculated once the surface is next flushed, zero otherwise.
+     */
+    int shift_stale;
+
+    /**
+     * The rectangle containing all zero hashes within shift_hashes, in units
+     * of segments horizontally and rows vertically. This is only meaningful
+     * if shift_stale is non-zero.
+     */
+    guac_common_rect shift_stale_rect;
+
+    /**
+     * Scratch memory reused by each search for shifted content, or NULL if
+     * no such search has yet required it.
+     */
+    void* shift_scratch;
+
+    /**
+     * The size of shift_scratch, in bytes.
+     */
+    size_t shift_scratch_size;
+
     /**
      * Mutex which is locked internally when access to the surface must be
      * synchronized. All public functions of guac_common_surface should be
@@ -312,6 +377,37 @@ void guac_common_surface_resize(guac_common_surface* surface, int w, int h);
 void guac_common_surface_draw(guac_common_surface* surface, int x, int y,
         cairo_surface_t* src);
 
+/**
+ * Notifies the given guac_common_surface that the given rectangle of its
+ * buffer has been modified directly, without using any guac_common_surface
+ * drawing function. This is necessary only if the buffer of the surface is
+ * written to by other code, such as a library which has been given the
+ * surface buffer as its own framebuffer. The alpha channel of each pixel
+ * within the rectangle is ignored, with all such pixels made fully opaque,
+ * and the rectangle will be sent to connected users when the surface is next
+ * flushed. Any part of the rectangle which merely shifts content previously
+ * sent to connected users vertically, as when scrolling, is instead sent
+ * immediately as a copy. The clipping rectangle of the surface, if any, does
+ * not apply.
+ *
+ * @param surface
+ *     The surface whose buffer was modified.
+ *
+ * @param x
+ *     The X coordinate of the upper-left corner of the modified rectangle.
+ *
+ * @param y
+ *     The Y coordinate of the upper-left corner of the modified rectangle.
+ *
+ * @param w
+ *     The width of the modified rectangle.
+ *
+ * @param h
+ *     The height of the modified rectangle.
+ */
+void guac_common_surface_invalidate(guac_common_surface* surface, int x, int y,
+        int w, int h);
+
 /**
  * Paints to the given guac_common_surface using the given data as a stencil,
  * filling opaque regions with the specified color, and leaving transparent
@@ -343,6 +439,42 @@ void guac_common_surface_paint(guac_common_surface* surface, int x, int y, cairo
 void guac_common_surface_copy(guac_common_surface* src, int sx, int sy, int w, int h,
                               guac_common_surface* dst, int dx, int dy);
 
+/**
+ * Copies a rectangle of data between two surfaces, as with
+ * guac_common_surface_copy(), except that the copy is always sent to
+ * connected users as a "copy" instruction. Any pending updates to either
+ * surface are flushed first, rather than the copied region being combined
+ * with those updates and later re-sent as image data. This is beneficial when
+ * the same content is copied repeatedly from a surface which connected users
+ * already have, such as a glyph cache.
+ *
+ * @param src
+ *     The source surface.
+ *
+ * @param sx
+ *     The X coordinate of the upper-left corner of the source rect.
+ *
+ * @param sy
+ *     The Y coordinate of the upper-left corner of the source rect.
+ *
+ * @param w
+ *     The width of the source rect.
+ *
+ * @param h
+ *     The height of the source rect.
+ *
+ * @param dst
+ *     The destination surface.
+ *
+ * @param dx
+ *     The X coordinate of the upper-left corner of the destination rect.
+ *
+ * @param dy
+ *     The Y coordinate of the upper-left corner of the destination rect.
+ */
+void guac_common_surface_copy_immediate(guac_common_surface* src, int sx,
+        int sy, int w, int h, guac_common_surface* dst, int dx, int dy);
+
 /**
  * Transfers a rectangle of data between two surfaces.
  *
@@ -535,5 +667,35 @@ void guac_common_surface_set_multitouch(guac_common_surface* surface,
 void guac_common_surface_set_lossless(guac_common_surface* surface,
         int lossless);
 
+/**
+ * Sets the tile cache used by the given surface to avoid resending tiles of
+ * image data that all users have already received. By default, newly-created
+ * surfaces do not use a tile cache.
+ *
+ * @param surface
+ *     The surface to modify.
+ *
+ * @param tile_cache
+ *     The tile cache to use, which is typically shared by all surfaces of the
+ *     same client, or NULL if tiles should not be cached.
+ */
+void guac_common_surface_set_tile_cache(guac_common_surface* surface,
+        guac_common_tile_cache* tile_cache);
+
+/**
+ * Sets the encoder which should be used to encode updates to the given
+ * surface in parallel. Images are still sent in the order they would have been
+ * sent if encoded serially. By default, surfaces have no encoder.
+ *
+ * @param surface
+ *     The surface to modify.
+ *
+ * @param encoder
+ *     The encoder to use, which is typically shared by all surfaces of the
+ *     same client, or NULL if updates should be encoded serially.
+ */
+void guac_common_surface_set_encoder(guac_common_surface* surface,
+        guac_common_encoder* encoder);
+
 #endif
 
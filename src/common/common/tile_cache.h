@@ -0,0 +1,308 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef GUAC_COMMON_TILE_CACHE_H
+#define GUAC_COMMON_TILE_CACHE_H
+
+#include "config.h"
+
+#include <guacamole/client.h>
+#include <guacamole/layer.h>
+#include <guacamole/socket.h>
+#include <guacamole/user.h>
+
+#include <pthread.h>
+
+/**
+ * The width and height of each cached tile, in pixels. Only tiles aligned to
+ * a grid of this size within a surface are cached.
+ */
+#define GUAC_COMMON_TILE_CACHE_TILE_SIZE 64
+
+/**
+ * The number of tiles stored along each side of each of the tile cache's
+ * off-screen buffers.
+ */
+#define GUAC_COMMON_TILE_CACHE_ATLAS_COLUMNS 16
+
+/**
+ * The number of tiles stored within each of the tile cache's off-screen
+ * buffers.
+ */
+#define GUAC_COMMON_TILE_CACHE_ATLAS_SIZE \
+    (GUAC_COMMON_TILE_CACHE_ATLAS_COLUMNS * GUAC_COMMON_TILE_CACHE_ATLAS_COLUMNS)
+
+/**
+ * The maximum number of off-screen buffers used by a tile cache. Buffers are
+ * allocated only as needed.
+ */
+#define GUAC_COMMON_TILE_CACHE_ATLASES 4
+
+/**
+ * The maximum number of tiles stored within a tile cache at any one time.
+ * Once this limit is reached, the least-recently-used tile is replaced. Each
+ * tile occupies GUAC_COMMON_TILE_CACHE_TILE_SIZE squared 32-bit pixels both
+ * on the server and within the client.
+ */
+#define GUAC_COMMON_TILE_CACHE_SIZE \
+    (GUAC_COMMON_TILE_CACHE_ATLASES * GUAC_COMMON_TILE_CACHE_ATLAS_SIZE)
+
+/**
+ * The number of buckets within the hash table used to locate cached tiles.
+ * This MUST be a power of two.
+ */
+#define GUAC_COMMON_TILE_CACHE_BUCKETS 2048
+
+/**
+ * The number of recently-offered tiles which are remembered by a tile cache,
+ * such that a tile is stored only when it is offered again. This MUST be a
+ * multiple of GUAC_COMMON_TILE_CACHE_CANDIDATE_WAYS, and the number of sets
+ * of candidates MUST be a power of two.
+ */
+#define GUAC_COMMON_TILE_CACHE_CANDIDATES 4096
+
+/**
+ * The number of candidates within each set of candidates. Each tile may be
+ * remembered within any candidate of the single set it maps to, such that
+ * tiles which map to the same set do not necessarily forget each other.
+ */
+#define GUAC_COMMON_TILE_CACHE_CANDIDATE_WAYS 4
+
+/**
+ * A single tile stored within the tile cache. The location of the tile within
+ * the off-screen buffers of the cache is determined by the index of the entry.
+ */
+typedef struct guac_common_tile_cache_entry {
+
+    /**
+     * The hash of the contents of the tile, as produced by
+     * guac_hash_surface().
+     */
+    unsigned int hash;
+
+    /**
+     * The index of the next entry within the same hash table bucket, or -1 if
+     * this is the last entry in the bucket.
+     */
+    int next;
+
+    /**
+     * The index of the entry used immediately more recently than this entry,
+     * or -1 if this is the most-recently-used entry.
+     */
+    int newer;
+
+    /**
+     * The index of the entry used immediately less recently than this entry,
+     * or -1 if this is the least-recently-used entry.
+     */
+    int older;
+
+} guac_common_tile_cache_entry;
+
+/**
+ * A cache of fixed-size tiles of image data which have previously been sent
+ * to all connected users, keyed by the contents of each tile. Cached tiles
+ * are stored within off-screen Guacamole buffers, such that a tile whose
+ * contents match a cached tile can be drawn with a "copy" instruction rather
+ * than being encoded and sent again.
+ */
+typedef struct guac_common_tile_cache {
+
+    /**
+     * The client whose users receive the tiles stored in this cache.
+     */
+    guac_client* client;
+
+    /**
+     * The off-screen buffers containing all cached tiles, each of which is
+     * NULL until first needed.
+     */
+    guac_layer* atlases[GUAC_COMMON_TILE_CACHE_ATLASES];
+
+    /**
+     * Copies of the image data within each off-screen buffer, each of which
+     * is NULL until the corresponding buffer is first needed. Cached tiles
+     * are compared against these copies to verify a match.
+     */
+    unsigned char* atlas_data[GUAC_COMMON_TILE_CACHE_ATLASES];
+
+    /**
+     * All cache entries. Only the first length entries are in use.
+     */
+    guac_common_tile_cache_entry entries[GUAC_COMMON_TILE_CACHE_SIZE];
+
+    /**
+     * The number of entries currently in use.
+     */
+    int length;
+
+    /**
+     * The index of the first entry within each hash table bucket, or -1 if
+     * the bucket is empty.
+     */
+    int buckets[GUAC_COMMON_TILE_CACHE_BUCKETS];
+
+    /**
+     * The index of the most-recently-used entry, or -1 if the cache is
+     * empty.
+     */
+    int newest;
+
+    /**
+     * The index of the least-recently-used entry, or -1 if the cache is
+     * empty.
+     */
+    int oldest;
+
+    /**
+     * Values identifying tiles which have been offered to
+     * guac_common_tile_cache_store() but not yet stored, or zero if unused.
+     * Candidates are grouped into sets of
+     * GUAC_COMMON_TILE_CACHE_CANDIDATE_WAYS, ordered from most to least
+     * recently offered, with the set of each tile selected by the lowest
+     * bits of its value. Tiles are stored only if already present, such that
+     * tiles sent only once are never copied into the cache.
+     */
+    unsigned int candidates[GUAC_COMMON_TILE_CACHE_CANDIDATES];
+
+    /**
+     * Mutex which is locked internally when access to the cache must be
+     * synchronized. All public functions of guac_common_tile_cache should be
+     * considered threadsafe.
+     */
+    pthread_mutex_t _lock;
+
+} guac_common_tile_cache;
+
+/**
+ * Allocates a new, empty tile cache whose tiles will be stored within
+ * off-screen buffers allocated from the given client.
+ *
+ * @param client
+ *     The client whose users will receive the tiles stored in the cache.
+ *
+ * @return
+ *     A newly-allocated tile cache, or NULL if allocation fails.
+ */
+guac_common_tile_cache* guac_common_tile_cache_alloc(guac_client* client);
+
+/**
+ * Frees the given tile cache, disposing of and freeing all off-screen buffers
+ * which it allocated.
+ *
+ * @param cache
+ *     The tile cache to free.
+ */
+void guac_common_tile_cache_free(guac_common_tile_cache* cache);
+
+/**
+ * Searches the given tile cache for a tile whose contents are identical to
+ * the given tile of image data. If found, the tile is marked as
+ * most-recently-used and the location of its contents within the off-screen
+ * buffers of the cache is returned.
+ *
+ * @param cache
+ *     The tile cache to search.
+ *
+ * @param data
+ *     The first pixel of a GUAC_COMMON_TILE_CACHE_TILE_SIZE square tile of
+ *     32-bit image data.
+ *
+ * @param stride
+ *     The number of bytes in each row of the given image data.
+ *
+ * @param layer
+ *     Pointer to the layer which receives the off-screen buffer containing
+ *     the cached tile, if found.
+ *
+ * @param x
+ *     Pointer to the int which receives the X coordinate of the cached tile
+ *     within the off-screen buffer, if found.
+ *
+ * @param y
+ *     Pointer to the int which receives the Y coordinate of the cached tile
+ *     within the off-screen buffer, if found.
+ *
+ * @return
+ *     Non-zero if an identical tile was found, zero otherwise.
+ */
+int guac_common_tile_cache_lookup(guac_common_tile_cache* cache,
+        const unsigned char* data, int stride, const guac_layer** layer,
+        int* x, int* y);
+
+/**
+ * Offers the given tile of image data for storage within the given tile
+ * cache. If an identical tile is already cached, that tile is simply marked
+ * as most-recently-used. A tile which is not yet cached is stored only if an
+ * identical tile was offered recently, as tiles which are sent only once
+ * would otherwise evict useful tiles while costing a copy each. Stored
+ * tiles replace the least-recently-used tile if the cache is full, and their
+ * contents are copied to an off-screen buffer by sending a "copy"
+ * instruction from the given layer, which must already contain identical
+ * image data at the given coordinates for all users.
+ *
+ * @param cache
+ *     The tile cache to store the tile within.
+ *
+ * @param socket
+ *     The socket over which the "copy" instruction should be sent.
+ *
+ * @param src_layer
+ *     The layer which currently contains the tile.
+ *
+ * @param src_x
+ *     The X coordinate of the tile within the given layer.
+ *
+ * @param src_y
+ *     The Y coordinate of the tile within the given layer.
+ *
+ * @param data
+ *     The first pixel of a GUAC_COMMON_TILE_CACHE_TILE_SIZE square tile of
+ *     32-bit image data, identical to the contents of the tile within the
+ *     given layer.
+ *
+ * @param stride
+ *     The number of bytes in each row of the given image data.
+ */
+void guac_common_tile_cache_store(guac_common_tile_cache* cache,
+        guac_socket* socket, const guac_layer* src_layer, int src_x, int src_y,
+        const unsigned char* data, int stride);
+
+/**
+ * Synchronizes the given tile cache with the given user. Rather than sending
+ * the full contents of every off-screen buffer, which may be far larger than
+ * the display itself, all cached tiles are discarded and the off-screen
+ * buffers are merely sized for the given user. Tiles are then cached again
+ * for all users as they are sent.
+ *
+ * @param cache
+ *     The tile cache to synchronize.
+ *
+ * @param user
+ *     The user receiving the contents of the tile cache.
+ *
+ * @param socket
+ *     The socket over which the contents of the tile cache should be sent.
+ */
+void guac_common_tile_cache_dup(guac_common_tile_cache* cache,
+        guac_user* user, guac_socket* socket);
+
+#endif
+
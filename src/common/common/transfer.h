@@ -0,0 +1,208 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef GUAC_COMMON_TRANSFER_H
+#define GUAC_COMMON_TRANSFER_H
+
+#include "config.h"
+
+#include <guacamole/protocol.h>
+#include <guacamole/stream.h>
+#include <guacamole/user.h>
+
+#include <stdint.h>
+
+/**
+ * The default maximum number of bytes of file data which may be sent to the
+ * user without yet having been acknowledged. At 50 ms of round-trip latency,
+ * this window permits roughly 5 MB/s.
+ */
+#define GUAC_COMMON_TRANSFER_DEFAULT_WINDOW 262144
+
+/**
+ * The number of bytes requested from the source of a transfer with each read.
+ * Reads may return fewer bytes.
+ */
+#define GUAC_COMMON_TRANSFER_READ_SIZE 65536
+
+/**
+ * The size of the buffer of data which has been read from the source of a
+ * transfer but not yet sent, in bytes. This must be at least
+ * GUAC_COMMON_TRANSFER_READ_SIZE.
+ */
+#define GUAC_COMMON_TRANSFER_BUFFER_SIZE 262144
+
+/**
+ * Return value of guac_common_transfer_ack() indicating that the transfer is
+ * still in progress.
+ */
+#define GUAC_COMMON_TRANSFER_IN_PROGRESS 1
+
+/**
+ * Return value of guac_common_transfer_ack() indicating that all data has
+ * been sent and acknowledged, and the stream has been ended.
+ */
+#define GUAC_COMMON_TRANSFER_COMPLETE 0
+
+/**
+ * Return value of guac_common_transfer_ack() indicating that the transfer
+ * has failed, either because the source could not be read (in which case the
+ * stream has been ended) or because the user rejected the data.
+ */
+#define GUAC_COMMON_TRANSFER_FAILED -1
+
+/**
+ * Handler which reads data from the source of a transfer, such as a file.
+ * Reads are always sequential.
+ *
+ * @param data
+ *     The arbitrary data associated with the transfer.
+ *
+ * @param offset
+ *     The offset of the data to read, in bytes from the start of the source.
+ *
+ * @param buffer
+ *     The buffer to read data into.
+ *
+ * @param length
+ *     The maximum number of bytes to read.
+ *
+ * @return
+ *     The number of bytes read, zero if the end of the source has been
+ *     reached, or a negative value if an error occurs.
+ */
+typedef int guac_common_transfer_read_handler(void* data, uint64_t offset,
+        char* buffer, int length);
+
+/**
+ * The state of an outbound transfer of data (a download) over a Guacamole
+ * stream. Rather than waiting for each blob to be acknowledged before sending
+ * the next, several blobs are kept in flight at once, with data read ahead of
+ * time into a ring buffer using reads much larger than a single blob.
+ */
+typedef struct guac_common_transfer {
+
+    /**
+     * The handler invoked to read data from the source of the transfer.
+     */
+    guac_common_transfer_read_handler* read_handler;
+
+    /**
+     * Arbitrary data passed to read_handler.
+     */
+    void* data;
+
+    /**
+     * The offset of the next read from the source, in bytes.
+     */
+    uint64_t offset;
+
+    /**
+     * Non-zero if the end of the source has been reached, zero otherwise.
+     */
+    int eof;
+
+    /**
+     * Ring buffer of data which has been read but not yet sent.
+     */
+    char buffer[GUAC_COMMON_TRANSFER_BUFFER_SIZE];
+
+    /**
+     * The offset within the buffer of the first byte not yet sent.
+     */
+    int start;
+
+    /**
+     * The number of bytes within the buffer not yet sent.
+     */
+    int length;
+
+    /**
+     * The maximum number of blobs which may be in flight at any one time, as
+     * derived from the window size given to guac_common_transfer_alloc().
+     */
+    int max_blobs;
+
+    /**
+     * The number of blobs which have been sent but not yet acknowledged.
+     */
+    int blobs_in_flight;
+
+} guac_common_transfer;
+
+/**
+ * Allocates the state of a new outbound transfer. No data is sent until the
+ * first call to guac_common_transfer_ack().
+ *
+ * @param read_handler
+ *     The handler to invoke to read data from the source of the transfer.
+ *
+ * @param data
+ *     Arbitrary data to pass to the read handler.
+ *
+ * @param window
+ *     The maximum number of bytes which may be sent without yet having been
+ *     acknowledged, typically GUAC_COMMON_TRANSFER_DEFAULT_WINDOW.
+ *
+ * @return
+ *     The state of a new transfer, or NULL if allocation fails.
+ */
+guac_common_transfer* guac_common_transfer_alloc(
+        guac_common_transfer_read_handler* read_handler, void* data,
+        int window);
+
+/**
+ * Handles an ack received along the stream of the given transfer, sending
+ * as many further blobs as the window allows, and ending the stream once all
+ * data has been sent and acknowledged. The first ack received (which
+ * acknowledges the creation of the stream) begins the transfer. The socket
+ * of the user is not flushed.
+ *
+ * @param transfer
+ *     The transfer associated with the stream.
+ *
+ * @param user
+ *     The user receiving the transfer.
+ *
+ * @param stream
+ *     The stream over which data is being sent.
+ *
+ * @param status
+ *     The status code of the received ack.
+ *
+ * @return
+ *     GUAC_COMMON_TRANSFER_IN_PROGRESS if further acks are expected,
+ *     GUAC_COMMON_TRANSFER_COMPLETE if the transfer has completed
+ *     successfully, or GUAC_COMMON_TRANSFER_FAILED if the transfer has
+ *     failed. In either of the latter cases, the caller is responsible for
+ *     freeing the stream and the transfer.
+ */
+int guac_common_transfer_ack(guac_common_transfer* transfer, guac_user* user,
+        guac_stream* stream, guac_protocol_status status);
+
+/**
+ * Frees the given transfer. The source of the transfer is not affected.
+ *
+ * @param transfer
+ *     The transfer to free.
+ */
+void guac_common_transfer_free(guac_common_transfer* transfer);
+
+#endif
+
@@ -0,0 +1,268 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef GUAC_COMMON_WRITE_QUEUE_H
+#define GUAC_COMMON_WRITE_QUEUE_H
+
+#include "config.h"
+
+#include <pthread.h>
+#include <stdint.h>
+
+/**
+ * The number of bytes of data which may be queued but not yet written for
+ * any single write queue. Data which does not fit is held aside until space
+ * is available, and the data which overflowed is not acknowledged until then.
+ */
+#define GUAC_COMMON_WRITE_QUEUE_BUFFER_SIZE 1048576
+
+/**
+ * The maximum number of bytes passed to the write handler of a write queue
+ * in a single call.
+ */
+#define GUAC_COMMON_WRITE_QUEUE_WRITE_SIZE 262144
+
+/**
+ * Handler which writes data to the destination of a write queue, such as a
+ * file. Writes are always sequential.
+ *
+ * @param data
+ *     The arbitrary data associated with the write queue.
+ *
+ * @param offset
+ *     The offset at which the data should be written, in bytes from the start
+ *     of the destination.
+ *
+ * @param buffer
+ *     The data to write.
+ *
+ * @param length
+ *     The number of bytes to write.
+ *
+ * @return
+ *     The number of bytes written, which may be fewer than requested, or a
+ *     negative value if an error occurs.
+ */
+typedef int guac_common_write_queue_write_handler(void* data, uint64_t offset,
+        const char* buffer, int length);
+
+/**
+ * Handler which acknowledges data whose acknowledgement was deferred because
+ * the write queue was full when that data was queued (see
+ * GUAC_COMMON_WRITE_QUEUE_DEFERRED). This handler is invoked from the thread
+ * of the write queue once all deferred data fits within the queue, or once a
+ * write has failed.
+ *
+ * @param data
+ *     The arbitrary data associated with the write queue.
+ *
+ * @param error
+ *     Non-zero if a write has failed, in which case the deferred data has
+ *     been discarded, zero otherwise.
+ */
+typedef void guac_common_write_queue_ack_handler(void* data, int error);
+
+/**
+ * The result of queueing data with guac_common_write_queue_write().
+ */
+typedef enum guac_common_write_queue_status {
+
+    /**
+     * The data was queued and may be acknowledged immediately.
+     */
+    GUAC_COMMON_WRITE_QUEUE_QUEUED,
+
+    /**
+     * The data was accepted, but the queue is full. The data must not be
+     * acknowledged until the ack handler of the queue is invoked.
+     */
+    GUAC_COMMON_WRITE_QUEUE_DEFERRED,
+
+    /**
+     * A previous write has failed, and the data was discarded.
+     */
+    GUAC_COMMON_WRITE_QUEUE_FAILED
+
+} guac_common_write_queue_status;
+
+/**
+ * A queue of data which has been received (such as the contents of an
+ * uploaded file) but not yet written to its destination. Data is copied into
+ * a bounded ring buffer and written by a dedicated thread, in chunks as large
+ * as the data which has accumulated, allowing the received data to be
+ * acknowledged without waiting for the write to complete. Queueing data never
+ * blocks. If the ring buffer is full, the data which does not fit is held
+ * aside and its acknowledgement is deferred to the thread of the queue, such
+ * that the sender stops sending until the destination catches up. Errors
+ * which occur while writing are retained and reported by later calls.
+ */
+typedef struct guac_common_write_queue {
+
+    /**
+     * The handler invoked to write data to the destination of the queue.
+     */
+    guac_common_write_queue_write_handler* write_handler;
+
+    /**
+     * The handler invoked to acknowledge data whose acknowledgement was
+     * deferred.
+     */
+    guac_common_write_queue_ack_handler* ack_handler;
+
+    /**
+     * Arbitrary data passed to write_handler and ack_handler.
+     */
+    void* data;
+
+    /**
+     * The thread writing queued data.
+     */
+    pthread_t thread;
+
+    /**
+     * Lock which must be held while accessing the state of the queue, with
+     * the exception of the buffered data currently being written.
+     */
+    pthread_mutex_t lock;
+
+    /**
+     * Condition which is signalled whenever data is added to or removed from
+     * the queue, or the state of the queue otherwise changes.
+     */
+    pthread_cond_t modified;
+
+    /**
+     * Ring buffer of data which has been queued but not yet written.
+     */
+    char buffer[GUAC_COMMON_WRITE_QUEUE_BUFFER_SIZE];
+
+    /**
+     * The offset within the buffer of the first byte not yet written.
+     */
+    int start;
+
+    /**
+     * The number of bytes within the buffer not yet written, including any
+     * bytes currently being written.
+     */
+    int length;
+
+    /**
+     * Data which was accepted while the ring buffer was full, and which will
+     * be moved into the ring buffer as space becomes available, or NULL if
+     * there is no such data.
+     */
+    char* overflow;
+
+    /**
+     * The number of bytes of overflow data not yet moved into the ring
+     * buffer.
+     */
+    int overflow_length;
+
+    /**
+     * The offset within the overflow data of the first byte not yet moved
+     * into the ring buffer.
+     */
+    int overflow_start;
+
+    /**
+     * Non-zero if the acknowledgement of queued data has been deferred and
+     * the ack handler has not yet been invoked, zero otherwise.
+     */
+    int ack_pending;
+
+    /**
+     * Non-zero if a write has failed, zero otherwise. Once a write fails, all
+     * queued data is discarded and no further data is written.
+     */
+    int error;
+
+    /**
+     * Non-zero if no further data will be queued, in which case the writing
+     * thread exits once all queued data has been written.
+     */
+    int closing;
+
+} guac_common_write_queue;
+
+/**
+ * Allocates a new write queue, starting the thread which writes its data.
+ *
+ * @param write_handler
+ *     The handler to invoke to write data to the destination of the queue.
+ *     This handler is invoked only from the thread of the write queue.
+ *
+ * @param ack_handler
+ *     The handler to invoke to acknowledge data whose acknowledgement was
+ *     deferred. This handler is invoked only from the thread of the write
+ *     queue.
+ *
+ * @param data
+ *     Arbitrary data to pass to the write handler and ack handler.
+ *
+ * @return
+ *     A new write queue, or NULL if the queue cannot be allocated or its
+ *     thread cannot be started.
+ */
+guac_common_write_queue* guac_common_write_queue_alloc(
+        guac_common_write_queue_write_handler* write_handler,
+        guac_common_write_queue_ack_handler* ack_handler, void* data);
+
+/**
+ * Queues the given data for writing, returning as soon as the data has been
+ * copied into the queue. This function never waits for data to be written.
+ * If the queue is full, the data is still accepted, but must not be
+ * acknowledged until the ack handler of the queue is invoked. No further
+ * data may be queued until then.
+ *
+ * @param queue
+ *     The write queue to add data to.
+ *
+ * @param buffer
+ *     The data to queue.
+ *
+ * @param length
+ *     The number of bytes to queue.
+ *
+ * @return
+ *     GUAC_COMMON_WRITE_QUEUE_QUEUED if the data may be acknowledged
+ *     immediately, GUAC_COMMON_WRITE_QUEUE_DEFERRED if its acknowledgement
+ *     must wait for the ack handler, or GUAC_COMMON_WRITE_QUEUE_FAILED if a
+ *     previous write has failed, in which case the data is discarded.
+ */
+guac_common_write_queue_status guac_common_write_queue_write(guac_common_write_queue* queue,
+        const char* buffer, int length);
+
+/**
+ * Waits for all queued data to be written, stops the thread of the given
+ * write queue, and frees the queue. The destination of the queue is not
+ * affected. Any acknowledgement still deferred is not sent.
+ *
+ * @param queue
+ *     The write queue to free.
+ *
+ * @return
+ *     Zero if all data queued was written successfully, or non-zero if any
+ *     write failed.
+ */
+int guac_common_write_queue_free(guac_common_write_queue* queue);
+
+#endif
+
@@ -130,6 +130,17 @@ guac_common_display* guac_common_display_alloc(guac_client* client,
         return NULL;
     }
 
+    /* Allocate tile cache shared by all surfaces */
+    display->tile_cache = guac_common_tile_cache_alloc(client);
+    if (display->tile_cache == NULL) {
+        guac_common_cursor_free(display->cursor);
+        free(display);
+        return NULL;
+    }
+
+    /* Encode updates in parallel where multiple processors are available */
+    display->encoder = guac_common_encoder_alloc(client);
+
     pthread_mutex_init(&display->_lock, NULL);
 
     /* Associate display with given client */
@@ -138,6 +149,11 @@ guac_common_display* guac_common_display_alloc(guac_client* client,
     display->default_surface = guac_common_surface_alloc(client,
             client->socket, GUAC_DEFAULT_LAYER, width, height);
 
+    guac_common_surface_set_tile_cache(display->default_surface,
+            display->tile_cache);
+    guac_common_surface_set_encoder(display->default_surface,
+            display->encoder);
+
     /* No initial layers or buffers */
     display->layers = NULL;
     display->buffers = NULL;
@@ -158,6 +174,13 @@ void guac_common_display_free(guac_common_display* display) {
     guac_common_display_free_layers(display->buffers, display->client);
     guac_common_display_free_layers(display->layers, display->client);
 
+    /* Free tile cache only after all surfaces which use it */
+    guac_common_tile_cache_free(display->tile_cache);
+
+    /* Likewise stop encoding threads only after all surfaces are freed */
+    if (display->encoder != NULL)
+        guac_common_encoder_free(display->encoder);
+
     pthread_mutex_destroy(&display->_lock);
     free(display);
 
@@ -171,6 +194,10 @@ void guac_common_display_dup(guac_common_display* display, guac_user* user,
     /* Sunchronize shared cursor */
     guac_common_cursor_dup(display->cursor, user, socket);
 
+    /* Discard cached tiles prior to synchronizing any surfaces, as the user
+     * does not have their contents */
+    guac_common_tile_cache_dup(display->tile_cache, user, socket);
+
     /* Synchronize default surface */
     guac_common_surface_dup(display->default_surface, user, socket);
 
@@ -314,6 +341,10 @@ guac_common_display_layer* guac_common_display_alloc_layer(
     /* Apply current display losslessness */
     guac_common_surface_set_lossless(surface, display->lossless);
 
+    /* Share display tile cache and encoder */
+    guac_common_surface_set_tile_cache(surface, display->tile_cache);
+    guac_common_surface_set_encoder(surface, display->encoder);
+
     /* Add layer and surface to list */
     guac_common_display_layer* display_layer =
         guac_common_display_add_layer(&display->layers, layer, surface);
@@ -338,6 +369,10 @@ guac_common_display_layer* guac_common_display_alloc_buffer(
     /* Apply current display losslessness */
     guac_common_surface_set_lossless(surface, display->lossless);
 
+    /* Share display tile cache and encoder */
+    guac_common_surface_set_tile_cache(surface, display->tile_cache);
+    guac_common_surface_set_encoder(surface, display->encoder);
+
     /* Add buffer and surface to list */
     guac_common_display_layer* display_layer =
         guac_common_display_add_layer(&display->buffers, buffer, surface);
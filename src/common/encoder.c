@@ -0,0 +1,708 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "config.h"
+#include "common/encoder.h"
+
+#include <cairo/cairo.h>
+#include <guacamole/client.h>
+#include <guacamole/layer.h>
+#include <guacamole/socket.h>
+#include <guacamole/stream.h>
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/**
+ * The initial size of the buffer of each in-memory segment of a batch, in
+ * bytes. Buffers grow as needed.
+ */
+#define GUAC_COMMON_ENCODER_SEGMENT_SIZE 4096
+
+/**
+ * The initial number of segments for which space is allocated within each
+ * batch. Space for additional segments is allocated as needed.
+ */
+#define GUAC_COMMON_ENCODER_BATCH_SIZE 16
+
+/**
+ * The maximum size of the buffer of any in-memory segment which may be kept
+ * for reuse, in bytes. Segments which have grown larger than this (typically
+ * due to a large image) are freed rather than holding on to their memory.
+ */
+#define GUAC_COMMON_ENCODER_MAX_SPARE_SEGMENT_SIZE 262144
+
+/**
+ * The contents of a single in-memory socket which receives some contiguous
+ * portion of the instructions of a batch.
+ */
+typedef struct guac_common_encoder_segment {
+
+    /**
+     * All bytes written to the segment thus far.
+     */
+    char* data;
+
+    /**
+     * The number of bytes written to the segment.
+     */
+    size_t length;
+
+    /**
+     * The number of bytes allocated for data.
+     */
+    size_t size;
+
+    /**
+     * The image stream used by the instructions within this segment, which
+     * must be freed once the segment has been written, or NULL if the
+     * segment does not contain an image.
+     */
+    guac_stream* stream;
+
+} guac_common_encoder_segment;
+
+struct guac_common_encoder_batch {
+
+    /**
+     * The encoder which encodes the images of this batch.
+     */
+    guac_common_encoder* encoder;
+
+    /**
+     * The socket which will receive the contents of all segments once the
+     * batch ends.
+     */
+    guac_socket* socket;
+
+    /**
+     * The in-memory sockets of all segments of the batch, in the order that
+     * their contents must be sent.
+     */
+    guac_socket** segments;
+
+    /**
+     * The number of segments within the batch.
+     */
+    int length;
+
+    /**
+     * The number of segments for which space has been allocated.
+     */
+    int size;
+
+    /**
+     * The segment which receives instructions written via
+     * guac_common_encoder_batch_socket(), or NULL if a new segment must be
+     * added to receive those instructions.
+     */
+    guac_socket* current;
+
+    /**
+     * The number of submitted jobs which have not yet completed.
+     */
+    int pending;
+
+    /**
+     * The number of image streams currently held by segments of the batch.
+     */
+    int streams;
+
+};
+
+/**
+ * Write handler for the in-memory sockets of batch segments, appending all
+ * written data to the buffer of the segment.
+ *
+ * @param socket
+ *     The segment socket being written to.
+ *
+ * @param buf
+ *     The data to write.
+ *
+ * @param count
+ *     The number of bytes to write.
+ *
+ * @return
+ *     The number of bytes written, or -1 if space could not be allocated.
+ */
+static ssize_t guac_common_encoder_segment_write(guac_socket* socket,
+        const void* buf, size_t count) {
+
+    guac_common_encoder_segment* segment =
+        (guac_common_encoder_segment*) socket->data;
+
+    /* Grow buffer as necessary */
+    if (segment->length + count > segment->size) {
+
+        size_t size = segment->size * 2;
+        while (segment->length + count > size)
+            size *= 2;
+
+        char* data = realloc(segment->data, size);
+        if (data == NULL)
+            return -1;
+
+        segment->data = data;
+        segment->size = size;
+
+    }
+
+    memcpy(segment->data + segment->length, buf, count);
+    segment->length += count;
+
+    return count;
+
+}
+
+/**
+ * Free handler for the in-memory sockets of batch segments, freeing the
+ * buffer of the segment.
+ *
+ * @param socket
+ *     The segment socket being freed.
+ *
+ * @return
+ *     Always zero.
+ */
+static int guac_common_encoder_segment_free(guac_socket* socket) {
+
+    guac_common_encoder_segment* segment =
+        (guac_common_encoder_segment*) socket->data;
+
+    free(segment->data);
+    free(segment);
+    return 0;
+
+}
+
+/**
+ * Removes and returns a previously-used segment socket from the spare
+ * segments of the given encoder, if any. The returned segment is empty.
+ *
+ * @param encoder
+ *     The encoder whose spare segments should be checked.
+ *
+ * @return
+ *     An empty, previously-used segment socket, or NULL if no spare segments
+ *     are available.
+ */
+static guac_socket* guac_common_encoder_reuse_segment(
+        guac_common_encoder* encoder) {
+
+    guac_socket* socket = NULL;
+
+    pthread_mutex_lock(&encoder->_lock);
+
+    if (encoder->spare_segment_count > 0)
+        socket = encoder->spare_segments[--encoder->spare_segment_count];
+
+    pthread_mutex_unlock(&encoder->_lock);
+
+    return socket;
+
+}
+
+/**
+ * Returns the given segment socket to the spare segments of the given
+ * encoder such that it may be reused by later batches, freeing the segment
+ * instead if there is no room or its buffer has grown too large. The lock of
+ * the encoder must be held.
+ *
+ * @param encoder
+ *     The encoder to return the segment to.
+ *
+ * @param socket
+ *     The segment socket to return. The contents of the segment are
+ *     discarded.
+ */
+static void guac_common_encoder_recycle_segment(guac_common_encoder* encoder,
+        guac_socket* socket) {
+
+    guac_common_encoder_segment* segment =
+        (guac_common_encoder_segment*) socket->data;
+
+    if (encoder->spare_segment_count == GUAC_COMMON_ENCODER_MAX_SPARE_SEGMENTS
+            || segment->size > GUAC_COMMON_ENCODER_MAX_SPARE_SEGMENT_SIZE) {
+        guac_socket_free(socket);
+        return;
+    }
+
+    segment->length = 0;
+    encoder->spare_segments[encoder->spare_segment_count++] = socket;
+
+}
+
+/**
+ * Adds a new, empty segment to the end of the given batch.
+ *
+ * @param batch
+ *     The batch to add a segment to.
+ *
+ * @return
+ *     The in-memory socket of the new segment, or NULL if allocation fails.
+ */
+static guac_socket* guac_common_encoder_batch_add_segment(
+        guac_common_encoder_batch* batch) {
+
+    /* Allocate space for additional segments as needed */
+    if (batch->length == batch->size) {
+
+        guac_socket** segments = realloc(batch->segments,
+                sizeof(guac_socket*) * batch->size * 2);
+        if (segments == NULL)
+            return NULL;
+
+        batch->segments = segments;
+        batch->size *= 2;
+
+    }
+
+    guac_socket* socket = guac_common_encoder_reuse_segment(batch->encoder);
+    if (socket == NULL) {
+
+        guac_common_encoder_segment* segment =
+            malloc(sizeof(guac_common_encoder_segment));
+        if (segment == NULL)
+            return NULL;
+
+        segment->data = malloc(GUAC_COMMON_ENCODER_SEGMENT_SIZE);
+        segment->length = 0;
+        segment->size = GUAC_COMMON_ENCODER_SEGMENT_SIZE;
+        segment->stream = NULL;
+
+        socket = guac_socket_alloc();
+        if (segment->data == NULL || socket == NULL) {
+            free(segment->data);
+            free(segment);
+            free(socket);
+            return NULL;
+        }
+
+        socket->data = segment;
+        socket->write_handler = guac_common_encoder_segment_write;
+        socket->free_handler = guac_common_encoder_segment_free;
+
+    }
+
+    batch->segments[batch->length++] = socket;
+    return socket;
+
+}
+
+/**
+ * Encodes the image of the given job, writing the resulting "img"
+ * instruction and image data to the segment socket of the job. The image
+ * surface of the job is destroyed once encoded.
+ *
+ * @param encoder
+ *     The encoder which the job was submitted to.
+ *
+ * @param job
+ *     The job to encode.
+ */
+static void guac_common_encoder_run(guac_common_encoder* encoder,
+        guac_common_encoder_job* job) {
+
+    switch (job->format) {
+
+        case GUAC_COMMON_ENCODER_PNG:
+            guac_client_write_png(encoder->client, job->socket, job->stream,
+                    job->mode, job->layer, job->x, job->y, job->surface);
+            break;
+
+        case GUAC_COMMON_ENCODER_JPEG:
+            guac_client_write_jpeg(encoder->client, job->socket, job->stream,
+                    job->mode, job->layer, job->x, job->y, job->surface,
+                    job->quality);
+            break;
+
+        case GUAC_COMMON_ENCODER_WEBP:
+            guac_client_write_webp(encoder->client, job->socket, job->stream,
+                    job->mode, job->layer, job->x, job->y, job->surface,
+                    job->quality, job->lossless);
+            break;
+
+    }
+
+    cairo_surface_destroy(job->surface);
+
+}
+
+/**
+ * Removes and returns the oldest job within the queue of the given encoder.
+ * The lock of the encoder must be held.
+ *
+ * @param encoder
+ *     The encoder whose job queue should be read.
+ *
+ * @return
+ *     The oldest job in the queue, or NULL if the queue is empty.
+ */
+static guac_common_encoder_job* guac_common_encoder_next_job(
+        guac_common_encoder* encoder) {
+
+    guac_common_encoder_job* job = encoder->first_job;
+    if (job == NULL)
+        return NULL;
+
+    encoder->first_job = job->next;
+    if (encoder->first_job == NULL)
+        encoder->last_job = NULL;
+
+    return job;
+
+}
+
+/**
+ * Encodes the image of the given job, marking the job as complete within its
+ * batch and freeing the job. The lock of the encoder must be held, and is
+ * released while the image is being encoded.
+ *
+ * @param encoder
+ *     The encoder which the job was submitted to.
+ *
+ * @param job
+ *     The job to encode.
+ */
+static void guac_common_encoder_complete(guac_common_encoder* encoder,
+        guac_common_encoder_job* job) {
+
+    pthread_mutex_unlock(&encoder->_lock);
+    guac_common_encoder_run(encoder, job);
+    pthread_mutex_lock(&encoder->_lock);
+
+    job->batch->pending--;
+    pthread_cond_broadcast(&encoder->_job_complete);
+
+    free(job);
+
+}
+
+/**
+ * Worker thread which encodes the images of submitted jobs until the encoder
+ * is freed.
+ *
+ * @param data
+ *     The guac_common_encoder which owns the thread.
+ *
+ * @return
+ *     Always NULL.
+ */
+static void* guac_common_encoder_worker(void* data) {
+
+    guac_common_encoder* encoder = (guac_common_encoder*) data;
+
+    pthread_mutex_lock(&encoder->_lock);
+
+    while (!encoder->stopping) {
+
+        guac_common_encoder_job* job = guac_common_encoder_next_job(encoder);
+
+        /* Wait for jobs if none are queued */
+        if (job == NULL)
+            pthread_cond_wait(&encoder->_job_available, &encoder->_lock);
+
+        else
+            guac_common_encoder_complete(encoder, job);
+
+    }
+
+    pthread_mutex_unlock(&encoder->_lock);
+    return NULL;
+
+}
+
+/**
+ * Waits for all images submitted to the given batch to be encoded, writing
+ * all segments of the batch to its socket in order. The image streams held
+ * by those segments are then freed, and the segments are returned to the
+ * encoder for reuse, leaving the batch empty. The calling thread assists
+ * with encoding while waiting.
+ *
+ * @param batch
+ *     The batch to write.
+ */
+static void guac_common_encoder_batch_write(guac_common_encoder_batch* batch) {
+
+    int i;
+    guac_common_encoder* encoder = batch->encoder;
+
+    pthread_mutex_lock(&encoder->_lock);
+
+    /* Assist with encoding until all jobs of the batch are complete */
+    while (batch->pending > 0) {
+
+        guac_common_encoder_job* job = guac_common_encoder_next_job(encoder);
+
+        /* Wait for other threads if no jobs remain queued */
+        if (job == NULL)
+            pthread_cond_wait(&encoder->_job_complete, &encoder->_lock);
+
+        else
+            guac_common_encoder_complete(encoder, job);
+
+    }
+
+    pthread_mutex_unlock(&encoder->_lock);
+
+    /* Write all segments in order */
+    for (i = 0; i < batch->length; i++) {
+
+        guac_socket* segment_socket = batch->segments[i];
+        guac_common_encoder_segment* segment =
+            (guac_common_encoder_segment*) segment_socket->data;
+
+        /* Segments contain only complete instructions */
+        if (segment->length > 0) {
+            guac_socket_instruction_begin(batch->socket);
+            guac_socket_write(batch->socket, segment->data, segment->length);
+            guac_socket_instruction_end(batch->socket);
+        }
+
+        /* The stream of any image may now be reused */
+        if (segment->stream != NULL) {
+            guac_client_free_stream(encoder->client, segment->stream);
+            segment->stream = NULL;
+        }
+
+    }
+
+    /* Keep segments for reuse by later batches */
+    pthread_mutex_lock(&encoder->_lock);
+
+    for (i = 0; i < batch->length; i++)
+        guac_common_encoder_recycle_segment(encoder, batch->segments[i]);
+
+    pthread_mutex_unlock(&encoder->_lock);
+
+    batch->length = 0;
+    batch->current = NULL;
+    batch->streams = 0;
+
+}
+
+guac_common_encoder* guac_common_encoder_alloc(guac_client* client) {
+
+    /* Parallel encoding is pointless with only one processor */
+    long processors = sysconf(_SC_NPROCESSORS_ONLN);
+    if (processors < 2)
+        return NULL;
+
+    guac_common_encoder* encoder = malloc(sizeof(guac_common_encoder));
+    if (encoder == NULL)
+        return NULL;
+
+    encoder->client = client;
+    encoder->first_job = NULL;
+    encoder->last_job = NULL;
+    encoder->stopping = 0;
+    encoder->spare_segment_count = 0;
+
+    pthread_mutex_init(&encoder->_lock, NULL);
+    pthread_cond_init(&encoder->_job_available, NULL);
+    pthread_cond_init(&encoder->_job_complete, NULL);
+
+    /* The thread ending each batch encodes alongside the worker threads */
+    int thread_count = processors - 1;
+    if (thread_count > GUAC_COMMON_ENCODER_MAX_THREADS)
+        thread_count = GUAC_COMMON_ENCODER_MAX_THREADS;
+
+    /* Start as many threads as possible */
+    for (encoder->thread_count = 0; encoder->thread_count < thread_count;
+            encoder->thread_count++) {
+
+        if (pthread_create(&encoder->threads[encoder->thread_count], NULL,
+                    guac_common_encoder_worker, encoder)) {
+            guac_client_log(client, GUAC_LOG_WARNING, "Only %i of %i image "
+                    "encoding threads could be started.",
+                    encoder->thread_count, thread_count);
+            break;
+        }
+
+    }
+
+    return encoder;
+
+}
+
+void guac_common_encoder_free(guac_common_encoder* encoder) {
+
+    int i;
+
+    /* Signal all threads to stop */
+    pthread_mutex_lock(&encoder->_lock);
+    encoder->stopping = 1;
+    pthread_cond_broadcast(&encoder->_job_available);
+    pthread_mutex_unlock(&encoder->_lock);
+
+    /* Wait for all threads to stop */
+    for (i = 0; i < encoder->thread_count; i++)
+        pthread_join(encoder->threads[i], NULL);
+
+    /* Free all segments retained for reuse */
+    for (i = 0; i < encoder->spare_segment_count; i++)
+        guac_socket_free(encoder->spare_segments[i]);
+
+    pthread_cond_destroy(&encoder->_job_complete);
+    pthread_cond_destroy(&encoder->_job_available);
+    pthread_mutex_destroy(&encoder->_lock);
+    free(encoder);
+
+}
+
+guac_common_encoder_batch* guac_common_encoder_batch_alloc(
+        guac_common_encoder* encoder, guac_socket* socket) {
+
+    guac_common_encoder_batch* batch =
+        malloc(sizeof(guac_common_encoder_batch));
+    if (batch == NULL)
+        return NULL;
+
+    batch->segments = malloc(sizeof(guac_socket*)
+            * GUAC_COMMON_ENCODER_BATCH_SIZE);
+    if (batch->segments == NULL) {
+        free(batch);
+        return NULL;
+    }
+
+    batch->encoder = encoder;
+    batch->socket = socket;
+    batch->length = 0;
+    batch->size = GUAC_COMMON_ENCODER_BATCH_SIZE;
+    batch->current = NULL;
+    batch->pending = 0;
+    batch->streams = 0;
+
+    return batch;
+
+}
+
+guac_socket* guac_common_encoder_batch_socket(
+        guac_common_encoder_batch* batch) {
+
+    /* Begin new segment following any submitted images if necessary */
+    if (batch->current == NULL)
+        batch->current = guac_common_encoder_batch_add_segment(batch);
+
+    /* Fall back to writing directly if the segment cannot be allocated,
+     * first writing everything added to the batch thus far to preserve
+     * order */
+    if (batch->current == NULL) {
+        guac_common_encoder_batch_write(batch);
+        return batch->socket;
+    }
+
+    return batch->current;
+
+}
+
+void guac_common_encoder_batch_submit(guac_common_encoder_batch* batch,
+        guac_common_encoder_format format, guac_composite_mode mode,
+        const guac_layer* layer, int x, int y, cairo_surface_t* surface,
+        int quality, int lossless) {
+
+    guac_common_encoder* encoder = batch->encoder;
+
+    guac_common_encoder_job* job = malloc(sizeof(guac_common_encoder_job));
+    if (job == NULL) {
+        cairo_surface_destroy(surface);
+        return;
+    }
+
+    job->batch = batch;
+    job->format = format;
+    job->mode = mode;
+    job->layer = layer;
+    job->x = x;
+    job->y = y;
+    job->surface = surface;
+    job->quality = quality;
+    job->lossless = lossless;
+    job->next = NULL;
+
+    /* Release the streams held by the batch if it holds too many */
+    if (batch->streams == GUAC_COMMON_ENCODER_MAX_BATCH_STREAMS)
+        guac_common_encoder_batch_write(batch);
+
+    /* Allocate the stream of the image now, holding its index until the
+     * image is actually written, releasing the streams of the batch if
+     * necessary */
+    job->stream = guac_client_alloc_stream(encoder->client);
+    if (job->stream == NULL && batch->streams > 0) {
+        guac_common_encoder_batch_write(batch);
+        job->stream = guac_client_alloc_stream(encoder->client);
+    }
+
+    if (job->stream == NULL) {
+        guac_client_log(encoder->client, GUAC_LOG_WARNING, "No stream is "
+                "available for an encoded image. The image will be "
+                "dropped.");
+        cairo_surface_destroy(surface);
+        free(job);
+        return;
+    }
+
+    /* Image data is sent within its own segment, with any later
+     * instructions following in a new segment */
+    job->socket = guac_common_encoder_batch_add_segment(batch);
+    batch->current = NULL;
+
+    /* Encode directly after everything added to the batch thus far if the
+     * segment cannot be allocated */
+    if (job->socket == NULL) {
+        guac_common_encoder_batch_write(batch);
+        job->socket = batch->socket;
+        guac_common_encoder_run(encoder, job);
+        guac_client_free_stream(encoder->client, job->stream);
+        free(job);
+        return;
+    }
+
+    /* The stream is freed only once the segment has been written */
+    ((guac_common_encoder_segment*) job->socket->data)->stream = job->stream;
+    batch->streams++;
+
+    /* Add job to queue */
+    pthread_mutex_lock(&encoder->_lock);
+
+    if (encoder->last_job != NULL)
+        encoder->last_job->next = job;
+    else
+        encoder->first_job = job;
+
+    encoder->last_job = job;
+    batch->pending++;
+
+    pthread_cond_signal(&encoder->_job_available);
+    pthread_mutex_unlock(&encoder->_lock);
+
+}
+
+void guac_common_encoder_batch_end(guac_common_encoder_batch* batch) {
+
+    /* Write all remaining segments in order */
+    guac_common_encoder_batch_write(batch);
+
+    free(batch->segments);
+    free(batch);
+
+}
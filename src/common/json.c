@@ -38,6 +38,8 @@ void guac_common_json_flush(guac_user* user, guac_stream* stream,
         guac_protocol_send_blob(user->socket, stream,
                 json_state->buffer, json_state->size);
 
+        json_state->blobs_in_flight++;
+
         /* Reset JSON buffer size */
         json_state->size = 0;
 
@@ -164,6 +166,7 @@ void guac_common_json_begin_object(guac_user* user, guac_stream* stream,
     /* Init JSON state */
     json_state->size = 0;
     json_state->properties_written = 0;
+    json_state->blobs_in_flight = 0;
 
     /* Write leading brace - no blob can possibly be written by this */
     assert(!guac_common_json_write(user, stream, json_state, "{", 1));
@@ -178,3 +181,14 @@ int guac_common_json_end_object(guac_user* user, guac_stream* stream,
 
 }
 
+void guac_common_json_ack(guac_common_json_state* json_state) {
+
+    if (json_state->blobs_in_flight > 0)
+        json_state->blobs_in_flight--;
+
+}
+
+int guac_common_json_window_full(guac_common_json_state* json_state) {
+    return json_state->blobs_in_flight >= GUAC_COMMON_JSON_WINDOW;
+}
+
@@ -0,0 +1,187 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "config.h"
+#include "common/read_ahead.h"
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * The thread of a read-ahead buffer, reading data whenever space is
+ * available until the end of the source is reached, a read fails, or the
+ * buffer is closed.
+ *
+ * @param data
+ *     The guac_common_read_ahead whose data should be read.
+ *
+ * @return
+ *     Always NULL.
+ */
+static void* guac_common_read_ahead_thread(void* data) {
+
+    guac_common_read_ahead* read_ahead = (guac_common_read_ahead*) data;
+    uint64_t offset = 0;
+
+    pthread_mutex_lock(&(read_ahead->lock));
+
+    while (!read_ahead->eof && !read_ahead->error) {
+
+        /* Wait for space, or for the buffer to be closed */
+        while (read_ahead->length == GUAC_COMMON_READ_AHEAD_BUFFER_SIZE
+                && !read_ahead->closing)
+            pthread_cond_wait(&(read_ahead->modified), &(read_ahead->lock));
+
+        if (read_ahead->closing)
+            break;
+
+        /* Reads always append to the end of the buffered data */
+        int end = (read_ahead->start + read_ahead->length)
+                % GUAC_COMMON_READ_AHEAD_BUFFER_SIZE;
+
+        /* Read only into the contiguous space following the end */
+        int available;
+        if (end >= read_ahead->start)
+            available = GUAC_COMMON_READ_AHEAD_BUFFER_SIZE - end;
+        else
+            available = read_ahead->start - end;
+
+        if (available > GUAC_COMMON_READ_AHEAD_READ_SIZE)
+            available = GUAC_COMMON_READ_AHEAD_READ_SIZE;
+
+        /* The space being read into is not part of the buffered data, and
+         * thus cannot be consumed, until the read completes */
+        pthread_mutex_unlock(&(read_ahead->lock));
+        int bytes_read = read_ahead->read_handler(read_ahead->data, offset,
+                read_ahead->buffer + end, available);
+        pthread_mutex_lock(&(read_ahead->lock));
+
+        if (bytes_read < 0)
+            read_ahead->error = 1;
+
+        else if (bytes_read == 0)
+            read_ahead->eof = 1;
+
+        else {
+            read_ahead->length += bytes_read;
+            offset += bytes_read;
+        }
+
+        pthread_cond_broadcast(&(read_ahead->modified));
+
+    }
+
+    pthread_mutex_unlock(&(read_ahead->lock));
+    return NULL;
+
+}
+
+guac_common_read_ahead* guac_common_read_ahead_alloc(
+        guac_common_read_ahead_read_handler* read_handler, void* data) {
+
+    guac_common_read_ahead* read_ahead =
+        malloc(sizeof(guac_common_read_ahead));
+    if (read_ahead == NULL)
+        return NULL;
+
+    read_ahead->read_handler = read_handler;
+    read_ahead->data = data;
+    read_ahead->start = 0;
+    read_ahead->length = 0;
+    read_ahead->eof = 0;
+    read_ahead->error = 0;
+    read_ahead->closing = 0;
+
+    pthread_mutex_init(&(read_ahead->lock), NULL);
+    pthread_cond_init(&(read_ahead->modified), NULL);
+
+    if (pthread_create(&(read_ahead->thread), NULL,
+                guac_common_read_ahead_thread, read_ahead)) {
+        pthread_cond_destroy(&(read_ahead->modified));
+        pthread_mutex_destroy(&(read_ahead->lock));
+        free(read_ahead);
+        return NULL;
+    }
+
+    return read_ahead;
+
+}
+
+int guac_common_read_ahead_read(guac_common_read_ahead* read_ahead,
+        char* buffer, int length) {
+
+    int copied = 0;
+
+    pthread_mutex_lock(&(read_ahead->lock));
+
+    /* Wait for data unless no more will be read */
+    while (read_ahead->length == 0 && !read_ahead->eof
+            && !read_ahead->error)
+        pthread_cond_wait(&(read_ahead->modified), &(read_ahead->lock));
+
+    /* Report failure only once all data read before the failure has been
+     * consumed */
+    if (read_ahead->length == 0 && read_ahead->error) {
+        pthread_mutex_unlock(&(read_ahead->lock));
+        return -1;
+    }
+
+    /* Copy as much as is available, possibly spanning the end of the ring
+     * buffer */
+    while (copied < length && read_ahead->length > 0) {
+
+        int size = length - copied;
+        if (size > read_ahead->length)
+            size = read_ahead->length;
+        if (size > GUAC_COMMON_READ_AHEAD_BUFFER_SIZE - read_ahead->start)
+            size = GUAC_COMMON_READ_AHEAD_BUFFER_SIZE - read_ahead->start;
+
+        memcpy(buffer + copied, read_ahead->buffer + read_ahead->start, size);
+
+        read_ahead->start = (read_ahead->start + size)
+                          % GUAC_COMMON_READ_AHEAD_BUFFER_SIZE;
+        read_ahead->length -= size;
+        copied += size;
+
+    }
+
+    pthread_cond_broadcast(&(read_ahead->modified));
+    pthread_mutex_unlock(&(read_ahead->lock));
+
+    return copied;
+
+}
+
+void guac_common_read_ahead_free(guac_common_read_ahead* read_ahead) {
+
+    /* Stop reading as soon as any read in progress completes */
+    pthread_mutex_lock(&(read_ahead->lock));
+    read_ahead->closing = 1;
+    pthread_cond_broadcast(&(read_ahead->modified));
+    pthread_mutex_unlock(&(read_ahead->lock));
+
+    pthread_join(read_ahead->thread, NULL);
+
+    pthread_cond_destroy(&(read_ahead->modified));
+    pthread_mutex_destroy(&(read_ahead->lock));
+    free(read_ahead);
+
+}
@@ -34,6 +34,17 @@
 #include <stdint.h>
 #include <string.h>
 
+/*
+ * Vectorized implementations are built only for x86 compilers which allow
+ * individual functions to target instruction sets beyond those enabled for
+ * the build as a whole.
+ */
+#if (defined(__x86_64__) || defined(__i386__)) \
+    && (defined(__clang__) || (defined(__GNUC__) && __GNUC__ >= 5))
+#define GUAC_SURFACE_X86_SIMD
+#include <immintrin.h>
+#endif
+
 /**
  * The width of an update which should be considered negible and thus
  * trivial overhead compared ot the cost of two updates.
@@ -103,6 +114,126 @@
  */
 #define GUAC_SURFACE_WEBP_BLOCK_SIZE 8
 
+/**
+ * The minimum number of pixels within each band of an update which is split
+ * into bands for parallel encoding. Updates smaller than this are encoded as
+ * a single image.
+ */
+#define GUAC_SURFACE_PARALLEL_MIN_PIXELS 65536
+
+/**
+ * The number of rows that the height of each band of an update split for
+ * parallel encoding must be a multiple of. This must be a multiple of both
+ * GUAC_SURFACE_JPEG_BLOCK_SIZE and GUAC_SURFACE_WEBP_BLOCK_SIZE.
+ */
+#define GUAC_SURFACE_PARALLEL_BAND_ALIGNMENT 64
+
+/**
+ * The minimum area, in pixels, of a drawn image before the surface checks
+ * whether the image merely shifts content already present on the surface.
+ */
+#define GUAC_SURFACE_SHIFT_MIN_AREA 16384
+
+/**
+ * The maximum distance, in pixels, that content may have shifted while still
+ * being detected as a shift.
+ */
+#define GUAC_SURFACE_SHIFT_MAX_DISTANCE 512
+
+/**
+ * The minimum number of changed rows or columns of a drawn image which must
+ * match shifted content before that content is redrawn with a copy.
+ */
+#define GUAC_SURFACE_SHIFT_MIN_LENGTH 16
+
+/**
+ * The number of pixels, spread evenly across each row or column, which are
+ * hashed to reject most differing rows or columns when cheaply testing whether
+ * a drawn image may shift content already present on the surface.
+ */
+#define GUAC_SURFACE_SHIFT_SAMPLE_PIXELS 8
+
+/**
+ * The initial value of each running hash of a row or column of pixels, as
+ * updated with __guac_common_surface_hash_pixel().
+ */
+#define GUAC_SURFACE_SHIFT_HASH_INITIAL 2166136261u
+
+/**
+ * The width, in pixels, of each segment of each row of a surface whose
+ * contents are hashed to detect shifted content in updates written directly
+ * to the surface buffer.
+ */
+#define GUAC_SURFACE_SHIFT_SEGMENT_WIDTH 64
+
+/**
+ * The initial value of the hash of each segment of a row, as calculated by
+ * __guac_common_surface_hash_segment().
+ */
+#define GUAC_SURFACE_SHIFT_SEGMENT_HASH_INITIAL 14695981039346656037ull
+
+/**
+ * The number of colors beyond which an update can no longer be encoded as a
+ * palette-based PNG. Updates containing no more than this many colors are
+ * always sent as PNG, as they compress well losslessly.
+ */
+#define GUAC_SURFACE_PALETTE_SIZE 256
+
+/**
+ * The number of bits within the bitmap used to estimate the number of unique
+ * colors within an update. This must be a multiple of 64 and a power of two
+ * no larger than 2^32.
+ */
+#define GUAC_SURFACE_COLOR_BITS 4096
+
+/**
+ * The statistics gathered by __guac_common_surface_analyze() for a single
+ * rectangle of a surface, used to decide how that rectangle should be
+ * encoded.
+ */
+typedef struct guac_common_surface_analysis {
+
+    /**
+     * Non-zero if the rectangle contains only fully opaque pixels, zero
+     * otherwise.
+     */
+    int opaque;
+
+    /**
+     * The average framerate of the heat map cells intersecting the
+     * rectangle, in frames per second.
+     */
+    unsigned int framerate;
+
+    /**
+     * Non-zero if the remaining statistics below were gathered. Content
+     * statistics are skipped if the framerate alone rules out lossy
+     * compression.
+     */
+    int content;
+
+    /**
+     * The number of pixels which have the same color as the pixel to their
+     * immediate left.
+     */
+    int num_same;
+
+    /**
+     * One more than the number of pixels which differ in color from the
+     * pixel to their immediate left.
+     */
+    int num_different;
+
+    /**
+     * The number of unique colors within the rectangle, counted over every
+     * row. Counting stops once this exceeds GUAC_SURFACE_PALETTE_SIZE.
+     * Colors whose hashes collide are counted once, so this may slightly
+     * underestimate the true number of colors.
+     */
+    int colors;
+
+} guac_common_surface_analysis;
+
 void guac_common_surface_set_multitouch(guac_common_surface* surface,
         int touches) {
 
@@ -125,6 +256,24 @@ void guac_common_surface_set_lossless(guac_common_surface* surface,
 
 }
 
+void guac_common_surface_set_tile_cache(guac_common_surface* surface,
+        guac_common_tile_cache* tile_cache) {
+
+    pthread_mutex_lock(&surface->_lock);
+    surface->tile_cache = tile_cache;
+    pthread_mutex_unlock(&surface->_lock);
+
+}
+
+void guac_common_surface_set_encoder(guac_common_surface* surface,
+        guac_common_encoder* encoder) {
+
+    pthread_mutex_lock(&surface->_lock);
+    surface->encoder = encoder;
+    pthread_mutex_unlock(&surface->_lock);
+
+}
+
 void guac_common_surface_move(guac_common_surface* surface, int x, int y) {
 
     pthread_mutex_lock(&surface->_lock);
@@ -232,54 +381,6 @@ static void __guac_common_clip_rect(guac_common_surface* surface,
 
 }
 
-/**
- * Returns whether a rectangle within the given surface contains only fully
- * opaque pixels.
- *
- * @param surface
- *     The surface to check.
- *
- * @param rect
- *     The rectangle to check.
- *
- * @return
- *     Non-zero if the rectangle contains only fully opaque pixels, zero
- *     otherwise.
- */
-static int __guac_common_surface_is_opaque(guac_common_surface* surface,
-        guac_common_rect* rect) {
-
-    int x, y;
-
-    int stride = surface ->stride;
-    unsigned char* buffer =
-        surface->buffer + (stride * rect->y) + (4 * rect->x);
-
-    /* For each row */
-    for (y = 0; y < rect->height; y++) {
-
-        /* Search for a non-opaque pixel */
-        uint32_t* current = (uint32_t*) buffer;
-        for (x=0; x < rect->width; x++) {
-
-            /* Rectangle is non-opaque if a single non-opaque pixel is found */
-            uint32_t color = *(current++);
-            if ((color & 0xFF000000) != 0xFF000000)
-                return 0;
-
-        }
-
-        /* Next row */
-        buffer += stride;
-
-    }
-
-    /* Rectangle is opaque */
-    return 1;
-
-}
-
-
 /**
  * Returns whether the given rectangle should be combined into the existing
  * dirty rectangle, to be eventually flushed as image data, or would be best
@@ -352,6 +453,116 @@ static int __guac_common_should_combine(guac_common_surface* surface, const guac
 
 }
 
+/**
+ * Calculates the hash of the given segment of a row of pixels, as stored
+ * within the shift_hashes of a surface. The result is never zero, as zero
+ * denotes a segment whose hash must be recalculated.
+ *
+ * @param pixels
+ *     The first pixel of the segment, in 32-bit ARGB format.
+ *
+ * @param width
+ *     The number of pixels within the segment.
+ *
+ * @return
+ *     The hash of the given segment.
+ */
+static uint64_t __guac_common_surface_hash_segment(const uint32_t* pixels,
+        int width) {
+
+    uint64_t hash = GUAC_SURFACE_SHIFT_SEGMENT_HASH_INITIAL;
+    for (int x = 0; x < width; x++)
+        hash = (hash ^ pixels[x]) * 1099511628211ull;
+
+    return hash ? hash : 1;
+
+}
+
+/**
+ * Marks the hashes of all segments of the given surface which intersect the
+ * given rectangle as needing to be recalculated, as the contents of those
+ * segments no longer match the contents of the remote display as of the last
+ * flush. If the surface has no segment hashes, this function has no effect.
+ *
+ * @param surface
+ *     The surface whose segment hashes should be updated.
+ *
+ * @param rect
+ *     The rectangle which has changed.
+ */
+static void __guac_common_surface_mark_stale(guac_common_surface* surface,
+        const guac_common_rect* rect) {
+
+    if (surface->shift_hashes == NULL || rect->width <= 0
+            || rect->height <= 0)
+        return;
+
+    /* Convert rectangle to segments horizontally and rows vertically */
+    guac_common_rect stale;
+    int first = rect->x / GUAC_SURFACE_SHIFT_SEGMENT_WIDTH;
+    int last = (rect->x + rect->width - 1) / GUAC_SURFACE_SHIFT_SEGMENT_WIDTH;
+    guac_common_rect_init(&stale, first, rect->y, last - first + 1,
+            rect->height);
+
+    for (int y = stale.y; y < stale.y + stale.height; y++)
+        memset(surface->shift_hashes + y * surface->shift_segments + stale.x,
+                0, sizeof(uint64_t) * stale.width);
+
+    if (surface->shift_stale)
+        guac_common_rect_extend(&surface->shift_stale_rect, &stale);
+    else {
+        surface->shift_stale_rect = stale;
+        surface->shift_stale = 1;
+    }
+
+}
+
+/**
+ * Recalculates all segment hashes of the given surface which were marked as
+ * needing recalculation by __guac_common_surface_mark_stale(). This must be
+ * invoked only after the surface has been completely flushed, such that the
+ * contents of the surface buffer match the contents of the remote display.
+ *
+ * @param surface
+ *     The surface whose segment hashes should be recalculated.
+ */
+static void __guac_common_surface_update_hashes(
+        guac_common_surface* surface) {
+
+    if (surface->shift_hashes == NULL || !surface->shift_stale)
+        return;
+
+    guac_common_rect* stale = &surface->shift_stale_rect;
+
+    for (int y = stale->y; y < stale->y + stale->height; y++) {
+
+        uint64_t* hash = surface->shift_hashes
+            + y * surface->shift_segments + stale->x;
+
+        const uint32_t* row = (uint32_t*) (surface->buffer
+                + y * surface->stride);
+
+        for (int i = stale->x; i < stale->x + stale->width; i++, hash++) {
+
+            if (*hash != 0)
+                continue;
+
+            /* The last segment of each row may be narrower than the rest */
+            int x = i * GUAC_SURFACE_SHIFT_SEGMENT_WIDTH;
+            int width = surface->width - x;
+            if (width > GUAC_SURFACE_SHIFT_SEGMENT_WIDTH)
+                width = GUAC_SURFACE_SHIFT_SEGMENT_WIDTH;
+
+            *hash = __guac_common_surface_hash_segment(row + x, width);
+
+        }
+
+    }
+
+    surface->shift_stale = 0;
+
+}
+
 /**
  * Expands the dirty rect of the given surface to contain the rect described by the given
  * coordinates.
@@ -365,6 +576,9 @@ static void __guac_common_mark_dirty(guac_common_surface* surface, const guac_co
     if (rect->width <= 0 || rect->height <= 0)
         return;
 
+    /* Dirty content will not match the remote display until flushed */
+    __guac_common_surface_mark_stale(surface, rect);
+
     /* If already dirty, update existing rect */
     if (surface->dirty)
         guac_common_rect_extend(&surface->dirty_rect, rect);
@@ -457,180 +671,465 @@ static unsigned int __guac_common_surface_calculate_framerate(
 
 }
 
- /**
- * Guesses whether a rectangle within a particular surface would be better
- * compressed as PNG or using a lossy format like JPEG. Positive values
- * indicate PNG is likely to be superior, while negative values indicate the
- * opposite.
+/**
+ * Records the given color within the bitmap used to estimate the number of
+ * unique colors within an update, incrementing the estimate if the color
+ * has not been seen before (or its hash collides with no previous color).
  *
- * @param surface
- *     The surface containing the image data to check.
+ * @param colors
+ *     The bitmap of hashed colors seen so far, GUAC_SURFACE_COLOR_BITS bits
+ *     in length.
  *
- * @param rect
- *     The rect to check within the given surface.
+ * @param color
+ *     The color to record, ignoring alpha.
  *
- * @return
- *     Positive values if PNG compression is likely to perform better than
- *     lossy alternatives, or negative values if PNG is likely to perform
- *     worse.
+ * @param count
+ *     The current estimate of the number of unique colors, which will be
+ *     incremented if the color is new.
  */
-static int __guac_common_surface_png_optimality(guac_common_surface* surface,
-        const guac_common_rect* rect) {
+static void __guac_common_surface_count_color(uint64_t* colors,
+        uint32_t color, int* count) {
 
-    int x, y;
+    /* Multiplicative hash, keeping only the uppermost bits */
+    uint32_t hash = ((color & 0xFFFFFF) * 2654435761u)
+        / (0x100000000ull / GUAC_SURFACE_COLOR_BITS);
 
-    int num_same = 0;
-    int num_different = 1;
+    uint64_t bit = 1ull << (hash & 63);
+    uint64_t* word = &colors[hash >> 6];
 
-    /* Get image/buffer metrics */
-    int width = rect->width;
-    int height = rect->height;
-    int stride = surface->stride;
+    if (!(*word & bit)) {
+        *word |= bit;
+        (*count)++;
+    }
 
-    /* Get buffer from surface */
-    unsigned char* buffer = surface->buffer + rect->y * stride + rect->x * 4;
+}
 
-    /* Image must be at least 1x1 */
-    if (width < 1 || height < 1)
-        return 0;
+/**
+ * Signature shared by all implementations of the per-row statistics gathered
+ * by __guac_common_surface_analyze(). Each implementation combines all
+ * pixels of the row with the given alpha accumulator using bitwise AND, and
+ * counts the pixels having the same color as the pixel to their immediate
+ * left, ignoring alpha.
+ *
+ * @param row
+ *     The pixels of the row, in 32-bit ARGB format.
+ *
+ * @param width
+ *     The number of pixels within the row, which must be at least 1.
+ *
+ * @param alpha
+ *     The accumulator to combine with each pixel using bitwise AND.
+ *
+ * @return
+ *     The number of pixels having the same color as the pixel to their
+ *     immediate left.
+ */
+typedef int guac_common_surface_row_analyzer(const uint32_t* row, int width,
+        uint32_t* alpha);
 
-    /* For each row */
-    for (y = 0; y < height; y++) {
+/**
+ * Gathers the per-row statistics of __guac_common_surface_analyze() without
+ * the use of any vector instructions. This implementation is used when no
+ * faster implementation is available, and to handle any pixels left over by
+ * the vectorized implementations.
+ *
+ * @param row
+ *     The pixels of the row, in 32-bit ARGB format.
+ *
+ * @param width
+ *     The number of pixels within the row, which must be at least 1.
+ *
+ * @param alpha
+ *     The accumulator to combine with each pixel using bitwise AND.
+ *
+ * @return
+ *     The number of pixels having the same color as the pixel to their
+ *     immediate left.
+ */
+static int __guac_common_surface_analyze_row_scalar(const uint32_t* row,
+        int width, uint32_t* alpha) {
 
-        uint32_t* row = (uint32_t*) buffer;
-        uint32_t last_pixel = *(row++) | 0xFF000000;
+    uint32_t row_alpha = row[0];
+    int same = 0;
 
-        /* For each pixel in current row */
-        for (x = 1; x < width; x++) {
+    for (int x = 1; x < width; x++) {
+        row_alpha &= row[x];
+        same += ((row[x] ^ row[x - 1]) & 0xFFFFFF) == 0;
+    }
 
-            /* Get next pixel */
-            uint32_t current_pixel = *(row++) | 0xFF000000;
+    *alpha &= row_alpha;
+    return same;
 
-            /* Update same/different counts according to pixel value */
-            if (current_pixel == last_pixel)
-                num_same++;
-            else
-                num_different++;
+}
 
-            last_pixel = current_pixel;
+#ifdef GUAC_SURFACE_X86_SIMD
 
-        }
+/**
+ * SSE2 implementation of the per-row statistics of
+ * __guac_common_surface_analyze(), comparing four pixels at a time with
+ * their left neighbors.
+ *
+ * @param row
+ *     The pixels of the row, in 32-bit ARGB format.
+ *
+ * @param width
+ *     The number of pixels within the row, which must be at least 1.
+ *
+ * @param alpha
+ *     The accumulator to combine with each pixel using bitwise AND.
+ *
+ * @return
+ *     The number of pixels having the same color as the pixel to their
+ *     immediate left.
+ */
+__attribute__((target("sse2")))
+static int __guac_common_surface_analyze_row_sse2(const uint32_t* row,
+        int width, uint32_t* alpha) {
 
-        /* Advance to next row */
-        buffer += stride;
+    const __m128i color_mask = _mm_set1_epi32(0xFFFFFF);
+    __m128i row_alpha = _mm_set1_epi32(row[0]);
+    __m128i same = _mm_setzero_si128();
+
+    /* Each lane of the comparison is -1 for matching pixels */
+    int x;
+    for (x = 1; x + 4 <= width; x += 4) {
+
+        __m128i current = _mm_loadu_si128((const __m128i*) (row + x));
+        __m128i left = _mm_loadu_si128((const __m128i*) (row + x - 1));
+
+        row_alpha = _mm_and_si128(row_alpha, current);
+        same = _mm_sub_epi32(same, _mm_cmpeq_epi32(
+                    _mm_and_si128(_mm_xor_si128(current, left), color_mask),
+                    _mm_setzero_si128()));
 
     }
 
-    /* Return rough approximation of optimality for PNG compression */
-    return 0x100 * num_same / num_different - 0x400;
+    uint32_t lanes_alpha[4];
+    uint32_t lanes_same[4];
+    _mm_storeu_si128((__m128i*) lanes_alpha, row_alpha);
+    _mm_storeu_si128((__m128i*) lanes_same, same);
+
+    *alpha &= lanes_alpha[0] & lanes_alpha[1] & lanes_alpha[2]
+        & lanes_alpha[3];
+
+    /* Finish any remaining pixels (the first pixel was accounted for by
+     * the initial alpha) */
+    int count = lanes_same[0] + lanes_same[1] + lanes_same[2] + lanes_same[3];
+    return count + __guac_common_surface_analyze_row_scalar(row + x - 1,
+            width - x + 1, alpha);
 
 }
 
 /**
- * Returns whether the given rectangle would be optimally encoded as JPEG
- * rather than PNG.
+ * AVX2 implementation of the per-row statistics of
+ * __guac_common_surface_analyze(), comparing eight pixels at a time with
+ * their left neighbors.
  *
- * @param surface
- *     The surface to be queried.
+ * @param row
+ *     The pixels of the row, in 32-bit ARGB format.
  *
- * @param rect
- *     The rectangle to check.
+ * @param width
+ *     The number of pixels within the row, which must be at least 1.
+ *
+ * @param alpha
+ *     The accumulator to combine with each pixel using bitwise AND.
  *
  * @return
- *     Non-zero if the rectangle would be optimally encoded as JPEG, zero
- *     otherwise.
+ *     The number of pixels having the same color as the pixel to their
+ *     immediate left.
  */
-static int __guac_common_surface_should_use_jpeg(guac_common_surface* surface,
-        const guac_common_rect* rect) {
+__attribute__((target("avx2")))
+static int __guac_common_surface_analyze_row_avx2(const uint32_t* row,
+        int width, uint32_t* alpha) {
 
-    /* Do not use JPEG if lossless quality is required */
-    if (surface->lossless)
-        return 0;
+    const __m256i color_mask = _mm256_set1_epi32(0xFFFFFF);
+    __m256i row_alpha = _mm256_set1_epi32(row[0]);
+    __m256i same = _mm256_setzero_si256();
+
+    /* Each lane of the comparison is -1 for matching pixels */
+    int x;
+    for (x = 1; x + 8 <= width; x += 8) {
+
+        __m256i current = _mm256_loadu_si256((const __m256i*) (row + x));
+        __m256i left = _mm256_loadu_si256((const __m256i*) (row + x - 1));
+
+        row_alpha = _mm256_and_si256(row_alpha, current);
+        same = _mm256_sub_epi32(same, _mm256_cmpeq_epi32(
+                    _mm256_and_si256(_mm256_xor_si256(current, left),
+                        color_mask),
+                    _mm256_setzero_si256()));
 
-    /* Calculate the average framerate for the given rect */
-    int framerate = __guac_common_surface_calculate_framerate(surface, rect);
+    }
+
+    uint32_t lanes_alpha[8];
+    uint32_t lanes_same[8];
+    _mm256_storeu_si256((__m256i*) lanes_alpha, row_alpha);
+    _mm256_storeu_si256((__m256i*) lanes_same, same);
 
-    int rect_size = rect->width * rect->height;
+    int count = 0;
+    for (int i = 0; i < 8; i++) {
+        *alpha &= lanes_alpha[i];
+        count += lanes_same[i];
+    }
 
-    /* JPEG is preferred if:
-     * - frame rate is high enough
-     * - image size is large enough
-     * - PNG is not more optimal based on image contents */
-    return framerate >= GUAC_COMMON_SURFACE_JPEG_FRAMERATE
-        && rect_size > GUAC_SURFACE_JPEG_MIN_BITMAP_SIZE
-        && __guac_common_surface_png_optimality(surface, rect) < 0;
+    /* Finish any remaining pixels (the first pixel was accounted for by
+     * the initial alpha) */
+    return count + __guac_common_surface_analyze_row_scalar(row + x - 1,
+            width - x + 1, alpha);
 
 }
 
+#endif
+
 /**
- * Returns whether the given rectangle would be optimally encoded as WebP
- * rather than PNG.
- *
- * @param surface
- *     The surface to be queried.
- *
- * @param rect
- *     The rectangle to check.
- *
- * @return
- *     Non-zero if the rectangle would be optimally encoded as WebP, zero
- *     otherwise.
+ * The fastest implementation of the per-row statistics of
+ * __guac_common_surface_analyze() supported by the current CPU. This is
+ * selected on first use by __guac_common_surface_select_row_analyzer().
  */
-static int __guac_common_surface_should_use_webp(guac_common_surface* surface,
-        const guac_common_rect* rect) {
+static guac_common_surface_row_analyzer* __guac_common_surface_analyze_row =
+    __guac_common_surface_analyze_row_scalar;
 
-    /* Do not use WebP if not supported */
-    if (!guac_client_supports_webp(surface->client))
-        return 0;
+/**
+ * Guards the one-time selection of __guac_common_surface_analyze_row.
+ */
+static pthread_once_t __guac_common_surface_row_analyzer_selected =
+    PTHREAD_ONCE_INIT;
+
+/**
+ * Selects the fastest implementation of the per-row statistics of
+ * __guac_common_surface_analyze() supported by the current CPU, storing that
+ * implementation within __guac_common_surface_analyze_row.
+ */
+static void __guac_common_surface_select_row_analyzer() {
+
+#ifdef GUAC_SURFACE_X86_SIMD
+    __builtin_cpu_init();
 
-    /* Calculate the average framerate for the given rect */
-    int framerate = __guac_common_surface_calculate_framerate(surface, rect);
+    if (__builtin_cpu_supports("avx2"))
+        __guac_common_surface_analyze_row =
+            __guac_common_surface_analyze_row_avx2;
 
-    /* WebP is preferred if:
-     * - frame rate is high enough
-     * - PNG is not more optimal based on image contents */
-    return framerate >= GUAC_COMMON_SURFACE_JPEG_FRAMERATE
-        && __guac_common_surface_png_optimality(surface, rect) < 0;
+    else if (__builtin_cpu_supports("sse2"))
+        __guac_common_surface_analyze_row =
+            __guac_common_surface_analyze_row_sse2;
+#endif
 
 }
 
 /**
- * Updates the heat map cells which intersect the given rectangle using the
- * given timestamp. This timestamp, along with timestamps from past updates,
- * is used to calculate the framerate of each heat cell.
+ * Analyzes the given rectangle of the given surface in a single pass over
+ * its pixels, determining whether the rectangle is opaque and, if lossy
+ * compression could be chosen based on the framerate of the rectangle,
+ * gathering the run and color statistics which decide between lossless and
+ * lossy compression. Opacity and runs are gathered using the fastest
+ * vectorized implementation supported by the current CPU.
  *
  * @param surface
- *     The surface containing the heat map cells to be updated.
+ *     The surface containing the rectangle to analyze.
  *
  * @param rect
- *     The rectangle containing the heat map cells to be updated.
+ *     The rectangle to analyze.
  *
- * @param time
- *     The timestamp to use when updating the heat map cells which intersect
- *     the given rectangle.
+ * @param opaque
+ *     Non-zero if the rectangle is already known to be opaque, in which case
+ *     opacity is not checked, zero otherwise.
+ *
+ * @param analysis
+ *     The analysis to populate.
  */
-static void __guac_common_surface_touch_rect(guac_common_surface* surface,
-        guac_common_rect* rect, guac_timestamp time) {
+static void __guac_common_surface_analyze(guac_common_surface* surface,
+        const guac_common_rect* rect, int opaque,
+        guac_common_surface_analysis* analysis) {
 
     int x, y;
 
-    /* Calculate heat map dimensions */
-    int heat_width = GUAC_COMMON_SURFACE_HEAT_DIMENSION(surface->width);
+    uint64_t colors[GUAC_SURFACE_COLOR_BITS / 64];
+    uint32_t alpha = 0xFF000000;
 
-    /* Calculate minimum X/Y coordinates intersecting given rect */
-    int min_x = rect->x / GUAC_COMMON_SURFACE_HEAT_CELL_SIZE;
-    int min_y = rect->y / GUAC_COMMON_SURFACE_HEAT_CELL_SIZE;
+    pthread_once(&__guac_common_surface_row_analyzer_selected,
+            __guac_common_surface_select_row_analyzer);
 
-    /* Calculate maximum X/Y coordinates intersecting given rect */
-    int max_x = min_x + (rect->width  - 1) / GUAC_COMMON_SURFACE_HEAT_CELL_SIZE;
-    int max_y = min_y + (rect->height - 1) / GUAC_COMMON_SURFACE_HEAT_CELL_SIZE;
+    /* Get image/buffer metrics */
+    int width = rect->width;
+    int height = rect->height;
+    int stride = surface->stride;
 
-    /* Get start of buffer at given coordinates */
-    guac_common_surface_heat_cell* heat_row =
-        surface->heat_map + min_y * heat_width + min_x;
+    /* Get buffer from surface */
+    unsigned char* buffer = surface->buffer + rect->y * stride + rect->x * 4;
 
-    /* Update all heat map cells which intersect with rectangle */
-    for (y = min_y; y <= max_y; y++) {
+    /* The heat map is consulted only once per rectangle */
+    analysis->framerate = __guac_common_surface_calculate_framerate(surface,
+            rect);
+
+    /* Content statistics matter only if lossy compression is possible */
+    analysis->content = width >= 1 && height >= 1
+        && analysis->framerate >= GUAC_COMMON_SURFACE_JPEG_FRAMERATE
+        && (!surface->lossless || guac_client_supports_webp(surface->client));
+
+    analysis->num_same = 0;
+    analysis->num_different = 1;
+    analysis->colors = 0;
+
+    /* Only opacity is needed, stopping at the first row containing a
+     * non-opaque pixel */
+    if (!analysis->content) {
+
+        for (y = 0; !opaque && y < height && width >= 1; y++) {
+
+            __guac_common_surface_analyze_row((uint32_t*) buffer, width,
+                    &alpha);
+
+            if (alpha != 0xFF000000)
+                break;
+
+            buffer += stride;
+
+        }
+
+        analysis->opaque = opaque || alpha == 0xFF000000;
+        return;
+
+    }
+
+    memset(colors, 0, sizeof(colors));
+
+    /* For each row */
+    for (y = 0; y < height; y++) {
+
+        uint32_t* row = (uint32_t*) buffer;
+
+        /* Accumulate opacity and count pixels matching their left neighbor,
+         * ignoring alpha */
+        int row_same = __guac_common_surface_analyze_row(row, width, &alpha);
+
+        analysis->num_same += row_same;
+        analysis->num_different += width - 1 - row_same;
+
+        /* Count unique colors from the start of each run of identical pixels
+         * while the row is still in cache, stopping once there are too many
+         * colors for a palette. Every row is counted, such that content with
+         * few colors can be relied upon to fit within a palette. */
+        if (analysis->colors <= GUAC_SURFACE_PALETTE_SIZE) {
+            __guac_common_surface_count_color(colors, row[0],
+                    &analysis->colors);
+            for (x = 1; x < width; x++) {
+                if ((row[x] ^ row[x - 1]) & 0xFFFFFF)
+                    __guac_common_surface_count_color(colors, row[x],
+                            &analysis->colors);
+            }
+        }
+
+        /* Advance to next row */
+        buffer += stride;
+
+    }
+
+    analysis->opaque = opaque || alpha == 0xFF000000;
+
+}
+
+/**
+ * Guesses whether an analyzed rectangle would be better compressed as PNG or
+ * using a lossy format like JPEG. Positive values indicate PNG is likely to
+ * be superior, while negative values indicate the opposite.
+ *
+ * @param analysis
+ *     The analysis of the rectangle, including content statistics.
+ *
+ * @return
+ *     Positive values if PNG compression is likely to perform better than
+ *     lossy alternatives, or negative values if PNG is likely to perform
+ *     worse.
+ */
+static int __guac_common_surface_png_optimality(
+        const guac_common_surface_analysis* analysis) {
+
+    /* PNG is ideal if a palette can be used */
+    if (analysis->colors <= GUAC_SURFACE_PALETTE_SIZE)
+        return 0;
+
+    /* Return rough approximation of optimality for PNG compression */
+    return 0x100 * analysis->num_same / analysis->num_different - 0x400;
+
+}
+
+/**
+ * Chooses the image format which should be used to encode the given
+ * rectangle of the given surface.
+ *
+ * @param surface
+ *     The surface containing the rectangle.
+ *
+ * @param rect
+ *     The rectangle to be encoded.
+ *
+ * @param analysis
+ *     The analysis of the rectangle produced by
+ *     __guac_common_surface_analyze().
+ *
+ * @return
+ *     The format which should be used to encode the rectangle.
+ */
+static guac_common_encoder_format __guac_common_surface_select_format(
+        guac_common_surface* surface, const guac_common_rect* rect,
+        const guac_common_surface_analysis* analysis) {
+
+    /* PNG is always used unless the framerate is high enough and the
+     * contents are unlikely to compress well as PNG */
+    if (!analysis->content || __guac_common_surface_png_optimality(analysis) >= 0)
+        return GUAC_COMMON_ENCODER_PNG;
+
+    /* Prefer WebP when supported */
+    if (guac_client_supports_webp(surface->client))
+        return GUAC_COMMON_ENCODER_WEBP;
+
+    /* JPEG is the next best (lossy) choice, if lossy quality is allowed, the
+     * image is large enough, and there is no transparency */
+    if (analysis->opaque && !surface->lossless
+            && rect->width * rect->height > GUAC_SURFACE_JPEG_MIN_BITMAP_SIZE)
+        return GUAC_COMMON_ENCODER_JPEG;
+
+    return GUAC_COMMON_ENCODER_PNG;
+
+}
+
+/**
+ * Updates the heat map cells which intersect the given rectangle using the
+ * given timestamp. This timestamp, along with timestamps from past updates,
+ * is used to calculate the framerate of each heat cell.
+ *
+ * @param surface
+ *     The surface containing the heat map cells to be updated.
+ *
+ * @param rect
+ *     The rectangle containing the heat map cells to be updated.
+ *
+ * @param time
+ *     The timestamp to use when updating the heat map cells which intersect
+ *     the given rectangle.
+ */
+static void __guac_common_surface_touch_rect(guac_common_surface* surface,
+        guac_common_rect* rect, guac_timestamp time) {
+
+    int x, y;
+
+    /* Calculate heat map dimensions */
+    int heat_width = GUAC_COMMON_SURFACE_HEAT_DIMENSION(surface->width);
+
+    /* Calculate minimum X/Y coordinates intersecting given rect */
+    int min_x = rect->x / GUAC_COMMON_SURFACE_HEAT_CELL_SIZE;
+    int min_y = rect->y / GUAC_COMMON_SURFACE_HEAT_CELL_SIZE;
+
+    /* Calculate maximum X/Y coordinates intersecting given rect */
+    int max_x = min_x + (rect->width  - 1) / GUAC_COMMON_SURFACE_HEAT_CELL_SIZE;
+    int max_y = min_y + (rect->height - 1) / GUAC_COMMON_SURFACE_HEAT_CELL_SIZE;
+
+    /* Get start of buffer at given coordinates */
+    guac_common_surface_heat_cell* heat_row =
+        surface->heat_map + min_y * heat_width + min_x;
+
+    /* Update all heat map cells which intersect with rectangle */
+    for (y = min_y; y <= max_y; y++) {
 
         /* Get current row of heat map */
         guac_common_surface_heat_cell* heat_cell = heat_row;
@@ -1274,6 +1773,8 @@ void guac_common_surface_free(guac_common_surface* surface) {
 
     pthread_mutex_destroy(&surface->_lock);
 
+    free(surface->shift_scratch);
+    free(surface->shift_hashes);
     free(surface->heat_map);
     free(surface->buffer);
     free(surface);
@@ -1295,89 +1796,1130 @@ void guac_common_surface_resize(guac_common_surface* surface, int w, int h) {
     int old_stride;
     guac_common_rect old_rect;
 
-    int sx = 0;
-    int sy = 0;
+    int sx = 0;
+    int sy = 0;
+
+    /* Calculate heat map dimensions */
+    int heat_width = GUAC_COMMON_SURFACE_HEAT_DIMENSION(w);
+    int heat_height = GUAC_COMMON_SURFACE_HEAT_DIMENSION(h);
+
+    /* Copy old surface data */
+    old_buffer = surface->buffer;
+    old_stride = surface->stride;
+    guac_common_rect_init(&old_rect, 0, 0, surface->width, surface->height);
+
+    /* Re-initialize at new size */
+    surface->width  = w;
+    surface->height = h;
+    surface->stride = cairo_format_stride_for_width(CAIRO_FORMAT_ARGB32, w);
+    surface->buffer = calloc(h, surface->stride);
+    __guac_common_bound_rect(surface, &surface->clip_rect, NULL, NULL);
+
+    /* Copy relevant old data */
+    __guac_common_bound_rect(surface, &old_rect, NULL, NULL);
+    __guac_common_surface_put(old_buffer, old_stride, &sx, &sy, surface, &old_rect, 1);
+
+    /* Free old data */
+    free(old_buffer);
+
+    /* Discard segment hashes and scratch memory (reallocated at the new
+     * size when next needed) */
+    free(surface->shift_hashes);
+    surface->shift_hashes = NULL;
+    surface->shift_stale = 0;
+
+    free(surface->shift_scratch);
+    surface->shift_scratch = NULL;
+    surface->shift_scratch_size = 0;
+
+    /* Allocate completely new heat map (can safely discard old stats) */
+    free(surface->heat_map);
+    surface->heat_map = calloc(heat_width * heat_height,
+            sizeof(guac_common_surface_heat_cell));
+
+    /* Resize dirty rect to fit new surface dimensions */
+    if (surface->dirty) {
+        __guac_common_bound_rect(surface, &surface->dirty_rect, NULL, NULL);
+        if (surface->dirty_rect.width <= 0 || surface->dirty_rect.height <= 0)
+            surface->dirty = 0;
+    }
+
+    /* Update Guacamole layer */
+    if (surface->realized)
+        guac_protocol_send_size(socket, layer, w, h);
+
+complete:
+    pthread_mutex_unlock(&surface->_lock);
+
+}
+
+/**
+ * Combines the given pixel with the given running hash, producing a new hash.
+ * Hashes of rows and columns of pixels are built by combining each pixel in
+ * turn, starting with GUAC_SURFACE_SHIFT_HASH_INITIAL.
+ *
+ * @param hash
+ *     The current value of the running hash.
+ *
+ * @param pixel
+ *     The 32-bit ARGB pixel to combine with the hash.
+ *
+ * @return
+ *     The new value of the running hash.
+ */
+static uint32_t __guac_common_surface_hash_pixel(uint32_t hash,
+        uint32_t pixel) {
+    return (hash ^ pixel) * 16777619;
+}
+
+/**
+ * Returns the number of slots within the hash table used by
+ * __guac_common_surface_find_shift() to index the given number of rows or
+ * columns of a surface. This is always a power of two.
+ *
+ * @param old_length
+ *     The number of rows or columns of the surface which are indexed.
+ *
+ * @return
+ *     The number of slots within the hash table.
+ */
+static int __guac_common_surface_shift_table_size(int old_length) {
+
+    int table_size = 1;
+    while (table_size < old_length * 2)
+        table_size <<= 1;
+
+    return table_size;
+
+}
+
+/**
+ * Returns the number of bytes of scratch memory required by
+ * __guac_common_surface_find_shift() to search the given numbers of rows or
+ * columns.
+ *
+ * @param length
+ *     The number of rows or columns in the drawn image.
+ *
+ * @param old_length
+ *     The number of rows or columns of the surface which may be the source of
+ *     shifted content.
+ *
+ * @return
+ *     The number of bytes of scratch memory required.
+ */
+static size_t __guac_common_surface_find_shift_size(int length,
+        int old_length) {
+
+    size_t table_size = __guac_common_surface_shift_table_size(old_length);
+    size_t distances = old_length + length - 1;
+
+    return table_size * (sizeof(int) + sizeof(char))
+         + distances * sizeof(int);
+
+}
+
+/**
+ * Locates the longest run of consecutive rows or columns of a drawn image
+ * which match rows or columns of the current surface contents, all shifted by
+ * the same distance. Candidate distances are chosen by locating rows or
+ * columns of the image which match exactly one row or column of the surface,
+ * such that runs of uniform content cannot produce false candidates.
+ *
+ * @param new_hashes
+ *     The hashes of each row or column of the drawn image.
+ *
+ * @param length
+ *     The number of rows or columns in the drawn image.
+ *
+ * @param old_hashes
+ *     The hashes of each row or column of the surface which may be the source
+ *     of shifted content.
+ *
+ * @param old_length
+ *     The number of rows or columns of the surface which were hashed.
+ *
+ * @param old_valid
+ *     Flags denoting which of the given hashes of the surface are valid, where
+ *     zero denotes a row or column whose contents are unknown and which
+ *     therefore can neither be the source of shifted content nor be assumed
+ *     unchanged. If NULL, all hashes are valid.
+ *
+ * @param offset
+ *     The index within old_hashes of the row or column of the surface which
+ *     will be replaced by the first row or column of the drawn image.
+ *
+ * @param scratch
+ *     Scratch memory of at least the size returned by
+ *     __guac_common_surface_find_shift_size() for the given lengths, aligned
+ *     suitably for an int.
+ *
+ * @param start
+ *     Pointer to an int which will receive the index of the first row or
+ *     column of the drawn image within the run.
+ *
+ * @param run_length
+ *     Pointer to an int which will receive the number of rows or columns in
+ *     the run.
+ *
+ * @param distance
+ *     Pointer to an int which will receive the distance between each row or
+ *     column of the run and the corresponding row or column of the surface.
+ *
+ * @return
+ *     Non-zero if a run was found whose length is at least
+ *     GUAC_SURFACE_SHIFT_MIN_LENGTH changed rows or columns, zero otherwise.
+ */
+static int __guac_common_surface_find_shift(const uint32_t* new_hashes,
+        int length, const uint32_t* old_hashes, int old_length,
+        const char* old_valid, int offset, void* scratch, int* start,
+        int* run_length, int* distance) {
+
+    int i;
+
+    /* Possible distances range from that between the last row of the image
+     * and the first row of the surface to that between the first row of the
+     * image and the last row of the surface */
+    int min_distance = -offset - length + 1;
+    int distances = old_length + length - 1;
+
+    /* Hash table mapping hashes to unique rows of the surface */
+    int table_size = __guac_common_surface_shift_table_size(old_length);
+
+    int* table = (int*) scratch;
+    int* votes = table + table_size;
+    char* duplicate = (char*) (votes + distances);
+
+    memset(table, 0xFF, sizeof(int) * table_size);
+    memset(votes, 0, sizeof(int) * distances);
+    memset(duplicate, 0, table_size);
+
+    /* Index surface rows by hash, noting hashes shared by multiple rows */
+    for (i = 0; i < old_length; i++) {
+
+        if (old_valid != NULL && !old_valid[i])
+            continue;
+
+        int slot = old_hashes[i] & (table_size - 1);
+        while (table[slot] != -1 && old_hashes[table[slot]] != old_hashes[i])
+            slot = (slot + 1) & (table_size - 1);
+
+        if (table[slot] == -1)
+            table[slot] = i;
+        else
+            duplicate[slot] = 1;
+
+    }
+
+    /* Vote for the distance to each uniquely-matching row */
+    for (i = 0; i < length; i++) {
+
+        int slot = new_hashes[i] & (table_size - 1);
+        while (table[slot] != -1 && old_hashes[table[slot]] != new_hashes[i])
+            slot = (slot + 1) & (table_size - 1);
+
+        if (table[slot] != -1 && !duplicate[slot])
+            votes[table[slot] - offset - i - min_distance]++;
+
+    }
+
+    /* Choose the most popular non-zero distance */
+    int best_distance = 0;
+    int best_votes = 0;
+    for (i = 0; i < distances; i++) {
+        if (i + min_distance != 0 && votes[i] > best_votes) {
+            best_distance = i + min_distance;
+            best_votes = votes[i];
+        }
+    }
+
+    if (best_votes == 0)
+        return 0;
+
+    /* Find the run of matching rows containing the most changed rows */
+    int run_start = 0;
+    int run_changed = 0;
+    int best_changed = 0;
+    for (i = 0; i <= length; i++) {
+
+        int row = offset + i + best_distance;
+
+        /* Extend run while rows continue to match */
+        if (i < length && row >= 0 && row < old_length
+                && (old_valid == NULL || old_valid[row])
+                && old_hashes[row] == new_hashes[i]) {
+            if (new_hashes[i] != old_hashes[offset + i]
+                    || (old_valid != NULL && !old_valid[offset + i]))
+                run_changed++;
+            continue;
+        }
+
+        /* Otherwise, the run has ended */
+        if (run_changed > best_changed) {
+            *start = run_start;
+            *run_length = i - run_start;
+            best_changed = run_changed;
+        }
+
+        run_start = i + 1;
+        run_changed = 0;
+
+    }
+
+    *distance = best_distance;
+    return best_changed >= GUAC_SURFACE_SHIFT_MIN_LENGTH;
+
+}
+
+/**
+ * Returns whether the given opaque image data is identical to the current
+ * contents of the given rectangle of the given surface.
+ *
+ * @param src_buffer
+ *     The first pixel of the image data to compare. The alpha channel of
+ *     this data is ignored.
+ *
+ * @param src_stride
+ *     The number of bytes in each row of the image data.
+ *
+ * @param surface
+ *     The surface to compare against.
+ *
+ * @param rect
+ *     The rectangle of the surface to compare against.
+ *
+ * @return
+ *     Non-zero if the image data is identical, zero otherwise.
+ */
+static int __guac_common_surface_matches(unsigned char* src_buffer,
+        int src_stride, guac_common_surface* surface,
+        const guac_common_rect* rect) {
+
+    int x, y;
+
+    unsigned char* dst_buffer = surface->buffer + rect->y * surface->stride
+                              + rect->x * 4;
+
+    for (y = 0; y < rect->height; y++) {
+
+        uint32_t* src_current = (uint32_t*) src_buffer;
+        uint32_t* dst_current = (uint32_t*) dst_buffer;
+
+        for (x = 0; x < rect->width; x++) {
+            if ((*(src_current++) | 0xFF000000) != *(dst_current++))
+                return 0;
+        }
+
+        src_buffer += src_stride;
+        dst_buffer += surface->stride;
+
+    }
+
+    return 1;
+
+}
+
+/**
+ * Returns scratch memory of at least the given size which may be used while
+ * searching for shifted content within the given surface. The memory is
+ * retained by the surface and reused by later searches, growing only as
+ * needed. Its contents are undefined.
+ *
+ * @param surface
+ *     The surface being searched.
+ *
+ * @param size
+ *     The minimum number of bytes of scratch memory required.
+ *
+ * @return
+ *     Scratch memory of at least the given size, or NULL if the memory could
+ *     not be allocated.
+ */
+static void* __guac_common_surface_shift_scratch(guac_common_surface* surface,
+        size_t size) {
+
+    if (size > surface->shift_scratch_size) {
+        free(surface->shift_scratch);
+        surface->shift_scratch = malloc(size);
+        surface->shift_scratch_size = (surface->shift_scratch != NULL) ? size : 0;
+    }
+
+    return surface->shift_scratch;
+
+}
+
+/**
+ * Calculates a cheap hash of the given line of pixels, using only a handful
+ * of pixels spread evenly across the line and ignoring the alpha channel. Two
+ * lines whose hashes differ cannot be identical. A line may be either a row or
+ * a column, depending on the distance between its pixels.
+ *
+ * @param line
+ *     The first pixel of the line.
+ *
+ * @param step
+ *     The number of bytes between each pixel of the line.
+ *
+ * @param pixels
+ *     The number of pixels in the line.
+ *
+ * @return
+ *     The hash of the sampled pixels of the given line.
+ */
+static uint32_t __guac_common_surface_sample_line(const unsigned char* line,
+        int step, int pixels) {
+
+    uint32_t hash = GUAC_SURFACE_SHIFT_HASH_INITIAL;
+
+    for (int i = 0; i < GUAC_SURFACE_SHIFT_SAMPLE_PIXELS; i++) {
+        int x = (int) ((2 * i + 1) * (int64_t) pixels
+                / (2 * GUAC_SURFACE_SHIFT_SAMPLE_PIXELS));
+        hash = __guac_common_surface_hash_pixel(hash,
+                *((uint32_t*) (line + x * step)) | 0xFF000000);
+    }
+
+    return hash;
+
+}
+
+/**
+ * Returns whether the given line of image data is identical to the given
+ * line of a surface, ignoring the alpha channel of the image data. A line may
+ * be either a row or a column, depending on the distance between its pixels.
+ *
+ * @param src_line
+ *     The first pixel of the line of image data.
+ *
+ * @param src_step
+ *     The number of bytes between each pixel of the line of image data.
+ *
+ * @param dst_line
+ *     The first pixel of the line of the surface.
+ *
+ * @param dst_step
+ *     The number of bytes between each pixel of the line of the surface.
+ *
+ * @param pixels
+ *     The number of pixels in each line.
+ *
+ * @return
+ *     Non-zero if the lines are identical, zero otherwise.
+ */
+static int __guac_common_surface_line_matches(const unsigned char* src_line,
+        int src_step, const unsigned char* dst_line, int dst_step,
+        int pixels) {
+
+    for (int i = 0; i < pixels; i++) {
+        if ((*((uint32_t*) src_line) | 0xFF000000)
+                != *((uint32_t*) dst_line))
+            return 0;
+        src_line += src_step;
+        dst_line += dst_step;
+    }
+
+    return 1;
+
+}
+
+/**
+ * Cheaply tests whether a drawn image may shift content already present on
+ * the surface along a single axis, such that the full search performed by
+ * __guac_common_surface_find_shift() need only be performed if the test
+ * succeeds. Only every GUAC_SURFACE_SHIFT_MIN_LENGTH'th line of the image is
+ * tested, such that at least one tested line lies within any run of shifted
+ * lines that __guac_common_surface_find_shift() would accept. As with that
+ * search, only lines which match exactly one line of the surface are
+ * considered, such that runs of uniform content (like blank lines) do not
+ * cause every update to be searched. A line may be either a row or a column,
+ * depending on the distance between lines and pixels.
+ *
+ * @param surface
+ *     The surface being drawn to, whose shift scratch memory will be used
+ *     while testing.
+ *
+ * @param src_buffer
+ *     The first pixel of the image data being drawn. The alpha channel of
+ *     this data is ignored.
+ *
+ * @param src_line_step
+ *     The number of bytes between each line of the image data.
+ *
+ * @param src_pixel_step
+ *     The number of bytes between each pixel of each line of the image data.
+ *
+ * @param length
+ *     The number of lines in the image data.
+ *
+ * @param dst_buffer
+ *     The first pixel of the first line of the surface which may be the
+ *     source of shifted content.
+ *
+ * @param dst_line_step
+ *     The number of bytes between each line of the surface.
+ *
+ * @param dst_pixel_step
+ *     The number of bytes between each pixel of each line of the surface.
+ *
+ * @param old_length
+ *     The number of lines of the surface which may be the source of shifted
+ *     content.
+ *
+ * @param offset
+ *     The index of the line of the surface, relative to dst_buffer, which will
+ *     be replaced by the first line of the image.
+ *
+ * @param pixels
+ *     The number of pixels in each line.
+ *
+ * @return
+ *     Non-zero if at least one tested line of the image uniquely matches a
+ *     line of the surface other than the line it replaces, zero otherwise.
+ */
+static int __guac_common_surface_may_shift(guac_common_surface* surface,
+        const unsigned char* src_buffer, int src_line_step,
+        int src_pixel_step, int length, const unsigned char* dst_buffer,
+        int dst_line_step, int dst_pixel_step, int old_length, int offset,
+        int pixels) {
+
+    uint32_t* samples = __guac_common_surface_shift_scratch(surface,
+            sizeof(uint32_t) * old_length);
+
+    if (samples == NULL)
+        return 0;
+
+    /* Hash a handful of pixels of each line of the surface, such that most
+     * lines which differ can be rejected without reading them */
+    for (int j = 0; j < old_length; j++)
+        samples[j] = __guac_common_surface_sample_line(
+                dst_buffer + j * dst_line_step, dst_pixel_step, pixels);
+
+    for (int i = GUAC_SURFACE_SHIFT_MIN_LENGTH - 1; i < length;
+            i += GUAC_SURFACE_SHIFT_MIN_LENGTH) {
+
+        const unsigned char* src_line = src_buffer + i * src_line_step;
+        uint32_t sample = __guac_common_surface_sample_line(src_line,
+                src_pixel_step, pixels);
+
+        int matches = 0;
+        int match = -1;
+
+        /* Locate matching lines, stopping once the line is known not to be
+         * unique */
+        for (int j = 0; j < old_length && matches < 2; j++) {
+            if (samples[j] == sample && __guac_common_surface_line_matches(
+                        src_line, src_pixel_step,
+                        dst_buffer + j * dst_line_step, dst_pixel_step,
+                        pixels)) {
+                matches++;
+                match = j;
+            }
+        }
+
+        if (matches == 1 && match != offset + i)
+            return 1;
+
+    }
+
+    return 0;
+
+}
+
+/**
+ * Searches the current contents of the given surface for content which the
+ * given opaque image data merely shifts vertically or horizontally, as when
+ * content is scrolled. If found, the shifted content is drawn on the remote
+ * display with a "copy" instruction and within the backing surface, such that
+ * only the remainder of the image need be drawn.
+ *
+ * @param surface
+ *     The surface being drawn to.
+ *
+ * @param src_buffer
+ *     The first pixel of the image data being drawn. The alpha channel of
+ *     this data is ignored.
+ *
+ * @param src_stride
+ *     The number of bytes in each row of the image data.
+ *
+ * @param rect
+ *     The rectangle of the surface being drawn to, which must already be
+ *     clipped to the bounds of the surface.
+ *
+ * @param shifted
+ *     Pointer to a rectangle which will receive the portion of the given
+ *     rectangle that was drawn by copying shifted content. This rectangle
+ *     always spans either the full width or the full height of the given
+ *     rectangle.
+ *
+ * @return
+ *     Non-zero if shifted content was found and drawn, zero otherwise.
+ */
+static int __guac_common_surface_draw_shift(guac_common_surface* surface,
+        unsigned char* src_buffer, int src_stride,
+        const guac_common_rect* rect, guac_common_rect* shifted) {
+
+    int i, j;
+    int start, length, distance;
+    int found = 0;
+    int dx = 0;
+    int dy = 0;
+
+    uint32_t* new_hashes;
+    uint32_t* old_hashes;
+    void* scratch;
+
+    /* Only consider sufficiently large updates */
+    if (rect->width * rect->height < GUAC_SURFACE_SHIFT_MIN_AREA)
+        return 0;
+
+    /* Range of surface rows which may contain vertically-shifted content */
+    int top = rect->y - GUAC_SURFACE_SHIFT_MAX_DISTANCE;
+    int bottom = rect->y + rect->height + GUAC_SURFACE_SHIFT_MAX_DISTANCE;
+    if (top < 0) top = 0;
+    if (bottom > surface->height) bottom = surface->height;
+
+    /* Range of surface columns which may contain horizontally-shifted
+     * content */
+    int left = rect->x - GUAC_SURFACE_SHIFT_MAX_DISTANCE;
+    int right = rect->x + rect->width + GUAC_SURFACE_SHIFT_MAX_DISTANCE;
+    if (left < 0) left = 0;
+    if (right > surface->width) right = surface->width;
+
+    /* Check for vertical shift, testing cheaply before hashing everything
+     * such that updates which shift nothing (like video) cost little */
+    if (__guac_common_surface_may_shift(surface, src_buffer, src_stride, 4,
+                rect->height,
+                surface->buffer + top * surface->stride + rect->x * 4,
+                surface->stride, 4, bottom - top, rect->y - top,
+                rect->width)) {
+
+        /* Hashes of each row of the image and of the surface share scratch
+         * memory with __guac_common_surface_find_shift() */
+        new_hashes = __guac_common_surface_shift_scratch(surface,
+                sizeof(uint32_t) * (rect->height + bottom - top)
+                + __guac_common_surface_find_shift_size(rect->height,
+                    bottom - top));
+
+        if (new_hashes == NULL)
+            return 0;
+
+        old_hashes = new_hashes + rect->height;
+        scratch = old_hashes + (bottom - top);
+
+        /* Hash each row of the image */
+        for (i = 0; i < rect->height; i++) {
+            uint32_t* current = (uint32_t*) (src_buffer + i * src_stride);
+            uint32_t hash = GUAC_SURFACE_SHIFT_HASH_INITIAL;
+            for (j = 0; j < rect->width; j++)
+                hash = __guac_common_surface_hash_pixel(hash,
+                        *(current++) | 0xFF000000);
+            new_hashes[i] = hash;
+        }
+
+        /* Hash each row of the surface within the same columns */
+        for (i = top; i < bottom; i++) {
+            uint32_t* current = (uint32_t*) (surface->buffer
+                    + i * surface->stride + rect->x * 4);
+            uint32_t hash = GUAC_SURFACE_SHIFT_HASH_INITIAL;
+            for (j = 0; j < rect->width; j++)
+                hash = __guac_common_surface_hash_pixel(hash, *(current++));
+            old_hashes[i - top] = hash;
+        }
+
+        if (__guac_common_surface_find_shift(new_hashes, rect->height,
+                    old_hashes, bottom - top, NULL, rect->y - top, scratch,
+                    &start, &length, &distance)) {
+            guac_common_rect_init(shifted, rect->x, rect->y + start,
+                    rect->width, length);
+            dy = distance;
+            found = 1;
+        }
+
+    }
+
+    /* Otherwise, check for horizontal shift, again testing cheaply first */
+    if (!found && __guac_common_surface_may_shift(surface, src_buffer, 4,
+                src_stride, rect->width,
+                surface->buffer + rect->y * surface->stride + left * 4,
+                4, surface->stride, right - left, rect->x - left,
+                rect->height)) {
+
+        new_hashes = __guac_common_surface_shift_scratch(surface,
+                sizeof(uint32_t) * (rect->width + right - left)
+                + __guac_common_surface_find_shift_size(rect->width,
+                    right - left));
+
+        if (new_hashes == NULL)
+            return 0;
+
+        old_hashes = new_hashes + rect->width;
+        scratch = old_hashes + (right - left);
+
+        for (j = 0; j < rect->width; j++)
+            new_hashes[j] = GUAC_SURFACE_SHIFT_HASH_INITIAL;
+
+        for (j = 0; j < right - left; j++)
+            old_hashes[j] = GUAC_SURFACE_SHIFT_HASH_INITIAL;
+
+        /* Hash each column of the image and of the surface within the same
+         * rows, one row at a time */
+        for (i = 0; i < rect->height; i++) {
+
+            uint32_t* current = (uint32_t*) (src_buffer + i * src_stride);
+            for (j = 0; j < rect->width; j++)
+                new_hashes[j] = __guac_common_surface_hash_pixel(new_hashes[j],
+                        *(current++) | 0xFF000000);
+
+            current = (uint32_t*) (surface->buffer
+                    + (rect->y + i) * surface->stride + left * 4);
+            for (j = 0; j < right - left; j++)
+                old_hashes[j] = __guac_common_surface_hash_pixel(old_hashes[j],
+                        *(current++));
+
+        }
+
+        if (__guac_common_surface_find_shift(new_hashes, rect->width,
+                    old_hashes, right - left, NULL, rect->x - left, scratch,
+                    &start, &length, &distance)) {
+            guac_common_rect_init(shifted, rect->x + start, rect->y,
+                    length, rect->height);
+            dx = distance;
+            found = 1;
+        }
+
+    }
+
+    if (!found)
+        return 0;
+
+    unsigned char* shifted_buffer = src_buffer
+        + (shifted->y - rect->y) * src_stride
+        + (shifted->x - rect->x) * 4;
+
+    /* Verify that hashes did not collide */
+    guac_common_rect source;
+    guac_common_rect_init(&source, shifted->x + dx, shifted->y + dy,
+            shifted->width, shifted->height);
+
+    if (!__guac_common_surface_matches(shifted_buffer, src_stride, surface,
+                &source))
+        return 0;
+
+    /* Bring remote display up to date with the surface before copying */
+    __guac_common_surface_flush(surface);
+
+    guac_protocol_send_copy(surface->socket, surface->layer,
+            source.x, source.y, source.width, source.height,
+            GUAC_COMP_OVER, surface->layer, shifted->x, shifted->y);
+
+    surface->realized = 1;
+    __guac_common_surface_mark_stale(surface, shifted);
+
+    /* Update backing surface to match */
+    for (i = 0; i < shifted->height; i++) {
+        uint32_t* src_current = (uint32_t*) (shifted_buffer + i * src_stride);
+        uint32_t* dst_current = (uint32_t*) (surface->buffer
+                + (shifted->y + i) * surface->stride + shifted->x * 4);
+        for (j = 0; j < shifted->width; j++)
+            *(dst_current++) = *(src_current++) | 0xFF000000;
+    }
+
+    return 1;
+
+}
+
+/**
+ * Draws the given rectangle of image data to the given surface, marking only
+ * the changed portion as dirty. The rectangle must already be clipped to the
+ * bounds of the surface. If the rectangle is empty, this function has no
+ * effect.
+ *
+ * @param surface
+ *     The surface to draw to.
+ *
+ * @param src_buffer
+ *     The image data to draw.
+ *
+ * @param src_stride
+ *     The number of bytes in each row of the image data.
+ *
+ * @param sx
+ *     The X coordinate of the upper-left corner of the source rectangle
+ *     within the image data.
+ *
+ * @param sy
+ *     The Y coordinate of the upper-left corner of the source rectangle
+ *     within the image data.
+ *
+ * @param rect
+ *     The rectangle of the surface to draw to.
+ *
+ * @param opaque
+ *     Non-zero if the image data is opaque (its alpha channel should be
+ *     ignored), zero otherwise.
+ */
+static void __guac_common_surface_draw_rect(guac_common_surface* surface,
+        unsigned char* src_buffer, int src_stride, int sx, int sy,
+        guac_common_rect* rect, int opaque) {
+
+    if (rect->width <= 0 || rect->height <= 0)
+        return;
+
+    /* Update backing surface */
+    __guac_common_surface_put(src_buffer, src_stride, &sx, &sy, surface, rect, opaque);
+    if (rect->width <= 0 || rect->height <= 0)
+        return;
+
+    /* Update the heat map for the update rectangle. */
+    guac_timestamp time = guac_timestamp_current();
+    __guac_common_surface_touch_rect(surface, rect, time);
+
+    /* Flush if not combining */
+    if (!__guac_common_should_combine(surface, rect, 0))
+        __guac_common_surface_flush_deferred(surface);
+
+    /* Always defer draws */
+    __guac_common_mark_dirty(surface, rect);
+
+}
+
+void guac_common_surface_draw(guac_common_surface* surface, int x, int y, cairo_surface_t* src) {
+
+    pthread_mutex_lock(&surface->_lock);
+
+    unsigned char* buffer = cairo_image_surface_get_data(src);
+    cairo_format_t format = cairo_image_surface_get_format(src);
+    int stride = cairo_image_surface_get_stride(src);
+    int w = cairo_image_surface_get_width(src);
+    int h = cairo_image_surface_get_height(src);
+    int opaque = (format != CAIRO_FORMAT_ARGB32);
+
+    int sx = 0;
+    int sy = 0;
+
+    guac_common_rect rect;
+    guac_common_rect_init(&rect, x, y, w, h);
+
+    guac_common_rect shifted;
+    guac_common_rect before;
+    guac_common_rect after;
+
+    /* Clip operation */
+    __guac_common_clip_rect(surface, &rect, &sx, &sy);
+    if (rect.width <= 0 || rect.height <= 0)
+        goto complete;
+
+    /* Draw content which has merely been shifted (scrolled) using a copy */
+    if (opaque && __guac_common_surface_draw_shift(surface,
+                buffer + sy * stride + sx * 4, stride, &rect, &shifted)) {
+
+        /* Split remainder of a vertical shift into rows above and below */
+        if (shifted.width == rect.width) {
+            guac_common_rect_init(&before, rect.x, rect.y,
+                    rect.width, shifted.y - rect.y);
+            guac_common_rect_init(&after, rect.x,
+                    shifted.y + shifted.height, rect.width,
+                    rect.y + rect.height - shifted.y - shifted.height);
+        }
+
+        /* Split remainder of a horizontal shift into columns left and
+         * right */
+        else {
+            guac_common_rect_init(&before, rect.x, rect.y,
+                    shifted.x - rect.x, rect.height);
+            guac_common_rect_init(&after, shifted.x + shifted.width,
+                    rect.y, rect.x + rect.width - shifted.x - shifted.width,
+                    rect.height);
+        }
+
+        __guac_common_surface_draw_rect(surface, buffer, stride,
+                sx + before.x - rect.x, sy + before.y - rect.y,
+                &before, opaque);
+
+        __guac_common_surface_draw_rect(surface, buffer, stride,
+                sx + after.x - rect.x, sy + after.y - rect.y,
+                &after, opaque);
+
+    }
+
+    /* Otherwise, draw entire update */
+    else
+        __guac_common_surface_draw_rect(surface, buffer, stride, sx, sy,
+                &rect, opaque);
+
+complete:
+    pthread_mutex_unlock(&surface->_lock);
+
+}
+
+/**
+ * Searches the contents of the remote display, as described by the segment
+ * hashes of the given surface, for content which the given rectangle of the
+ * surface buffer merely shifts vertically, as when content is scrolled. The
+ * surface buffer must have already been updated with the new contents of
+ * the rectangle, and thus cannot itself be searched. If found, the shifted
+ * content is drawn on the remote display with a "copy" instruction, such that
+ * only the remainder of the rectangle need be drawn.
+ *
+ * Only whole segments of each row are considered, and thus the shifted
+ * content may span fewer columns than the given rectangle. If the surface
+ * does not yet have segment hashes, they are allocated (to be calculated
+ * during the next flush) and no shifted content is found.
+ *
+ * @param surface
+ *     The surface whose buffer has been written to directly.
+ *
+ * @param rect
+ *     The rectangle of the surface which was written to, which must already
+ *     be bounded by the surface.
+ *
+ * @param shifted
+ *     Pointer to a rectangle which will receive the portion of the given
+ *     rectangle that was drawn by copying shifted content.
+ *
+ * @return
+ *     Non-zero if shifted content was found and drawn, zero otherwise.
+ */
+static int __guac_common_surface_invalidate_shift(guac_common_surface* surface,
+        const guac_common_rect* rect, guac_common_rect* shifted) {
+
+    int i, j;
+    int start, length, distance;
+
+    /* Allocate segment hashes if not yet present, marking all segments as
+     * needing calculation */
+    if (surface->shift_hashes == NULL) {
+
+        surface->shift_segments = (surface->width
+                + GUAC_SURFACE_SHIFT_SEGMENT_WIDTH - 1)
+                / GUAC_SURFACE_SHIFT_SEGMENT_WIDTH;
+
+        surface->shift_hashes = calloc(surface->shift_segments
+                * surface->height, sizeof(uint64_t));
+
+        guac_common_rect_init(&surface->shift_stale_rect, 0, 0,
+                surface->shift_segments, surface->height);
+        surface->shift_stale = 1;
+        return 0;
+
+    }
+
+    /* Consider only whole segments, including the last segment of each row
+     * only if the rectangle reaches the right edge of the surface */
+    int first = (rect->x + GUAC_SURFACE_SHIFT_SEGMENT_WIDTH - 1)
+              / GUAC_SURFACE_SHIFT_SEGMENT_WIDTH;
+    int last = (rect->x + rect->width) / GUAC_SURFACE_SHIFT_SEGMENT_WIDTH;
+    if (rect->x + rect->width == surface->width)
+        last = surface->shift_segments;
+
+    int segments = last - first;
+    if (segments <= 0)
+        return 0;
+
+    int left = first * GUAC_SURFACE_SHIFT_SEGMENT_WIDTH;
+    int right = last * GUAC_SURFACE_SHIFT_SEGMENT_WIDTH;
+    if (right > surface->width)
+        right = surface->width;
+
+    /* Only consider sufficiently large updates */
+    if ((right - left) * rect->height < GUAC_SURFACE_SHIFT_MIN_AREA)
+        return 0;
+
+    /* Range of surface rows which may contain vertically-shifted content */
+    int top = rect->y - GUAC_SURFACE_SHIFT_MAX_DISTANCE;
+    int bottom = rect->y + rect->height + GUAC_SURFACE_SHIFT_MAX_DISTANCE;
+    if (top < 0) top = 0;
+    if (bottom > surface->height) bottom = surface->height;
+
+    /* Hashes of each segment and row of the new contents and of the remote
+     * display share scratch memory with __guac_common_surface_find_shift(),
+     * with the validity of each row of the remote display last */
+    size_t find_size = __guac_common_surface_find_shift_size(rect->height,
+            bottom - top);
+
+    uint64_t* new_segment_hashes = __guac_common_surface_shift_scratch(surface,
+            sizeof(uint64_t) * segments * rect->height
+            + sizeof(uint32_t) * (rect->height + bottom - top)
+            + find_size + (bottom - top));
+
+    if (new_segment_hashes == NULL)
+        return 0;
+
+    uint32_t* new_hashes = (uint32_t*) (new_segment_hashes
+            + segments * rect->height);
+    uint32_t* old_hashes = new_hashes + rect->height;
+    void* scratch = old_hashes + (bottom - top);
+    char* old_valid = (char*) scratch + find_size;
+
+    /* Hash each segment of each row of the new contents, combining the
+     * hashes of each row */
+    for (i = 0; i < rect->height; i++) {
+
+        const uint32_t* row = (uint32_t*) (surface->buffer
+                + (rect->y + i) * surface->stride);
+
+        uint64_t* segment_hash = new_segment_hashes + i * segments;
+        uint32_t hash = GUAC_SURFACE_SHIFT_HASH_INITIAL;
+
+        for (j = first; j < last; j++) {
+
+            int x = j * GUAC_SURFACE_SHIFT_SEGMENT_WIDTH;
+            int width = surface->width - x;
+            if (width > GUAC_SURFACE_SHIFT_SEGMENT_WIDTH)
+                width = GUAC_SURFACE_SHIFT_SEGMENT_WIDTH;
+
+            *segment_hash = __guac_common_surface_hash_segment(row + x, width);
+            hash = __guac_common_surface_hash_pixel(hash,
+                    (uint32_t) *segment_hash ^ (uint32_t) (*segment_hash >> 32));
+            segment_hash++;
+
+        }
+
+        new_hashes[i] = hash;
+
+    }
+
+    /* Combine the hashes of the same segments of each row of the remote
+     * display, noting rows whose contents are not known */
+    for (i = top; i < bottom; i++) {
+
+        const uint64_t* segment_hash = surface->shift_hashes
+            + i * surface->shift_segments + first;
+
+        uint32_t hash = GUAC_SURFACE_SHIFT_HASH_INITIAL;
+        old_valid[i - top] = 1;
+
+        for (j = first; j < last; j++) {
+            if (*segment_hash == 0)
+                old_valid[i - top] = 0;
+            hash = __guac_common_surface_hash_pixel(hash,
+                    (uint32_t) *segment_hash ^ (uint32_t) (*segment_hash >> 32));
+            segment_hash++;
+        }
+
+        old_hashes[i - top] = hash;
+
+    }
+
+    if (!__guac_common_surface_find_shift(new_hashes, rect->height,
+                old_hashes, bottom - top, old_valid, rect->y - top, scratch,
+                &start, &length, &distance))
+        return 0;
 
-    /* Calculate heat map dimensions */
-    int heat_width = GUAC_COMMON_SURFACE_HEAT_DIMENSION(w);
-    int heat_height = GUAC_COMMON_SURFACE_HEAT_DIMENSION(h);
+    /* Verify that combined row hashes did not collide */
+    for (i = start; i < start + length; i++) {
+        if (memcmp(new_segment_hashes + i * segments,
+                    surface->shift_hashes
+                        + (rect->y + i + distance) * surface->shift_segments
+                        + first,
+                    sizeof(uint64_t) * segments) != 0)
+            return 0;
+    }
 
-    /* Copy old surface data */
-    old_buffer = surface->buffer;
-    old_stride = surface->stride;
-    guac_common_rect_init(&old_rect, 0, 0, surface->width, surface->height);
+    guac_common_rect_init(shifted, left, rect->y + start, right - left,
+            length);
 
-    /* Re-initialize at new size */
-    surface->width  = w;
-    surface->height = h;
-    surface->stride = cairo_format_stride_for_width(CAIRO_FORMAT_ARGB32, w);
-    surface->buffer = calloc(h, surface->stride);
-    __guac_common_bound_rect(surface, &surface->clip_rect, NULL, NULL);
+    /* The source of the copy already contains the expected content on the
+     * remote display, thus there is no need to flush first */
+    guac_protocol_send_copy(surface->socket, surface->layer,
+            shifted->x, shifted->y + distance, shifted->width, shifted->height,
+            GUAC_COMP_OVER, surface->layer, shifted->x, shifted->y);
 
-    /* Copy relevant old data */
-    __guac_common_bound_rect(surface, &old_rect, NULL, NULL);
-    __guac_common_surface_put(old_buffer, old_stride, &sx, &sy, surface, &old_rect, 1);
+    surface->realized = 1;
+    __guac_common_surface_mark_stale(surface, shifted);
+    return 1;
 
-    /* Free old data */
-    free(old_buffer);
+}
 
-    /* Allocate completely new heat map (can safely discard old stats) */
-    free(surface->heat_map);
-    surface->heat_map = calloc(heat_width * heat_height,
-            sizeof(guac_common_surface_heat_cell));
+/**
+ * Marks the given rectangle of the given surface, whose contents within the
+ * surface buffer have changed, as dirty. If the rectangle is empty, this
+ * function has no effect.
+ *
+ * @param surface
+ *     The surface containing the changed rectangle.
+ *
+ * @param rect
+ *     The rectangle which has changed.
+ */
+static void __guac_common_surface_invalidate_rect(guac_common_surface* surface,
+        const guac_common_rect* rect) {
 
-    /* Resize dirty rect to fit new surface dimensions */
-    if (surface->dirty) {
-        __guac_common_bound_rect(surface, &surface->dirty_rect, NULL, NULL);
-        if (surface->dirty_rect.width <= 0 || surface->dirty_rect.height <= 0)
-            surface->dirty = 0;
-    }
+    if (rect->width <= 0 || rect->height <= 0)
+        return;
 
-    /* Update Guacamole layer */
-    if (surface->realized)
-        guac_protocol_send_size(socket, layer, w, h);
+    /* Flush if not combining */
+    if (!__guac_common_should_combine(surface, rect, 0))
+        __guac_common_surface_flush_deferred(surface);
 
-complete:
-    pthread_mutex_unlock(&surface->_lock);
+    /* Always defer updates */
+    __guac_common_mark_dirty(surface, rect);
 
 }
 
-void guac_common_surface_draw(guac_common_surface* surface, int x, int y, cairo_surface_t* src) {
+void guac_common_surface_invalidate(guac_common_surface* surface, int x, int y,
+        int w, int h) {
 
     pthread_mutex_lock(&surface->_lock);
 
-    unsigned char* buffer = cairo_image_surface_get_data(src);
-    cairo_format_t format = cairo_image_surface_get_format(src);
-    int stride = cairo_image_surface_get_stride(src);
-    int w = cairo_image_surface_get_width(src);
-    int h = cairo_image_surface_get_height(src);
-
-    int sx = 0;
-    int sy = 0;
+    int dx, dy;
 
     guac_common_rect rect;
     guac_common_rect_init(&rect, x, y, w, h);
 
-    /* Clip operation */
-    __guac_common_clip_rect(surface, &rect, &sx, &sy);
+    /* Bound operation (modifications ignore the clipping rectangle) */
+    __guac_common_bound_rect(surface, &rect, NULL, NULL);
     if (rect.width <= 0 || rect.height <= 0)
         goto complete;
 
-    /* Update backing surface */
-    __guac_common_surface_put(buffer, stride, &sx, &sy, surface, &rect, format != CAIRO_FORMAT_ARGB32);
-    if (rect.width <= 0 || rect.height <= 0)
-        goto complete;
+    /* Directly-written pixels are always opaque */
+    unsigned char* buffer = surface->buffer + (surface->stride * rect.y)
+                          + (4 * rect.x);
+
+    for (dy = 0; dy < rect.height; dy++) {
+
+        uint32_t* current = (uint32_t*) buffer;
+        for (dx = 0; dx < rect.width; dx++)
+            *(current++) |= 0xFF000000;
+
+        buffer += surface->stride;
+
+    }
 
     /* Update the heat map for the update rectangle. */
     guac_timestamp time = guac_timestamp_current();
     __guac_common_surface_touch_rect(surface, &rect, time);
 
-    /* Flush if not combining */
-    if (!__guac_common_should_combine(surface, &rect, 0))
-        __guac_common_surface_flush_deferred(surface);
+    /* Draw content which has merely been shifted (scrolled) using a copy,
+     * invalidating only the rows above and below and the columns to either
+     * side */
+    guac_common_rect shifted;
+    if (__guac_common_surface_invalidate_shift(surface, &rect, &shifted)) {
 
-    /* Always defer draws */
-    __guac_common_mark_dirty(surface, &rect);
+        guac_common_rect remainder;
+
+        guac_common_rect_init(&remainder, rect.x, rect.y,
+                rect.width, shifted.y - rect.y);
+        __guac_common_surface_invalidate_rect(surface, &remainder);
+
+        guac_common_rect_init(&remainder, rect.x, shifted.y + shifted.height,
+                rect.width, rect.y + rect.height - shifted.y - shifted.height);
+        __guac_common_surface_invalidate_rect(surface, &remainder);
+
+        guac_common_rect_init(&remainder, rect.x, shifted.y,
+                shifted.x - rect.x, shifted.height);
+        __guac_common_surface_invalidate_rect(surface, &remainder);
+
+        guac_common_rect_init(&remainder, shifted.x + shifted.width, shifted.y,
+                rect.x + rect.width - shifted.x - shifted.width,
+                shifted.height);
+        __guac_common_surface_invalidate_rect(surface, &remainder);
+
+    }
+
+    /* Otherwise, invalidate entire update */
+    else
+        __guac_common_surface_invalidate_rect(surface, &rect);
 
 complete:
     pthread_mutex_unlock(&surface->_lock);
@@ -1420,8 +2962,42 @@ complete:
 
 }
 
-void guac_common_surface_copy(guac_common_surface* src, int sx, int sy,
-        int w, int h, guac_common_surface* dst, int dx, int dy) {
+/**
+ * Copies a rectangle of data between two surfaces, as described by
+ * guac_common_surface_copy() and guac_common_surface_copy_immediate().
+ *
+ * @param src
+ *     The source surface.
+ *
+ * @param sx
+ *     The X coordinate of the upper-left corner of the source rect.
+ *
+ * @param sy
+ *     The Y coordinate of the upper-left corner of the source rect.
+ *
+ * @param w
+ *     The width of the source rect.
+ *
+ * @param h
+ *     The height of the source rect.
+ *
+ * @param dst
+ *     The destination surface.
+ *
+ * @param dx
+ *     The X coordinate of the upper-left corner of the destination rect.
+ *
+ * @param dy
+ *     The Y coordinate of the upper-left corner of the destination rect.
+ *
+ * @param immediate
+ *     Non-zero if the copy must always be sent as a "copy" instruction,
+ *     flushing both surfaces first, zero if the copy may instead be combined
+ *     with other pending updates to the destination surface.
+ */
+static void __guac_common_surface_copy(guac_common_surface* src, int sx,
+        int sy, int w, int h, guac_common_surface* dst, int dx, int dy,
+        int immediate) {
 
     /* Lock both surfaces */
     pthread_mutex_lock(&dst->_lock);
@@ -1460,8 +3036,8 @@ void guac_common_surface_copy(guac_common_surface* src, int sx, int sy,
             goto complete;
     }
 
-    /* Defer if combining */
-    if (__guac_common_should_combine(dst, &drect, 1))
+    /* Defer if combining (and allowed to combine) */
+    if (!immediate && __guac_common_should_combine(dst, &drect, 1))
         __guac_common_mark_dirty(dst, &drect);
 
     /* Otherwise, flush and draw immediately */
@@ -1472,6 +3048,7 @@ void guac_common_surface_copy(guac_common_surface* src, int sx, int sy,
                 drect.width, drect.height, GUAC_COMP_OVER, dst_layer,
                 drect.x, drect.y);
         dst->realized = 1;
+        __guac_common_surface_mark_stale(dst, &drect);
     }
 
     /* Update backing surface last if drect can intersect srect */
@@ -1488,6 +3065,16 @@ complete:
 
 }
 
+void guac_common_surface_copy(guac_common_surface* src, int sx, int sy,
+        int w, int h, guac_common_surface* dst, int dx, int dy) {
+    __guac_common_surface_copy(src, sx, sy, w, h, dst, dx, dy, 0);
+}
+
+void guac_common_surface_copy_immediate(guac_common_surface* src, int sx,
+        int sy, int w, int h, guac_common_surface* dst, int dx, int dy) {
+    __guac_common_surface_copy(src, sx, sy, w, h, dst, dx, dy, 1);
+}
+
 void guac_common_surface_transfer(guac_common_surface* src, int sx, int sy, int w, int h,
                                   guac_transfer_function op, guac_common_surface* dst, int dx, int dy) {
 
@@ -1538,6 +3125,7 @@ void guac_common_surface_transfer(guac_common_surface* src, int sx, int sy, int
         guac_protocol_send_transfer(socket, src_layer, srect.x, srect.y,
                 drect.width, drect.height, op, dst_layer, drect.x, drect.y);
         dst->realized = 1;
+        __guac_common_surface_mark_stale(dst, &drect);
     }
 
     /* Update backing surface last if drect can intersect srect */
@@ -1596,6 +3184,7 @@ void guac_common_surface_set(guac_common_surface* surface,
         guac_protocol_send_rect(socket, layer, rect.x, rect.y, rect.width, rect.height);
         guac_protocol_send_cfill(socket, GUAC_COMP_OVER, layer, red, green, blue, alpha);
         surface->realized = 1;
+        __guac_common_surface_mark_stale(surface, &rect);
     }
 
 complete:
@@ -1628,6 +3217,136 @@ void guac_common_surface_reset_clip(guac_common_surface* surface) {
     pthread_mutex_unlock(&surface->_lock);
 }
 
+/**
+ * Returns the socket which should receive instructions that are being sent
+ * as part of flushing the given surface. If the surface is being flushed
+ * using parallel encoding, this will be a socket which maintains the order of
+ * those instructions relative to images being encoded.
+ *
+ * @param surface
+ *     The surface being flushed.
+ *
+ * @return
+ *     The socket which should receive flushed instructions.
+ */
+static guac_socket* __guac_common_surface_get_socket(
+        guac_common_surface* surface) {
+
+    if (surface->batch != NULL)
+        return guac_common_encoder_batch_socket(surface->batch);
+
+    return surface->socket;
+
+}
+
+/**
+ * Sends the given rectangle of the given surface via an "img" instruction
+ * using the given format, encoding immediately unless the surface is being
+ * flushed using parallel encoding. When encoding in parallel, large
+ * rectangles are split into horizontal bands which are encoded concurrently.
+ *
+ * @param surface
+ *     The surface to send image data from.
+ *
+ * @param rect
+ *     The rectangle of image data to send.
+ *
+ * @param format
+ *     The format to encode the image data as.
+ *
+ * @param opaque
+ *     Whether the rectangle contains only fully-opaque pixels.
+ *
+ * @param quality
+ *     The JPEG or WebP image quality, between 0 and 100 inclusive. This is
+ *     ignored for PNG.
+ *
+ * @param lossless
+ *     Non-zero if a WebP image should be encoded losslessly, zero otherwise.
+ *     This is ignored for JPEG and PNG.
+ */
+static void __guac_common_surface_stream(guac_common_surface* surface,
+        const guac_common_rect* rect, guac_common_encoder_format format,
+        int opaque, int quality, int lossless) {
+
+    int band_y;
+    int band_height = rect->height;
+
+    /* Use RGB24 if the image is fully opaque, otherwise ARGB32 is needed */
+    cairo_format_t cairo_format = opaque ? CAIRO_FORMAT_RGB24
+                                         : CAIRO_FORMAT_ARGB32;
+
+    /* Split large rectangles such that each encoding thread receives a band
+     * of roughly equal size, keeping band boundaries aligned to the grid
+     * used by lossy formats */
+    if (surface->batch != NULL) {
+
+        int bands = rect->width * rect->height
+                  / GUAC_SURFACE_PARALLEL_MIN_PIXELS;
+
+        if (bands > surface->encoder->thread_count + 1)
+            bands = surface->encoder->thread_count + 1;
+
+        if (bands > 1) {
+            band_height = (rect->height + bands - 1) / bands;
+            band_height = (band_height + GUAC_SURFACE_PARALLEL_BAND_ALIGNMENT - 1)
+                        / GUAC_SURFACE_PARALLEL_BAND_ALIGNMENT
+                        * GUAC_SURFACE_PARALLEL_BAND_ALIGNMENT;
+        }
+
+    }
+
+    for (band_y = rect->y; band_y < rect->y + rect->height;
+            band_y += band_height) {
+
+        int height = rect->y + rect->height - band_y;
+        if (height > band_height)
+            height = band_height;
+
+        /* Get Cairo surface for current band */
+        unsigned char* buffer = surface->buffer
+                              + band_y * surface->stride
+                              + rect->x * 4;
+
+        cairo_surface_t* image = cairo_image_surface_create_for_data(buffer,
+                cairo_format, rect->width, height, surface->stride);
+
+        /* Defer encoding to worker threads if possible */
+        if (surface->batch != NULL) {
+            guac_common_encoder_batch_submit(surface->batch, format,
+                    GUAC_COMP_OVER, surface->layer, rect->x, band_y, image,
+                    quality, lossless);
+            continue;
+        }
+
+        switch (format) {
+
+            case GUAC_COMMON_ENCODER_PNG:
+                guac_client_stream_png(surface->client, surface->socket,
+                        GUAC_COMP_OVER, surface->layer, rect->x, band_y,
+                        image);
+                break;
+
+            case GUAC_COMMON_ENCODER_JPEG:
+                guac_client_stream_jpeg(surface->client, surface->socket,
+                        GUAC_COMP_OVER, surface->layer, rect->x, band_y,
+                        image, quality);
+                break;
+
+            case GUAC_COMMON_ENCODER_WEBP:
+                guac_client_stream_webp(surface->client, surface->socket,
+                        GUAC_COMP_OVER, surface->layer, rect->x, band_y,
+                        image, quality, lossless);
+                break;
+
+        }
+
+        cairo_surface_destroy(image);
+
+    }
+
+}
+
 /**
  * Flushes the bitmap update currently described by the dirty rectangle within
  * the given surface directly via an "img" instruction as PNG data. The
@@ -1645,30 +3364,12 @@ static void __guac_common_surface_flush_to_png(guac_common_surface* surface,
 
     if (surface->dirty) {
 
-        guac_socket* socket = surface->socket;
-        const guac_layer* layer = surface->layer;
-
-        /* Get Cairo surface for specified rect */
-        unsigned char* buffer = surface->buffer
-                              + surface->dirty_rect.y * surface->stride
-                              + surface->dirty_rect.x * 4;
-
-        cairo_surface_t* rect;
-
-        /* Use RGB24 if the image is fully opaque */
-        if (opaque)
-            rect = cairo_image_surface_create_for_data(buffer,
-                    CAIRO_FORMAT_RGB24, surface->dirty_rect.width,
-                    surface->dirty_rect.height, surface->stride);
+        /* Clear destination rect first if the image is not fully opaque */
+        if (!opaque) {
 
-        /* Otherwise ARGB32 is needed */
-        else {
-
-            rect = cairo_image_surface_create_for_data(buffer,
-                    CAIRO_FORMAT_ARGB32, surface->dirty_rect.width,
-                    surface->dirty_rect.height, surface->stride);
+            guac_socket* socket = __guac_common_surface_get_socket(surface);
+            const guac_layer* layer = surface->layer;
 
-            /* Clear destination rect first */
             guac_protocol_send_rect(socket, layer,
                     surface->dirty_rect.x, surface->dirty_rect.y,
                     surface->dirty_rect.width, surface->dirty_rect.height);
@@ -1678,10 +3379,9 @@ static void __guac_common_surface_flush_to_png(guac_common_surface* surface,
         }
 
         /* Send PNG for rect */
-        guac_client_stream_png(surface->client, socket, GUAC_COMP_OVER,
-                layer, surface->dirty_rect.x, surface->dirty_rect.y, rect);
+        __guac_common_surface_stream(surface, &surface->dirty_rect,
+                GUAC_COMMON_ENCODER_PNG, opaque, 0, 0);
 
-        cairo_surface_destroy(rect);
         surface->realized = 1;
 
         /* Surface is no longer dirty */
@@ -1734,9 +3434,6 @@ static void __guac_common_surface_flush_to_jpeg(guac_common_surface* surface) {
 
     if (surface->dirty) {
 
-        guac_socket* socket = surface->socket;
-        const guac_layer* layer = surface->layer;
-
         guac_common_rect max;
         guac_common_rect_init(&max, 0, 0, surface->width, surface->height);
 
@@ -1745,21 +3442,11 @@ static void __guac_common_surface_flush_to_jpeg(guac_common_surface* surface) {
         guac_common_rect_expand_to_grid(GUAC_SURFACE_JPEG_BLOCK_SIZE,
                                         &surface->dirty_rect, &max);
 
-        /* Get Cairo surface for specified rect */
-        unsigned char* buffer = surface->buffer
-                              + surface->dirty_rect.y * surface->stride
-                              + surface->dirty_rect.x * 4;
-
-        cairo_surface_t* rect = cairo_image_surface_create_for_data(buffer,
-                CAIRO_FORMAT_RGB24, surface->dirty_rect.width,
-                surface->dirty_rect.height, surface->stride);
-
         /* Send JPEG for rect */
-        guac_client_stream_jpeg(surface->client, socket, GUAC_COMP_OVER, layer,
-                surface->dirty_rect.x, surface->dirty_rect.y, rect,
-                guac_common_surface_suggest_quality(surface->client));
+        __guac_common_surface_stream(surface, &surface->dirty_rect,
+                GUAC_COMMON_ENCODER_JPEG, 1,
+                guac_common_surface_suggest_quality(surface->client), 0);
 
-        cairo_surface_destroy(rect);
         surface->realized = 1;
 
         /* Surface is no longer dirty */
@@ -1786,9 +3473,6 @@ static void __guac_common_surface_flush_to_webp(guac_common_surface* surface,
 
     if (surface->dirty) {
 
-        guac_socket* socket = surface->socket;
-        const guac_layer* layer = surface->layer;
-
         guac_common_rect max;
         guac_common_rect_init(&max, 0, 0, surface->width, surface->height);
 
@@ -1797,32 +3481,12 @@ static void __guac_common_surface_flush_to_webp(guac_common_surface* surface,
         guac_common_rect_expand_to_grid(GUAC_SURFACE_WEBP_BLOCK_SIZE,
                                         &surface->dirty_rect, &max);
 
-        /* Get Cairo surface for specified rect */
-        unsigned char* buffer = surface->buffer
-                              + surface->dirty_rect.y * surface->stride
-                              + surface->dirty_rect.x * 4;
-
-        cairo_surface_t* rect;
-
-        /* Use RGB24 if the image is fully opaque */
-        if (opaque)
-            rect = cairo_image_surface_create_for_data(buffer,
-                    CAIRO_FORMAT_RGB24, surface->dirty_rect.width,
-                    surface->dirty_rect.height, surface->stride);
-
-        /* Otherwise ARGB32 is needed */
-        else
-            rect = cairo_image_surface_create_for_data(buffer,
-                    CAIRO_FORMAT_ARGB32, surface->dirty_rect.width,
-                    surface->dirty_rect.height, surface->stride);
-
         /* Send WebP for rect */
-        guac_client_stream_webp(surface->client, socket, GUAC_COMP_OVER, layer,
-                surface->dirty_rect.x, surface->dirty_rect.y, rect,
+        __guac_common_surface_stream(surface, &surface->dirty_rect,
+                GUAC_COMMON_ENCODER_WEBP, opaque,
                 guac_common_surface_suggest_quality(surface->client),
                 surface->lossless ? 1 : 0);
 
-        cairo_surface_destroy(rect);
         surface->realized = 1;
 
         /* Surface is no longer dirty */
@@ -1832,6 +3496,196 @@ static void __guac_common_surface_flush_to_webp(guac_common_surface* surface,
 
 }
 
+/**
+ * Flushes the bitmap update currently described by the dirty rectangle within
+ * the given surface as a single image, choosing between WebP, JPEG, and PNG
+ * depending on the nature of the update.
+ *
+ * @param surface
+ *     The surface to flush.
+ *
+ * @param analysis
+ *     The analysis of the dirty rectangle produced by
+ *     __guac_common_surface_analyze().
+ *
+ * @return
+ *     Non-zero if the update was sent losslessly as PNG, zero if a lossy
+ *     format may have been used.
+ */
+static int __guac_common_surface_flush_to_image(guac_common_surface* surface,
+        const guac_common_surface_analysis* analysis) {
+
+    switch (__guac_common_surface_select_format(surface, &surface->dirty_rect,
+                analysis)) {
+
+        case GUAC_COMMON_ENCODER_WEBP:
+            __guac_common_surface_flush_to_webp(surface, analysis->opaque);
+            return 0;
+
+        case GUAC_COMMON_ENCODER_JPEG:
+            __guac_common_surface_flush_to_jpeg(surface);
+            return 0;
+
+        /* Use PNG if no lossy formats are appropriate */
+        default:
+            __guac_common_surface_flush_to_png(surface, analysis->opaque);
+            return 1;
+
+    }
+
+}
+
+/**
+ * Flushes the given rectangle of the given opaque surface as a single image,
+ * offering each complete tile of the rectangle to the tile cache of the
+ * surface if the image was sent losslessly. If the rectangle is empty, this
+ * function has no effect.
+ *
+ * @param surface
+ *     The surface to flush.
+ *
+ * @param x
+ *     The X coordinate of the upper-left corner of the rectangle to flush.
+ *
+ * @param y
+ *     The Y coordinate of the upper-left corner of the rectangle to flush.
+ *
+ * @param width
+ *     The width of the rectangle to flush.
+ *
+ * @param height
+ *     The height of the rectangle to flush.
+ *
+ * @param analysis
+ *     The analysis of the rectangle produced by
+ *     __guac_common_surface_analyze(), or NULL if the rectangle has not yet
+ *     been analyzed.
+ */
+static void __guac_common_surface_flush_region(guac_common_surface* surface,
+        int x, int y, int width, int height,
+        const guac_common_surface_analysis* analysis) {
+
+    int tx, ty;
+    int size = GUAC_COMMON_TILE_CACHE_TILE_SIZE;
+
+    if (width <= 0 || height <= 0)
+        return;
+
+    guac_common_surface_analysis region_analysis;
+
+    guac_common_rect_init(&surface->dirty_rect, x, y, width, height);
+    surface->dirty = 1;
+
+    /* Analyze region if necessary, which is already known to be opaque */
+    if (analysis == NULL) {
+        __guac_common_surface_analyze(surface, &surface->dirty_rect, 1,
+                &region_analysis);
+        analysis = &region_analysis;
+    }
+
+    /* Only tiles sent losslessly may be reused */
+    if (!__guac_common_surface_flush_to_image(surface, analysis))
+        return;
+
+    /* Offer all complete tiles within rectangle to the cache, which stores
+     * only those tiles which were offered before */
+    for (ty = (y + size - 1) / size * size; ty + size <= y + height; ty += size) {
+        for (tx = (x + size - 1) / size * size; tx + size <= x + width; tx += size) {
+            guac_common_tile_cache_store(surface->tile_cache,
+                    __guac_common_surface_get_socket(surface),
+                    surface->layer, tx, ty,
+                    surface->buffer + ty * surface->stride + tx * 4,
+                    surface->stride);
+        }
+    }
+
+}
+
+/**
+ * Flushes the bitmap update currently described by the dirty rectangle within
+ * the given opaque surface, drawing each complete tile of the update which
+ * matches a tile within the tile cache of the surface by copying the cached
+ * tile. All remaining portions of the update are sent as images, with rows
+ * of tiles containing no matches combined into as few images as possible.
+ *
+ * @param surface
+ *     The surface to flush.
+ *
+ * @param analysis
+ *     The analysis of the entire update produced by
+ *     __guac_common_surface_analyze(), which is reused if no tiles of the
+ *     update are found in the cache.
+ */
+static void __guac_common_surface_flush_to_tiles(guac_common_surface* surface,
+        const guac_common_surface_analysis* analysis) {
+
+    int tx, ty;
+    int size = GUAC_COMMON_TILE_CACHE_TILE_SIZE;
+
+    guac_common_rect rect = surface->dirty_rect;
+    surface->dirty = 0;
+
+    /* Determine bounds of complete tiles within update */
+    int start_x = (rect.x + size - 1) / size * size;
+    int start_y = (rect.y + size - 1) / size * size;
+    int end_x = (rect.x + rect.width) / size * size;
+    int end_y = (rect.y + rect.height) / size * size;
+
+    /* First row of update which has not yet been flushed */
+    int pending_y = rect.y;
+
+    for (ty = start_y; ty < end_y; ty += size) {
+
+        /* First column of current row of tiles not yet flushed */
+        int pending_x = rect.x;
+
+        for (tx = start_x; tx < end_x; tx += size) {
+
+            const guac_layer* cached_layer;
+            int cached_x, cached_y;
+
+            /* Leave tile for later flush unless already cached */
+            if (!guac_common_tile_cache_lookup(surface->tile_cache,
+                        surface->buffer + ty * surface->stride + tx * 4,
+                        surface->stride, &cached_layer, &cached_x, &cached_y))
+                continue;
+
+            /* Flush all rows prior to first match in current row of tiles */
+            if (pending_x == rect.x)
+                __guac_common_surface_flush_region(surface, rect.x,
+                        pending_y, rect.width, ty - pending_y, NULL);
+
+            /* Flush any unmatched portion of row prior to match */
+            __guac_common_surface_flush_region(surface, pending_x, ty,
+                    tx - pending_x, size, NULL);
+
+            /* Draw matching tile from cache */
+            guac_protocol_send_copy(__guac_common_surface_get_socket(surface),
+                    cached_layer, cached_x, cached_y, size, size,
+                    GUAC_COMP_OVER, surface->layer, tx, ty);
+
+            surface->realized = 1;
+            pending_x = tx + size;
+
+        }
+
+        /* Flush remainder of any row of tiles containing a match */
+        if (pending_x != rect.x) {
+            __guac_common_surface_flush_region(surface, pending_x, ty,
+                    rect.x + rect.width - pending_x, size, NULL);
+            pending_y = ty + size;
+        }
+
+    }
+
+    /* Flush all rows following the last match, reusing the analysis of the
+     * entire update if nothing matched */
+    __guac_common_surface_flush_region(surface, rect.x, pending_y,
+            rect.width, rect.y + rect.height - pending_y,
+            pending_y == rect.y ? analysis : NULL);
+
+}
+
 /**
  * Comparator for instances of guac_common_surface_bitmap_rect, the elements
  * which make up a surface's bitmap buffer.
@@ -1892,6 +3746,11 @@ static void __guac_common_surface_flush(guac_common_surface* surface) {
     /* Flush final dirty rectangle to queue. */
     __guac_common_surface_flush_to_queue(surface);
 
+    /* Encode updates in parallel if possible */
+    if (surface->encoder != NULL && surface->bitmap_queue_length > 0)
+        surface->batch = guac_common_encoder_batch_alloc(surface->encoder,
+                surface->socket);
+
     guac_common_surface_bitmap_rect* current = surface->bitmap_queue;
     int i, j;
     int original_queue_length;
@@ -1945,22 +3804,17 @@ static void __guac_common_surface_flush(guac_common_surface* surface) {
 
                 flushed++;
 
-                int opaque = __guac_common_surface_is_opaque(surface,
-                            &surface->dirty_rect);
+                guac_common_surface_analysis analysis;
+                __guac_common_surface_analyze(surface, &surface->dirty_rect,
+                        0, &analysis);
 
-                /* Prefer WebP when reasonable */
-                if (__guac_common_surface_should_use_webp(surface,
-                            &surface->dirty_rect))
-                    __guac_common_surface_flush_to_webp(surface, opaque);
+                /* Reuse previously-sent tiles of opaque updates if possible */
+                if (analysis.opaque && surface->tile_cache != NULL)
+                    __guac_common_surface_flush_to_tiles(surface, &analysis);
 
-                /* If not WebP, JPEG is the next best (lossy) choice */
-                else if (opaque && __guac_common_surface_should_use_jpeg(
-                            surface, &surface->dirty_rect))
-                    __guac_common_surface_flush_to_jpeg(surface);
-
-                /* Use PNG if no lossy formats are appropriate */
+                /* Otherwise, send update as a single image */
                 else
-                    __guac_common_surface_flush_to_png(surface, opaque);
+                    __guac_common_surface_flush_to_image(surface, &analysis);
 
             }
 
@@ -1970,9 +3824,18 @@ static void __guac_common_surface_flush(guac_common_surface* surface) {
 
     }
 
+    /* Send all updates in order once encoded */
+    if (surface->batch != NULL) {
+        guac_common_encoder_batch_end(surface->batch);
+        surface->batch = NULL;
+    }
+
     /* Flush complete */
     surface->bitmap_queue_length = 0;
 
+    /* The remote display now matches the surface buffer */
+    __guac_common_surface_update_hashes(surface);
+
 }
 
 void guac_common_surface_flush(guac_common_surface* surface) {
@@ -0,0 +1,81 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "common/json.h"
+#include "util/test_util.h"
+
+#include <CUnit/CUnit.h>
+#include <guacamole/socket.h>
+#include <guacamole/stream.h>
+#include <guacamole/user.h>
+
+/**
+ * Test which verifies that each blob of JSON flushed along a stream is
+ * counted against the window of blobs in flight, and that each ack received
+ * while blobs are in flight frees space within that window.
+ */
+void test_json__window() {
+
+    int i;
+
+    guac_user* user = test_util_user_alloc();
+    guac_stream* stream = guac_user_alloc_stream(user);
+
+    guac_common_json_state json_state;
+    guac_common_json_begin_object(user, stream, &json_state);
+    CU_ASSERT_EQUAL(json_state.blobs_in_flight, 0);
+
+    /* The ack acknowledging creation of the stream is ignored */
+    guac_common_json_ack(&json_state);
+    CU_ASSERT_EQUAL(json_state.blobs_in_flight, 0);
+    CU_ASSERT_FALSE(guac_common_json_window_full(&json_state));
+
+    /* Write properties until the window is full */
+    for (i = 0; i < 100000 && !guac_common_json_window_full(&json_state); i++)
+        guac_common_json_write_property(user, stream, &json_state,
+                "/some/rather/long/path/to/a/file", "application/octet-stream");
+
+    guac_socket_flush(user->socket);
+    CU_ASSERT_TRUE(guac_common_json_window_full(&json_state));
+    CU_ASSERT_EQUAL(json_state.blobs_in_flight, GUAC_COMMON_JSON_WINDOW);
+    CU_ASSERT_EQUAL(test_util_count("4.blob,"), GUAC_COMMON_JSON_WINDOW);
+
+    /* Each ack frees exactly one blob */
+    guac_common_json_ack(&json_state);
+    CU_ASSERT_FALSE(guac_common_json_window_full(&json_state));
+    CU_ASSERT_EQUAL(json_state.blobs_in_flight, GUAC_COMMON_JSON_WINDOW - 1);
+
+    /* Completing the object flushes one final blob */
+    guac_common_json_end_object(user, stream, &json_state);
+    guac_common_json_flush(user, stream, &json_state);
+    guac_socket_flush(user->socket);
+    CU_ASSERT_EQUAL(json_state.blobs_in_flight, GUAC_COMMON_JSON_WINDOW);
+    CU_ASSERT_EQUAL(test_util_count("4.blob,"), GUAC_COMMON_JSON_WINDOW + 1);
+
+    /* Acks beyond the number of blobs sent are ignored */
+    for (i = 0; i < GUAC_COMMON_JSON_WINDOW + 5; i++)
+        guac_common_json_ack(&json_state);
+
+    CU_ASSERT_EQUAL(json_state.blobs_in_flight, 0);
+
+    guac_user_free_stream(user, stream);
+    test_util_user_free(user);
+
+}
+
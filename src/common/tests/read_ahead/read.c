@@ -0,0 +1,119 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "common/read_ahead.h"
+#include "util/test_util.h"
+
+#include <CUnit/CUnit.h>
+
+#include <stdint.h>
+
+/**
+ * Test which verifies that guac_common_read_ahead_read() returns all data
+ * from the source intact and in order, followed by EOF.
+ */
+void test_read_ahead__read() {
+
+    int i;
+    char buffer[65536];
+
+    guac_common_read_ahead* read_ahead = guac_common_read_ahead_alloc(
+            test_util_read, NULL);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(read_ahead);
+
+    /* Consume using varying lengths such that reads span the end of the
+     * ring buffer at different points */
+    uint64_t offset = 0;
+    int length = 1;
+    for (;;) {
+
+        int bytes_read = guac_common_read_ahead_read(read_ahead, buffer,
+                length);
+        CU_ASSERT_FATAL(bytes_read >= 0);
+        CU_ASSERT_FATAL(bytes_read <= length);
+
+        if (bytes_read == 0)
+            break;
+
+        for (i = 0; i < bytes_read; i++) {
+            if (buffer[i] != test_util_file_byte(offset + i))
+                break;
+        }
+
+        CU_ASSERT_EQUAL_FATAL(i, bytes_read);
+        offset += bytes_read;
+
+        length = (length * 7 + 1) % sizeof(buffer) + 1;
+
+    }
+
+    CU_ASSERT_EQUAL(offset, TEST_UTIL_FILE_SIZE);
+
+    /* EOF is reported consistently */
+    CU_ASSERT_EQUAL(guac_common_read_ahead_read(read_ahead, buffer,
+                sizeof(buffer)), 0);
+
+    guac_common_read_ahead_free(read_ahead);
+
+}
+
+/**
+ * Test which verifies that guac_common_read_ahead_read() reports a failed
+ * read only after all data read prior to the failure has been consumed.
+ */
+void test_read_ahead__failure() {
+
+    char buffer[4096];
+    int bytes_read;
+
+    guac_common_read_ahead* read_ahead = guac_common_read_ahead_alloc(
+            test_util_failing_read, NULL);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(read_ahead);
+
+    uint64_t offset = 0;
+    while ((bytes_read = guac_common_read_ahead_read(read_ahead, buffer,
+                    sizeof(buffer))) > 0)
+        offset += bytes_read;
+
+    CU_ASSERT(bytes_read < 0);
+    CU_ASSERT_EQUAL(offset, TEST_UTIL_FAILURE_OFFSET);
+
+    guac_common_read_ahead_free(read_ahead);
+
+}
+
+/**
+ * Test which verifies that a read-ahead buffer can be freed before all data
+ * has been consumed.
+ */
+void test_read_ahead__abort() {
+
+    char buffer[4096];
+
+    guac_common_read_ahead* read_ahead = guac_common_read_ahead_alloc(
+            test_util_read, NULL);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(read_ahead);
+
+    CU_ASSERT(guac_common_read_ahead_read(read_ahead, buffer,
+                sizeof(buffer)) > 0);
+
+    guac_common_read_ahead_free(read_ahead);
+
+}
+
@@ -0,0 +1,84 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "common/surface.h"
+#include "util/test_util.h"
+
+#include <CUnit/CUnit.h>
+#include <guacamole/client.h>
+#include <guacamole/layer.h>
+#include <guacamole/user.h>
+
+#include <string.h>
+
+/**
+ * Verifies that guac_common_surface_copy_immediate() always sends a "copy"
+ * instruction, flushing pending updates to the destination surface first,
+ * whereas guac_common_surface_copy() combines the copied region with those
+ * pending updates.
+ */
+void test_surface__copy_immediate() {
+
+    guac_user* user = test_util_user_alloc();
+    guac_client* client = user->client;
+    guac_layer* buffer = guac_client_alloc_buffer(client);
+
+    guac_common_surface* src = guac_common_surface_alloc(client,
+            user->socket, buffer, 64, 64);
+    guac_common_surface* dst = guac_common_surface_alloc(client,
+            user->socket, GUAC_DEFAULT_LAYER, 256, 256);
+
+    /* Send contents of source surface to the client */
+    memset(src->buffer, 0x80, src->stride * src->height);
+    guac_common_surface_invalidate(src, 0, 0, 64, 64);
+    guac_common_surface_flush(src);
+
+    /* Leave a pending update to the destination */
+    memset(dst->buffer, 0x40, dst->stride * dst->height);
+    guac_common_surface_invalidate(dst, 0, 0, 256, 256);
+
+    /* A normal copy is combined with the pending update */
+    test_util_output_length = 0;
+    test_util_output[0] = '\0';
+
+    guac_common_surface_copy(src, 0, 0, 16, 16, dst, 16, 16);
+    CU_ASSERT_EQUAL(test_util_count("4.copy,"), 0);
+
+    /* An immediate copy is sent as a copy after the pending update */
+    guac_common_surface_copy_immediate(src, 0, 0, 16, 16, dst, 32, 16);
+    CU_ASSERT_EQUAL(test_util_count("3.img,"), 1);
+    CU_ASSERT_EQUAL(test_util_count("4.copy,"), 1);
+    CU_ASSERT_PTR_NOT_NULL(strstr(test_util_output, "4.copy,"));
+    CU_ASSERT_TRUE(strstr(test_util_output, "3.img,")
+            < strstr(test_util_output, "4.copy,"));
+
+    /* The copied region is not sent again as image data */
+    test_util_output_length = 0;
+    test_util_output[0] = '\0';
+
+    guac_common_surface_flush(dst);
+    CU_ASSERT_EQUAL(test_util_count("3.img,"), 0);
+
+    guac_common_surface_free(dst);
+    guac_common_surface_free(src);
+    guac_client_free_buffer(client, buffer);
+    test_util_user_free(user);
+
+}
+
@@ -0,0 +1,184 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "common/surface.h"
+#include "util/test_util.h"
+
+#include <cairo/cairo.h>
+#include <CUnit/CUnit.h>
+#include <guacamole/client.h>
+#include <guacamole/user.h>
+
+#include <stdint.h>
+#include <string.h>
+
+/**
+ * The width of the test surface, in pixels.
+ */
+#define TEST_SURFACE_WIDTH 300
+
+/**
+ * The height of the test surface, in pixels.
+ */
+#define TEST_SURFACE_HEIGHT 200
+
+/**
+ * The number of rows or columns that the contents of the test surface are
+ * shifted by.
+ */
+#define TEST_SURFACE_SHIFT 16
+
+/**
+ * Draws opaque test content covering the entirety of the given surface, such
+ * that each row (or each column) of the content is unique.
+ *
+ * @param surface
+ *     The surface to draw to.
+ *
+ * @param first
+ *     The index of the row or column of content to draw at the first row or
+ *     column of the surface.
+ *
+ * @param columns
+ *     Non-zero if each column of the content should be unique, zero if each
+ *     row should be unique.
+ *
+ * @param multiplier
+ *     The value that the position of each pixel within its row or column is
+ *     multiplied by when generating content. Content generated with
+ *     different multipliers shares no rows or columns.
+ */
+static void test_surface_draw_lines(guac_common_surface* surface, int first,
+        int columns, uint32_t multiplier) {
+
+    cairo_surface_t* image = cairo_image_surface_create(CAIRO_FORMAT_RGB24,
+            surface->width, surface->height);
+
+    unsigned char* data = cairo_image_surface_get_data(image);
+    int stride = cairo_image_surface_get_stride(image);
+
+    for (int y = 0; y < surface->height; y++) {
+        uint32_t* row = (uint32_t*) (data + y * stride);
+        for (int x = 0; x < surface->width; x++) {
+            int line = columns ? x : y;
+            int position = columns ? y : x;
+            row[x] = ((first + line) * 2654435761u)
+                   ^ (position * multiplier);
+        }
+    }
+
+    cairo_surface_mark_dirty(image);
+    guac_common_surface_draw(surface, 0, 0, image);
+    cairo_surface_destroy(image);
+
+}
+
+/**
+ * Draws initial test content to a new test surface and flushes that surface,
+ * clearing any output produced by doing so.
+ *
+ * @param user
+ *     The user whose socket should receive output from the surface.
+ *
+ * @param columns
+ *     Non-zero if each column of the initial content should be unique, zero
+ *     if each row should be unique.
+ *
+ * @return
+ *     A newly-allocated test surface.
+ */
+static guac_common_surface* test_surface_alloc_drawn(guac_user* user,
+        int columns) {
+
+    guac_common_surface* surface = guac_common_surface_alloc(user->client,
+            user->socket, GUAC_DEFAULT_LAYER, TEST_SURFACE_WIDTH,
+            TEST_SURFACE_HEIGHT);
+
+    test_surface_draw_lines(surface, 0, columns, 40503);
+    guac_common_surface_flush(surface);
+
+    test_util_output_length = 0;
+    test_util_output[0] = '\0';
+
+    return surface;
+
+}
+
+/**
+ * Verifies that content which is scrolled vertically by a draw is redrawn with
+ * a "copy" instruction, with only the newly-exposed rows drawn as an image.
+ */
+void test_surface__draw_shift_vertical() {
+
+    guac_user* user = test_util_user_alloc();
+    guac_common_surface* surface = test_surface_alloc_drawn(user, 0);
+
+    test_surface_draw_lines(surface, TEST_SURFACE_SHIFT, 0, 40503);
+    guac_common_surface_flush(surface);
+
+    CU_ASSERT_EQUAL(test_util_count("4.copy,1.0,1.0,2.16,3.300,3.184,"), 1);
+    CU_ASSERT_EQUAL(test_util_count("4.copy,"), 1);
+    CU_ASSERT_EQUAL(test_util_count("3.img,"), 1);
+
+    guac_common_surface_free(surface);
+    test_util_user_free(user);
+
+}
+
+/**
+ * Verifies that content which is scrolled horizontally by a draw is redrawn
+ * with a "copy" instruction, with only the newly-exposed columns drawn as an
+ * image.
+ */
+void test_surface__draw_shift_horizontal() {
+
+    guac_user* user = test_util_user_alloc();
+    guac_common_surface* surface = test_surface_alloc_drawn(user, 1);
+
+    test_surface_draw_lines(surface, TEST_SURFACE_SHIFT, 1, 40503);
+    guac_common_surface_flush(surface);
+
+    CU_ASSERT_EQUAL(test_util_count("4.copy,1.0,2.16,1.0,3.284,3.200,"), 1);
+    CU_ASSERT_EQUAL(test_util_count("4.copy,"), 1);
+    CU_ASSERT_EQUAL(test_util_count("3.img,"), 1);
+
+    guac_common_surface_free(surface);
+    test_util_user_free(user);
+
+}
+
+/**
+ * Verifies that a draw which shifts nothing already present on the surface
+ * is drawn only as an image.
+ */
+void test_surface__draw_shift_none() {
+
+    guac_user* user = test_util_user_alloc();
+    guac_common_surface* surface = test_surface_alloc_drawn(user, 0);
+
+    test_surface_draw_lines(surface, TEST_SURFACE_SHIFT, 0, 69069);
+    guac_common_surface_flush(surface);
+
+    CU_ASSERT_EQUAL(test_util_count("4.copy,"), 0);
+    CU_ASSERT_TRUE(test_util_count("3.img,") >= 1);
+
+    guac_common_surface_free(surface);
+    test_util_user_free(user);
+
+}
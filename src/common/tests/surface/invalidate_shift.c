@@ -0,0 +1,113 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "common/transfer.h"
+
+#include "common/surface.h"
+#include "util/test_util.h"
+
+#include <CUnit/CUnit.h>
+#include <guacamole/client.h>
+#include <guacamole/user.h>
+
+#include <stdint.h>
+#include <string.h>
+
+/**
+ * The width of the test surface, in pixels. This is deliberately not a
+ * multiple of the width of the segments hashed by the surface.
+ */
+#define TEST_SURFACE_WIDTH 300
+
+/**
+ * The height of the test surface, in pixels.
+ */
+#define TEST_SURFACE_HEIGHT 200
+
+/**
+ * The number of rows that the contents of the test surface are scrolled by.
+ */
+#define TEST_SURFACE_SCROLL 16
+
+/**
+ * Writes the given lines of test content directly to the buffer of the given
+ * surface, such that line N of the content is written to row N - first of
+ * the surface. Each line of the content is unique.
+ *
+ * @param surface
+ *     The surface to write to.
+ *
+ * @param first
+ *     The index of the line of content to write to the first row of the
+ *     surface.
+ */
+static void test_surface_write_lines(guac_common_surface* surface,
+        int first) {
+
+    for (int y = 0; y < surface->height; y++) {
+        uint32_t* row = (uint32_t*) (surface->buffer + y * surface->stride);
+        for (int x = 0; x < surface->width; x++)
+            row[x] = ((first + y) * 2654435761u) ^ (x * 40503);
+    }
+
+}
+
+/**
+ * Verifies that content which is scrolled within a surface buffer that is
+ * written to directly, as when the VNC framebuffer is aliased to the default
+ * layer, is redrawn with a "copy" instruction, despite the previous contents
+ * of the buffer having already been overwritten by the time the surface is
+ * invalidated.
+ */
+void test_surface__invalidate_shift() {
+
+    guac_user* user = test_util_user_alloc();
+    guac_common_surface* surface = guac_common_surface_alloc(user->client,
+            user->socket, GUAC_DEFAULT_LAYER, TEST_SURFACE_WIDTH,
+            TEST_SURFACE_HEIGHT);
+
+    /* Initial update is drawn normally */
+    test_surface_write_lines(surface, 0);
+    guac_common_surface_invalidate(surface, 0, 0,
+            TEST_SURFACE_WIDTH, TEST_SURFACE_HEIGHT);
+    guac_common_surface_flush(surface);
+
+    CU_ASSERT_EQUAL(test_util_count("4.copy,"), 0);
+
+    /* Scroll entire surface up, as libvncclient would write it */
+    test_util_output_length = 0;
+    test_util_output[0] = '\0';
+
+    test_surface_write_lines(surface, TEST_SURFACE_SCROLL);
+    guac_common_surface_invalidate(surface, 0, 0,
+            TEST_SURFACE_WIDTH, TEST_SURFACE_HEIGHT);
+    guac_common_surface_flush(surface);
+
+    /* All but the newly-exposed rows are copied from the old location */
+    CU_ASSERT_EQUAL(test_util_count("4.copy,1.0,1.0,2.16,3.300,3.184,"), 1);
+    CU_ASSERT_EQUAL(test_util_count("4.copy,"), 1);
+
+    /* The newly-exposed rows are still drawn */
+    CU_ASSERT_EQUAL(test_util_count("3.img,"), 1);
+
+    guac_common_surface_free(surface);
+    test_util_user_free(user);
+
+}
+
@@ -0,0 +1,284 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "common/tile_cache.h"
+
+#include <CUnit/CUnit.h>
+#include <guacamole/client.h>
+#include <guacamole/layer.h>
+
+#include <stdint.h>
+#include <stdlib.h>
+
+/**
+ * The number of bytes in each row of the test images.
+ */
+#define TEST_STRIDE (GUAC_COMMON_TILE_CACHE_TILE_SIZE * 4)
+
+/**
+ * Fills the given tile of image data with a pattern unique to the given seed.
+ *
+ * @param data
+ *     The tile of image data to fill, which must be
+ *     GUAC_COMMON_TILE_CACHE_TILE_SIZE pixels square with rows of TEST_STRIDE
+ *     bytes.
+ *
+ * @param seed
+ *     Arbitrary value determining the contents of the tile.
+ */
+static void fill_tile(unsigned char* data, int seed) {
+
+    int i;
+    uint32_t* pixel = (uint32_t*) data;
+
+    for (i = 0; i < GUAC_COMMON_TILE_CACHE_TILE_SIZE
+            * GUAC_COMMON_TILE_CACHE_TILE_SIZE; i++)
+        *(pixel++) = 0xFF000000 | ((seed * 7919 + i * 31) & 0xFFFFFF);
+
+}
+
+/**
+ * Offers the given tile to the given tile cache twice, as required for a tile
+ * not yet cached to be stored.
+ *
+ * @param cache
+ *     The tile cache to store the tile within.
+ *
+ * @param client
+ *     The client owning the tile cache.
+ *
+ * @param data
+ *     The tile of image data to store, which must be
+ *     GUAC_COMMON_TILE_CACHE_TILE_SIZE pixels square with rows of TEST_STRIDE
+ *     bytes.
+ */
+static void store_tile(guac_common_tile_cache* cache, guac_client* client,
+        const unsigned char* data) {
+
+    int i;
+
+    for (i = 0; i < 2; i++)
+        guac_common_tile_cache_store(cache, client->socket,
+                GUAC_DEFAULT_LAYER, 0, 0, data, TEST_STRIDE);
+
+}
+
+/**
+ * Test which verifies that guac_common_tile_cache_lookup() finds only tiles
+ * whose contents are identical to tiles previously stored with
+ * guac_common_tile_cache_store().
+ */
+void test_tile_cache__lookup() {
+
+    const guac_layer* layer;
+    int x, y;
+
+    unsigned char* tile = malloc(TEST_STRIDE
+            * GUAC_COMMON_TILE_CACHE_TILE_SIZE);
+
+    guac_client* client = guac_client_alloc();
+    CU_ASSERT_PTR_NOT_NULL_FATAL(client);
+
+    guac_common_tile_cache* cache = guac_common_tile_cache_alloc(client);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(cache);
+
+    /* Nothing is cached initially */
+    fill_tile(tile, 1);
+    CU_ASSERT_FALSE(guac_common_tile_cache_lookup(cache, tile, TEST_STRIDE,
+                &layer, &x, &y));
+
+    /* Stored tiles are found */
+    store_tile(cache, client, tile);
+    CU_ASSERT_TRUE_FATAL(guac_common_tile_cache_lookup(cache, tile,
+                TEST_STRIDE, &layer, &x, &y));
+
+    CU_ASSERT_PTR_NOT_NULL(layer);
+    CU_ASSERT_EQUAL(0, x);
+    CU_ASSERT_EQUAL(0, y);
+
+    /* Tiles differing by a single pixel are not found */
+    tile[TEST_STRIDE * 10 + 20] ^= 0x01;
+    CU_ASSERT_FALSE(guac_common_tile_cache_lookup(cache, tile, TEST_STRIDE,
+                &layer, &x, &y));
+
+    /* Distinct tiles are stored separately */
+    store_tile(cache, client, tile);
+    CU_ASSERT_TRUE_FATAL(guac_common_tile_cache_lookup(cache, tile,
+                TEST_STRIDE, &layer, &x, &y));
+
+    CU_ASSERT_EQUAL(GUAC_COMMON_TILE_CACHE_TILE_SIZE, x);
+    CU_ASSERT_EQUAL(0, y);
+
+    guac_common_tile_cache_free(cache);
+    guac_client_free(client);
+    free(tile);
+
+}
+
+/**
+ * Test which verifies that the least-recently-used tile is replaced once the
+ * tile cache is full, and that looking up a tile marks it as recently used.
+ */
+void test_tile_cache__eviction() {
+
+    int i;
+    const guac_layer* layer;
+    int x, y;
+
+    unsigned char* tile = malloc(TEST_STRIDE
+            * GUAC_COMMON_TILE_CACHE_TILE_SIZE);
+
+    guac_client* client = guac_client_alloc();
+    CU_ASSERT_PTR_NOT_NULL_FATAL(client);
+
+    guac_common_tile_cache* cache = guac_common_tile_cache_alloc(client);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(cache);
+
+    /* Fill cache to capacity */
+    for (i = 0; i < GUAC_COMMON_TILE_CACHE_SIZE; i++) {
+        fill_tile(tile, i);
+        store_tile(cache, client, tile);
+    }
+
+    /* Mark oldest tile as recently used */
+    fill_tile(tile, 0);
+    CU_ASSERT_TRUE(guac_common_tile_cache_lookup(cache, tile, TEST_STRIDE,
+                &layer, &x, &y));
+
+    /* Store one more tile, which must replace the second-oldest */
+    fill_tile(tile, GUAC_COMMON_TILE_CACHE_SIZE);
+    store_tile(cache, client, tile);
+
+    CU_ASSERT_TRUE(guac_common_tile_cache_lookup(cache, tile, TEST_STRIDE,
+                &layer, &x, &y));
+
+    fill_tile(tile, 0);
+    CU_ASSERT_TRUE(guac_common_tile_cache_lookup(cache, tile, TEST_STRIDE,
+                &layer, &x, &y));
+
+    fill_tile(tile, 1);
+    CU_ASSERT_FALSE(guac_common_tile_cache_lookup(cache, tile, TEST_STRIDE,
+                &layer, &x, &y));
+
+    fill_tile(tile, 2);
+    CU_ASSERT_TRUE(guac_common_tile_cache_lookup(cache, tile, TEST_STRIDE,
+                &layer, &x, &y));
+
+    guac_common_tile_cache_free(cache);
+    guac_client_free(client);
+    free(tile);
+
+}
+
+/**
+ * Test which verifies that guac_common_tile_cache_store() stores a tile only
+ * once an identical tile has been offered before, such that tiles sent only
+ * once never evict cached tiles.
+ */
+void test_tile_cache__admission() {
+
+    int i;
+    const guac_layer* layer;
+    int x, y;
+
+    unsigned char* tile = malloc(TEST_STRIDE
+            * GUAC_COMMON_TILE_CACHE_TILE_SIZE);
+
+    guac_client* client = guac_client_alloc();
+    CU_ASSERT_PTR_NOT_NULL_FATAL(client);
+
+    guac_common_tile_cache* cache = guac_common_tile_cache_alloc(client);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(cache);
+
+    /* Tiles offered once are not stored */
+    fill_tile(tile, 1);
+    guac_common_tile_cache_store(cache, client->socket, GUAC_DEFAULT_LAYER,
+            0, 0, tile, TEST_STRIDE);
+    CU_ASSERT_FALSE(guac_common_tile_cache_lookup(cache, tile, TEST_STRIDE,
+                &layer, &x, &y));
+
+    /* Tiles offered again are stored */
+    guac_common_tile_cache_store(cache, client->socket, GUAC_DEFAULT_LAYER,
+            0, 0, tile, TEST_STRIDE);
+    CU_ASSERT_TRUE(guac_common_tile_cache_lookup(cache, tile, TEST_STRIDE,
+                &layer, &x, &y));
+
+    /* Fill cache to capacity */
+    for (i = 2; i <= GUAC_COMMON_TILE_CACHE_SIZE; i++) {
+        fill_tile(tile, i);
+        store_tile(cache, client, tile);
+    }
+
+    /* Many tiles offered only once do not evict anything */
+    for (i = 0; i < GUAC_COMMON_TILE_CACHE_SIZE; i++) {
+        fill_tile(tile, GUAC_COMMON_TILE_CACHE_SIZE + 1 + i);
+        guac_common_tile_cache_store(cache, client->socket,
+                GUAC_DEFAULT_LAYER, 0, 0, tile, TEST_STRIDE);
+    }
+
+    fill_tile(tile, 1);
+    CU_ASSERT_TRUE(guac_common_tile_cache_lookup(cache, tile, TEST_STRIDE,
+                &layer, &x, &y));
+
+    guac_common_tile_cache_free(cache);
+    guac_client_free(client);
+    free(tile);
+
+}
+
+/**
+ * Test which verifies that guac_common_tile_cache_dup() discards all cached
+ * tiles, as a newly-joined user does not have their contents.
+ */
+void test_tile_cache__dup() {
+
+    const guac_layer* layer;
+    int x, y;
+
+    unsigned char* tile = malloc(TEST_STRIDE
+            * GUAC_COMMON_TILE_CACHE_TILE_SIZE);
+
+    guac_client* client = guac_client_alloc();
+    CU_ASSERT_PTR_NOT_NULL_FATAL(client);
+
+    guac_common_tile_cache* cache = guac_common_tile_cache_alloc(client);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(cache);
+
+    fill_tile(tile, 1);
+    store_tile(cache, client, tile);
+    CU_ASSERT_TRUE(guac_common_tile_cache_lookup(cache, tile, TEST_STRIDE,
+                &layer, &x, &y));
+
+    /* Nothing remains cached after synchronizing a new user */
+    guac_common_tile_cache_dup(cache, NULL, client->socket);
+    CU_ASSERT_FALSE(guac_common_tile_cache_lookup(cache, tile, TEST_STRIDE,
+                &layer, &x, &y));
+
+    /* Tiles are cached again as they are stored, reusing the same buffer */
+    store_tile(cache, client, tile);
+    CU_ASSERT_TRUE(guac_common_tile_cache_lookup(cache, tile, TEST_STRIDE,
+                &layer, &x, &y));
+    CU_ASSERT_EQUAL(0, x);
+    CU_ASSERT_EQUAL(0, y);
+
+    guac_common_tile_cache_free(cache);
+    guac_client_free(client);
+    free(tile);
+
+}
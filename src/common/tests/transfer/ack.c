@@ -0,0 +1,151 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "common/transfer.h"
+#include "util/test_util.h"
+
+#include <CUnit/CUnit.h>
+#include <guacamole/protocol.h>
+#include <guacamole/socket.h>
+#include <guacamole/stream.h>
+#include <guacamole/user.h>
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * Test which verifies that guac_common_transfer_ack() sends no more than the
+ * configured window of blobs at once, and that all data is sent intact
+ * before the stream is ended.
+ */
+void test_transfer__window() {
+
+    int i;
+    int result;
+
+    guac_user* user = test_util_user_alloc();
+    guac_stream* stream = guac_user_alloc_stream(user);
+
+    guac_common_transfer* transfer = guac_common_transfer_alloc(
+            test_util_read, NULL, 10 * GUAC_PROTOCOL_BLOB_MAX_LENGTH);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(transfer);
+
+    /* Acknowledging creation of the stream fills the window */
+    result = guac_common_transfer_ack(transfer, user, stream,
+            GUAC_PROTOCOL_STATUS_SUCCESS);
+    guac_socket_flush(user->socket);
+    CU_ASSERT_EQUAL(result, GUAC_COMMON_TRANSFER_IN_PROGRESS);
+    CU_ASSERT_EQUAL(test_util_count("4.blob,"), 10);
+
+    /* Each later ack permits exactly one more blob until data runs out */
+    result = guac_common_transfer_ack(transfer, user, stream,
+            GUAC_PROTOCOL_STATUS_SUCCESS);
+    guac_socket_flush(user->socket);
+    CU_ASSERT_EQUAL(result, GUAC_COMMON_TRANSFER_IN_PROGRESS);
+    CU_ASSERT_EQUAL(test_util_count("4.blob,"), 11);
+
+    /* Acknowledge until complete */
+    for (i = 0; i < 10000 && result == GUAC_COMMON_TRANSFER_IN_PROGRESS; i++)
+        result = guac_common_transfer_ack(transfer, user, stream,
+                GUAC_PROTOCOL_STATUS_SUCCESS);
+
+    guac_socket_flush(user->socket);
+    CU_ASSERT_EQUAL(result, GUAC_COMMON_TRANSFER_COMPLETE);
+    CU_ASSERT_EQUAL(test_util_count("3.end,"), 1);
+
+    /* Verify contents of all blobs, in order */
+    uint64_t offset = 0;
+    char* current = test_util_output;
+    while ((current = strstr(current, "4.blob,")) != NULL) {
+
+        /* Skip stream index */
+        current = strchr(current + 7, ',') + 1;
+
+        /* Decode data in place */
+        char* base64;
+        int encoded_length = strtol(current, &base64, 10);
+        base64++;
+        base64[encoded_length] = '\0';
+        int length = guac_protocol_decode_base64(base64);
+
+        for (i = 0; i < length; i++) {
+            if (base64[i] != test_util_file_byte(offset + i))
+                break;
+        }
+
+        CU_ASSERT_EQUAL_FATAL(i, length);
+        offset += length;
+
+        /* Continue after end of instruction */
+        current = base64 + encoded_length + 1;
+
+    }
+
+    CU_ASSERT_EQUAL(offset, TEST_UTIL_FILE_SIZE);
+
+    guac_common_transfer_free(transfer);
+    test_util_user_free(user);
+
+}
+
+/**
+ * Test which verifies that guac_common_transfer_ack() reports failure if the
+ * source of the transfer cannot be read or the user rejects the data.
+ */
+void test_transfer__failure() {
+
+    guac_user* user = test_util_user_alloc();
+    guac_stream* stream = guac_user_alloc_stream(user);
+
+    int i;
+    int result = GUAC_COMMON_TRANSFER_IN_PROGRESS;
+
+    /* Read errors end the stream */
+    guac_common_transfer* transfer = guac_common_transfer_alloc(
+            test_util_failing_read, NULL,
+            GUAC_COMMON_TRANSFER_DEFAULT_WINDOW);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(transfer);
+
+    for (i = 0; i < 10000 && result == GUAC_COMMON_TRANSFER_IN_PROGRESS; i++)
+        result = guac_common_transfer_ack(transfer, user, stream,
+                GUAC_PROTOCOL_STATUS_SUCCESS);
+
+    guac_socket_flush(user->socket);
+    CU_ASSERT_EQUAL(result, GUAC_COMMON_TRANSFER_FAILED);
+    CU_ASSERT_EQUAL(test_util_count("3.end,"), 1);
+    guac_common_transfer_free(transfer);
+
+    /* Rejected data aborts the transfer without sending anything */
+    transfer = guac_common_transfer_alloc(test_util_read, NULL,
+            GUAC_COMMON_TRANSFER_DEFAULT_WINDOW);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(transfer);
+
+    test_util_output_length = 0;
+    CU_ASSERT_EQUAL(guac_common_transfer_ack(transfer, user, stream,
+                GUAC_PROTOCOL_STATUS_CLIENT_FORBIDDEN),
+            GUAC_COMMON_TRANSFER_FAILED);
+    guac_socket_flush(user->socket);
+    CU_ASSERT_EQUAL(test_util_output_length, 0);
+    guac_common_transfer_free(transfer);
+
+    test_util_user_free(user);
+
+}
+
@@ -0,0 +1,121 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "test_util.h"
+
+#include <guacamole/client.h>
+#include <guacamole/socket.h>
+#include <guacamole/user.h>
+
+#include <stdint.h>
+#include <string.h>
+
+char test_util_output[TEST_UTIL_OUTPUT_SIZE + 1];
+
+int test_util_output_length;
+
+/**
+ * Write handler for the socket of the user allocated by
+ * test_util_user_alloc(), appending all data to test_util_output.
+ */
+static ssize_t test_util_write_handler(guac_socket* socket, const void* buf,
+        size_t count) {
+
+    /* Fail the write if the output buffer is full */
+    if (test_util_output_length + count > TEST_UTIL_OUTPUT_SIZE)
+        return -1;
+
+    memcpy(test_util_output + test_util_output_length, buf, count);
+    test_util_output_length += count;
+    test_util_output[test_util_output_length] = '\0';
+    return count;
+
+}
+
+char test_util_file_byte(uint64_t offset) {
+    return (char) (offset * 131);
+}
+
+int test_util_read(void* data, uint64_t offset, char* buffer, int length) {
+
+    int i;
+
+    if (offset >= TEST_UTIL_FILE_SIZE)
+        return 0;
+
+    if (length > 10000)
+        length = 10000;
+
+    if (length > TEST_UTIL_FILE_SIZE - offset)
+        length = TEST_UTIL_FILE_SIZE - offset;
+
+    for (i = 0; i < length; i++)
+        buffer[i] = test_util_file_byte(offset + i);
+
+    return length;
+
+}
+
+int test_util_failing_read(void* data, uint64_t offset, char* buffer,
+        int length) {
+
+    if (offset >= TEST_UTIL_FAILURE_OFFSET)
+        return -1;
+
+    if (length > TEST_UTIL_FAILURE_OFFSET - offset)
+        length = TEST_UTIL_FAILURE_OFFSET - offset;
+
+    return test_util_read(data, offset, buffer, length);
+
+}
+
+guac_user* test_util_user_alloc() {
+
+    guac_user* user = guac_user_alloc();
+    user->client = guac_client_alloc();
+    user->socket = guac_socket_alloc();
+    user->socket->write_handler = test_util_write_handler;
+
+    test_util_output_length = 0;
+    test_util_output[0] = '\0';
+
+    return user;
+
+}
+
+void test_util_user_free(guac_user* user) {
+    guac_client* client = user->client;
+    guac_socket_free(user->socket);
+    guac_user_free(user);
+    guac_client_free(client);
+}
+
+int test_util_count(const char* str) {
+
+    int count = 0;
+    char* current = test_util_output;
+
+    while ((current = strstr(current, str)) != NULL) {
+        current += strlen(str);
+        count++;
+    }
+
+    return count;
+
+}
@@ -0,0 +1,147 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef GUAC_COMMON_TEST_UTIL_H
+#define GUAC_COMMON_TEST_UTIL_H
+
+#include <guacamole/user.h>
+
+#include <stdint.h>
+
+/**
+ * The size of the in-memory test file read by test_util_read(), in bytes.
+ * This is deliberately not a multiple of any blob size, read or write size,
+ * or buffer size, and is larger than the buffers of the code under test.
+ */
+#define TEST_UTIL_FILE_SIZE 3000003
+
+/**
+ * The offset at and beyond which test_util_failing_read() fails.
+ */
+#define TEST_UTIL_FAILURE_OFFSET 100000
+
+/**
+ * The maximum number of bytes of protocol data captured from the socket of
+ * the user allocated by test_util_user_alloc().
+ */
+#define TEST_UTIL_OUTPUT_SIZE (4 * TEST_UTIL_FILE_SIZE)
+
+/**
+ * All protocol data written to the socket of the user allocated by
+ * test_util_user_alloc(), always null-terminated.
+ */
+extern char test_util_output[TEST_UTIL_OUTPUT_SIZE + 1];
+
+/**
+ * The number of bytes written to test_util_output.
+ */
+extern int test_util_output_length;
+
+/**
+ * Returns the byte at the given offset within the in-memory test file. The
+ * contents of the test file are a simple function of offset, such that data
+ * read from or written to any part of the file can be verified.
+ *
+ * @param offset
+ *     The offset of the byte to return.
+ *
+ * @return
+ *     The byte at the given offset.
+ */
+char test_util_file_byte(uint64_t offset);
+
+/**
+ * Read handler which reads from the in-memory test file, returning at most
+ * 10000 bytes per read to exercise short reads. The signature of this
+ * function matches the read handlers of guac_common_read_ahead and
+ * guac_common_transfer.
+ *
+ * @param data
+ *     Ignored.
+ *
+ * @param offset
+ *     The offset to read from.
+ *
+ * @param buffer
+ *     The buffer to read into.
+ *
+ * @param length
+ *     The maximum number of bytes to read.
+ *
+ * @return
+ *     The number of bytes read, or zero at the end of the file.
+ */
+int test_util_read(void* data, uint64_t offset, char* buffer, int length);
+
+/**
+ * Read handler which behaves as test_util_read(), except that all reads at
+ * or beyond TEST_UTIL_FAILURE_OFFSET fail.
+ *
+ * @param data
+ *     Ignored.
+ *
+ * @param offset
+ *     The offset to read from.
+ *
+ * @param buffer
+ *     The buffer to read into.
+ *
+ * @param length
+ *     The maximum number of bytes to read.
+ *
+ * @return
+ *     The number of bytes read, or a negative value if the read is at or
+ *     beyond TEST_UTIL_FAILURE_OFFSET.
+ */
+int test_util_failing_read(void* data, uint64_t offset, char* buffer,
+        int length);
+
+/**
+ * Allocates a new user, along with the client it belongs to, whose socket
+ * captures all protocol data written to it within test_util_output.
+ * Previously-captured data is discarded.
+ *
+ * @return
+ *     A new user, which must be freed with test_util_user_free().
+ */
+guac_user* test_util_user_alloc();
+
+/**
+ * Frees the given user, its socket, and its client, all of which must have
+ * been allocated by test_util_user_alloc().
+ *
+ * @param user
+ *     The user to free.
+ */
+void test_util_user_free(guac_user* user);
+
+/**
+ * Returns the number of occurrences of the given string within all protocol
+ * data captured in test_util_output.
+ *
+ * @param str
+ *     The string to search for.
+ *
+ * @return
+ *     The number of occurrences of the given string.
+ */
+int test_util_count(const char* str);
+
+#endif
+
@@ -0,0 +1,242 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "common/write_queue.h"
+#include "util/test_util.h"
+
+#include <CUnit/CUnit.h>
+#include <guacamole/protocol.h>
+
+#include <pthread.h>
+#include <stdint.h>
+#include <string.h>
+
+/**
+ * The contents of the test file, as written by the write queue.
+ */
+static char test_file[TEST_UTIL_FILE_SIZE];
+
+/**
+ * The number of bytes written to test_file. Writes must be sequential, so
+ * this is also the offset of the next expected write.
+ */
+static uint64_t test_file_length;
+
+/**
+ * Write handler which writes to test_file, writing at most 100000 bytes per
+ * call to exercise short writes. Writes which are not sequential or which
+ * exceed the bounds of the file are rejected.
+ */
+static int test_write_handler(void* data, uint64_t offset,
+        const char* buffer, int length) {
+
+    if (offset != test_file_length
+            || length > TEST_UTIL_FILE_SIZE - offset)
+        return -1;
+
+    if (length > 100000)
+        length = 100000;
+
+    memcpy(test_file + offset, buffer, length);
+    test_file_length += length;
+    return length;
+
+}
+
+/**
+ * Write handler which fails for all writes at or beyond
+ * TEST_UTIL_FAILURE_OFFSET.
+ */
+static int test_failing_write_handler(void* data, uint64_t offset,
+        const char* buffer, int length) {
+
+    if (offset + length > TEST_UTIL_FAILURE_OFFSET)
+        return -1;
+
+    return test_write_handler(data, offset, buffer, length);
+
+}
+
+/**
+ * Lock which must be held while accessing test_ack_pending or test_ack_error.
+ */
+static pthread_mutex_t test_ack_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * Condition which is signalled when a deferred acknowledgement is received.
+ */
+static pthread_cond_t test_ack_received = PTHREAD_COND_INITIALIZER;
+
+/**
+ * Non-zero while an acknowledgement has been deferred and not yet received,
+ * as the sender of a real upload would track while waiting for an ack.
+ */
+static int test_ack_pending;
+
+/**
+ * The error flag passed to the most recent deferred acknowledgement.
+ */
+static int test_ack_error;
+
+/**
+ * Ack handler which records the deferred acknowledgement and wakes
+ * test_send().
+ */
+static void test_ack_handler(void* data, int error) {
+    pthread_mutex_lock(&test_ack_lock);
+    test_ack_pending = 0;
+    test_ack_error = error;
+    pthread_cond_signal(&test_ack_received);
+    pthread_mutex_unlock(&test_ack_lock);
+}
+
+/**
+ * Queues the given data, waiting for the deferred acknowledgement of that
+ * data if necessary, as the sender of a real upload waits for each blob to
+ * be acknowledged.
+ *
+ * @return
+ *     Zero if the data was acknowledged as successful, non-zero if it was
+ *     acknowledged as failed.
+ */
+static int test_send(guac_common_write_queue* queue, const char* buffer,
+        int length) {
+
+    pthread_mutex_lock(&test_ack_lock);
+    test_ack_pending = 1;
+    pthread_mutex_unlock(&test_ack_lock);
+
+    switch (guac_common_write_queue_write(queue, buffer, length)) {
+
+        case GUAC_COMMON_WRITE_QUEUE_QUEUED:
+            return 0;
+
+        case GUAC_COMMON_WRITE_QUEUE_DEFERRED:
+            break;
+
+        default:
+            return 1;
+
+    }
+
+    pthread_mutex_lock(&test_ack_lock);
+    while (test_ack_pending)
+        pthread_cond_wait(&test_ack_received, &test_ack_lock);
+    int error = test_ack_error;
+    pthread_mutex_unlock(&test_ack_lock);
+
+    return error;
+
+}
+
+/**
+ * Test which verifies that all data queued with
+ * guac_common_write_queue_write() is written intact and in order by the time
+ * guac_common_write_queue_free() returns.
+ */
+void test_write_queue__write() {
+
+    int i;
+    char blob[GUAC_PROTOCOL_BLOB_MAX_LENGTH];
+
+    test_file_length = 0;
+
+    guac_common_write_queue* queue = guac_common_write_queue_alloc(
+            test_write_handler, test_ack_handler, NULL);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(queue);
+
+    /* Queue entire file as individual blobs */
+    uint64_t offset = 0;
+    int length;
+    while ((length = test_util_read(NULL, offset, blob, sizeof(blob))) > 0) {
+        CU_ASSERT_EQUAL_FATAL(test_send(queue, blob, length), 0);
+        offset += length;
+    }
+
+    /* All data must be written once the queue is freed */
+    CU_ASSERT_EQUAL(guac_common_write_queue_free(queue), 0);
+    CU_ASSERT_EQUAL_FATAL(test_file_length, TEST_UTIL_FILE_SIZE);
+
+    for (i = 0; i < TEST_UTIL_FILE_SIZE; i++) {
+        if (test_file[i] != test_util_file_byte(i))
+            break;
+    }
+
+    CU_ASSERT_EQUAL(i, TEST_UTIL_FILE_SIZE);
+
+}
+
+/**
+ * Test which verifies that write failures are reported both by later calls
+ * to guac_common_write_queue_write() or deferred acknowledgements, and by
+ * guac_common_write_queue_free().
+ */
+void test_write_queue__failure() {
+
+    char blob[GUAC_PROTOCOL_BLOB_MAX_LENGTH] = { 0 };
+    int failed = 0;
+
+    test_file_length = 0;
+
+    guac_common_write_queue* queue = guac_common_write_queue_alloc(
+            test_failing_write_handler, test_ack_handler, NULL);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(queue);
+
+    /* Queue more data than fits within the buffer, such that the failure
+     * must be encountered before all data can be queued */
+    uint64_t offset = 0;
+    while (offset < TEST_UTIL_FILE_SIZE - sizeof(blob) && !failed) {
+        failed = test_send(queue, blob, sizeof(blob));
+        offset += sizeof(blob);
+    }
+
+    CU_ASSERT(failed);
+    CU_ASSERT_NOT_EQUAL(guac_common_write_queue_free(queue), 0);
+    CU_ASSERT(test_file_length <= TEST_UTIL_FAILURE_OFFSET);
+
+}
+
+/**
+ * Test which verifies that data which does not fit within a full queue is
+ * accepted without waiting for any write, and that its acknowledgement is
+ * deferred until the data has been moved into the queue.
+ */
+void test_write_queue__deferred_ack() {
+
+    static char data[GUAC_COMMON_WRITE_QUEUE_BUFFER_SIZE + 1000];
+    int i;
+
+    for (i = 0; i < sizeof(data); i++)
+        data[i] = test_util_file_byte(i);
+
+    test_file_length = 0;
+
+    guac_common_write_queue* queue = guac_common_write_queue_alloc(
+            test_write_handler, test_ack_handler, NULL);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(queue);
+
+    /* More than the queue can hold must still be accepted, with the excess
+     * acknowledged later */
+    CU_ASSERT_EQUAL(test_send(queue, data, sizeof(data)), 0);
+
+    CU_ASSERT_EQUAL(guac_common_write_queue_free(queue), 0);
+    CU_ASSERT_EQUAL_FATAL(test_file_length, sizeof(data));
+    CU_ASSERT(memcmp(test_file, data, sizeof(data)) == 0);
+
+}
@@ -0,0 +1,509 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "config.h"
+#include "common/tile_cache.h"
+
+#include <cairo/cairo.h>
+#include <guacamole/client.h>
+#include <guacamole/hash.h>
+#include <guacamole/layer.h>
+#include <guacamole/protocol.h>
+#include <guacamole/socket.h>
+#include <guacamole/user.h>
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * The width and height of each off-screen buffer of a tile cache, in pixels.
+ */
+#define GUAC_COMMON_TILE_CACHE_ATLAS_DIMENSION \
+    (GUAC_COMMON_TILE_CACHE_ATLAS_COLUMNS * GUAC_COMMON_TILE_CACHE_TILE_SIZE)
+
+/**
+ * The number of bytes in each row of the server-side copy of each off-screen
+ * buffer of a tile cache.
+ */
+#define GUAC_COMMON_TILE_CACHE_ATLAS_STRIDE \
+    (GUAC_COMMON_TILE_CACHE_ATLAS_DIMENSION * 4)
+
+/**
+ * Returns the hash of the given tile of image data, as produced by
+ * guac_hash_surface().
+ *
+ * @param data
+ *     The first pixel of a GUAC_COMMON_TILE_CACHE_TILE_SIZE square tile of
+ *     32-bit image data.
+ *
+ * @param stride
+ *     The number of bytes in each row of the given image data.
+ *
+ * @return
+ *     The hash of the given tile.
+ */
+static unsigned int guac_common_tile_cache_hash(const unsigned char* data,
+        int stride) {
+
+    cairo_surface_t* tile = cairo_image_surface_create_for_data(
+            (unsigned char*) data, CAIRO_FORMAT_ARGB32,
+            GUAC_COMMON_TILE_CACHE_TILE_SIZE, GUAC_COMMON_TILE_CACHE_TILE_SIZE,
+            stride);
+
+    unsigned int hash = guac_hash_surface(tile);
+
+    cairo_surface_destroy(tile);
+    return hash;
+
+}
+
+/**
+ * Returns the value identifying the given tile of image data among the
+ * candidates of a tile cache. As the hash produced by guac_hash_surface() is
+ * identical for all tiles of uniform color (and many other regular
+ * patterns), that hash is combined with a few pixels of the tile. Zero is
+ * never returned, as zero denotes an unused candidate.
+ *
+ * @param hash
+ *     The hash of the given tile, as produced by
+ *     guac_common_tile_cache_hash().
+ *
+ * @param data
+ *     The first pixel of a GUAC_COMMON_TILE_CACHE_TILE_SIZE square tile of
+ *     32-bit image data.
+ *
+ * @param stride
+ *     The number of bytes in each row of the given image data.
+ *
+ * @return
+ *     A non-zero value identifying the given tile.
+ */
+static unsigned int guac_common_tile_cache_candidate(unsigned int hash,
+        const unsigned char* data, int stride) {
+
+    int center = GUAC_COMMON_TILE_CACHE_TILE_SIZE / 2;
+    int last = GUAC_COMMON_TILE_CACHE_TILE_SIZE - 1;
+
+    unsigned int value = hash;
+    value = value * 31 + ((const uint32_t*) data)[0];
+    value = value * 31 + ((const uint32_t*) (data + center * stride))[center];
+    value = value * 31 + ((const uint32_t*) (data + last * stride))[last];
+
+    /* Spread all bits into the low bits used to select the candidate */
+    value ^= value >> 16;
+    value *= 0x45D9F3B;
+    value ^= value >> 16;
+
+    return value != 0 ? value : 1;
+
+}
+
+/**
+ * Returns whether the contents of the given cached tile are identical to the
+ * given tile of image data.
+ *
+ * @param cache
+ *     The tile cache containing the cached tile.
+ *
+ * @param index
+ *     The index of the entry of the cached tile.
+ *
+ * @param data
+ *     The first pixel of a GUAC_COMMON_TILE_CACHE_TILE_SIZE square tile of
+ *     32-bit image data.
+ *
+ * @param stride
+ *     The number of bytes in each row of the given image data.
+ *
+ * @return
+ *     Non-zero if the contents of the tiles are identical, zero otherwise.
+ */
+static int guac_common_tile_cache_matches(guac_common_tile_cache* cache,
+        int index, const unsigned char* data, int stride) {
+
+    int atlas = index / GUAC_COMMON_TILE_CACHE_ATLAS_SIZE;
+    int slot = index % GUAC_COMMON_TILE_CACHE_ATLAS_SIZE;
+
+    unsigned char* cached = cache->atlas_data[atlas]
+        + (slot / GUAC_COMMON_TILE_CACHE_ATLAS_COLUMNS)
+            * GUAC_COMMON_TILE_CACHE_TILE_SIZE * GUAC_COMMON_TILE_CACHE_ATLAS_STRIDE
+        + (slot % GUAC_COMMON_TILE_CACHE_ATLAS_COLUMNS)
+            * GUAC_COMMON_TILE_CACHE_TILE_SIZE * 4;
+
+    cairo_surface_t* a = cairo_image_surface_create_for_data(
+            (unsigned char*) data, CAIRO_FORMAT_ARGB32,
+            GUAC_COMMON_TILE_CACHE_TILE_SIZE, GUAC_COMMON_TILE_CACHE_TILE_SIZE,
+            stride);
+
+    cairo_surface_t* b = cairo_image_surface_create_for_data(cached,
+            CAIRO_FORMAT_ARGB32,
+            GUAC_COMMON_TILE_CACHE_TILE_SIZE, GUAC_COMMON_TILE_CACHE_TILE_SIZE,
+            GUAC_COMMON_TILE_CACHE_ATLAS_STRIDE);
+
+    int matches = guac_surface_cmp(a, b) == 0;
+
+    cairo_surface_destroy(a);
+    cairo_surface_destroy(b);
+    return matches;
+
+}
+
+/**
+ * Removes the given entry from the list of entries ordered by most recent
+ * use.
+ *
+ * @param cache
+ *     The tile cache containing the entry.
+ *
+ * @param index
+ *     The index of the entry to remove.
+ */
+static void guac_common_tile_cache_unlink(guac_common_tile_cache* cache,
+        int index) {
+
+    guac_common_tile_cache_entry* entry = &cache->entries[index];
+
+    if (entry->newer != -1)
+        cache->entries[entry->newer].older = entry->older;
+    else
+        cache->newest = entry->older;
+
+    if (entry->older != -1)
+        cache->entries[entry->older].newer = entry->newer;
+    else
+        cache->oldest = entry->newer;
+
+}
+
+/**
+ * Inserts the given entry at the head of the list of entries ordered by most
+ * recent use, marking it as the most-recently-used entry.
+ *
+ * @param cache
+ *     The tile cache containing the entry.
+ *
+ * @param index
+ *     The index of the entry to mark as most-recently-used.
+ */
+static void guac_common_tile_cache_touch(guac_common_tile_cache* cache,
+        int index) {
+
+    guac_common_tile_cache_entry* entry = &cache->entries[index];
+
+    entry->newer = -1;
+    entry->older = cache->newest;
+
+    if (cache->newest != -1)
+        cache->entries[cache->newest].newer = index;
+    else
+        cache->oldest = index;
+
+    cache->newest = index;
+
+}
+
+/**
+ * Removes the given entry from its hash table bucket.
+ *
+ * @param cache
+ *     The tile cache containing the entry.
+ *
+ * @param index
+ *     The index of the entry to remove.
+ */
+static void guac_common_tile_cache_remove(guac_common_tile_cache* cache,
+        int index) {
+
+    int* current = &cache->buckets[cache->entries[index].hash
+        & (GUAC_COMMON_TILE_CACHE_BUCKETS - 1)];
+
+    /* Locate and unlink entry within bucket */
+    while (*current != -1) {
+
+        if (*current == index) {
+            *current = cache->entries[index].next;
+            break;
+        }
+
+        current = &cache->entries[*current].next;
+
+    }
+
+}
+
+guac_common_tile_cache* guac_common_tile_cache_alloc(guac_client* client) {
+
+    int i;
+
+    guac_common_tile_cache* cache = malloc(sizeof(guac_common_tile_cache));
+    if (cache == NULL)
+        return NULL;
+
+    cache->client = client;
+    cache->length = 0;
+    cache->newest = -1;
+    cache->oldest = -1;
+
+    /* Buffers are allocated only as needed */
+    for (i = 0; i < GUAC_COMMON_TILE_CACHE_ATLASES; i++) {
+        cache->atlases[i] = NULL;
+        cache->atlas_data[i] = NULL;
+    }
+
+    /* All buckets are initially empty */
+    for (i = 0; i < GUAC_COMMON_TILE_CACHE_BUCKETS; i++)
+        cache->buckets[i] = -1;
+
+    /* No tiles have yet been offered */
+    memset(cache->candidates, 0, sizeof(cache->candidates));
+
+    pthread_mutex_init(&cache->_lock, NULL);
+
+    return cache;
+
+}
+
+void guac_common_tile_cache_free(guac_common_tile_cache* cache) {
+
+    int i;
+    guac_client* client = cache->client;
+
+    /* Dispose and free all allocated buffers */
+    for (i = 0; i < GUAC_COMMON_TILE_CACHE_ATLASES; i++) {
+
+        if (cache->atlases[i] == NULL)
+            continue;
+
+        guac_protocol_send_dispose(client->socket, cache->atlases[i]);
+        guac_client_free_buffer(client, cache->atlases[i]);
+        free(cache->atlas_data[i]);
+
+    }
+
+    pthread_mutex_destroy(&cache->_lock);
+    free(cache);
+
+}
+
+int guac_common_tile_cache_lookup(guac_common_tile_cache* cache,
+        const unsigned char* data, int stride, const guac_layer** layer,
+        int* x, int* y) {
+
+    pthread_mutex_lock(&cache->_lock);
+
+    unsigned int hash = guac_common_tile_cache_hash(data, stride);
+    int index = cache->buckets[hash & (GUAC_COMMON_TILE_CACHE_BUCKETS - 1)];
+
+    /* Search bucket for identical tile */
+    while (index != -1) {
+
+        guac_common_tile_cache_entry* entry = &cache->entries[index];
+
+        if (entry->hash == hash
+                && guac_common_tile_cache_matches(cache, index, data, stride)) {
+
+            int slot = index % GUAC_COMMON_TILE_CACHE_ATLAS_SIZE;
+
+            /* Tile is now the most-recently-used */
+            guac_common_tile_cache_unlink(cache, index);
+            guac_common_tile_cache_touch(cache, index);
+
+            *layer = cache->atlases[index / GUAC_COMMON_TILE_CACHE_ATLAS_SIZE];
+            *x = (slot % GUAC_COMMON_TILE_CACHE_ATLAS_COLUMNS)
+                * GUAC_COMMON_TILE_CACHE_TILE_SIZE;
+            *y = (slot / GUAC_COMMON_TILE_CACHE_ATLAS_COLUMNS)
+                * GUAC_COMMON_TILE_CACHE_TILE_SIZE;
+
+            pthread_mutex_unlock(&cache->_lock);
+            return 1;
+
+        }
+
+        index = entry->next;
+
+    }
+
+    pthread_mutex_unlock(&cache->_lock);
+    return 0;
+
+}
+
+void guac_common_tile_cache_store(guac_common_tile_cache* cache,
+        guac_socket* socket, const guac_layer* src_layer, int src_x, int src_y,
+        const unsigned char* data, int stride) {
+
+    int i;
+    int index;
+
+    pthread_mutex_lock(&cache->_lock);
+
+    unsigned int hash = guac_common_tile_cache_hash(data, stride);
+
+    /* Do not store duplicate tiles, instead marking any identical tile as
+     * most-recently-used */
+    index = cache->buckets[hash & (GUAC_COMMON_TILE_CACHE_BUCKETS - 1)];
+    while (index != -1) {
+
+        if (cache->entries[index].hash == hash
+                && guac_common_tile_cache_matches(cache, index, data, stride)) {
+            guac_common_tile_cache_unlink(cache, index);
+            guac_common_tile_cache_touch(cache, index);
+            pthread_mutex_unlock(&cache->_lock);
+            return;
+        }
+
+        index = cache->entries[index].next;
+
+    }
+
+    /* Store only tiles which have been offered before */
+    unsigned int value = guac_common_tile_cache_candidate(hash, data, stride);
+    unsigned int* candidates = &cache->candidates[(value
+            & (GUAC_COMMON_TILE_CACHE_CANDIDATES
+                / GUAC_COMMON_TILE_CACHE_CANDIDATE_WAYS - 1))
+        * GUAC_COMMON_TILE_CACHE_CANDIDATE_WAYS];
+
+    for (i = 0; i < GUAC_COMMON_TILE_CACHE_CANDIDATE_WAYS; i++) {
+        if (candidates[i] == value)
+            break;
+    }
+
+    /* Otherwise, remember the tile in case it is offered again, forgetting
+     * the least-recently-offered tile of the same set */
+    if (i == GUAC_COMMON_TILE_CACHE_CANDIDATE_WAYS) {
+        memmove(candidates + 1, candidates, sizeof(unsigned int)
+                * (GUAC_COMMON_TILE_CACHE_CANDIDATE_WAYS - 1));
+        candidates[0] = value;
+        pthread_mutex_unlock(&cache->_lock);
+        return;
+    }
+
+    /* Use next unused entry if the cache is not yet full */
+    if (cache->length < GUAC_COMMON_TILE_CACHE_SIZE) {
+
+        index = cache->length;
+        int atlas = index / GUAC_COMMON_TILE_CACHE_ATLAS_SIZE;
+
+        /* Allocate buffer if not yet in use */
+        if (cache->atlases[atlas] == NULL) {
+
+            cache->atlas_data[atlas] = calloc(
+                    GUAC_COMMON_TILE_CACHE_ATLAS_DIMENSION,
+                    GUAC_COMMON_TILE_CACHE_ATLAS_STRIDE);
+
+            /* Simply do not cache the tile if memory is exhausted */
+            if (cache->atlas_data[atlas] == NULL) {
+                pthread_mutex_unlock(&cache->_lock);
+                return;
+            }
+
+            cache->atlases[atlas] = guac_client_alloc_buffer(cache->client);
+            guac_protocol_send_size(socket, cache->atlases[atlas],
+                    GUAC_COMMON_TILE_CACHE_ATLAS_DIMENSION,
+                    GUAC_COMMON_TILE_CACHE_ATLAS_DIMENSION);
+
+        }
+
+        cache->length++;
+
+    }
+
+    /* Otherwise, replace the least-recently-used tile */
+    else {
+        index = cache->oldest;
+        guac_common_tile_cache_unlink(cache, index);
+        guac_common_tile_cache_remove(cache, index);
+    }
+
+    /* Tile is no longer merely a candidate */
+    candidates[i] = 0;
+
+    int atlas = index / GUAC_COMMON_TILE_CACHE_ATLAS_SIZE;
+    int slot = index % GUAC_COMMON_TILE_CACHE_ATLAS_SIZE;
+
+    int x = (slot % GUAC_COMMON_TILE_CACHE_ATLAS_COLUMNS)
+        * GUAC_COMMON_TILE_CACHE_TILE_SIZE;
+    int y = (slot / GUAC_COMMON_TILE_CACHE_ATLAS_COLUMNS)
+        * GUAC_COMMON_TILE_CACHE_TILE_SIZE;
+
+    /* Keep server-side copy of tile for later comparison */
+    unsigned char* cached = cache->atlas_data[atlas]
+        + y * GUAC_COMMON_TILE_CACHE_ATLAS_STRIDE + x * 4;
+
+    for (i = 0; i < GUAC_COMMON_TILE_CACHE_TILE_SIZE; i++) {
+        memcpy(cached, data, GUAC_COMMON_TILE_CACHE_TILE_SIZE * 4);
+        cached += GUAC_COMMON_TILE_CACHE_ATLAS_STRIDE;
+        data += stride;
+    }
+
+    /* Copy tile into buffer for all users */
+    guac_protocol_send_copy(socket, src_layer, src_x, src_y,
+            GUAC_COMMON_TILE_CACHE_TILE_SIZE, GUAC_COMMON_TILE_CACHE_TILE_SIZE,
+            GUAC_COMP_SRC, cache->atlases[atlas], x, y);
+
+    /* Add to hash table as the most-recently-used tile */
+    guac_common_tile_cache_entry* entry = &cache->entries[index];
+    entry->hash = hash;
+
+    int* bucket = &cache->buckets[entry->hash
+        & (GUAC_COMMON_TILE_CACHE_BUCKETS - 1)];
+    entry->next = *bucket;
+    *bucket = index;
+
+    guac_common_tile_cache_touch(cache, index);
+
+    pthread_mutex_unlock(&cache->_lock);
+
+}
+
+void guac_common_tile_cache_dup(guac_common_tile_cache* cache,
+        guac_user* user, guac_socket* socket) {
+
+    int i;
+
+    pthread_mutex_lock(&cache->_lock);
+
+    /* Forget all cached tiles, such that no tile is copied from a buffer
+     * whose contents the user does not have */
+    cache->length = 0;
+    cache->newest = -1;
+    cache->oldest = -1;
+
+    for (i = 0; i < GUAC_COMMON_TILE_CACHE_BUCKETS; i++)
+        cache->buckets[i] = -1;
+
+    /* Size each allocated buffer, which will be filled again as tiles are
+     * stored */
+    for (i = 0; i < GUAC_COMMON_TILE_CACHE_ATLASES; i++) {
+
+        if (cache->atlases[i] == NULL)
+            continue;
+
+        guac_protocol_send_size(socket, cache->atlases[i],
+                GUAC_COMMON_TILE_CACHE_ATLAS_DIMENSION,
+                GUAC_COMMON_TILE_CACHE_ATLAS_DIMENSION);
+
+    }
+
+    pthread_mutex_unlock(&cache->_lock);
+
+}
+
@@ -0,0 +1,173 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "config.h"
+#include "common/transfer.h"
+
+#include <guacamole/protocol.h>
+#include <guacamole/stream.h>
+#include <guacamole/user.h>
+
+#include <stdint.h>
+#include <stdlib.h>
+
+/**
+ * The maximum number of bytes sent within each blob.
+ */
+#define GUAC_COMMON_TRANSFER_BLOB_SIZE GUAC_PROTOCOL_BLOB_MAX_LENGTH
+
+/**
+ * Reads from the source of the given transfer into its ring buffer until
+ * the buffer contains at least the given number of bytes, the buffer is
+ * full, or the end of the source is reached.
+ *
+ * @param transfer
+ *     The transfer to read data for.
+ *
+ * @param needed
+ *     The number of bytes which should be available within the buffer.
+ *
+ * @return
+ *     Zero on success (including reaching the end of the source), non-zero
+ *     if the source could not be read.
+ */
+static int guac_common_transfer_read(guac_common_transfer* transfer,
+        int needed) {
+
+    while (!transfer->eof && transfer->length < needed) {
+
+        /* Stop if the buffer is full */
+        if (transfer->length == GUAC_COMMON_TRANSFER_BUFFER_SIZE)
+            break;
+
+        /* Reads always append to the end of the buffered data */
+        int end = (transfer->start + transfer->length)
+                % GUAC_COMMON_TRANSFER_BUFFER_SIZE;
+
+        /* Read only into the contiguous space following the end */
+        int available;
+        if (end >= transfer->start)
+            available = GUAC_COMMON_TRANSFER_BUFFER_SIZE - end;
+        else
+            available = transfer->start - end;
+
+        if (available > GUAC_COMMON_TRANSFER_READ_SIZE)
+            available = GUAC_COMMON_TRANSFER_READ_SIZE;
+
+        int bytes_read = transfer->read_handler(transfer->data,
+                transfer->offset, transfer->buffer + end, available);
+
+        if (bytes_read < 0)
+            return 1;
+
+        if (bytes_read == 0)
+            transfer->eof = 1;
+
+        transfer->offset += bytes_read;
+        transfer->length += bytes_read;
+
+    }
+
+    return 0;
+
+}
+
+guac_common_transfer* guac_common_transfer_alloc(
+        guac_common_transfer_read_handler* read_handler, void* data,
+        int window) {
+
+    guac_common_transfer* transfer = malloc(sizeof(guac_common_transfer));
+    if (transfer == NULL)
+        return NULL;
+
+    transfer->read_handler = read_handler;
+    transfer->data = data;
+    transfer->offset = 0;
+    transfer->eof = 0;
+    transfer->start = 0;
+    transfer->length = 0;
+    transfer->blobs_in_flight = 0;
+
+    /* Always allow at least one blob in flight */
+    transfer->max_blobs = (window + GUAC_COMMON_TRANSFER_BLOB_SIZE - 1)
+                        / GUAC_COMMON_TRANSFER_BLOB_SIZE;
+    if (transfer->max_blobs < 1)
+        transfer->max_blobs = 1;
+
+    return transfer;
+
+}
+
+int guac_common_transfer_ack(guac_common_transfer* transfer, guac_user* user,
+        guac_stream* stream, guac_protocol_status status) {
+
+    /* Abort if the user rejected the data */
+    if (status != GUAC_PROTOCOL_STATUS_SUCCESS)
+        return GUAC_COMMON_TRANSFER_FAILED;
+
+    /* Each ack after the first acknowledges one blob */
+    if (transfer->blobs_in_flight > 0)
+        transfer->blobs_in_flight--;
+
+    /* Read enough data to fill the window */
+    int blobs = transfer->max_blobs - transfer->blobs_in_flight;
+    if (guac_common_transfer_read(transfer,
+                blobs * GUAC_COMMON_TRANSFER_BLOB_SIZE)) {
+        guac_user_log(user, GUAC_LOG_ERROR, "Error reading file for "
+                "download");
+        guac_protocol_send_end(user->socket, stream);
+        return GUAC_COMMON_TRANSFER_FAILED;
+    }
+
+    /* Send as many blobs as the window allows */
+    while (transfer->blobs_in_flight < transfer->max_blobs
+            && transfer->length > 0) {
+
+        /* Blobs cannot span the end of the ring buffer */
+        int size = transfer->length;
+        if (size > GUAC_COMMON_TRANSFER_BLOB_SIZE)
+            size = GUAC_COMMON_TRANSFER_BLOB_SIZE;
+        if (size > GUAC_COMMON_TRANSFER_BUFFER_SIZE - transfer->start)
+            size = GUAC_COMMON_TRANSFER_BUFFER_SIZE - transfer->start;
+
+        guac_protocol_send_blob(user->socket, stream,
+                transfer->buffer + transfer->start, size);
+
+        transfer->start = (transfer->start + size)
+                        % GUAC_COMMON_TRANSFER_BUFFER_SIZE;
+        transfer->length -= size;
+        transfer->blobs_in_flight++;
+
+    }
+
+    /* End stream only once all data has been sent and acknowledged */
+    if (transfer->eof && transfer->length == 0
+            && transfer->blobs_in_flight == 0) {
+        guac_protocol_send_end(user->socket, stream);
+        return GUAC_COMMON_TRANSFER_COMPLETE;
+    }
+
+    return GUAC_COMMON_TRANSFER_IN_PROGRESS;
+
+}
+
+void guac_common_transfer_free(guac_common_transfer* transfer) {
+    free(transfer);
+}
+
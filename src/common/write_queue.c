@@ -0,0 +1,341 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "config.h"
+#include "common/write_queue.h"
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * Writes all of the given data using the write handler of the given queue,
+ * retrying as necessary to handle short writes.
+ *
+ * @param queue
+ *     The write queue whose handler should be invoked.
+ *
+ * @param offset
+ *     The offset at which the data should be written, in bytes from the start
+ *     of the destination.
+ *
+ * @param buffer
+ *     The data to write.
+ *
+ * @param length
+ *     The number of bytes to write.
+ *
+ * @return
+ *     Zero if all data was written, non-zero if the write handler failed or
+ *     made no progress.
+ */
+static int guac_common_write_queue_write_all(guac_common_write_queue* queue,
+        uint64_t offset, const char* buffer, int length) {
+
+    while (length > 0) {
+
+        int written = queue->write_handler(queue->data, offset, buffer,
+                length);
+        if (written <= 0)
+            return 1;
+
+        offset += written;
+        buffer += written;
+        length -= written;
+
+    }
+
+    return 0;
+
+}
+
+/**
+ * Copies as much of the given data as fits into the free space of the ring
+ * buffer of the given queue. The lock of the queue must be held.
+ *
+ * @param queue
+ *     The write queue to copy data into.
+ *
+ * @param buffer
+ *     The data to copy.
+ *
+ * @param length
+ *     The number of bytes to copy.
+ *
+ * @return
+ *     The number of bytes copied, which may be fewer than requested if the
+ *     ring buffer has become full.
+ */
+static int guac_common_write_queue_fill(guac_common_write_queue* queue,
+        const char* buffer, int length) {
+
+    int copied = 0;
+
+    while (length > 0
+            && queue->length < GUAC_COMMON_WRITE_QUEUE_BUFFER_SIZE) {
+
+        /* Copy only into the contiguous space following the end */
+        int end = (queue->start + queue->length)
+                % GUAC_COMMON_WRITE_QUEUE_BUFFER_SIZE;
+
+        int available;
+        if (end >= queue->start)
+            available = GUAC_COMMON_WRITE_QUEUE_BUFFER_SIZE - end;
+        else
+            available = queue->start - end;
+
+        if (available > length)
+            available = length;
+
+        memcpy(queue->buffer + end, buffer, available);
+        queue->length += available;
+        buffer += available;
+        length -= available;
+        copied += available;
+
+    }
+
+    return copied;
+
+}
+
+/**
+ * Discards any overflow data of the given queue. The lock of the queue must
+ * be held.
+ *
+ * @param queue
+ *     The write queue whose overflow data should be discarded.
+ */
+static void guac_common_write_queue_discard_overflow(
+        guac_common_write_queue* queue) {
+
+    free(queue->overflow);
+    queue->overflow = NULL;
+    queue->overflow_length = 0;
+    queue->overflow_start = 0;
+
+}
+
+/**
+ * The thread of a write queue, writing queued data until the queue is closed
+ * and all data has been written, or until a write fails. Deferred
+ * acknowledgements are sent from this thread as soon as all overflow data
+ * has been moved into the ring buffer.
+ *
+ * @param data
+ *     The guac_common_write_queue whose data should be written.
+ *
+ * @return
+ *     Always NULL.
+ */
+static void* guac_common_write_queue_thread(void* data) {
+
+    guac_common_write_queue* queue = (guac_common_write_queue*) data;
+    uint64_t offset = 0;
+
+    pthread_mutex_lock(&(queue->lock));
+
+    for (;;) {
+
+        /* Wait for data, or for the queue to be closed (overflow data exists
+         * only while the ring buffer is full) */
+        while (queue->length == 0 && !queue->closing)
+            pthread_cond_wait(&(queue->modified), &(queue->lock));
+
+        /* Stop once closed and drained (writes stop on error, which also
+         * drains the queue) */
+        if (queue->length == 0)
+            break;
+
+        /* Write everything queued so far, up to the end of the buffer, as a
+         * single chunk */
+        int start = queue->start;
+        int size = queue->length;
+        if (size > GUAC_COMMON_WRITE_QUEUE_WRITE_SIZE)
+            size = GUAC_COMMON_WRITE_QUEUE_WRITE_SIZE;
+        if (size > GUAC_COMMON_WRITE_QUEUE_BUFFER_SIZE - start)
+            size = GUAC_COMMON_WRITE_QUEUE_BUFFER_SIZE - start;
+
+        /* The chunk remains part of the queued data, and thus cannot be
+         * overwritten, until the write completes */
+        pthread_mutex_unlock(&(queue->lock));
+        int failed = guac_common_write_queue_write_all(queue, offset,
+                queue->buffer + start, size);
+        pthread_mutex_lock(&(queue->lock));
+
+        /* Discard all queued data if the write failed */
+        if (failed) {
+            queue->error = 1;
+            queue->length = 0;
+            guac_common_write_queue_discard_overflow(queue);
+        }
+
+        else {
+
+            queue->start = (start + size) % GUAC_COMMON_WRITE_QUEUE_BUFFER_SIZE;
+            queue->length -= size;
+            offset += size;
+
+            /* Move as much overflow data as now fits into the ring buffer */
+            if (queue->overflow_length > 0) {
+
+                int copied = guac_common_write_queue_fill(queue,
+                        queue->overflow + queue->overflow_start,
+                        queue->overflow_length);
+
+                queue->overflow_start += copied;
+                queue->overflow_length -= copied;
+
+                if (queue->overflow_length == 0)
+                    guac_common_write_queue_discard_overflow(queue);
+
+            }
+
+        }
+
+        /* Acknowledge deferred data once it has all been queued, or once it
+         * has been discarded due to failure */
+        if (queue->ack_pending && queue->overflow_length == 0
+                && !queue->closing) {
+
+            int error = queue->error;
+            queue->ack_pending = 0;
+
+            pthread_mutex_unlock(&(queue->lock));
+            queue->ack_handler(queue->data, error);
+            pthread_mutex_lock(&(queue->lock));
+
+        }
+
+    }
+
+    pthread_mutex_unlock(&(queue->lock));
+    return NULL;
+
+}
+
+guac_common_write_queue* guac_common_write_queue_alloc(
+        guac_common_write_queue_write_handler* write_handler,
+        guac_common_write_queue_ack_handler* ack_handler, void* data) {
+
+    guac_common_write_queue* queue = malloc(sizeof(guac_common_write_queue));
+    if (queue == NULL)
+        return NULL;
+
+    queue->write_handler = write_handler;
+    queue->ack_handler = ack_handler;
+    queue->data = data;
+    queue->start = 0;
+    queue->length = 0;
+    queue->overflow = NULL;
+    queue->overflow_length = 0;
+    queue->overflow_start = 0;
+    queue->ack_pending = 0;
+    queue->error = 0;
+    queue->closing = 0;
+
+    pthread_mutex_init(&(queue->lock), NULL);
+    pthread_cond_init(&(queue->modified), NULL);
+
+    if (pthread_create(&(queue->thread), NULL,
+                guac_common_write_queue_thread, queue)) {
+        pthread_cond_destroy(&(queue->modified));
+        pthread_mutex_destroy(&(queue->lock));
+        free(queue);
+        return NULL;
+    }
+
+    return queue;
+
+}
+
+guac_common_write_queue_status guac_common_write_queue_write(
+        guac_common_write_queue* queue, const char* buffer, int length) {
+
+    pthread_mutex_lock(&(queue->lock));
+
+    if (queue->error) {
+        pthread_mutex_unlock(&(queue->lock));
+        return GUAC_COMMON_WRITE_QUEUE_FAILED;
+    }
+
+    /* Copy as much as fits directly into the ring buffer, preserving order
+     * with respect to any data already held aside */
+    if (queue->overflow_length == 0) {
+        int copied = guac_common_write_queue_fill(queue, buffer, length);
+        buffer += copied;
+        length -= copied;
+    }
+
+    guac_common_write_queue_status status = GUAC_COMMON_WRITE_QUEUE_QUEUED;
+
+    /* Hold aside whatever does not fit, deferring its acknowledgement until
+     * it has been moved into the ring buffer */
+    if (length > 0) {
+
+        char* overflow = malloc(queue->overflow_length + length);
+        if (overflow == NULL) {
+            queue->error = 1;
+            pthread_mutex_unlock(&(queue->lock));
+            return GUAC_COMMON_WRITE_QUEUE_FAILED;
+        }
+
+        if (queue->overflow_length > 0)
+            memcpy(overflow, queue->overflow + queue->overflow_start,
+                    queue->overflow_length);
+        memcpy(overflow + queue->overflow_length, buffer, length);
+
+        free(queue->overflow);
+        queue->overflow = overflow;
+        queue->overflow_start = 0;
+        queue->overflow_length += length;
+
+        queue->ack_pending = 1;
+        status = GUAC_COMMON_WRITE_QUEUE_DEFERRED;
+
+    }
+
+    pthread_cond_broadcast(&(queue->modified));
+    pthread_mutex_unlock(&(queue->lock));
+
+    return status;
+
+}
+
+int guac_common_write_queue_free(guac_common_write_queue* queue) {
+
+    /* Allow the thread to exit once all queued data is written */
+    pthread_mutex_lock(&(queue->lock));
+    queue->closing = 1;
+    pthread_cond_broadcast(&(queue->modified));
+    pthread_mutex_unlock(&(queue->lock));
+
+    pthread_join(queue->thread, NULL);
+
+    int error = queue->error;
+
+    free(queue->overflow);
+    pthread_cond_destroy(&(queue->modified));
+    pthread_mutex_destroy(&(queue->lock));
+    free(queue);
+
+    return error;
+
+}
@@ -64,7 +64,40 @@ void guac_drv_drawable_copy_fb(DrawablePtr src, int srcx, int srcy,
     if (srcw <= 0 || srch <= 0)
         return;
 
-    /* Retrieve image contents */
+    FbBits* bits;
+    FbStride stride;
+    int bpp;
+    int xoff;
+    int yoff;
+
+    /* Locate backing memory of the framebuffer containing the source */
+    fbGetDrawable(src, bits, stride, bpp, xoff, yoff);
+
+    /* If the framebuffer is already 32bpp, read the damaged rectangle in
+     * place using the framebuffer's own stride, avoiding any intermediate
+     * copy of the image data */
+    if (bpp == 32) {
+
+        /* Locate upper-left corner of rectangle within framebuffer (fb
+         * reports stride in units of FbBits) */
+        char* data = (char*) bits
+            + (srcy + src->y + yoff) * stride * sizeof(FbBits)
+            + (srcx + src->x + xoff) * 4;
+
+        guac_drv_drawable_put(dst, data, GUAC_DRV_DRAWABLE_RGB_24,
+                stride * sizeof(FbBits), dstx, dsty, srcw, srch);
+
+        fbFinishAccess(src);
+        return;
+
+    }
+
+    fbFinishAccess(src);
+
+    /* Otherwise, copy image contents into a packed buffer, as was always
+     * done before the in-place path above. fbGetImage() performs no pixel
+     * format conversion, so the buffer receives pixels in the drawable's own
+     * format, which is interpreted as 32bpp RGB exactly as before */
     char* buffer = malloc(srcw * srch * 4);
     fbGetImage(src, srcx, srcy, srcw, srch, ZPixmap, FB_ALLONES, buffer);
 
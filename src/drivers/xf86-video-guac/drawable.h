@@ -284,7 +284,10 @@ void guac_drv_drawable_stub(guac_drv_drawable* drawable, int dx, int dy,
  * Copies a rectangle of image data from a given source drawable, drawing it
  * to the given Guacamole-specific drawable via a normal image update. The
  * image data is copied from the "fb" module, and is thus independent of any
- * Guacamole-specific image state.
+ * Guacamole-specific image state. If the framebuffer is 32bpp, the image data
+ * is read directly from the framebuffer's backing memory without any
+ * intermediate buffer, such that only the damaged rectangle is copied, and
+ * only once.
  */
 void guac_drv_drawable_copy_fb(DrawablePtr src, int srcx, int srcy,
         int srcw, int srch, guac_drv_drawable* dst, int dstx, int dsty);
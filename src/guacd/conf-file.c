@@ -24,8 +24,10 @@
 #include "conf-parse.h"
 
 #include <guacamole/client.h>
+#include <guacamole/user-constants.h>
 
 #include <errno.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -89,6 +91,33 @@ static int guacd_conf_callback(const char* section, const char* param, const cha
 
         }
 
+        /* Processes to create in advance */
+        else if (strcmp(param, "prefork") == 0) {
+            free(config->prefork);
+            config->prefork = strdup(value);
+            return 0;
+        }
+
+        /* Output queued per user */
+        else if (strcmp(param, "output_queue_limit") == 0) {
+
+            char* end;
+            errno = 0;
+            unsigned long long limit = strtoull(value, &end, 10);
+
+            /* Invalid limit */
+            if (errno || end == value || *end != '\0' || limit == 0
+                    || limit > SIZE_MAX) {
+                guacd_conf_parse_error = "Invalid output queue limit. The "
+                    "limit must be a positive number of bytes.";
+                return 1;
+            }
+
+            config->output_queue_limit = limit;
+            return 0;
+
+        }
+
     }
 
     /* SSL-specific options */
@@ -181,6 +210,8 @@ guacd_config* guacd_conf_load() {
     conf->pidfile = NULL;
     conf->foreground = 0;
     conf->print_version = 0;
+    conf->prefork = NULL;
+    conf->output_queue_limit = GUAC_USER_OUTPUT_QUEUE_LIMIT;
     conf->max_log_level = GUAC_LOG_INFO;
 
 #ifdef ENABLE_SSL
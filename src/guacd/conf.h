@@ -66,6 +66,20 @@ typedef struct guacd_config {
     char* key_file;
 #endif
 
+    /**
+     * The protocols for which processes should be created in advance, and the
+     * number of such processes to keep waiting for each protocol, as a
+     * comma-separated list of PROTOCOL:COUNT pairs. If no processes should be
+     * created in advance, this will be NULL.
+     */
+    char* prefork;
+
+    /**
+     * The maximum number of bytes of output which may be queued for any one
+     * user of a connection before output is dropped for that user.
+     */
+    size_t output_queue_limit;
+
     /**
      * The maximum log level to be logged by guacd.
      */
@@ -19,11 +19,18 @@
 
 #include "config.h"
 
+/* splice() is a GNU extension */
+#ifdef HAVE_SPLICE
+#define _GNU_SOURCE
+#endif
+
 #include "connection.h"
 #include "log.h"
 #include "move-fd.h"
 #include "proc.h"
 #include "proc-map.h"
+#include "proc-pool.h"
+#include "relay.h"
 
 #include <guacamole/client.h>
 #include <guacamole/error.h>
@@ -39,11 +46,20 @@
 #endif
 
 #include <errno.h>
+#include <fcntl.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <sys/wait.h>
+#include <unistd.h>
+
+/**
+ * The maximum number of bytes to transfer through the intermediate pipe with
+ * each call to splice(). This is equal to the default capacity of a pipe on
+ * Linux.
+ */
+#define GUACD_SPLICE_BLOCK_SIZE 65536
 
 /**
  * Behaves exactly as write(), but writes as much as possible, returning
@@ -82,6 +98,92 @@ static int __write_all(int fd, char* buffer, int length) {
 
 }
 
+/**
+ * Continuously transfers all data from one file descriptor to another using
+ * splice() and an intermediate pipe, such that the data never passes through
+ * userspace. The transfer terminates when end-of-file is reached on the input
+ * file descriptor or when either file descriptor fails.
+ *
+ * If splice() cannot be used with the given file descriptors at all (the
+ * kernel lacks support, or the file descriptors are of a type that does not
+ * support splice()), no data is transferred and non-zero is returned, in which
+ * case the caller should fall back to copying the data manually.
+ *
+ * @param in_fd
+ *     The file descriptor to read data from.
+ *
+ * @param out_fd
+ *     The file descriptor to write data to.
+ *
+ * @return
+ *     Zero if the transfer took place and has now terminated, non-zero if
+ *     splice() cannot be used and no data was transferred.
+ */
+static int guacd_connection_splice(int in_fd, int out_fd) {
+
+#ifdef HAVE_SPLICE
+
+    int pipe_fds[2];
+    int transferred = 0;
+
+    if (pipe(pipe_fds) < 0)
+        return 1;
+
+    for (;;) {
+
+        /* Move as much data as is available into the pipe */
+        ssize_t length = splice(in_fd, NULL, pipe_fds[1], NULL,
+                GUACD_SPLICE_BLOCK_SIZE, SPLICE_F_MOVE);
+
+        /* Retry if interrupted */
+        if (length < 0 && errno == EINTR)
+            continue;
+
+        /* Fall back to copying if splice() is unsupported for the given
+         * file descriptors */
+        if (length < 0 && !transferred
+                && (errno == EINVAL || errno == ENOSYS)) {
+            close(pipe_fds[0]);
+            close(pipe_fds[1]);
+            return 1;
+        }
+
+        /* Stop at end-of-file or error */
+        if (length <= 0)
+            break;
+
+        transferred = 1;
+
+        /* Drain the entire contents of the pipe into the output */
+        while (length > 0) {
+
+            ssize_t written = splice(pipe_fds[0], NULL, out_fd, NULL,
+                    length, SPLICE_F_MOVE);
+
+            if (written < 0 && errno == EINTR)
+                continue;
+
+            if (written <= 0)
+                goto done;
+
+            length -= written;
+
+        }
+
+    }
+
+done:
+    close(pipe_fds[0]);
+    close(pipe_fds[1]);
+    return 0;
+
+#else
+    /* Data must always be copied if splice() is not available */
+    return 1;
+#endif
+
+}
+
 /**
  * Continuously reads from a guac_socket, writing all data read to a file
  * descriptor. Any data already buffered from that guac_socket by a given
@@ -89,6 +191,9 @@ static int __write_all(int fd, char* buffer, int length) {
  * guac_socket. The provided guac_parser will be freed once its buffers have
  * been emptied, but the guac_socket will not.
  *
+ * If the guac_socket is not using SSL/TLS, data is transferred directly from
+ * its underlying file descriptor using splice(), bypassing the guac_socket.
+ *
  * This thread ultimately terminates when no further data can be read from the
  * guac_socket.
  *
@@ -117,10 +222,16 @@ static void* guacd_connection_write_thread(void* data) {
     /* Parser is no longer needed */
     guac_parser_free(params->parser);
 
-    /* Transfer data from file descriptor to socket */
-    while ((length = guac_socket_read(params->socket, buffer, sizeof(buffer))) > 0) {
-        if (__write_all(params->fd, buffer, length) < 0)
-            break;
+    /* Transfer data from socket to file descriptor without copying, if
+     * possible, otherwise transfer that data manually */
+    if (params->relay_fd == -1
+            || guacd_connection_splice(params->relay_fd, params->fd)) {
+
+        while ((length = guac_socket_read(params->socket, buffer, sizeof(buffer))) > 0) {
+            if (__write_all(params->fd, buffer, length) < 0)
+                break;
+        }
+
     }
 
     return NULL;
@@ -137,11 +248,17 @@ void* guacd_connection_io_thread(void* data) {
     pthread_t write_thread;
     pthread_create(&write_thread, NULL, guacd_connection_write_thread, params);
 
-    /* Transfer data from file descriptor to socket */
-    while ((length = read(params->fd, buffer, sizeof(buffer))) > 0) {
-        if (guac_socket_write(params->socket, buffer, length))
-            break;
-        guac_socket_flush(params->socket);
+    /* Transfer data from file descriptor to socket without copying, if
+     * possible, otherwise transfer that data manually */
+    if (params->relay_fd == -1
+            || guacd_connection_splice(params->fd, params->relay_fd)) {
+
+        while ((length = read(params->fd, buffer, sizeof(buffer))) > 0) {
+            if (guac_socket_write(params->socket, buffer, length))
+                break;
+            guac_socket_flush(params->socket);
+        }
+
     }
 
     /* Wait for write thread to die */
@@ -158,7 +275,8 @@ void* guacd_connection_io_thread(void* data) {
 
 /**
  * Adds the given socket as a new user to the given process, automatically
- * reading/writing from the socket via read/write threads. The given socket,
+ * reading/writing from the socket via the given relay or, if the relay cannot
+ * be used, via read/write threads. The given socket,
  * parser, and any associated resources will be freed unless the user is not
  * added successfully.
  *
@@ -176,10 +294,21 @@ void* guacd_connection_io_thread(void* data) {
  *     The socket associated with the user to be added to the existing
  *     process.
  *
+ * @param relay
+ *     The shared relay which should transfer data for the user if possible,
+ *     or NULL if data must be transferred by dedicated threads.
+ *
+ * @param relay_fd
+ *     The file descriptor underlying the given guac_socket, if data may be
+ *     transferred to and from that file descriptor directly, or -1 if all
+ *     data must be transferred through the guac_socket (such as when SSL/TLS
+ *     is in use).
+ *
  * @return
  *     Zero if the user was added successfully, non-zero if an error occurred.
  */
-static int guacd_add_user(guacd_proc* proc, guac_parser* parser, guac_socket* socket) {
+static int guacd_add_user(guacd_proc* proc, guac_parser* parser,
+        guac_socket* socket, guacd_relay* relay, int relay_fd) {
 
     int sockets[2];
 
@@ -201,10 +330,16 @@ static int guacd_add_user(guacd_proc* proc, guac_parser* parser, guac_socket* so
     /* Close our end of the process file descriptor */
     close(proc_fd);
 
+    /* Transfer all further data using the shared relay, if possible */
+    if (relay != NULL && relay_fd != -1
+            && !guacd_relay_add(relay, parser, socket, relay_fd, user_fd))
+        return 0;
+
     guacd_connection_io_thread_params* params = malloc(sizeof(guacd_connection_io_thread_params));
     params->parser = parser;
     params->socket = socket;
     params->fd = user_fd;
+    params->relay_fd = relay_fd;
 
     /* Start I/O thread */
     pthread_t io_thread;
@@ -227,15 +362,30 @@ static int guacd_add_user(guacd_proc* proc, guac_parser* parser, guac_socket* so
  * @param map
  *     The map of existing client processes.
  *
+ * @param pool
+ *     The pool of processes created in advance for new connections, or NULL
+ *     if all processes must be created on demand.
+ *
  * @param socket
  *     The socket associated with the new connection that must be routed to
  *     a new or existing process within the given map.
  *
+ * @param relay
+ *     The shared relay which should transfer data for the connection if
+ *     possible, or NULL if data must be transferred by dedicated threads.
+ *
+ * @param relay_fd
+ *     The file descriptor underlying the given guac_socket, if data may be
+ *     transferred to and from that file descriptor directly, or -1 if all
+ *     data must be transferred through the guac_socket (such as when SSL/TLS
+ *     is in use).
+ *
  * @return
  *     Zero if the connection was successfully routed, non-zero if routing has
  *     failed.
  */
-static int guacd_route_connection(guacd_proc_map* map, guac_socket* socket) {
+static int guacd_route_connection(guacd_proc_map* map, guacd_proc_pool* pool,
+        guac_socket* socket, guacd_relay* relay, int relay_fd) {
 
     guac_parser* parser = guac_parser_alloc();
 
@@ -294,8 +444,18 @@ static int guacd_route_connection(guacd_proc_map* map, guac_socket* socket) {
         guacd_log(GUAC_LOG_INFO, "Creating new client for protocol \"%s\"",
                 identifier);
 
-        /* Create new process */
-        proc = guacd_create_proc(identifier);
+        /* Use a waiting process if available, creating a new process only
+         * if necessary */
+        proc = NULL;
+        if (pool != NULL)
+            proc = guacd_proc_pool_take(pool, identifier);
+
+        if (proc != NULL)
+            guacd_log(GUAC_LOG_DEBUG, "Using waiting process for protocol "
+                    "\"%s\"", identifier);
+        else
+            proc = guacd_create_proc(identifier);
+
         new_process = 1;
 
     }
@@ -308,7 +468,8 @@ static int guacd_route_connection(guacd_proc_map* map, guac_socket* socket) {
     }
 
     /* Add new user (in the case of a new process, this will be the owner */
-    int add_user_failed = guacd_add_user(proc, parser, socket);
+    int add_user_failed = guacd_add_user(proc, parser, socket,
+            relay, relay_fd);
 
     /* If new process was created, manage that process */
     if (new_process) {
@@ -367,6 +528,9 @@ void* guacd_connection_thread(void* data) {
 
     guac_socket* socket;
 
+    /* Data may be relayed directly unless SSL/TLS is in use */
+    int relay_fd = connected_socket_fd;
+
 #ifdef ENABLE_SSL
 
     SSL_CTX* ssl_context = params->ssl_context;
@@ -380,6 +544,7 @@ void* guacd_connection_thread(void* data) {
             free(params);
             return NULL;
         }
+        relay_fd = -1;
     }
     else
         socket = guac_socket_open(connected_socket_fd);
@@ -390,7 +555,8 @@ void* guacd_connection_thread(void* data) {
 #endif
 
     /* Route connection according to Guacamole, creating a new process if needed */
-    if (guacd_route_connection(map, socket))
+    if (guacd_route_connection(map, params->pool, socket,
+                params->relay, relay_fd))
         guac_socket_free(socket);
 
     free(params);
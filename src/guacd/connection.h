@@ -23,6 +23,8 @@
 #include "config.h"
 
 #include "proc-map.h"
+#include "proc-pool.h"
+#include "relay.h"
 
 #ifdef ENABLE_SSL
 #include <openssl/ssl.h>
@@ -38,6 +40,19 @@ typedef struct guacd_connection_thread_params {
      */
     guacd_proc_map* map;
 
+    /**
+     * The shared pool of processes created in advance for new connections,
+     * or NULL if all processes must be created on demand.
+     */
+    guacd_proc_pool* pool;
+
+    /**
+     * The shared relay which should transfer data for all connections not
+     * using SSL/TLS, or NULL if each connection must be relayed by its own
+     * threads.
+     */
+    guacd_relay* relay;
+
 #ifdef ENABLE_SSL
     /**
      * SSL context for encrypted connections to guacd. If SSL is not active,
@@ -98,6 +113,15 @@ typedef struct guacd_connection_io_thread_params {
      */
     int fd;
 
+    /**
+     * The file descriptor underlying the guac_socket, if data may be
+     * transferred directly between that file descriptor and the
+     * connection-specific process using splice(), bypassing the guac_socket
+     * entirely. If the guac_socket must be used (such as when SSL/TLS is in
+     * use), this will be -1.
+     */
+    int relay_fd;
+
 } guacd_connection_io_thread_params;
 
 /**
@@ -25,6 +25,9 @@
 #include "connection.h"
 #include "log.h"
 #include "proc-map.h"
+#include "proc-pool.h"
+#include "proc.h"
+#include "relay.h"
 
 #ifdef ENABLE_SSL
 #include <openssl/ssl.h>
@@ -197,6 +200,7 @@ int main(int argc, char* argv[]) {
 
     /* Init logging as early as possible */
     guacd_log_level = config->max_log_level;
+    guacd_output_queue_limit = config->output_queue_limit;
     openlog(GUACD_LOG_NAME, LOG_PID, LOG_DAEMON);
 
     /* Log start */
@@ -358,6 +362,22 @@ int main(int argc, char* argv[]) {
                 "Child processes may pile up in the process table.");
     }
 
+    /* Relay connection data with a single shared event loop if possible */
+    guacd_relay* relay = guacd_relay_alloc();
+    if (relay == NULL)
+        guacd_log(GUAC_LOG_DEBUG, "Shared connection relay unavailable. "
+                "Each connection will be relayed by dedicated threads.");
+
+    /* Create processes for new connections in advance if requested */
+    guacd_proc_pool* pool = NULL;
+    if (config->prefork != NULL) {
+        pool = guacd_proc_pool_alloc(config->prefork);
+        if (pool == NULL) {
+            guacd_log(GUAC_LOG_ERROR, "Could not create process pool.");
+            exit(EXIT_FAILURE);
+        }
+    }
+
     /* Log listening status */
     guacd_log(GUAC_LOG_INFO, "Listening on host %s, port %s", bound_address, bound_port);
 
@@ -393,6 +413,8 @@ int main(int argc, char* argv[]) {
         }
 
         params->map = map;
+        params->pool = pool;
+        params->relay = relay;
         params->connected_socket_fd = connected_socket_fd;
 
 #ifdef ENABLE_SSL
@@ -0,0 +1,290 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "config.h"
+
+#include "log.h"
+#include "proc.h"
+#include "proc-pool.h"
+
+#include <guacamole/client.h>
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+/**
+ * Frees the parent's view of the given process, which has not received any
+ * users, signalling the process to stop if it is still running.
+ *
+ * @param proc
+ *     The process to free.
+ */
+static void guacd_proc_pool_free_proc(guacd_proc* proc) {
+    guacd_proc_stop(proc);
+    guac_client_free(proc->client);
+    free(proc);
+}
+
+/**
+ * Returns whether the given process is still running. As guacd ignores
+ * SIGCHLD, child processes are reaped automatically upon termination, and
+ * waitpid() will fail for any process which has exited.
+ *
+ * @param proc
+ *     The process to test.
+ *
+ * @return
+ *     Non-zero if the process is still running, zero otherwise.
+ */
+static int guacd_proc_pool_is_running(guacd_proc* proc) {
+    return waitpid(proc->pid, NULL, WNOHANG) == 0;
+}
+
+/**
+ * Creates new processes for every protocol within the given pool until each
+ * protocol has its configured number of waiting processes. The pool lock must
+ * be held when this function is invoked. The lock is released while each
+ * process is created, such that connections may continue to take processes
+ * from the pool. If a process cannot be created, refilling is abandoned until
+ * it is next requested.
+ *
+ * @param pool
+ *     The pool to refill.
+ */
+static void guacd_proc_pool_refill(guacd_proc_pool* pool) {
+
+    int i;
+    for (i = 0; i < pool->protocol_count; i++) {
+
+        guacd_proc_pool_protocol* current = &(pool->protocols[i]);
+        while (current->count < current->size) {
+
+            /* Create process without blocking other users of the pool */
+            pthread_mutex_unlock(&(pool->lock));
+            guacd_proc* proc = guacd_create_proc(current->protocol);
+            pthread_mutex_lock(&(pool->lock));
+
+            if (proc == NULL) {
+                guacd_log(GUAC_LOG_WARNING, "Unable to create waiting "
+                        "process for protocol \"%s\".", current->protocol);
+                return;
+            }
+
+            /* Discard process if pool has been filled in the meantime */
+            if (current->count >= current->size) {
+                guacd_proc_pool_free_proc(proc);
+                break;
+            }
+
+            current->procs[current->count++] = proc;
+
+        }
+
+    }
+
+}
+
+/**
+ * Refills the given pool whenever a refill is requested, never returning.
+ *
+ * @param data
+ *     A pointer to the guacd_proc_pool to refill.
+ *
+ * @return
+ *     Always NULL.
+ */
+static void* guacd_proc_pool_refill_thread(void* data) {
+
+    guacd_proc_pool* pool = (guacd_proc_pool*) data;
+
+    pthread_mutex_lock(&(pool->lock));
+
+    for (;;) {
+
+        /* Wait until a process has been taken */
+        while (!pool->refill_requested)
+            pthread_cond_wait(&(pool->refill_cond), &(pool->lock));
+
+        pool->refill_requested = 0;
+        guacd_proc_pool_refill(pool);
+
+    }
+
+    return NULL;
+
+}
+
+/**
+ * Parses the given PROTOCOL:COUNT pair, storing the result within the given
+ * guacd_proc_pool_protocol. The count of waiting processes is initialized to
+ * zero.
+ *
+ * @param entry
+ *     The PROTOCOL:COUNT pair to parse.
+ *
+ * @param protocol
+ *     The guacd_proc_pool_protocol to store the parsed protocol and number
+ *     of processes within.
+ *
+ * @return
+ *     Zero if the pair was parsed successfully, non-zero otherwise.
+ */
+static int guacd_proc_pool_parse_protocol(const char* entry,
+        guacd_proc_pool_protocol* protocol) {
+
+    const char* separator = strchr(entry, ':');
+    if (separator == NULL || separator == entry)
+        return 1;
+
+    /* Parse number of processes */
+    char* end;
+    long size = strtol(separator + 1, &end, 10);
+    if (separator[1] == '\0' || *end != '\0'
+            || size < 0 || size > GUACD_PROC_POOL_MAX_SIZE)
+        return 1;
+
+    protocol->protocol = strndup(entry, separator - entry);
+    protocol->size = size;
+    protocol->count = 0;
+
+    return protocol->protocol == NULL;
+
+}
+
+guacd_proc_pool* guacd_proc_pool_alloc(const char* spec) {
+
+    guacd_proc_pool* pool = calloc(1, sizeof(guacd_proc_pool));
+    if (pool == NULL)
+        return NULL;
+
+    char* entries = strdup(spec);
+    if (entries == NULL) {
+        free(pool);
+        return NULL;
+    }
+
+    /* Allocate one protocol for each comma-separated entry */
+    int count = 1;
+    char* current;
+    for (current = entries; *current != '\0'; current++) {
+        if (*current == ',')
+            count++;
+    }
+
+    pool->protocols = calloc(count, sizeof(guacd_proc_pool_protocol));
+    if (pool->protocols == NULL)
+        goto fail;
+
+    /* Parse each PROTOCOL:COUNT pair */
+    char* saveptr;
+    char* entry = strtok_r(entries, ",", &saveptr);
+    while (entry != NULL) {
+
+        if (guacd_proc_pool_parse_protocol(entry,
+                    &(pool->protocols[pool->protocol_count]))) {
+            guacd_log(GUAC_LOG_ERROR, "Invalid process pool entry \"%s\". "
+                    "Entries must be of the form PROTOCOL:COUNT, where COUNT "
+                    "is no greater than %i.", entry, GUACD_PROC_POOL_MAX_SIZE);
+            goto fail;
+        }
+
+        pool->protocol_count++;
+        entry = strtok_r(NULL, ",", &saveptr);
+
+    }
+
+    pthread_mutex_init(&(pool->lock), NULL);
+    pthread_cond_init(&(pool->refill_cond), NULL);
+
+    /* Fill pool immediately */
+    pool->refill_requested = 1;
+
+    if (pthread_create(&(pool->refill_thread), NULL,
+                guacd_proc_pool_refill_thread, pool)) {
+        guacd_log(GUAC_LOG_ERROR, "Unable to start process pool thread.");
+        pthread_cond_destroy(&(pool->refill_cond));
+        pthread_mutex_destroy(&(pool->lock));
+        goto fail;
+    }
+
+    pthread_detach(pool->refill_thread);
+    free(entries);
+    return pool;
+
+fail:
+    if (pool->protocols != NULL) {
+        int i;
+        for (i = 0; i < pool->protocol_count; i++)
+            free(pool->protocols[i].protocol);
+        free(pool->protocols);
+    }
+    free(entries);
+    free(pool);
+    return NULL;
+
+}
+
+guacd_proc* guacd_proc_pool_take(guacd_proc_pool* pool, const char* protocol) {
+
+    guacd_proc* proc = NULL;
+
+    pthread_mutex_lock(&(pool->lock));
+
+    int i;
+    for (i = 0; i < pool->protocol_count; i++) {
+
+        guacd_proc_pool_protocol* current = &(pool->protocols[i]);
+        if (strcmp(current->protocol, protocol) != 0)
+            continue;
+
+        /* Take the most recently created process which is still running */
+        while (proc == NULL && current->count > 0) {
+
+            proc = current->procs[--current->count];
+
+            /* Processes may have exited (for example, if the plugin for the
+             * protocol could not be loaded) */
+            if (!guacd_proc_pool_is_running(proc)) {
+                guacd_log(GUAC_LOG_WARNING, "Waiting process for protocol "
+                        "\"%s\" has terminated.", protocol);
+                guacd_proc_pool_free_proc(proc);
+                proc = NULL;
+            }
+
+        }
+
+        /* Replace any processes taken */
+        pool->refill_requested = 1;
+        pthread_cond_signal(&(pool->refill_cond));
+        break;
+
+    }
+
+    pthread_mutex_unlock(&(pool->lock));
+
+    return proc;
+
+}
+
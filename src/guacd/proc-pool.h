@@ -0,0 +1,143 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef GUACD_PROC_POOL_H
+#define GUACD_PROC_POOL_H
+
+#include "config.h"
+#include "proc.h"
+
+#include <pthread.h>
+
+/**
+ * The maximum number of processes which may be kept waiting for any one
+ * protocol.
+ */
+#define GUACD_PROC_POOL_MAX_SIZE 256
+
+/**
+ * The processes kept waiting for connections to a single protocol.
+ */
+typedef struct guacd_proc_pool_protocol {
+
+    /**
+     * The name of the protocol that each process has been initialized for.
+     */
+    char* protocol;
+
+    /**
+     * The number of processes which should be kept waiting for this protocol.
+     */
+    int size;
+
+    /**
+     * The number of processes currently waiting within procs.
+     */
+    int count;
+
+    /**
+     * Processes which have been created and initialized for this protocol,
+     * but have not yet received any users. Only the first count entries are
+     * valid.
+     */
+    guacd_proc* procs[GUACD_PROC_POOL_MAX_SIZE];
+
+} guacd_proc_pool_protocol;
+
+/**
+ * A set of pre-forked processes which have already loaded the client plugin
+ * for their protocol and are waiting for their first user, allowing new
+ * connections to skip the cost of fork() and loading the plugin. The pool is
+ * refilled in the background whenever a process is taken.
+ */
+typedef struct guacd_proc_pool {
+
+    /**
+     * The protocols for which processes are kept waiting.
+     */
+    guacd_proc_pool_protocol* protocols;
+
+    /**
+     * The number of entries within protocols.
+     */
+    int protocol_count;
+
+    /**
+     * Lock which guards access to all processes within the pool, as well as
+     * the refill_requested flag.
+     */
+    pthread_mutex_t lock;
+
+    /**
+     * Condition which is signalled whenever refill_requested is set.
+     */
+    pthread_cond_t refill_cond;
+
+    /**
+     * Non-zero if the pool should be refilled by the refill thread, zero
+     * otherwise.
+     */
+    int refill_requested;
+
+    /**
+     * The thread which creates new processes to refill the pool.
+     */
+    pthread_t refill_thread;
+
+} guacd_proc_pool;
+
+/**
+ * Allocates a new process pool for the protocols described by the given
+ * string, starting the thread which fills that pool. The string must be a
+ * comma-separated list of PROTOCOL:COUNT pairs, where COUNT is the number of
+ * processes to keep waiting for the protocol PROTOCOL, such as "rdp:8,vnc:2".
+ * There is intended to be at most one pool, which persists for the life of
+ * guacd. As the pool is filled by a thread, this function must not be
+ * invoked prior to daemonizing.
+ *
+ * @param spec
+ *     The protocols and number of processes to keep waiting for each
+ *     protocol.
+ *
+ * @return
+ *     A newly-allocated process pool, or NULL if the given string is invalid
+ *     or the pool could not be allocated.
+ */
+guacd_proc_pool* guacd_proc_pool_alloc(const char* spec);
+
+/**
+ * Removes and returns a waiting process for the given protocol from the
+ * given pool, requesting that the pool be refilled in the background. The
+ * returned process is equivalent to one returned by guacd_create_proc().
+ *
+ * @param pool
+ *     The pool to take a process from.
+ *
+ * @param protocol
+ *     The protocol that the process must have been initialized for.
+ *
+ * @return
+ *     A process initialized for the given protocol, or NULL if no such
+ *     process is waiting within the pool, in which case the caller should
+ *     create a new process with guacd_create_proc().
+ */
+guacd_proc* guacd_proc_pool_take(guacd_proc_pool* pool, const char* protocol);
+
+#endif
+
@@ -43,6 +43,8 @@
 #include <sys/socket.h>
 #include <sys/wait.h>
 
+size_t guacd_output_queue_limit = GUAC_USER_OUTPUT_QUEUE_LIMIT;
+
 /**
  * Parameters for the user thread.
  */
@@ -422,6 +424,9 @@ guacd_proc* guacd_create_proc(const char* protocol) {
     /* Init logging */
     proc->client->log_handler = guacd_client_log;
 
+    /* Apply configured limit on output queued for each user */
+    proc->client->output_queue_limit = guacd_output_queue_limit;
+
     /* Fork */
     proc->pid = fork();
     if (proc->pid < 0) {
@@ -80,6 +80,14 @@ typedef struct guacd_proc {
 
 } guacd_proc;
 
+/**
+ * The maximum number of bytes of output which may be queued for any one user
+ * of a connection before output is dropped for that user, as assigned to the
+ * output_queue_limit of each guac_client created by guacd_create_proc(). This
+ * defaults to GUAC_USER_OUTPUT_QUEUE_LIMIT.
+ */
+extern size_t guacd_output_queue_limit;
+
 /**
  * Creates a new background process for handling the given protocol, returning
  * a structure allowing communication with and monitoring of the process
@@ -0,0 +1,666 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "config.h"
+
+/* splice() is a GNU extension */
+#ifdef HAVE_SPLICE
+#define _GNU_SOURCE
+#endif
+
+#include "log.h"
+#include "relay.h"
+
+#include <guacamole/parser.h>
+#include <guacamole/socket.h>
+
+#ifdef HAVE_EPOLL
+#include <sys/epoll.h>
+#endif
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#ifdef HAVE_EPOLL
+
+/**
+ * Sets the O_NONBLOCK flag on the given file descriptor.
+ *
+ * @param fd
+ *     The file descriptor to modify.
+ *
+ * @return
+ *     Zero on success, non-zero if the flag could not be set.
+ */
+static int guacd_relay_set_nonblocking(int fd) {
+
+    int flags = fcntl(fd, F_GETFL);
+    if (flags < 0)
+        return 1;
+
+    return fcntl(fd, F_SETFL, flags | O_NONBLOCK) < 0;
+
+}
+
+/**
+ * Restores blocking mode on the given file descriptor, undoing a previous
+ * call to guacd_relay_set_nonblocking().
+ *
+ * @param fd
+ *     The file descriptor to place back into blocking mode.
+ *
+ * @return
+ *     Zero on success, non-zero if the file descriptor could not be placed
+ *     back into blocking mode.
+ */
+static int guacd_relay_set_blocking(int fd) {
+
+    int flags = fcntl(fd, F_GETFL);
+    if (flags < 0)
+        return 1;
+
+    return fcntl(fd, F_SETFL, flags & ~O_NONBLOCK) < 0;
+
+}
+
+/**
+ * Initializes the given direction of a relayed connection, allocating the
+ * pipe through which data will be moved using splice() or, if splice() is
+ * not available, the buffer through which data will be copied.
+ *
+ * @param direction
+ *     The direction to initialize.
+ *
+ * @param in_fd
+ *     The file descriptor that data should be read from.
+ *
+ * @param out_fd
+ *     The file descriptor that data should be written to.
+ *
+ * @return
+ *     Zero on success, non-zero if the necessary resources could not be
+ *     allocated.
+ */
+static int guacd_relay_direction_init(guacd_relay_direction* direction,
+        int in_fd, int out_fd) {
+
+    direction->in_fd = in_fd;
+    direction->out_fd = out_fd;
+    direction->pipe_fds[0] = -1;
+    direction->pipe_fds[1] = -1;
+    direction->buffer = NULL;
+    direction->offset = 0;
+    direction->length = 0;
+    direction->eof = 0;
+
+#ifdef HAVE_SPLICE
+    /* Move data through a pipe with splice() if possible */
+    if (pipe(direction->pipe_fds) == 0) {
+
+        /* Neither end of the pipe may block the relay thread */
+        if (!guacd_relay_set_nonblocking(direction->pipe_fds[0])
+                && !guacd_relay_set_nonblocking(direction->pipe_fds[1]))
+            return 0;
+
+        close(direction->pipe_fds[0]);
+        close(direction->pipe_fds[1]);
+        direction->pipe_fds[0] = -1;
+        direction->pipe_fds[1] = -1;
+
+    }
+#endif
+
+    /* Otherwise, copy data through a buffer */
+    direction->buffer = malloc(GUACD_RELAY_BLOCK_SIZE);
+    return direction->buffer == NULL;
+
+}
+
+/**
+ * Frees all resources associated with the given direction of a relayed
+ * connection. The file descriptors that data is read from and written to are
+ * not closed.
+ *
+ * @param direction
+ *     The direction to free.
+ */
+static void guacd_relay_direction_free(guacd_relay_direction* direction) {
+
+    if (direction->pipe_fds[0] != -1) {
+        close(direction->pipe_fds[0]);
+        close(direction->pipe_fds[1]);
+    }
+
+    free(direction->buffer);
+
+}
+
+/**
+ * Switches the given direction of a relayed connection from moving data with
+ * splice() to copying data through a buffer. This function may only be
+ * invoked while no data is pending within the pipe.
+ *
+ * @param direction
+ *     The direction to switch to copying data through a buffer.
+ *
+ * @return
+ *     Zero on success, non-zero if the buffer could not be allocated.
+ */
+static int guacd_relay_direction_use_buffer(guacd_relay_direction* direction) {
+
+    direction->buffer = malloc(GUACD_RELAY_BLOCK_SIZE);
+    if (direction->buffer == NULL)
+        return 1;
+
+    close(direction->pipe_fds[0]);
+    close(direction->pipe_fds[1]);
+    direction->pipe_fds[0] = -1;
+    direction->pipe_fds[1] = -1;
+
+    return 0;
+
+}
+
+/**
+ * Reads as much data as is immediately available from the input file
+ * descriptor of the given direction, up to GUACD_RELAY_BLOCK_SIZE bytes. This
+ * function may only be invoked while no data is pending.
+ *
+ * @param direction
+ *     The direction to read data for.
+ *
+ * @return
+ *     The number of bytes read, zero if end-of-file has been reached, or a
+ *     negative value if an error occurs, in which case errno will be set
+ *     appropriately.
+ */
+static ssize_t guacd_relay_direction_fill(guacd_relay_direction* direction) {
+
+#ifdef HAVE_SPLICE
+    if (direction->pipe_fds[0] != -1)
+        return splice(direction->in_fd, NULL, direction->pipe_fds[1], NULL,
+                GUACD_RELAY_BLOCK_SIZE, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+#endif
+
+    direction->offset = 0;
+    return read(direction->in_fd, direction->buffer, GUACD_RELAY_BLOCK_SIZE);
+
+}
+
+/**
+ * Writes as much pending data as possible to the output file descriptor of
+ * the given direction without blocking.
+ *
+ * @param direction
+ *     The direction to write pending data for.
+ *
+ * @return
+ *     The number of bytes written, or a negative value if an error occurs,
+ *     in which case errno will be set appropriately.
+ */
+static ssize_t guacd_relay_direction_drain(guacd_relay_direction* direction) {
+
+#ifdef HAVE_SPLICE
+    if (direction->pipe_fds[0] != -1)
+        return splice(direction->pipe_fds[0], NULL, direction->out_fd, NULL,
+                direction->length, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+#endif
+
+    ssize_t written = write(direction->out_fd,
+            direction->buffer + direction->offset, direction->length);
+
+    if (written > 0)
+        direction->offset += written;
+
+    return written;
+
+}
+
+/**
+ * Queues all data buffered by the given guac_parser as pending data within
+ * the given direction, such that it will be written before any further data
+ * is read. This function may only be invoked while no data is pending, and
+ * only if the direction copies data through a buffer or the parser has no
+ * buffered data (see guacd_relay_add()). As the parser buffer is smaller than
+ * GUACD_RELAY_BLOCK_SIZE, all buffered data will fit within the (empty)
+ * buffer of the direction.
+ *
+ * @param direction
+ *     The direction to queue data within.
+ *
+ * @param parser
+ *     The parser whose buffered data should be queued.
+ */
+static void guacd_relay_direction_prefill(guacd_relay_direction* direction,
+        guac_parser* parser) {
+
+    if (direction->buffer == NULL)
+        return;
+
+    direction->offset = 0;
+    direction->length = guac_parser_shift(parser, direction->buffer,
+            GUACD_RELAY_BLOCK_SIZE);
+
+}
+
+/**
+ * Transfers as much data as possible in the given direction without
+ * blocking. Once end-of-file is reached on the input file descriptor and all
+ * pending data has been written, the output file descriptor is shut down for
+ * writing, such that the recipient also sees end-of-file.
+ *
+ * @param direction
+ *     The direction to transfer data for.
+ *
+ * @return
+ *     Zero if data was transferred successfully or no further data can
+ *     currently be transferred without blocking, non-zero if an error
+ *     occurred and the connection should be closed.
+ */
+static int guacd_relay_direction_pump(guacd_relay_direction* direction) {
+
+    for (;;) {
+
+        /* Write out any pending data */
+        while (direction->length > 0) {
+
+            ssize_t written = guacd_relay_direction_drain(direction);
+            if (written < 0) {
+
+                /* Wait for output to become writable */
+                if (errno == EAGAIN || errno == EWOULDBLOCK)
+                    return 0;
+
+                if (errno == EINTR)
+                    continue;
+
+                return 1;
+
+            }
+
+            direction->length -= written;
+
+        }
+
+        /* Nothing further to transfer after end-of-file */
+        if (direction->eof)
+            return 0;
+
+        ssize_t length = guacd_relay_direction_fill(direction);
+        if (length < 0) {
+
+            /* Wait for input to become readable */
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+                return 0;
+
+            if (errno == EINTR)
+                continue;
+
+            /* Fall back to copying if splice() is unsupported for the given
+             * file descriptors */
+            if (errno == EINVAL && direction->pipe_fds[0] != -1
+                    && !guacd_relay_direction_use_buffer(direction))
+                continue;
+
+            return 1;
+
+        }
+
+        /* Propagate end-of-file to recipient */
+        if (length == 0) {
+            direction->eof = 1;
+            shutdown(direction->out_fd, SHUT_WR);
+            return 0;
+        }
+
+        direction->length = length;
+
+    }
+
+}
+
+/**
+ * Transfers as much data as possible in both directions of the given
+ * connection without blocking, closing the connection if an error occurs or
+ * if end-of-file has been reached in both directions. Closed connections are
+ * removed from the epoll instance immediately, but are only freed by the
+ * caller once all events from the current call to epoll_wait() have been
+ * handled.
+ *
+ * @param relay
+ *     The relay handling the given connection.
+ *
+ * @param connection
+ *     The connection to transfer data for.
+ *
+ * @param closed
+ *     Pointer to the list of connections awaiting deallocation. If the
+ *     connection is closed, it will be added to this list.
+ */
+static void guacd_relay_connection_pump(guacd_relay* relay,
+        guacd_relay_connection* connection, guacd_relay_connection** closed) {
+
+    /* Ignore any remaining events for closed connections */
+    if (connection->closed)
+        return;
+
+    int failed = guacd_relay_direction_pump(&connection->inbound)
+              || guacd_relay_direction_pump(&connection->outbound);
+
+    /* Continue relaying until both sides have finished */
+    if (!failed && !(connection->inbound.eof && connection->inbound.length == 0
+                && connection->outbound.eof && connection->outbound.length == 0))
+        return;
+
+    epoll_ctl(relay->epoll_fd, EPOLL_CTL_DEL, connection->inbound.in_fd, NULL);
+    epoll_ctl(relay->epoll_fd, EPOLL_CTL_DEL, connection->outbound.in_fd, NULL);
+
+    connection->closed = 1;
+    connection->next = *closed;
+    *closed = connection;
+
+}
+
+/**
+ * Frees the given relayed connection and all associated resources, including
+ * its guac_socket and the file descriptor of the connection-specific process.
+ *
+ * @param connection
+ *     The connection to free.
+ */
+static void guacd_relay_connection_free(guacd_relay_connection* connection) {
+
+    guacd_relay_direction_free(&connection->inbound);
+    guacd_relay_direction_free(&connection->outbound);
+
+    /* Closes the file descriptor of the user's connection */
+    guac_socket_free(connection->socket);
+
+    close(connection->inbound.out_fd);
+    free(connection);
+
+}
+
+/**
+ * Registers all pending connections with the epoll instance of the given
+ * relay, transferring any data which is already available.
+ *
+ * @param relay
+ *     The relay whose pending connections should be registered.
+ *
+ * @param closed
+ *     Pointer to the list of connections awaiting deallocation.
+ */
+static void guacd_relay_register_pending(guacd_relay* relay,
+        guacd_relay_connection** closed) {
+
+    char wake_buffer[64];
+
+    /* Clear all pending wake notifications */
+    while (read(relay->wake_fds[0], wake_buffer, sizeof(wake_buffer)) > 0);
+
+    pthread_mutex_lock(&(relay->lock));
+    guacd_relay_connection* current = relay->pending;
+    relay->pending = NULL;
+    pthread_mutex_unlock(&(relay->lock));
+
+    while (current != NULL) {
+
+        guacd_relay_connection* next = current->next;
+        current->next = NULL;
+
+        struct epoll_event event = {
+            .events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET,
+            .data.ptr = current
+        };
+
+        /* Monitor both the user and the process */
+        if (epoll_ctl(relay->epoll_fd, EPOLL_CTL_ADD,
+                    current->inbound.in_fd, &event)
+                || epoll_ctl(relay->epoll_fd, EPOLL_CTL_ADD,
+                    current->outbound.in_fd, &event)) {
+            guacd_log(GUAC_LOG_ERROR, "Unable to relay connection: %s",
+                    strerror(errno));
+            epoll_ctl(relay->epoll_fd, EPOLL_CTL_DEL,
+                    current->inbound.in_fd, NULL);
+            guacd_relay_connection_free(current);
+        }
+
+        /* Transfer any data which arrived prior to registration */
+        else
+            guacd_relay_connection_pump(relay, current, closed);
+
+        current = next;
+
+    }
+
+}
+
+/**
+ * Relays data for all connections added to the given relay, never returning.
+ *
+ * @param data
+ *     A pointer to the guacd_relay to run.
+ *
+ * @return
+ *     Always NULL.
+ */
+static void* guacd_relay_thread(void* data) {
+
+    guacd_relay* relay = (guacd_relay*) data;
+    struct epoll_event events[GUACD_RELAY_MAX_EVENTS];
+
+    int i;
+
+    for (;;) {
+
+        guacd_relay_connection* closed = NULL;
+
+        int count = epoll_wait(relay->epoll_fd, events,
+                GUACD_RELAY_MAX_EVENTS, -1);
+
+        if (count < 0) {
+            if (errno != EINTR)
+                guacd_log(GUAC_LOG_ERROR, "Error waiting for relayed "
+                        "connections: %s", strerror(errno));
+            continue;
+        }
+
+        for (i = 0; i < count; i++) {
+
+            guacd_relay_connection* connection =
+                (guacd_relay_connection*) events[i].data.ptr;
+
+            /* The wake pipe is registered without an associated connection */
+            if (connection == NULL)
+                guacd_relay_register_pending(relay, &closed);
+            else
+                guacd_relay_connection_pump(relay, connection, &closed);
+
+        }
+
+        /* Free closed connections only after all events referencing those
+         * connections have been handled */
+        while (closed != NULL) {
+            guacd_relay_connection* next = closed->next;
+            guacd_relay_connection_free(closed);
+            closed = next;
+        }
+
+    }
+
+    return NULL;
+
+}
+
+guacd_relay* guacd_relay_alloc() {
+
+    guacd_relay* relay = malloc(sizeof(guacd_relay));
+    if (relay == NULL)
+        return NULL;
+
+    relay->pending = NULL;
+
+    relay->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (relay->epoll_fd < 0) {
+        guacd_log(GUAC_LOG_WARNING, "Unable to create epoll instance for "
+                "connection relay: %s", strerror(errno));
+        free(relay);
+        return NULL;
+    }
+
+    if (pipe(relay->wake_fds) < 0) {
+        guacd_log(GUAC_LOG_WARNING, "Unable to create wake pipe for "
+                "connection relay: %s", strerror(errno));
+        close(relay->epoll_fd);
+        free(relay);
+        return NULL;
+    }
+
+    struct epoll_event event = {
+        .events = EPOLLIN,
+        .data.ptr = NULL
+    };
+
+    /* Wake relay thread whenever connections are pending */
+    if (guacd_relay_set_nonblocking(relay->wake_fds[0])
+            || guacd_relay_set_nonblocking(relay->wake_fds[1])
+            || epoll_ctl(relay->epoll_fd, EPOLL_CTL_ADD, relay->wake_fds[0],
+                &event)) {
+        guacd_log(GUAC_LOG_WARNING, "Unable to monitor wake pipe for "
+                "connection relay: %s", strerror(errno));
+        goto fail;
+    }
+
+    pthread_mutex_init(&(relay->lock), NULL);
+
+    if (pthread_create(&(relay->thread), NULL, guacd_relay_thread, relay)) {
+        guacd_log(GUAC_LOG_WARNING, "Unable to start connection relay "
+                "thread.");
+        pthread_mutex_destroy(&(relay->lock));
+        goto fail;
+    }
+
+    pthread_detach(relay->thread);
+    return relay;
+
+fail:
+    close(relay->wake_fds[0]);
+    close(relay->wake_fds[1]);
+    close(relay->epoll_fd);
+    free(relay);
+    return NULL;
+
+}
+
+int guacd_relay_add(guacd_relay* relay, guac_parser* parser,
+        guac_socket* socket, int socket_fd, int proc_fd) {
+
+    guacd_relay_connection* connection = malloc(sizeof(guacd_relay_connection));
+    if (connection == NULL)
+        return 1;
+
+    /* Allocate resources for each direction */
+    if (guacd_relay_direction_init(&connection->inbound, socket_fd, proc_fd)) {
+        free(connection);
+        return 1;
+    }
+
+    if (guacd_relay_direction_init(&connection->outbound, proc_fd, socket_fd)) {
+        guacd_relay_direction_free(&connection->inbound);
+        free(connection);
+        return 1;
+    }
+
+    /* Data buffered by the parser is copied through a buffer rather than
+     * written into the pipe, as the pipe may have been created with less
+     * capacity than the parser buffer (for example, if the user's pipe buffer
+     * limit has been reached) and writing only part of that data would
+     * corrupt the stream */
+    if (guac_parser_length(parser) > 0
+            && connection->inbound.buffer == NULL
+            && guacd_relay_direction_use_buffer(&connection->inbound)) {
+        guacd_relay_direction_free(&connection->inbound);
+        guacd_relay_direction_free(&connection->outbound);
+        free(connection);
+        return 1;
+    }
+
+    /* Further I/O must not block the relay thread */
+    if (guacd_relay_set_nonblocking(socket_fd)
+            || guacd_relay_set_nonblocking(proc_fd)) {
+
+        /* The caller falls back to blocking I/O on failure */
+        if (guacd_relay_set_blocking(socket_fd)
+                || guacd_relay_set_blocking(proc_fd))
+            guacd_log(GUAC_LOG_WARNING, "Unable to restore blocking mode "
+                    "after failing to relay connection: %s",
+                    strerror(errno));
+
+        guacd_relay_direction_free(&connection->inbound);
+        guacd_relay_direction_free(&connection->outbound);
+        free(connection);
+        return 1;
+
+    }
+
+    connection->socket = socket;
+    connection->closed = 0;
+
+    /* Queue any data buffered by the parser for delivery to the process */
+    guacd_relay_direction_prefill(&connection->inbound, parser);
+    guac_parser_free(parser);
+
+    /* Queue connection for registration by relay thread */
+    pthread_mutex_lock(&(relay->lock));
+    connection->next = relay->pending;
+    relay->pending = connection;
+    pthread_mutex_unlock(&(relay->lock));
+
+    /* Wake relay thread (if the wake pipe is full, the relay thread is
+     * already due to wake) */
+    char wake = 0;
+    if (write(relay->wake_fds[1], &wake, 1) < 0 && errno != EAGAIN)
+        guacd_log(GUAC_LOG_WARNING, "Unable to wake connection relay: %s",
+                strerror(errno));
+
+    return 0;
+
+}
+
+#else
+
+guacd_relay* guacd_relay_alloc() {
+    /* Each connection must be relayed by its own threads without epoll */
+    return NULL;
+}
+
+int guacd_relay_add(guacd_relay* relay, guac_parser* parser,
+        guac_socket* socket, int socket_fd, int proc_fd) {
+    return 1;
+}
+
+#endif
+
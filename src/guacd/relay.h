@@ -0,0 +1,213 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef GUACD_RELAY_H
+#define GUACD_RELAY_H
+
+#include "config.h"
+
+#include <guacamole/parser.h>
+#include <guacamole/socket.h>
+
+#include <pthread.h>
+#include <sys/types.h>
+
+/**
+ * The maximum number of bytes to buffer for each direction of a relayed
+ * connection before waiting for that data to be written. This is equal to the
+ * default capacity of a pipe on Linux.
+ */
+#define GUACD_RELAY_BLOCK_SIZE 65536
+
+/**
+ * The maximum number of events to handle with each call to epoll_wait().
+ */
+#define GUACD_RELAY_MAX_EVENTS 64
+
+/**
+ * One direction of data transfer within a relayed connection.
+ */
+typedef struct guacd_relay_direction {
+
+    /**
+     * The file descriptor that data is read from.
+     */
+    int in_fd;
+
+    /**
+     * The file descriptor that data is written to.
+     */
+    int out_fd;
+
+    /**
+     * The pipe through which data is moved using splice(), where index 0 is
+     * the read end and index 1 is the write end. If data is instead copied
+     * through buffer, both will be -1.
+     */
+    int pipe_fds[2];
+
+    /**
+     * The buffer through which data is copied if splice() cannot be used, or
+     * NULL if data is moved through pipe_fds.
+     */
+    char* buffer;
+
+    /**
+     * The offset of the first byte within buffer which has not yet been
+     * written. This is only used if data is copied through buffer.
+     */
+    size_t offset;
+
+    /**
+     * The number of bytes which have been read from in_fd but not yet
+     * written to out_fd.
+     */
+    size_t length;
+
+    /**
+     * Non-zero if end-of-file has been reached on in_fd, zero otherwise.
+     */
+    int eof;
+
+} guacd_relay_direction;
+
+/**
+ * A connection between a user and a connection-specific process whose data is
+ * relayed by a guacd_relay.
+ */
+typedef struct guacd_relay_connection {
+
+    /**
+     * The guac_socket which handled the user's connection to guacd during
+     * the handshake. This socket is no longer used for I/O, but is freed
+     * (closing its file descriptor) once the connection is closed.
+     */
+    guac_socket* socket;
+
+    /**
+     * Data travelling from the user to the connection-specific process.
+     */
+    guacd_relay_direction inbound;
+
+    /**
+     * Data travelling from the connection-specific process to the user.
+     */
+    guacd_relay_direction outbound;
+
+    /**
+     * Non-zero if this connection has been closed and is awaiting
+     * deallocation, zero otherwise.
+     */
+    int closed;
+
+    /**
+     * The next connection in whichever list this connection is currently
+     * part of (connections awaiting registration or connections awaiting
+     * deallocation), or NULL if this is the last connection.
+     */
+    struct guacd_relay_connection* next;
+
+} guacd_relay_connection;
+
+/**
+ * An event loop which relays data for any number of connections between users
+ * and their connection-specific processes using a single thread and epoll,
+ * rather than a pair of threads per connection.
+ */
+typedef struct guacd_relay {
+
+    /**
+     * The epoll instance monitoring the file descriptors of all relayed
+     * connections.
+     */
+    int epoll_fd;
+
+    /**
+     * Pipe used to wake the relay thread when new connections are added,
+     * where index 0 is the read end and index 1 is the write end.
+     */
+    int wake_fds[2];
+
+    /**
+     * Lock which guards access to the pending list.
+     */
+    pthread_mutex_t lock;
+
+    /**
+     * Connections which have been added but not yet registered with the
+     * epoll instance by the relay thread.
+     */
+    guacd_relay_connection* pending;
+
+    /**
+     * The thread running the relay event loop.
+     */
+    pthread_t thread;
+
+} guacd_relay;
+
+/**
+ * Allocates a new guacd_relay, starting the thread which will relay data for
+ * all connections added with guacd_relay_add(). There is intended to be
+ * exactly one relay, which persists for the life of guacd. As the relay is
+ * driven by a thread, this function must not be invoked prior to
+ * daemonizing.
+ *
+ * @return
+ *     A newly-allocated guacd_relay, or NULL if the relay could not be
+ *     started or is not supported on this platform, in which case each
+ *     connection must be relayed using its own threads.
+ */
+guacd_relay* guacd_relay_alloc();
+
+/**
+ * Adds the given connection to the given relay, such that all further data is
+ * transferred between the user and the connection-specific process by the
+ * relay thread. Any data already buffered by the given guac_parser is first
+ * written to the connection-specific process. On success, the relay takes
+ * ownership of the guac_parser, guac_socket, and process file descriptor,
+ * freeing or closing each once the connection terminates. On failure, none of
+ * these are touched.
+ *
+ * @param relay
+ *     The relay to add the connection to.
+ *
+ * @param parser
+ *     The parser associated with the given guac_socket, which may have
+ *     buffered but unhandled data.
+ *
+ * @param socket
+ *     The guac_socket which handled the user's connection to guacd during the
+ *     handshake. This guac_socket must not be using SSL/TLS.
+ *
+ * @param socket_fd
+ *     The file descriptor underlying the given guac_socket.
+ *
+ * @param proc_fd
+ *     The file descriptor which is being handled by a guac_socket within the
+ *     connection-specific process.
+ *
+ * @return
+ *     Zero if the connection was added successfully, non-zero otherwise.
+ */
+int guacd_relay_add(guacd_relay* relay, guac_parser* parser,
+        guac_socket* socket, int socket_fd, int proc_fd);
+
+#endif
+
@@ -0,0 +1,156 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "config.h"
+
+#include "arena.h"
+
+#include <stddef.h>
+#include <stdlib.h>
+
+/**
+ * The alignment of all allocations made from an arena, in bytes. This is
+ * sufficient for any standard type on all supported platforms.
+ */
+#define GUAC_ARENA_ALIGNMENT 16
+
+/**
+ * The number of bytes reserved at the start of each block for the
+ * guac_arena_block structure, rounded up to preserve alignment.
+ */
+#define GUAC_ARENA_HEADER_SIZE \
+    ((sizeof(guac_arena_block) + GUAC_ARENA_ALIGNMENT - 1) \
+        & ~((size_t) GUAC_ARENA_ALIGNMENT - 1))
+
+/**
+ * Allocates a new block of at least the given size, adding it to the given
+ * arena as the block from which allocations are currently made.
+ *
+ * @param arena
+ *     The arena to add a block to.
+ *
+ * @param size
+ *     The minimum number of bytes which must be available for allocation
+ *     within the new block.
+ *
+ * @return
+ *     The newly-allocated block, or NULL if allocation fails.
+ */
+static guac_arena_block* guac_arena_add_block(guac_arena* arena,
+        size_t size) {
+
+    /* Grow geometrically to minimize the number of blocks */
+    if (size < arena->size)
+        size = arena->size;
+
+    if (size < GUAC_ARENA_BLOCK_SIZE)
+        size = GUAC_ARENA_BLOCK_SIZE;
+
+    guac_arena_block* block = malloc(GUAC_ARENA_HEADER_SIZE + size);
+    if (block == NULL)
+        return NULL;
+
+    block->next = arena->current;
+    block->size = size;
+    block->used = 0;
+
+    arena->current = block;
+    arena->size += size;
+
+    return block;
+
+}
+
+/**
+ * Frees all blocks of the given arena.
+ *
+ * @param arena
+ *     The arena whose blocks should be freed.
+ */
+static void guac_arena_free_blocks(guac_arena* arena) {
+
+    guac_arena_block* block = arena->current;
+    while (block != NULL) {
+        guac_arena_block* next = block->next;
+        free(block);
+        block = next;
+    }
+
+    arena->current = NULL;
+    arena->size = 0;
+
+}
+
+guac_arena* guac_arena_alloc() {
+
+    guac_arena* arena = malloc(sizeof(guac_arena));
+    if (arena == NULL)
+        return NULL;
+
+    arena->current = NULL;
+    arena->size = 0;
+
+    return arena;
+
+}
+
+void* guac_arena_malloc(guac_arena* arena, size_t size) {
+
+    /* Preserve alignment of all following allocations */
+    size = (size + GUAC_ARENA_ALIGNMENT - 1)
+         & ~((size_t) GUAC_ARENA_ALIGNMENT - 1);
+
+    /* Add new block if current block is insufficient */
+    guac_arena_block* block = arena->current;
+    if (block == NULL || block->size - block->used < size) {
+        block = guac_arena_add_block(arena, size);
+        if (block == NULL)
+            return NULL;
+    }
+
+    void* allocated = ((char*) block) + GUAC_ARENA_HEADER_SIZE + block->used;
+    block->used += size;
+
+    return allocated;
+
+}
+
+void guac_arena_reset(guac_arena* arena) {
+
+    guac_arena_block* block = arena->current;
+    if (block == NULL)
+        return;
+
+    /* Replace multiple blocks with a single block of the same total size */
+    if (block->next != NULL) {
+        size_t size = arena->size;
+        guac_arena_free_blocks(arena);
+        guac_arena_add_block(arena, size);
+        return;
+    }
+
+    block->used = 0;
+
+}
+
+void guac_arena_free(guac_arena* arena) {
+    guac_arena_free_blocks(arena);
+    free(arena);
+}
+
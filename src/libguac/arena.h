@@ -0,0 +1,125 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef GUAC_ARENA_H
+#define GUAC_ARENA_H
+
+#include "config.h"
+
+#include <stddef.h>
+
+/**
+ * The size of the first block of memory allocated by each arena, in bytes.
+ */
+#define GUAC_ARENA_BLOCK_SIZE 65536
+
+/**
+ * A single contiguous block of memory from which the allocations of an arena
+ * are made. The memory available for allocation immediately follows this
+ * structure.
+ */
+typedef struct guac_arena_block {
+
+    /**
+     * The block allocated prior to this block, or NULL if this is the first
+     * block.
+     */
+    struct guac_arena_block* next;
+
+    /**
+     * The number of bytes available for allocation within this block.
+     */
+    size_t size;
+
+    /**
+     * The number of bytes of this block which have been allocated.
+     */
+    size_t used;
+
+} guac_arena_block;
+
+/**
+ * Scratch memory from which any number of short-lived allocations can be
+ * made, all of which are released together with guac_arena_reset(). Memory
+ * is retained across resets, such that a workload which repeatedly makes
+ * similar allocations and then resets the arena will quickly stop calling
+ * malloc() entirely. Arenas are not threadsafe.
+ */
+typedef struct guac_arena {
+
+    /**
+     * The block from which allocations are currently being made, or NULL if
+     * no blocks have yet been allocated. Older blocks are reachable through
+     * the next pointer of this block.
+     */
+    guac_arena_block* current;
+
+    /**
+     * The total number of bytes available within all blocks.
+     */
+    size_t size;
+
+} guac_arena;
+
+/**
+ * Allocates a new, empty arena. No memory is allocated for the arena's
+ * blocks until the first allocation is made.
+ *
+ * @return
+ *     A newly-allocated arena, or NULL if allocation fails.
+ */
+guac_arena* guac_arena_alloc();
+
+/**
+ * Allocates the given number of bytes from the given arena. The returned
+ * memory is suitably aligned for any type and remains valid until the arena
+ * is reset or freed. There is no way to free individual allocations.
+ *
+ * @param arena
+ *     The arena to allocate memory from.
+ *
+ * @param size
+ *     The number of bytes to allocate.
+ *
+ * @return
+ *     A pointer to the allocated memory, or NULL if allocation fails.
+ */
+void* guac_arena_malloc(guac_arena* arena, size_t size);
+
+/**
+ * Releases all allocations made from the given arena, such that the memory
+ * of those allocations may be reused. If the allocations spanned multiple
+ * blocks, those blocks are replaced with a single block large enough to
+ * satisfy the same allocations again.
+ *
+ * @param arena
+ *     The arena to reset.
+ */
+void guac_arena_reset(guac_arena* arena);
+
+/**
+ * Frees the given arena and all memory allocated from it.
+ *
+ * @param arena
+ *     The arena to free.
+ */
+void guac_arena_free(guac_arena* arena);
+
+#endif
+
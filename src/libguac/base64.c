@@ -0,0 +1,303 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "config.h"
+
+#include "base64.h"
+
+#include <pthread.h>
+#include <stddef.h>
+
+/*
+ * Vectorized implementations are built only for x86 compilers which allow
+ * individual functions to target instruction sets beyond those enabled for
+ * the build as a whole.
+ */
+#if (defined(__x86_64__) || defined(__i386__)) \
+    && (defined(__clang__) || (defined(__GNUC__) && __GNUC__ >= 5))
+#define GUAC_BASE64_X86_SIMD
+#include <immintrin.h>
+#endif
+
+/**
+ * All 64 characters of the base64 alphabet, in order of the values they
+ * represent.
+ */
+static const char GUAC_BASE64_CHARACTERS[64] =
+    "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+/**
+ * Signature shared by all implementations of guac_base64_encode().
+ */
+typedef size_t guac_base64_encoder(char* output, const unsigned char* data,
+        size_t length);
+
+/**
+ * Encodes all complete three-byte groups of the given data without the use
+ * of any vector instructions, returning the number of bytes written. This
+ * implementation is used when no faster implementation is available, and to
+ * encode any trailing groups left over by the vectorized implementations.
+ *
+ * @param output
+ *     The buffer to write the base64-encoded data to.
+ *
+ * @param data
+ *     The data to encode.
+ *
+ * @param length
+ *     The number of bytes of data available within the given buffer.
+ *
+ * @return
+ *     The number of bytes written to the output buffer.
+ */
+static size_t guac_base64_encode_scalar(char* output,
+        const unsigned char* data, size_t length) {
+
+    char* current = output;
+
+    for (; length >= 3; length -= 3, data += 3) {
+
+        unsigned int group = (data[0] << 16) | (data[1] << 8) | data[2];
+
+        *(current++) = GUAC_BASE64_CHARACTERS[(group >> 18) & 0x3F];
+        *(current++) = GUAC_BASE64_CHARACTERS[(group >> 12) & 0x3F];
+        *(current++) = GUAC_BASE64_CHARACTERS[(group >>  6) & 0x3F];
+        *(current++) = GUAC_BASE64_CHARACTERS[ group        & 0x3F];
+
+    }
+
+    return current - output;
+
+}
+
+#ifdef GUAC_BASE64_X86_SIMD
+
+/**
+ * Converts each of the sixteen 6-bit values within the given vector into the
+ * corresponding base64 character. Rather than looking up each value
+ * individually, the offset from each value to its character is looked up
+ * based on which of the five contiguous ranges of the base64 alphabet the
+ * value falls within.
+ *
+ * @param values
+ *     Sixteen 6-bit values, one per byte.
+ *
+ * @return
+ *     The base64 characters corresponding to each given value.
+ */
+__attribute__((target("ssse3")))
+static __m128i guac_base64_lookup_ssse3(__m128i values) {
+
+    /* Offsets for A-Z (13), a-z (0), 0-9 (1-10), "+" (11), and "/" (12) */
+    const __m128i offsets = _mm_setr_epi8(
+            'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+            '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62,
+            '/' - 63, 'A', 0, 0);
+
+    /* Values 52 through 63 map to 1 through 12, all others to 0 */
+    __m128i range = _mm_subs_epu8(values, _mm_set1_epi8(51));
+
+    /* Values 0 through 25 map to 13 */
+    __m128i upper = _mm_cmpgt_epi8(_mm_set1_epi8(26), values);
+    range = _mm_or_si128(range, _mm_and_si128(upper, _mm_set1_epi8(13)));
+
+    return _mm_add_epi8(values, _mm_shuffle_epi8(offsets, range));
+
+}
+
+/**
+ * Splits the first twelve bytes of the given vector into sixteen 6-bit
+ * values, one per byte, in the order those values are encoded as base64.
+ *
+ * @param data
+ *     The vector containing the twelve bytes of data to split within its
+ *     lowest-order bytes.
+ *
+ * @return
+ *     The sixteen 6-bit values represented by the given twelve bytes.
+ */
+__attribute__((target("ssse3")))
+static __m128i guac_base64_split_ssse3(__m128i data) {
+
+    /* Duplicate bytes such that each 32-bit lane contains one group */
+    data = _mm_shuffle_epi8(data, _mm_setr_epi8(
+            1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10));
+
+    /* Shift the first and third values of each group into place */
+    __m128i first = _mm_mulhi_epu16(
+            _mm_and_si128(data, _mm_set1_epi32(0x0FC0FC00)),
+            _mm_set1_epi32(0x04000040));
+
+    /* Shift the second and fourth values of each group into place */
+    __m128i second = _mm_mullo_epi16(
+            _mm_and_si128(data, _mm_set1_epi32(0x003F03F0)),
+            _mm_set1_epi32(0x01000010));
+
+    return _mm_or_si128(first, second);
+
+}
+
+/**
+ * SSSE3 implementation of guac_base64_encode(), encoding twelve bytes of
+ * data into sixteen base64 characters at a time.
+ *
+ * @param output
+ *     The buffer to write the base64-encoded data to.
+ *
+ * @param data
+ *     The data to encode.
+ *
+ * @param length
+ *     The number of bytes of data available within the given buffer.
+ *
+ * @return
+ *     The number of bytes written to the output buffer.
+ */
+__attribute__((target("ssse3")))
+static size_t guac_base64_encode_ssse3(char* output,
+        const unsigned char* data, size_t length) {
+
+    char* current = output;
+
+    /* Each iteration reads 16 bytes, but encodes only 12 */
+    for (; length >= 16; length -= 12, data += 12, current += 16) {
+        __m128i input = _mm_loadu_si128((const __m128i*) data);
+        __m128i encoded = guac_base64_lookup_ssse3(
+                guac_base64_split_ssse3(input));
+        _mm_storeu_si128((__m128i*) current, encoded);
+    }
+
+    return (current - output)
+        + guac_base64_encode_scalar(current, data, length);
+
+}
+
+/**
+ * AVX2 implementation of guac_base64_encode(), encoding 24 bytes of data into
+ * 32 base64 characters at a time. Each 128-bit lane is processed exactly as
+ * by guac_base64_encode_ssse3().
+ *
+ * @param output
+ *     The buffer to write the base64-encoded data to.
+ *
+ * @param data
+ *     The data to encode.
+ *
+ * @param length
+ *     The number of bytes of data available within the given buffer.
+ *
+ * @return
+ *     The number of bytes written to the output buffer.
+ */
+__attribute__((target("avx2")))
+static size_t guac_base64_encode_avx2(char* output,
+        const unsigned char* data, size_t length) {
+
+    const __m256i offsets = _mm256_setr_epi8(
+            'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+            '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62,
+            '/' - 63, 'A', 0, 0,
+            'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+            '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62,
+            '/' - 63, 'A', 0, 0);
+
+    const __m256i shuffle = _mm256_setr_epi8(
+            1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10,
+            1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10);
+
+    char* current = output;
+
+    /* Each iteration reads 28 bytes, but encodes only 24 */
+    for (; length >= 28; length -= 24, data += 24, current += 32) {
+
+        /* Load twelve bytes into the low end of each lane */
+        __m256i input = _mm256_inserti128_si256(
+                _mm256_castsi128_si256(
+                    _mm_loadu_si128((const __m128i*) data)),
+                _mm_loadu_si128((const __m128i*) (data + 12)), 1);
+
+        /* Split into 6-bit values (see guac_base64_split_ssse3()) */
+        input = _mm256_shuffle_epi8(input, shuffle);
+
+        __m256i values = _mm256_or_si256(
+                _mm256_mulhi_epu16(
+                    _mm256_and_si256(input, _mm256_set1_epi32(0x0FC0FC00)),
+                    _mm256_set1_epi32(0x04000040)),
+                _mm256_mullo_epi16(
+                    _mm256_and_si256(input, _mm256_set1_epi32(0x003F03F0)),
+                    _mm256_set1_epi32(0x01000010)));
+
+        /* Translate into characters (see guac_base64_lookup_ssse3()) */
+        __m256i range = _mm256_or_si256(
+                _mm256_subs_epu8(values, _mm256_set1_epi8(51)),
+                _mm256_and_si256(
+                    _mm256_cmpgt_epi8(_mm256_set1_epi8(26), values),
+                    _mm256_set1_epi8(13)));
+
+        _mm256_storeu_si256((__m256i*) current, _mm256_add_epi8(values,
+                    _mm256_shuffle_epi8(offsets, range)));
+
+    }
+
+    /* Encode remaining data with SSSE3 (and scalar) implementation */
+    return (current - output)
+        + guac_base64_encode_ssse3(current, data, length);
+
+}
+
+#endif
+
+/**
+ * The implementation of guac_base64_encode() selected for the current CPU.
+ */
+static guac_base64_encoder* guac_base64_selected_encoder =
+    guac_base64_encode_scalar;
+
+/**
+ * Guards the one-time selection of guac_base64_selected_encoder.
+ */
+static pthread_once_t guac_base64_encoder_selected = PTHREAD_ONCE_INIT;
+
+/**
+ * Selects the fastest implementation of guac_base64_encode() supported by the
+ * current CPU, storing that implementation within
+ * guac_base64_selected_encoder.
+ */
+static void guac_base64_select_encoder() {
+
+#ifdef GUAC_BASE64_X86_SIMD
+    __builtin_cpu_init();
+
+    if (__builtin_cpu_supports("avx2"))
+        guac_base64_selected_encoder = guac_base64_encode_avx2;
+
+    else if (__builtin_cpu_supports("ssse3"))
+        guac_base64_selected_encoder = guac_base64_encode_ssse3;
+#endif
+
+}
+
+size_t guac_base64_encode(char* output, const unsigned char* data,
+        size_t length) {
+
+    pthread_once(&guac_base64_encoder_selected, guac_base64_select_encoder);
+    return guac_base64_selected_encoder(output, data, length);
+
+}
+
@@ -0,0 +1,51 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef GUAC_BASE64_H
+#define GUAC_BASE64_H
+
+#include <stddef.h>
+
+/**
+ * Encodes as many complete three-byte groups of the given data as possible
+ * as base64, writing the encoded result to the given output buffer. Any one
+ * or two bytes which do not form a complete group are ignored and must be
+ * encoded separately by the caller, along with any required padding. The
+ * fastest implementation supported by the current CPU is selected
+ * automatically upon first use.
+ *
+ * @param output
+ *     The buffer to write the base64-encoded data to. This buffer must be at
+ *     least (length / 3) * 4 bytes long.
+ *
+ * @param data
+ *     The data to encode.
+ *
+ * @param length
+ *     The number of bytes of data available within the given buffer.
+ *
+ * @return
+ *     The number of bytes written to the output buffer, which will always be
+ *     exactly (length / 3) * 4.
+ */
+size_t guac_base64_encode(char* output, const unsigned char* data,
+        size_t length);
+
+#endif
+
@@ -0,0 +1,65 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "benchmark.h"
+
+#include <guacamole/socket.h>
+#include <guacamole/timestamp.h>
+
+#include <stdlib.h>
+
+/**
+ * The number of bytes of data to encode per call to
+ * guac_socket_write_base64(), equal to the size of the blobs written by
+ * guac_protocol_send_blobs().
+ */
+#define BENCHMARK_BLOB_LENGTH 6048
+
+/**
+ * The total number of bytes of data to encode.
+ */
+#define BENCHMARK_TOTAL_LENGTH (BENCHMARK_BLOB_LENGTH * 65536)
+
+void guac_benchmark_base64() {
+
+    int i;
+    unsigned char* data = malloc(BENCHMARK_BLOB_LENGTH);
+
+    /* Sockets without handlers simply discard all written data */
+    guac_socket* socket = guac_socket_alloc();
+
+    for (i = 0; i < BENCHMARK_BLOB_LENGTH; i++)
+        data[i] = i * 31;
+
+    guac_timestamp start = guac_timestamp_current();
+
+    /* Encode data as would be done for blob instructions */
+    for (i = 0; i < BENCHMARK_TOTAL_LENGTH / BENCHMARK_BLOB_LENGTH; i++) {
+        guac_socket_write_base64(socket, data, BENCHMARK_BLOB_LENGTH);
+        guac_socket_flush_base64(socket);
+    }
+
+    guac_benchmark_report("guac_socket_write_base64()",
+            BENCHMARK_TOTAL_LENGTH, start);
+
+    guac_socket_free(socket);
+    free(data);
+
+}
+
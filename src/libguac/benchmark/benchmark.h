@@ -0,0 +1,70 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef GUAC_BENCHMARK_H
+#define GUAC_BENCHMARK_H
+
+/**
+ * Benchmarks of performance-sensitive parts of libguac. Benchmarks are not
+ * unit tests and are not run by "make check". They are built and run with
+ * "make benchmark", reporting the throughput of each benchmarked operation.
+ *
+ * @file benchmark.h
+ */
+
+#include <guacamole/timestamp.h>
+
+/**
+ * Reports the throughput of a benchmarked operation, printing the amount of
+ * data processed, the time taken, and the resulting rate in MB/s.
+ *
+ * @param name
+ *     A human-readable name describing the benchmarked operation.
+ *
+ * @param bytes
+ *     The total number of bytes processed by the operation.
+ *
+ * @param start
+ *     The time at which the operation started, as returned by
+ *     guac_timestamp_current().
+ */
+void guac_benchmark_report(const char* name, double bytes,
+        guac_timestamp start);
+
+/**
+ * Measures the throughput of guac_socket_write_base64() when encoding
+ * blob-sized blocks of data to a socket which discards all written data.
+ */
+void guac_benchmark_base64();
+
+/**
+ * Measures the time taken and the number of allocations made by
+ * guac_png_write() and guac_jpeg_write() for each image when repeatedly
+ * encoding small and moderately-sized images.
+ */
+void guac_benchmark_encode();
+
+/**
+ * Measures the throughput of guac_parser_append() when parsing blob
+ * instructions of the size produced by file transfers.
+ */
+void guac_benchmark_parser();
+
+#endif
+
@@ -0,0 +1,184 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "benchmark.h"
+#include "encode-jpeg.h"
+#include "encode-png.h"
+
+#include <cairo/cairo.h>
+#include <guacamole/socket.h>
+#include <guacamole/stream.h>
+#include <guacamole/timestamp.h>
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+/**
+ * The total number of pixels to encode for each benchmarked combination of
+ * encoder and image size.
+ */
+#define BENCHMARK_TOTAL_PIXELS 4194304
+
+/**
+ * The JPEG quality to use when encoding benchmarked images, matching the
+ * quality typically chosen for updates which are not changing rapidly.
+ */
+#define BENCHMARK_JPEG_QUALITY 90
+
+/**
+ * The number of allocations made through malloc(), calloc() or realloc()
+ * since the benchmark started, or -1 if allocations cannot be counted on
+ * this platform.
+ */
+#ifdef __GLIBC__
+static long guac_benchmark_allocations = 0;
+#else
+static long guac_benchmark_allocations = -1;
+#endif
+
+#ifdef __GLIBC__
+/*
+ * The standard allocation functions are replaced with versions which count
+ * each allocation before invoking the original glibc implementation. As the
+ * benchmarks are single-threaded, the count need not be atomic.
+ */
+
+extern void* __libc_malloc(size_t size);
+extern void* __libc_calloc(size_t nmemb, size_t size);
+extern void* __libc_realloc(void* ptr, size_t size);
+
+void* malloc(size_t size) {
+    guac_benchmark_allocations++;
+    return __libc_malloc(size);
+}
+
+void* calloc(size_t nmemb, size_t size) {
+    guac_benchmark_allocations++;
+    return __libc_calloc(nmemb, size);
+}
+
+void* realloc(void* ptr, size_t size) {
+    guac_benchmark_allocations++;
+    return __libc_realloc(ptr, size);
+}
+#endif
+
+/**
+ * Encodes the given image to the given socket using the encoder with the
+ * given name.
+ *
+ * @param encoder
+ *     The name of the encoder to use, either "png" or "jpeg".
+ *
+ * @param socket
+ *     The socket to write the encoded image to.
+ *
+ * @param stream
+ *     The stream to associate with the encoded image.
+ *
+ * @param surface
+ *     The image to encode.
+ */
+static void guac_benchmark_encode_image(const char* encoder,
+        guac_socket* socket, guac_stream* stream, cairo_surface_t* surface) {
+
+    if (encoder[0] == 'p')
+        guac_png_write(socket, stream, surface);
+    else
+        guac_jpeg_write(socket, stream, surface, BENCHMARK_JPEG_QUALITY);
+
+}
+
+/**
+ * Repeatedly encodes an image of the given size with the encoder of the
+ * given name, reporting the average time taken and number of allocations
+ * made per image. The image contains few enough colors that PNG encoding
+ * uses a palette, as is typical of small terminal and desktop updates.
+ *
+ * @param encoder
+ *     The name of the encoder to use, either "png" or "jpeg".
+ *
+ * @param size
+ *     The width and height of the square image to encode, in pixels.
+ */
+static void guac_benchmark_encode_size(const char* encoder, int size) {
+
+    int i;
+    int images = BENCHMARK_TOTAL_PIXELS / (size * size);
+
+    /* Sockets without handlers simply discard all written data */
+    guac_socket* socket = guac_socket_alloc();
+    guac_stream stream = { .index = 1 };
+
+    cairo_surface_t* surface = cairo_image_surface_create(CAIRO_FORMAT_RGB24,
+            size, size);
+
+    /* Draw mostly uniform background with a few distinct colors */
+    uint32_t* data = (uint32_t*) cairo_image_surface_get_data(surface);
+    int stride = cairo_image_surface_get_stride(surface) / sizeof(uint32_t);
+
+    srand(1);
+    for (i = 0; i < size * size; i++) {
+        int x = i % size;
+        int y = i / size;
+        data[y * stride + x] = (i % 7 == 0) ? 0x202020 * (rand() % 6)
+                                            : 0xC0C0C0 + y % 3;
+    }
+
+    cairo_surface_mark_dirty(surface);
+
+    /* Encode once beforehand, such that one-time allocations of state which
+     * is reused across images are not counted */
+    guac_benchmark_encode_image(encoder, socket, &stream, surface);
+
+    long allocations = guac_benchmark_allocations;
+    guac_timestamp start = guac_timestamp_current();
+
+    for (i = 0; i < images; i++)
+        guac_benchmark_encode_image(encoder, socket, &stream, surface);
+
+    guac_timestamp duration = guac_timestamp_current() - start;
+    allocations = guac_benchmark_allocations - allocations;
+
+    printf("guac_%s_write() (%ix%i): %i images in %ims "
+            "(%.1f us/image", encoder, size, size, images, (int) duration,
+            duration * 1000.0 / images);
+
+    if (guac_benchmark_allocations >= 0)
+        printf(", %.1f allocations/image", (double) allocations / images);
+
+    printf(")\n");
+
+    cairo_surface_destroy(surface);
+    guac_socket_free(socket);
+
+}
+
+void guac_benchmark_encode() {
+
+    guac_benchmark_encode_size("png", 16);
+    guac_benchmark_encode_size("png", 64);
+    guac_benchmark_encode_size("png", 256);
+
+    guac_benchmark_encode_size("jpeg", 16);
+    guac_benchmark_encode_size("jpeg", 64);
+    guac_benchmark_encode_size("jpeg", 256);
+
+}
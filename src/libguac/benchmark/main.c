@@ -0,0 +1,92 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "benchmark.h"
+
+#include <guacamole/timestamp.h>
+
+#include <stdio.h>
+#include <string.h>
+
+/**
+ * A single benchmark which may be run by name.
+ */
+typedef struct guac_benchmark {
+
+    /**
+     * The name of the benchmark, as may be given on the command line.
+     */
+    const char* name;
+
+    /**
+     * The function which runs the benchmark and reports its results.
+     */
+    void (*run)();
+
+} guac_benchmark;
+
+/**
+ * All available benchmarks, terminated by an entry with a NULL name.
+ */
+static const guac_benchmark guac_benchmarks[] = {
+    { "base64", guac_benchmark_base64 },
+    { "encode", guac_benchmark_encode },
+    { "parser", guac_benchmark_parser },
+    { NULL }
+};
+
+void guac_benchmark_report(const char* name, double bytes,
+        guac_timestamp start) {
+
+    guac_timestamp duration = guac_timestamp_current() - start;
+    if (duration < 1)
+        duration = 1;
+
+    printf("%s: %.1f MB in %ims (%.1f MB/s)\n", name, bytes / 1000000,
+            (int) duration, bytes / 1000.0 / duration);
+
+}
+
+/**
+ * Runs the benchmarks named on the command line, or all benchmarks if none
+ * are named.
+ */
+int main(int argc, char** argv) {
+
+    const guac_benchmark* benchmark;
+    int i;
+
+    for (benchmark = guac_benchmarks; benchmark->name != NULL; benchmark++) {
+
+        /* Skip benchmarks which were not requested */
+        int requested = (argc <= 1);
+        for (i = 1; i < argc; i++) {
+            if (strcmp(argv[i], benchmark->name) == 0)
+                requested = 1;
+        }
+
+        if (requested)
+            benchmark->run();
+
+    }
+
+    return 0;
+
+}
+
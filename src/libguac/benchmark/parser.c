@@ -0,0 +1,102 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "benchmark.h"
+
+#include <guacamole/parser.h>
+#include <guacamole/timestamp.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * The length of the base64 data within each benchmarked blob instruction,
+ * equal to the length of the data sent within blobs written by
+ * guac_protocol_send_blobs().
+ */
+#define BENCHMARK_BLOB_LENGTH 8064
+
+/**
+ * The number of blob instructions to parse.
+ */
+#define BENCHMARK_INSTRUCTIONS 65536
+
+/**
+ * As guac_parser_append() modifies the buffer it parses and must be reset for
+ * each instruction, each instruction is first copied from a pristine buffer
+ * and parsed with a newly-allocated parser. The time taken by that copy and
+ * allocation is included in the measurement.
+ */
+void guac_benchmark_parser() {
+
+    int i;
+    guac_parser* parser = NULL;
+
+    /* Build blob instruction containing base64-like content */
+    char prefix[] = "4.blob,1.1,8064.";
+    int length = sizeof(prefix) - 1 + BENCHMARK_BLOB_LENGTH + 1;
+    char* instruction = malloc(length);
+    char* buffer = malloc(length);
+
+    memcpy(instruction, prefix, sizeof(prefix) - 1);
+    for (i = 0; i < BENCHMARK_BLOB_LENGTH; i++)
+        instruction[sizeof(prefix) - 1 + i] = 'A' + (i % 26);
+    instruction[length - 1] = ';';
+
+    guac_timestamp start = guac_timestamp_current();
+
+    for (i = 0; i < BENCHMARK_INSTRUCTIONS; i++) {
+
+        char* current = buffer;
+        int remaining = length;
+
+        memcpy(buffer, instruction, length);
+
+        /* Parse entire instruction using a fresh parser */
+        guac_parser_free(parser);
+        parser = guac_parser_alloc();
+
+        while (remaining > 0) {
+
+            int parsed = guac_parser_append(parser, current, remaining);
+            if (parsed == 0)
+                break;
+
+            current += parsed;
+            remaining -= parsed;
+
+        }
+
+    }
+
+    /* A benchmark of a broken parser is meaningless */
+    if (parser->state != GUAC_PARSE_COMPLETE
+            || strlen(parser->argv[1]) != BENCHMARK_BLOB_LENGTH)
+        fprintf(stderr, "guac_parser_append(): Blob parsed incorrectly\n");
+
+    guac_benchmark_report("guac_parser_append()",
+            (double) length * BENCHMARK_INSTRUCTIONS, start);
+
+    guac_parser_free(parser);
+    free(instruction);
+    free(buffer);
+
+}
+
@@ -120,12 +120,15 @@ guac_stream* guac_client_alloc_stream(guac_client* client) {
 
 void guac_client_free_stream(guac_client* client, guac_stream* stream) {
 
-    /* Release index to pool */
-    guac_pool_free_int(client->__stream_pool, (stream->index - 1) / 2);
+    int stream_index = (stream->index - 1) / 2;
 
-    /* Mark stream as closed */
+    /* Mark stream as closed before its index may be reused by another
+     * thread */
     stream->index = GUAC_CLIENT_CLOSED_STREAM_INDEX;
 
+    /* Release index to pool */
+    guac_pool_free_int(client->__stream_pool, stream_index);
+
 }
 
 guac_client* guac_client_alloc() {
@@ -147,6 +150,7 @@ guac_client* guac_client_alloc() {
     client->args = __GUAC_CLIENT_NO_ARGS;
     client->state = GUAC_CLIENT_RUNNING;
     client->last_sent_timestamp = guac_timestamp_current();
+    client->output_queue_limit = GUAC_USER_OUTPUT_QUEUE_LIMIT;
 
     /* Generate ID */
     client->connection_id = guac_generate_id(GUAC_CLIENT_ID_PREFIX);
@@ -574,12 +578,9 @@ void guac_client_stream_argv(guac_client* client, guac_socket* socket,
 
 }
 
-void guac_client_stream_png(guac_client* client, guac_socket* socket,
-        guac_composite_mode mode, const guac_layer* layer, int x, int y,
-        cairo_surface_t* surface) {
-
-    /* Allocate new stream for image */
-    guac_stream* stream = guac_client_alloc_stream(client);
+void guac_client_write_png(guac_client* client, guac_socket* socket,
+        guac_stream* stream, guac_composite_mode mode,
+        const guac_layer* layer, int x, int y, cairo_surface_t* surface) {
 
     /* Declare stream as containing image data */
     guac_protocol_send_img(socket, stream, mode, layer, "image/png", x, y);
@@ -590,6 +591,54 @@ void guac_client_stream_png(guac_client* client, guac_socket* socket,
     /* Terminate stream */
     guac_protocol_send_end(socket, stream);
 
+}
+
+void guac_client_write_jpeg(guac_client* client, guac_socket* socket,
+        guac_stream* stream, guac_composite_mode mode,
+        const guac_layer* layer, int x, int y, cairo_surface_t* surface,
+        int quality) {
+
+    /* Declare stream as containing image data */
+    guac_protocol_send_img(socket, stream, mode, layer, "image/jpeg", x, y);
+
+    /* Write JPEG data */
+    guac_jpeg_write(socket, stream, surface, quality);
+
+    /* Terminate stream */
+    guac_protocol_send_end(socket, stream);
+
+}
+
+void guac_client_write_webp(guac_client* client, guac_socket* socket,
+        guac_stream* stream, guac_composite_mode mode,
+        const guac_layer* layer, int x, int y, cairo_surface_t* surface,
+        int quality, int lossless) {
+
+#ifdef ENABLE_WEBP
+    /* Declare stream as containing image data */
+    guac_protocol_send_img(socket, stream, mode, layer, "image/webp", x, y);
+
+    /* Write WebP data */
+    guac_webp_write(socket, stream, surface, quality, lossless);
+
+    /* Terminate stream */
+    guac_protocol_send_end(socket, stream);
+#else
+    /* Do nothing if WebP support is not built in */
+#endif
+
+}
+
+void guac_client_stream_png(guac_client* client, guac_socket* socket,
+        guac_composite_mode mode, const guac_layer* layer, int x, int y,
+        cairo_surface_t* surface) {
+
+    /* Allocate new stream for image */
+    guac_stream* stream = guac_client_alloc_stream(client);
+
+    /* Send image data along stream */
+    guac_client_write_png(client, socket, stream, mode, layer, x, y, surface);
+
     /* Free allocated stream */
     guac_client_free_stream(client, stream);
 
@@ -602,14 +651,9 @@ void guac_client_stream_jpeg(guac_client* client, guac_socket* socket,
     /* Allocate new stream for image */
     guac_stream* stream = guac_client_alloc_stream(client);
 
-    /* Declare stream as containing image data */
-    guac_protocol_send_img(socket, stream, mode, layer, "image/jpeg", x, y);
-
-    /* Write JPEG data */
-    guac_jpeg_write(socket, stream, surface, quality);
-
-    /* Terminate stream */
-    guac_protocol_send_end(socket, stream);
+    /* Send image data along stream */
+    guac_client_write_jpeg(client, socket, stream, mode, layer, x, y,
+            surface, quality);
 
     /* Free allocated stream */
     guac_client_free_stream(client, stream);
@@ -624,14 +668,9 @@ void guac_client_stream_webp(guac_client* client, guac_socket* socket,
     /* Allocate new stream for image */
     guac_stream* stream = guac_client_alloc_stream(client);
 
-    /* Declare stream as containing image data */
-    guac_protocol_send_img(socket, stream, mode, layer, "image/webp", x, y);
-
-    /* Write WebP data */
-    guac_webp_write(socket, stream, surface, quality, lossless);
-
-    /* Terminate stream */
-    guac_protocol_send_end(socket, stream);
+    /* Send image data along stream */
+    guac_client_write_webp(client, socket, stream, mode, layer, x, y,
+            surface, quality, lossless);
 
     /* Free allocated stream */
     guac_client_free_stream(client, stream);
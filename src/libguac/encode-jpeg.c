@@ -29,6 +29,7 @@
 #include <jpeglib.h>
 
 #include <inttypes.h>
+#include <pthread.h>
 #include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
@@ -164,6 +165,102 @@ static void jpeg_guac_dest(j_compress_ptr cinfo, guac_socket* socket,
 
 }
 
+/**
+ * Per-thread state which is reused across all JPEG images encoded by that
+ * thread. Creating a libjpeg compression structure allocates (and destroying
+ * it frees) several pools of memory, which would otherwise be repeated for
+ * every image.
+ */
+typedef struct guac_jpeg_context {
+
+    /**
+     * The libjpeg compression structure used for all images.
+     */
+    struct jpeg_compress_struct cinfo;
+
+    /**
+     * The libjpeg error manager associated with cinfo.
+     */
+    struct jpeg_error_mgr jerr;
+
+    /**
+     * Buffer receiving each scanline after conversion from BGRx to RGB, if
+     * that conversion is needed.
+     */
+    unsigned char* scanline;
+
+    /**
+     * The number of bytes allocated for the scanline buffer.
+     */
+    int scanline_size;
+
+} guac_jpeg_context;
+
+/**
+ * The key used to store and retrieve the guac_jpeg_context of the current
+ * thread.
+ */
+static pthread_key_t guac_jpeg_context_key;
+
+/**
+ * Ensures guac_jpeg_context_key is initialized only once.
+ */
+static pthread_once_t guac_jpeg_context_key_init = PTHREAD_ONCE_INIT;
+
+/**
+ * Frees the given guac_jpeg_context. This function is automatically invoked
+ * when a thread which has used guac_jpeg_write() exits.
+ *
+ * @param data
+ *     The guac_jpeg_context to free.
+ */
+static void guac_jpeg_free_context(void* data) {
+
+    guac_jpeg_context* context = (guac_jpeg_context*) data;
+
+    jpeg_destroy_compress(&context->cinfo);
+    free(context->scanline);
+    free(context);
+
+}
+
+/**
+ * Creates the key used to store the guac_jpeg_context of each thread. This
+ * function is invoked only once, via pthread_once().
+ */
+static void guac_jpeg_create_context_key() {
+    pthread_key_create(&guac_jpeg_context_key, guac_jpeg_free_context);
+}
+
+/**
+ * Returns the guac_jpeg_context of the current thread, allocating it and
+ * creating its compression structure if necessary.
+ *
+ * @return
+ *     The guac_jpeg_context of the current thread, or NULL if it could not
+ *     be allocated.
+ */
+static guac_jpeg_context* guac_jpeg_get_context() {
+
+    pthread_once(&guac_jpeg_context_key_init, guac_jpeg_create_context_key);
+
+    /* Reuse existing context, if any */
+    guac_jpeg_context* context = pthread_getspecific(guac_jpeg_context_key);
+    if (context != NULL)
+        return context;
+
+    context = calloc(1, sizeof(guac_jpeg_context));
+    if (context == NULL)
+        return NULL;
+
+    context->cinfo.err = jpeg_std_error(&context->jerr);
+    jpeg_create_compress(&context->cinfo);
+
+    pthread_setspecific(guac_jpeg_context_key, context);
+    return context;
+
+}
+
 int guac_jpeg_write(guac_socket* socket, guac_stream* stream,
         cairo_surface_t* surface, int quality) {
 
@@ -185,48 +282,66 @@ int guac_jpeg_write(guac_socket* socket, guac_stream* stream,
     /* Flush pending operations to surface */
     cairo_surface_flush(surface);
 
-    /* Prepare JPEG bits */
-    struct jpeg_compress_struct cinfo;
-    struct jpeg_error_mgr jerr;
-    cinfo.err = jpeg_std_error(&jerr);
-    jpeg_create_compress(&cinfo);
+    /* Reuse JPEG bits from any previous image encoded by this thread */
+    guac_jpeg_context* context = guac_jpeg_get_context();
+    if (context == NULL) {
+        guac_error = GUAC_STATUS_NO_MEMORY;
+        guac_error_message = "Unable to allocate JPEG encoder state";
+        return -1;
+    }
+
+    j_compress_ptr cinfo = &context->cinfo;
 
     /* Write JPEG directly to given stream */
-    jpeg_guac_dest(&cinfo, socket, stream);
+    jpeg_guac_dest(cinfo, socket, stream);
 
-    cinfo.image_width = width; /* image width and height, in pixels */
-    cinfo.image_height = height;
-    cinfo.arith_code = TRUE;
+    cinfo->image_width = width; /* image width and height, in pixels */
+    cinfo->image_height = height;
+    cinfo->arith_code = TRUE;
 
 #ifdef JCS_EXTENSIONS
     /* The Turbo JPEG extentions allows us to use the Cairo surface
      * (BGRx) as input without converting it */
-    cinfo.input_components = 4;
-    cinfo.in_color_space = JCS_EXT_BGRX;
+    cinfo->input_components = 4;
+    cinfo->in_color_space = JCS_EXT_BGRX;
 #else
     /* Standard JPEG supports RGB as input so we will have to convert
      * the contents of the Cairo surface from (BGRx) to RGB */
-    cinfo.input_components = 3;
-    cinfo.in_color_space = JCS_RGB;
-
-    /* Create a buffer for the write scan line which is where we will
-     * put the converted pixels (BGRx -> RGB) */
-    int write_stride = cinfo.image_width * cinfo.input_components;
-    unsigned char *scanline_data = malloc(write_stride);
-    memset(scanline_data, 0, write_stride);
+    cinfo->input_components = 3;
+    cinfo->in_color_space = JCS_RGB;
+
+    /* Grow the buffer for the write scan line, which is where we will
+     * put the converted pixels (BGRx -> RGB), only as necessary */
+    int write_stride = cinfo->image_width * cinfo->input_components;
+    if (context->scanline_size < write_stride) {
+
+        free(context->scanline);
+        context->scanline = malloc(write_stride);
+        if (context->scanline == NULL) {
+            context->scanline_size = 0;
+            guac_error = GUAC_STATUS_NO_MEMORY;
+            guac_error_message = "Unable to allocate JPEG scanline buffer";
+            return -1;
+        }
+
+        context->scanline_size = write_stride;
+
+    }
+
+    unsigned char *scanline_data = context->scanline;
 #endif
 
     /* Initialize the JPEG compressor */
-    jpeg_set_defaults(&cinfo);
-    jpeg_set_quality(&cinfo, quality, TRUE /* limit to baseline-JPEG values */);
-    jpeg_start_compress(&cinfo, TRUE);
+    jpeg_set_defaults(cinfo);
+    jpeg_set_quality(cinfo, quality, TRUE /* limit to baseline-JPEG values */);
+    jpeg_start_compress(cinfo, TRUE);
 
     JSAMPROW row_pointer[1]; /* pointer to a single row */
 
     /* Write scanlines to be used in JPEG compression */
-    while (cinfo.next_scanline < cinfo.image_height) {
+    while (cinfo->next_scanline < cinfo->image_height) {
 
-        int row_offset = stride * cinfo.next_scanline;
+        int row_offset = stride * cinfo->next_scanline;
 
 #ifdef JCS_EXTENSIONS
         /* In Turbo JPEG we can use the raw BGRx scanline  */
@@ -250,18 +365,12 @@ int guac_jpeg_write(guac_socket* socket, guac_stream* stream,
         row_pointer[0] = scanline_data;
 #endif
 
-        jpeg_write_scanlines(&cinfo, row_pointer, 1);
+        jpeg_write_scanlines(cinfo, row_pointer, 1);
     }
 
-#ifndef JCS_EXTENSIONS
-    free(scanline_data);
-#endif
-
-    /* Finalize compression */
-    jpeg_finish_compress(&cinfo);
-
-    /* Clean up */
-    jpeg_destroy_compress(&cinfo);
+    /* Finalize compression, leaving the compression structure ready for the
+     * next image */
+    jpeg_finish_compress(cinfo);
     return 0;
 
 }
@@ -19,6 +19,7 @@
 
 #include "config.h"
 
+#include "arena.h"
 #include "encode-png.h"
 #include "guacamole/error.h"
 #include "guacamole/protocol.h"
@@ -33,6 +34,7 @@
 #endif
 
 #include <inttypes.h>
+#include <pthread.h>
 #include <setjmp.h>
 #include <stdint.h>
 #include <stdlib.h>
@@ -265,12 +267,252 @@ static void guac_png_flush_handler(png_structp png) {
 
 }
 
+/**
+ * The maximum number of bytes of index buffer and row pointers which each
+ * thread retains between PNG images. The buffers allocated for any larger
+ * image are freed once that image has been written, such that a single large
+ * image does not permanently increase the memory held by every thread which
+ * encodes PNG images.
+ */
+#define GUAC_PNG_MAX_RETAINED_SIZE 1048576
+
+/**
+ * Per-thread state which is reused across all PNG images encoded by that
+ * thread, such that encoding a series of small images does not require
+ * repeatedly allocating and freeing the same memory.
+ */
+typedef struct guac_png_context {
+
+    /**
+     * Scratch memory from which all memory required internally by libpng
+     * (and zlib) is allocated. This arena is reset after each image.
+     */
+    guac_arena* arena;
+
+    /**
+     * The palette of the image currently being encoded.
+     */
+    guac_palette palette;
+
+    /**
+     * Buffer of palette indices for each pixel of the image currently being
+     * encoded, one byte per pixel.
+     */
+    png_byte* indices;
+
+    /**
+     * The number of bytes allocated for the indices buffer.
+     */
+    size_t indices_size;
+
+    /**
+     * Array of pointers to the start of each row within the indices buffer.
+     */
+    png_byte** rows;
+
+    /**
+     * The number of row pointers allocated for the rows array.
+     */
+    int rows_size;
+
+} guac_png_context;
+
+/**
+ * The key used to store and retrieve the guac_png_context of the current
+ * thread.
+ */
+static pthread_key_t guac_png_context_key;
+
+/**
+ * Ensures guac_png_context_key is initialized only once.
+ */
+static pthread_once_t guac_png_context_key_init = PTHREAD_ONCE_INIT;
+
+/**
+ * Frees the given guac_png_context. This function is automatically invoked
+ * when a thread which has used guac_png_write() exits.
+ *
+ * @param data
+ *     The guac_png_context to free.
+ */
+static void guac_png_free_context(void* data) {
+
+    guac_png_context* context = (guac_png_context*) data;
+
+    guac_arena_free(context->arena);
+    free(context->indices);
+    free(context->rows);
+    free(context);
+
+}
+
+/**
+ * Creates the key used to store the guac_png_context of each thread. This
+ * function is invoked only once, via pthread_once().
+ */
+static void guac_png_create_context_key() {
+    pthread_key_create(&guac_png_context_key, guac_png_free_context);
+}
+
+/**
+ * Returns the guac_png_context of the current thread, allocating it if
+ * necessary.
+ *
+ * @return
+ *     The guac_png_context of the current thread, or NULL if it could not
+ *     be allocated.
+ */
+static guac_png_context* guac_png_get_context() {
+
+    pthread_once(&guac_png_context_key_init, guac_png_create_context_key);
+
+    /* Reuse existing context, if any */
+    guac_png_context* context = pthread_getspecific(guac_png_context_key);
+    if (context != NULL)
+        return context;
+
+    context = calloc(1, sizeof(guac_png_context));
+    if (context == NULL)
+        return NULL;
+
+    context->arena = guac_arena_alloc();
+    if (context->arena == NULL) {
+        free(context);
+        return NULL;
+    }
+
+    pthread_setspecific(guac_png_context_key, context);
+    return context;
+
+}
+
+/**
+ * Ensures the index buffer and row pointers of the given guac_png_context
+ * are large enough for an image having the given dimensions, and that each
+ * row pointer points to its corresponding row.
+ *
+ * @param context
+ *     The guac_png_context to prepare.
+ *
+ * @param width
+ *     The width of the image, in pixels.
+ *
+ * @param height
+ *     The height of the image, in pixels.
+ *
+ * @return
+ *     Zero if the buffers are ready, non-zero if they could not be
+ *     allocated.
+ */
+static int guac_png_prepare_context(guac_png_context* context,
+        int width, int height) {
+
+    int y;
+
+    /* Grow index buffer only as necessary */
+    size_t indices_size = (size_t) width * height;
+    if (context->indices_size < indices_size) {
+
+        free(context->indices);
+        context->indices = malloc(indices_size);
+        if (context->indices == NULL) {
+            context->indices_size = 0;
+            return 1;
+        }
+
+        context->indices_size = indices_size;
+
+    }
+
+    /* Likewise grow row pointer array */
+    if (context->rows_size < height) {
+
+        free(context->rows);
+        context->rows = malloc(sizeof(png_byte*) * height);
+        if (context->rows == NULL) {
+            context->rows_size = 0;
+            return 1;
+        }
+
+        context->rows_size = height;
+
+    }
+
+    for (y=0; y<height; y++)
+        context->rows[y] = context->indices + (size_t) y * width;
+
+    return 0;
+
+}
+
+/**
+ * Releases the memory used by the given guac_png_context for the image just
+ * written, such that the context is ready for the next image. The arena is
+ * reset, and the index buffer and row pointers are freed if they exceed
+ * GUAC_PNG_MAX_RETAINED_SIZE.
+ *
+ * @param context
+ *     The guac_png_context to release.
+ */
+static void guac_png_release_context(guac_png_context* context) {
+
+    guac_arena_reset(context->arena);
+
+    /* Retain only buffers suitable for typical images */
+    if (context->indices_size + sizeof(png_byte*) * context->rows_size
+            > GUAC_PNG_MAX_RETAINED_SIZE) {
+
+        free(context->indices);
+        context->indices = NULL;
+        context->indices_size = 0;
+
+        free(context->rows);
+        context->rows = NULL;
+        context->rows_size = 0;
+
+    }
+
+}
+
+/**
+ * Allocates memory on behalf of libpng from the arena of the current
+ * guac_png_context. This handler is set via png_create_write_struct_2().
+ *
+ * @param png
+ *     The PNG compression state structure requesting the allocation. The
+ *     arena to allocate from will have been provided to
+ *     png_create_write_struct_2() and is accessible via png_get_mem_ptr().
+ *
+ * @param size
+ *     The number of bytes to allocate.
+ *
+ * @return
+ *     A pointer to the allocated memory, or NULL if allocation fails.
+ */
+static png_voidp guac_png_arena_malloc(png_structp png, png_size_t size) {
+    return guac_arena_malloc((guac_arena*) png_get_mem_ptr(png), size);
+}
+
+/**
+ * Ignores a request from libpng to free memory allocated by
+ * guac_png_arena_malloc(). All such memory is released at once when the
+ * arena is reset after each image.
+ *
+ * @param png
+ *     The PNG compression state structure which allocated the memory.
+ *
+ * @param ptr
+ *     The memory being freed.
+ */
+static void guac_png_arena_free(png_structp png, png_voidp ptr) {
+    /* Arena memory is released only by guac_arena_reset() */
+}
+
 int guac_png_write(guac_socket* socket, guac_stream* stream,
         cairo_surface_t* surface) {
 
     png_structp png;
     png_infop png_info;
-    png_byte** png_rows;
     int bpp;
 
     int x, y;
@@ -288,26 +530,42 @@ int guac_png_write(guac_socket* socket, guac_stream* stream,
     if (format != CAIRO_FORMAT_RGB24 || data == NULL)
         return guac_png_cairo_write(socket, stream, surface);
 
+    /* Get state reused across images encoded by this thread */
+    guac_png_context* context = guac_png_get_context();
+    if (context == NULL) {
+        guac_error = GUAC_STATUS_NO_MEMORY;
+        guac_error_message = "Unable to allocate PNG encoder state";
+        return -1;
+    }
+
     /* Flush pending operations to surface */
     cairo_surface_flush(surface);
 
-    /* Attempt to build palette */
-    guac_palette* palette = guac_palette_alloc(surface);
-
-    /* If not possible, resort to Cairo PNG writer */
-    if (palette == NULL)
+    /* Attempt to build palette, resorting to Cairo PNG writer if not
+     * possible */
+    guac_palette* palette = &(context->palette);
+    if (guac_palette_build(palette, surface))
         return guac_png_cairo_write(socket, stream, surface);
 
+    /* Index buffers are needed only once the palette is known to fit */
+    if (guac_png_prepare_context(context, width, height)) {
+        guac_png_release_context(context);
+        guac_error = GUAC_STATUS_NO_MEMORY;
+        guac_error_message = "Unable to allocate PNG encoder state";
+        return -1;
+    }
+
     /* Calculate BPP from palette size */
     if      (palette->size <= 2)  bpp = 1;
     else if (palette->size <= 4)  bpp = 2;
     else if (palette->size <= 16) bpp = 4;
     else                          bpp = 8;
 
-    /* Set up PNG writer */
-    png = png_create_write_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+    /* Set up PNG writer, allocating all libpng memory from the arena */
+    png = png_create_write_struct_2(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL,
+            context->arena, guac_png_arena_malloc, guac_png_arena_free);
     if (!png) {
-        guac_palette_free(palette);
+        guac_png_release_context(context);
         guac_error = GUAC_STATUS_INTERNAL_ERROR;
         guac_error_message = "libpng failed to create write structure";
         return -1;
@@ -316,7 +574,7 @@ int guac_png_write(guac_socket* socket, guac_stream* stream,
     png_info = png_create_info_struct(png);
     if (!png_info) {
         png_destroy_write_struct(&png, NULL);
-        guac_palette_free(palette);
+        guac_png_release_context(context);
         guac_error = GUAC_STATUS_INTERNAL_ERROR;
         guac_error_message = "libpng failed to create info structure";
         return -1;
@@ -325,7 +583,7 @@ int guac_png_write(guac_socket* socket, guac_stream* stream,
     /* Set error handler */
     if (setjmp(png_jmpbuf(png))) {
         png_destroy_write_struct(&png, &png_info);
-        guac_palette_free(palette);
+        guac_png_release_context(context);
         guac_error = GUAC_STATUS_IO_ERROR;
         guac_error_message = "libpng output error";
         return -1;
@@ -342,12 +600,9 @@ int guac_png_write(guac_socket* socket, guac_stream* stream,
             guac_png_flush_handler);
 
     /* Copy data from surface into PNG data */
-    png_rows = (png_byte**) malloc(sizeof(png_byte*) * height);
     for (y=0; y<height; y++) {
 
-        /* Allocate new PNG row */
-        png_byte* row = (png_byte*) malloc(sizeof(png_byte) * width);
-        png_rows[y] = row;
+        png_byte* row = context->rows[y];
 
         /* Copy data from surface into current row */
         for (x=0; x<width; x++) {
@@ -382,23 +637,15 @@ int guac_png_write(guac_socket* socket, guac_stream* stream,
     png_set_PLTE(png, png_info, palette->colors, palette->size);
 
     /* Write image */
-    png_set_rows(png, png_info, png_rows);
+    png_set_rows(png, png_info, context->rows);
     png_write_png(png, png_info, PNG_TRANSFORM_PACKING, NULL);
 
-    /* Finish write */
+    /* Finish write, releasing all libpng memory for the next image */
     png_destroy_write_struct(&png, &png_info);
-
-    /* Free palette */
-    guac_palette_free(palette);
-
-    /* Free PNG data */
-    for (y=0; y<height; y++)
-        free(png_rows[y]);
-    free(png_rows);
+    guac_png_release_context(context);
 
     /* Ensure all data is written */
     guac_png_flush_data(&write_state);
     return 0;
 
 }
-
@@ -35,6 +35,7 @@
 #include "socket-types.h"
 #include "stream-types.h"
 #include "timestamp-types.h"
+#include "user-constants.h"
 #include "user-fntypes.h"
 #include "user-types.h"
 
@@ -257,6 +258,39 @@ struct guac_client {
      */
     void* __plugin_handle;
 
+    /**
+     * Handler for resync events, called whenever display output written to
+     * the broadcast socket has been dropped for a user that was not keeping
+     * up with the connection. The handler is invoked from a thread dedicated
+     * to that user's output, and must send the full current state of the
+     * display to the user's socket, typically using the same mechanism used
+     * to synchronize newly-joined users. Other output, such as audio and file
+     * transfers, is never dropped.
+     *
+     * If this handler is not defined, or if a user falls behind even without
+     * display output, that user is instead disconnected.
+     *
+     * Example:
+     * @code
+     *     int resync_handler(guac_user* user);
+     *
+     *     int guac_client_init(guac_client* client) {
+     *         client->resync_handler = resync_handler;
+     *     }
+     * @endcode
+     */
+    guac_user_resync_handler* resync_handler;
+
+    /**
+     * The maximum number of bytes of output which may be queued for any one
+     * user before display data written to the broadcast socket is dropped
+     * for that user (see resync_handler). This defaults to
+     * GUAC_USER_OUTPUT_QUEUE_LIMIT, and may be changed by the client plugin
+     * or the hosting daemon at any time before users join. Changes do not
+     * affect users which have already joined.
+     */
+    size_t output_queue_limit;
+
 };
 
 /**
@@ -708,6 +742,138 @@ void guac_client_stream_webp(guac_client* client, guac_socket* socket,
         guac_composite_mode mode, const guac_layer* layer, int x, int y,
         cairo_surface_t* surface, int quality, int lossless);
 
+/**
+ * Streams the image data of the given surface over the given image stream
+ * ("img" instruction) as PNG-encoded data. Unlike guac_client_stream_png(),
+ * the image stream is not allocated or freed, and must remain allocated until
+ * the instructions written to the given socket have actually been sent. This
+ * is necessary if those instructions are buffered and sent later, as the
+ * index of a freed stream may be reused by other threads in the meantime.
+ *
+ * @param client
+ *     The Guacamole client which allocated the given stream.
+ *
+ * @param socket
+ *     The socket over which instructions associated with the image stream
+ *     should be sent.
+ *
+ * @param stream
+ *     The image stream to send the image data along, as allocated by
+ *     guac_client_alloc_stream().
+ *
+ * @param mode
+ *     The composite mode to use when rendering the image over the given layer.
+ *
+ * @param layer
+ *     The destination layer.
+ *
+ * @param x
+ *     The X coordinate of the upper-left corner of the destination rectangle
+ *     within the given layer.
+ *
+ * @param y
+ *     The Y coordinate of the upper-left corner of the destination rectangle
+ *     within the given layer.
+ *
+ * @param surface
+ *     A Cairo surface containing the image data to be streamed.
+ */
+void guac_client_write_png(guac_client* client, guac_socket* socket,
+        guac_stream* stream, guac_composite_mode mode,
+        const guac_layer* layer, int x, int y, cairo_surface_t* surface);
+
+/**
+ * Streams the image data of the given surface over the given image stream
+ * ("img" instruction) as JPEG-encoded data at the given quality. The image
+ * stream is not allocated or freed, as described by guac_client_write_png().
+ *
+ * @param client
+ *     The Guacamole client which allocated the given stream.
+ *
+ * @param socket
+ *     The socket over which instructions associated with the image stream
+ *     should be sent.
+ *
+ * @param stream
+ *     The image stream to send the image data along, as allocated by
+ *     guac_client_alloc_stream().
+ *
+ * @param mode
+ *     The composite mode to use when rendering the image over the given layer.
+ *
+ * @param layer
+ *     The destination layer.
+ *
+ * @param x
+ *     The X coordinate of the upper-left corner of the destination rectangle
+ *     within the given layer.
+ *
+ * @param y
+ *     The Y coordinate of the upper-left corner of the destination rectangle
+ *     within the given layer.
+ *
+ * @param surface
+ *     A Cairo surface containing the image data to be streamed.
+ *
+ * @param quality
+ *     The JPEG image quality, which must be an integer value between 0 and 100
+ *     inclusive. Larger values indicate improving quality at the expense of
+ *     larger file size.
+ */
+void guac_client_write_jpeg(guac_client* client, guac_socket* socket,
+        guac_stream* stream, guac_composite_mode mode,
+        const guac_layer* layer, int x, int y, cairo_surface_t* surface,
+        int quality);
+
+/**
+ * Streams the image data of the given surface over the given image stream
+ * ("img" instruction) as WebP-encoded data at the given quality. The image
+ * stream is not allocated or freed, as described by guac_client_write_png().
+ * If the server does not support WebP, this function has no effect.
+ *
+ * @param client
+ *     The Guacamole client which allocated the given stream.
+ *
+ * @param socket
+ *     The socket over which instructions associated with the image stream
+ *     should be sent.
+ *
+ * @param stream
+ *     The image stream to send the image data along, as allocated by
+ *     guac_client_alloc_stream().
+ *
+ * @param mode
+ *     The composite mode to use when rendering the image over the given layer.
+ *
+ * @param layer
+ *     The destination layer.
+ *
+ * @param x
+ *     The X coordinate of the upper-left corner of the destination rectangle
+ *     within the given layer.
+ *
+ * @param y
+ *     The Y coordinate of the upper-left corner of the destination rectangle
+ *     within the given layer.
+ *
+ * @param surface
+ *     A Cairo surface containing the image data to be streamed.
+ *
+ * @param quality
+ *     The WebP image quality, which must be an integer value between 0 and 100
+ *     inclusive. For lossy images, larger values indicate improving quality at
+ *     the expense of larger file size. For lossless images, this dictates the
+ *     quality of compression, with larger values producing smaller files at
+ *     the expense of speed.
+ *
+ * @param lossless
+ *     Zero to encode a lossy image, non-zero to encode losslessly.
+ */
+void guac_client_write_webp(guac_client* client, guac_socket* socket,
+        guac_stream* stream, guac_composite_mode mode,
+        const guac_layer* layer, int x, int y, cairo_surface_t* surface,
+        int quality, int lossless);
+
 /**
  * Returns whether the owner of the given client supports the "required"
  * instruction, returning non-zero if the client owner does support the
@@ -31,6 +31,13 @@
  */
 #define GUAC_SOCKET_OUTPUT_BUFFER_SIZE 8192
 
+/**
+ * The number of bytes of base64-encoded data to produce at once when writing
+ * binary data with guac_socket_write_base64(). This value must be a multiple
+ * of four.
+ */
+#define GUAC_SOCKET_BASE64_BLOCK_SIZE 4096
+
 /**
  * The number of milliseconds to wait between keep-alive pings on a socket
  * with keep-alive enabled.
@@ -235,6 +235,11 @@ guac_socket* guac_socket_tee(guac_socket* primary, guac_socket* secondary);
  * from the socket will fail.  If a write occurs while no users are connected,
  * that write will simply be dropped.
  *
+ * Data written to the returned socket is encoded only once, regardless of the
+ * number of connected users. Each complete instruction is then written to
+ * the socket of each user as a single block, without the socket of any user
+ * being held locked while the instruction is being constructed.
+ *
  * Return values (error codes) from each user's socket will not affect the
  * in-progress write, but each failing user will be forcibly stopped with
  * guac_user_stop().
@@ -52,6 +52,17 @@
  */
 #define GUAC_USER_UNDEFINED_OBJECT_INDEX -1
 
+/**
+ * The default maximum number of bytes of output which may be queued for any
+ * one guac_user before display data written to the broadcast socket of the
+ * associated guac_client is dropped for that user. Users which fall this far
+ * behind are resynchronized using the resync_handler of the guac_client, if
+ * defined, and are otherwise disconnected, as are users which exceed this
+ * limit even without display data. The limit actually used is the
+ * output_queue_limit of the guac_client.
+ */
+#define GUAC_USER_OUTPUT_QUEUE_LIMIT 16777216
+
 /**
  * The stream name reserved for the root of a Guacamole protocol object.
  */
@@ -429,6 +429,23 @@ typedef int guac_user_join_handler(guac_user* user, int argc, char** argv);
  */
 typedef int guac_user_leave_handler(guac_user* user);
 
+/**
+ * Handler for Guacamole resync events. A resync event is fired by the
+ * guac_client whenever output written to its broadcast socket had to be
+ * dropped for a particular guac_user because that user was not receiving
+ * data quickly enough. The handler must send the complete current state of
+ * the connection to the user, just as would be done for a newly-joined user.
+ * There is no instruction associated with a resync event.
+ *
+ * @param user
+ *     The user whose view of the connection must be resynchronized.
+ *
+ * @return
+ *     Zero if the user has been successfully resynchronized, non-zero
+ *     otherwise.
+ */
+typedef int guac_user_resync_handler(guac_user* user);
+
 /**
  * Handler for Guacamole sync events. A sync event is fired by the
  * guac_client whenever a guac_user responds to a "sync" instruction. Sync
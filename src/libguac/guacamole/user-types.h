@@ -38,5 +38,11 @@ typedef struct guac_user guac_user;
  */
 typedef struct guac_user_info guac_user_info;
 
+/**
+ * Statistics describing the output queued for a particular user, as
+ * retrieved with guac_user_get_output_stats().
+ */
+typedef struct guac_user_output_stats guac_user_output_stats;
+
 #endif
 
@@ -42,6 +42,31 @@
 
 #include <pthread.h>
 #include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+
+struct guac_user_output_stats {
+
+    /**
+     * The number of bytes of output which have been queued for the user but
+     * not yet written to the user's connection.
+     */
+    size_t queue_length;
+
+    /**
+     * The number of times that queued output written to the broadcast socket
+     * had to be dropped because the user was not keeping up with the
+     * connection.
+     */
+    int drops;
+
+    /**
+     * The total number of bytes of output written to the broadcast socket
+     * which have been dropped for the user.
+     */
+    uint64_t dropped_bytes;
+
+};
 
 struct guac_user_info {
 
@@ -530,6 +555,13 @@ struct guac_user {
      */
     guac_user_touch_handler* touch_handler;
 
+    /**
+     * The queue through which all output to this user is written while the
+     * user is connected, or NULL if output is not currently being queued.
+     * This is currently only used internally by libguac.
+     */
+    struct guac_user_output* __output;
+
 };
 
 /**
@@ -619,6 +651,27 @@ guac_stream* guac_user_alloc_stream(guac_user* user);
  */
 void guac_user_free_stream(guac_user* user, guac_stream* stream);
 
+/**
+ * Retrieves the current state of the given user's output queue, including the
+ * amount of output queued and how much output has been dropped because the
+ * user was not keeping up with the connection. The statistics are read while
+ * holding the lock guarding the queue, and are thus consistent with each
+ * other. If the user's output is not being queued (the user is not connected
+ * or has already left), all statistics are zero.
+ *
+ * This function may only be invoked for a user that is part of its
+ * guac_client (for example, from within guac_client_foreach_user() or any
+ * handler of that user), as the output queue is freed once the user leaves.
+ *
+ * @param user
+ *     The user whose output queue statistics should be retrieved.
+ *
+ * @param stats
+ *     The guac_user_output_stats structure to populate.
+ */
+void guac_user_get_output_stats(guac_user* user,
+        guac_user_output_stats* stats);
+
 /**
  * Signals the given user that it must disconnect, or advises cooperating
  * services that the given user is no longer connected.
@@ -30,6 +30,22 @@
 
 guac_palette* guac_palette_alloc(cairo_surface_t* surface) {
 
+    /* Allocate palette */
+    guac_palette* palette = (guac_palette*) malloc(sizeof(guac_palette));
+    memset(palette, 0, sizeof(guac_palette));
+
+    /* Populate palette, failing if there are too many colors */
+    if (guac_palette_build(palette, surface)) {
+        guac_palette_free(palette);
+        return NULL;
+    }
+
+    return palette;
+
+}
+
+int guac_palette_build(guac_palette* palette, cairo_surface_t* surface) {
+
     int x, y;
 
     int width = cairo_image_surface_get_width(surface);
@@ -37,9 +53,12 @@ guac_palette* guac_palette_alloc(cairo_surface_t* surface) {
     int stride = cairo_image_surface_get_stride(surface);
     unsigned char* data = cairo_image_surface_get_data(surface);
 
-    /* Allocate palette */
-    guac_palette* palette = (guac_palette*) malloc(sizeof(guac_palette));
-    memset(palette, 0, sizeof(guac_palette));
+    /* Clear only those entries used by any previous contents of the palette,
+     * rather than the entire table */
+    for (x=0; x<palette->size; x++)
+        palette->entries[palette->hashes[x]].index = 0;
+
+    palette->size = 0;
 
     for (y=0; y<height; y++) {
         for (x=0; x<width; x++) {
@@ -63,10 +82,8 @@ guac_palette* guac_palette_alloc(cairo_surface_t* surface) {
                     png_color* c;
 
                     /* Stop if already at capacity */
-                    if (palette->size == 256) {
-                        guac_palette_free(palette);
-                        return NULL;
-                    }
+                    if (palette->size == 256)
+                        return -1;
 
                     /* Store in palette */
                     c = &(palette->colors[palette->size]);
@@ -75,6 +92,7 @@ guac_palette* guac_palette_alloc(cairo_surface_t* surface) {
                     c->red   = (color >> 16) & 0xFF;
 
                     /* Add color to map */
+                    palette->hashes[palette->size] = hash;
                     entry->index = ++palette->size;
                     entry->color = color;
 
@@ -97,7 +115,7 @@ guac_palette* guac_palette_alloc(cairo_surface_t* surface) {
 
     }
 
-    return palette;
+    return 0;
 
 }
 
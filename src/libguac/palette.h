@@ -35,11 +35,13 @@ typedef struct guac_palette {
 
     guac_palette_entry entries[0x1000];
     png_color colors[256];
+    int hashes[256];
     int size;
 
 } guac_palette;
 
 guac_palette* guac_palette_alloc(cairo_surface_t* surface);
+int guac_palette_build(guac_palette* palette, cairo_surface_t* surface);
 int guac_palette_find(guac_palette* palette, int color);
 void guac_palette_free(guac_palette* palette);
 
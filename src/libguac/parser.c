@@ -24,10 +24,15 @@
 #include "guacamole/socket.h"
 #include "guacamole/unicode.h"
 
+#include <stdint.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
 static void guac_parser_reset(guac_parser* parser) {
     parser->opcode = NULL;
     parser->argc = 0;
@@ -36,6 +41,66 @@ static void guac_parser_reset(guac_parser* parser) {
     parser->__element_length = 0;
 }
 
+/**
+ * Returns the number of bytes at the beginning of the given buffer which are
+ * ASCII characters (have their high bit clear), examining no more than the
+ * given number of bytes. As each ASCII character is exactly one byte, this
+ * is also the number of codepoints which may be skipped without decoding any
+ * UTF-8. The buffer is examined 16 bytes at a time using SSE2 where
+ * available, and one machine word at a time otherwise.
+ *
+ * @param buffer
+ *     The buffer to examine.
+ *
+ * @param length
+ *     The maximum number of bytes to examine.
+ *
+ * @return
+ *     The number of leading bytes within the given buffer which are ASCII,
+ *     which will be no greater than the given length.
+ */
+static int guac_parser_ascii_length(const char* buffer, int length) {
+
+    int scanned = 0;
+
+#ifdef __SSE2__
+    /* Test the high bits of 16 bytes at a time */
+    while (length - scanned >= 16) {
+
+        int mask = _mm_movemask_epi8(
+                _mm_loadu_si128((const __m128i*) (buffer + scanned)));
+
+        /* Stop at first non-ASCII byte, if any */
+        if (mask != 0)
+            return scanned + __builtin_ctz(mask);
+
+        scanned += 16;
+
+    }
+#else
+    /* Test the high bits of 8 bytes at a time */
+    while (length - scanned >= 8) {
+
+        uint64_t word;
+        memcpy(&word, buffer + scanned, sizeof(word));
+
+        /* Locate the exact non-ASCII byte below */
+        if (word & 0x8080808080808080ULL)
+            break;
+
+        scanned += 8;
+
+    }
+#endif
+
+    /* Test any remaining bytes individually */
+    while (scanned < length && !(buffer[scanned] & 0x80))
+        scanned++;
+
+    return scanned;
+
+}
+
 guac_parser* guac_parser_alloc() {
 
     /* Allocate space for parser */
@@ -112,6 +177,25 @@ int guac_parser_append(guac_parser* parser, void* buffer, int length) {
 
         while (bytes_parsed < length && parser->__element_length >= 0) {
 
+            /* Skip directly past any run of ASCII characters within the
+             * element, stopping short of the terminator */
+            if (parser->__element_length > 0) {
+
+                int available = length - bytes_parsed;
+                if (available > parser->__element_length)
+                    available = parser->__element_length;
+
+                int skipped = guac_parser_ascii_length(char_buffer, available);
+                parser->__element_length -= skipped;
+                bytes_parsed += skipped;
+                char_buffer += skipped;
+
+                /* Wait for more data if entire buffer was skipped */
+                if (bytes_parsed == length)
+                    break;
+
+            }
+
             /* Get length of current character */
             char c = *char_buffer;
             int char_length = guac_utf8_charsize((unsigned char) c);
@@ -23,9 +23,36 @@
 #include "guacamole/error.h"
 #include "guacamole/socket.h"
 #include "guacamole/user.h"
+#include "socket-chunk.h"
+#include "user-output.h"
 
 #include <pthread.h>
 #include <stdlib.h>
+#include <string.h>
+
+/**
+ * The opcodes of all instructions which only affect the display, and whose
+ * effect is therefore restored when a user is resynchronized. The "img",
+ * "blob" and "end" instructions are handled separately, as they may also
+ * belong to streams which are not images. The "dispose" instruction is
+ * deliberately absent, as resynchronization does not remove layers which no
+ * longer exist.
+ */
+static const char* __guac_socket_broadcast_display_opcodes[] = {
+    "arc", "cfill", "clip", "close", "copy", "cstroke", "cursor", "curve",
+    "distort", "identity", "lfill", "line", "lstroke", "mouse", "move",
+    "pop", "push", "rect", "reset", "set", "shade", "size", "start", "sync",
+    "transfer", "transform", NULL
+};
+
+/**
+ * The opcodes of all instructions other than "img" which open a new
+ * client-level stream, and thus indicate that the index of that stream no
+ * longer refers to an image stream.
+ */
+static const char* __guac_socket_broadcast_stream_opcodes[] = {
+    "argv", "audio", "body", "clipboard", "file", "pipe", "video", NULL
+};
 
 /**
  * Data associated with an open socket which writes to all connected users of
@@ -45,24 +72,29 @@ typedef struct guac_socket_broadcast_data {
      */
     pthread_mutex_t socket_lock;
 
-} guac_socket_broadcast_data;
-
-/**
- * Single chunk of data, to be broadcast to all users.
- */
-typedef struct __write_chunk {
+    /**
+     * Lock which protects access to the pending chunk of this socket,
+     * guaranteeing atomicity of writes and broadcasts.
+     */
+    pthread_mutex_t buffer_lock;
 
     /**
-     * The buffer to write.
+     * The chunk into which all data written to this socket is encoded before
+     * being broadcast. Data is encoded into this chunk exactly once,
+     * regardless of the number of connected users, and the same chunk is then
+     * written to each user's socket in its entirety. This will be NULL only
+     * if a replacement chunk could not be allocated after a broadcast.
      */
-    const void* buffer;
+    guac_socket_chunk* chunk;
 
     /**
-     * The number of bytes in the buffer.
+     * Non-zero for each client-level stream, indexed by the array index of
+     * that stream within the guac_client, which was opened by an "img"
+     * instruction written to this socket and has not yet been ended.
      */
-    size_t length;
+    char image_streams[GUAC_CLIENT_MAX_STREAMS];
 
-} __write_chunk;
+} guac_socket_broadcast_data;
 
 /**
  * Callback which handles read requests on the broadcast socket. This callback
@@ -91,35 +123,335 @@ static ssize_t __guac_socket_broadcast_read_handler(guac_socket* socket,
 }
 
 /**
- * Callback invoked by guac_client_foreach_user() which write a given chunk of
- * data to that user's socket. If the write attempt fails, the user is
- * signalled to stop with guac_user_stop().
+ * Callback invoked by guac_client_foreach_user() which writes a given chunk of
+ * data to that user's socket as a single, atomic unit. If the user's output
+ * is queued, the chunk itself is shared with the user's output queue rather
+ * than copied. If the write attempt fails, the user is signalled to stop with
+ * guac_user_stop().
  *
  * @param user
  *     The user that the chunk of data should be written to.
  *
  * @param data
- *     A pointer to a __write_chunk which describes the data to be written.
+ *     A pointer to the guac_socket_chunk which should be written.
  *
  * @return
  *     Always NULL.
  */
 static void* __write_chunk_callback(guac_user* user, void* data) {
 
-    __write_chunk* chunk = (__write_chunk*) data;
+    guac_socket_chunk* chunk = (guac_socket_chunk*) data;
+    guac_socket* socket = user->socket;
+
+    /* Share chunk with output queue, if any, without waiting on the user */
+    if (user->__output != NULL) {
+        guac_user_output_broadcast(user->__output, chunk);
+        return NULL;
+    }
+
+    /* Chunks only ever contain whole instructions, so they must not be
+     * interleaved with anything else written to the user's socket */
+    guac_socket_instruction_begin(socket);
 
     /* Attempt write, disconnect on failure */
-    if (guac_socket_write(user->socket, chunk->buffer, chunk->length))
+    if (guac_socket_write(socket, chunk->buffer, chunk->length))
         guac_user_stop(user);
 
+    guac_socket_instruction_end(socket);
+
     return NULL;
 
 }
 
 /**
- * Socket write handler which operates on each of the sockets of all connected
- * users. This write handler will always succeed, but any failing user-specific
- * writes will invoke guac_user_stop() on the failing user.
+ * Parses the element of a Guacamole instruction beginning at the given offset
+ * within the given buffer, advancing the offset past the element and its
+ * terminator.
+ *
+ * @param buffer
+ *     The buffer containing the instruction.
+ *
+ * @param length
+ *     The number of bytes within the buffer.
+ *
+ * @param offset
+ *     The offset of the element within the buffer. This is updated to point
+ *     to the data following the element's terminator.
+ *
+ * @param value
+ *     Receives a pointer to the value of the element.
+ *
+ * @param value_length
+ *     Receives the length of the value of the element, in bytes.
+ *
+ * @return
+ *     The terminator of the element (',' or ';'), or zero if the buffer does
+ *     not contain a complete, valid element at the given offset.
+ */
+static char __guac_socket_broadcast_parse_element(const char* buffer,
+        size_t length, size_t* offset, const char** value,
+        size_t* value_length) {
+
+    size_t current = *offset;
+    size_t codepoints = 0;
+
+    /* Parse length prefix, which counts Unicode codepoints */
+    while (current < length && buffer[current] >= '0'
+            && buffer[current] <= '9' && codepoints < length)
+        codepoints = codepoints * 10 + buffer[current++] - '0';
+
+    if (current == *offset || current >= length || buffer[current++] != '.')
+        return 0;
+
+    /* Skip the value, one UTF-8 character at a time */
+    *value = buffer + current;
+    while (codepoints > 0 && current < length) {
+
+        unsigned char c = (unsigned char) buffer[current];
+
+        if (c < 0x80)
+            current += 1;
+        else if ((c & 0xE0) == 0xC0)
+            current += 2;
+        else if ((c & 0xF0) == 0xE0)
+            current += 3;
+        else
+            current += 4;
+
+        codepoints--;
+
+    }
+
+    if (codepoints > 0 || current >= length)
+        return 0;
+
+    *value_length = buffer + current - *value;
+    *offset = current + 1;
+
+    /* Only commas and semicolons may terminate an element */
+    if (buffer[current] != ',' && buffer[current] != ';')
+        return 0;
+
+    return buffer[current];
+
+}
+
+/**
+ * Parses the given value as the index of a client-level stream, returning
+ * the array index of that stream within the guac_client.
+ *
+ * @param value
+ *     The value to parse.
+ *
+ * @param value_length
+ *     The length of the value, in bytes.
+ *
+ * @return
+ *     The array index of the client-level stream, or -1 if the value is not
+ *     the index of a client-level stream.
+ */
+static int __guac_socket_broadcast_parse_stream(const char* value,
+        size_t value_length) {
+
+    int index = 0;
+
+    if (value_length == 0 || value_length > 4)
+        return -1;
+
+    while (value_length > 0) {
+
+        if (*value < '0' || *value > '9')
+            return -1;
+
+        index = index * 10 + *(value++) - '0';
+        value_length--;
+
+    }
+
+    /* Client-level streams have odd indices (see guac_client_alloc_stream()) */
+    if (index % 2 != 1 || index / 2 >= GUAC_CLIENT_MAX_STREAMS)
+        return -1;
+
+    return index / 2;
+
+}
+
+/**
+ * Returns whether the given opcode is present within the given
+ * NULL-terminated list of opcodes.
+ *
+ * @param opcodes
+ *     The NULL-terminated list of opcodes to search.
+ *
+ * @param opcode
+ *     The opcode to search for. This need not be null-terminated.
+ *
+ * @param opcode_length
+ *     The length of the opcode to search for, in bytes.
+ *
+ * @return
+ *     Non-zero if the opcode is present within the list, zero otherwise.
+ */
+static int __guac_socket_broadcast_has_opcode(const char** opcodes,
+        const char* opcode, size_t opcode_length) {
+
+    for (; *opcodes != NULL; opcodes++) {
+        if (strlen(*opcodes) == opcode_length
+                && memcmp(opcode, *opcodes, opcode_length) == 0)
+            return 1;
+    }
+
+    return 0;
+
+}
+
+/**
+ * Determines whether the pending chunk of the given broadcast socket contains
+ * only display data which may be dropped for a user which is not keeping up
+ * and restored by resynchronizing that user, storing the result within the
+ * chunk. Only chunks containing exactly one complete instruction are
+ * classified as anything other than GUAC_SOCKET_CHUNK_OTHER, but the image
+ * streams opened and closed by every instruction are tracked. This function
+ * must ONLY be called if the buffer lock has already been acquired.
+ *
+ * @param socket
+ *     The broadcast socket whose pending chunk should be classified.
+ */
+static void __guac_socket_broadcast_classify(guac_socket* socket) {
+
+    guac_socket_broadcast_data* data =
+        (guac_socket_broadcast_data*) socket->data;
+
+    guac_socket_chunk* chunk = data->chunk;
+    const char* buffer = chunk->buffer;
+    size_t length = chunk->length;
+    size_t offset = 0;
+
+    guac_socket_chunk_type type = GUAC_SOCKET_CHUNK_OTHER;
+    int instructions = 0;
+    int stream_index = -1;
+
+    while (offset < length) {
+
+        const char* opcode;
+        size_t opcode_length;
+        const char* value;
+        size_t value_length;
+        int stream = -1;
+        char terminator;
+
+        /* Parse opcode and, if present, the first argument */
+        terminator = __guac_socket_broadcast_parse_element(buffer, length,
+                &offset, &opcode, &opcode_length);
+
+        if (terminator == ',') {
+            terminator = __guac_socket_broadcast_parse_element(buffer,
+                    length, &offset, &value, &value_length);
+            stream = __guac_socket_broadcast_parse_stream(value,
+                    value_length);
+        }
+
+        /* Skip remaining arguments */
+        while (terminator == ',')
+            terminator = __guac_socket_broadcast_parse_element(buffer,
+                    length, &offset, &value, &value_length);
+
+        /* Data which cannot be parsed is never dropped */
+        if (terminator != ';') {
+            instructions = 0;
+            break;
+        }
+
+        instructions++;
+        type = GUAC_SOCKET_CHUNK_OTHER;
+
+        /* Track the image streams opened by "img" */
+        if (opcode_length == 3 && memcmp(opcode, "img", 3) == 0) {
+            if (stream != -1) {
+                data->image_streams[stream] = 1;
+                type = GUAC_SOCKET_CHUNK_IMAGE_BEGIN;
+                stream_index = stream * 2 + 1;
+            }
+        }
+
+        /* Blobs of image streams are display data */
+        else if (opcode_length == 4 && memcmp(opcode, "blob", 4) == 0) {
+            if (stream != -1 && data->image_streams[stream])
+                type = GUAC_SOCKET_CHUNK_DISPLAY;
+        }
+
+        /* The end of an image stream closes that stream */
+        else if (opcode_length == 3 && memcmp(opcode, "end", 3) == 0) {
+            if (stream != -1 && data->image_streams[stream]) {
+                data->image_streams[stream] = 0;
+                type = GUAC_SOCKET_CHUNK_IMAGE_END;
+                stream_index = stream * 2 + 1;
+            }
+        }
+
+        /* Any other stream reusing the index is not an image */
+        else if (__guac_socket_broadcast_has_opcode(
+                    __guac_socket_broadcast_stream_opcodes,
+                    opcode, opcode_length)) {
+            if (stream != -1)
+                data->image_streams[stream] = 0;
+        }
+
+        /* All other display instructions */
+        else if (__guac_socket_broadcast_has_opcode(
+                    __guac_socket_broadcast_display_opcodes,
+                    opcode, opcode_length))
+            type = GUAC_SOCKET_CHUNK_DISPLAY;
+
+    }
+
+    /* Classify only chunks containing exactly one instruction */
+    if (instructions == 1) {
+        chunk->type = type;
+        chunk->stream_index = stream_index;
+    }
+    else {
+        chunk->type = GUAC_SOCKET_CHUNK_OTHER;
+        chunk->stream_index = -1;
+    }
+
+}
+
+/**
+ * Writes the contents of the pending chunk of the given broadcast socket to
+ * the sockets of all connected users, replacing the pending chunk with an
+ * empty chunk. This function must ONLY be called if the buffer lock has
+ * already been acquired.
+ *
+ * @param socket
+ *     The broadcast socket whose pending chunk should be broadcast.
+ */
+static void __guac_socket_broadcast_chunk(guac_socket* socket) {
+
+    guac_socket_broadcast_data* data =
+        (guac_socket_broadcast_data*) socket->data;
+
+    /* Nothing to do if no data is pending */
+    if (data->chunk == NULL || data->chunk->length == 0)
+        return;
+
+    /* Determine whether users which fall behind may drop this chunk */
+    __guac_socket_broadcast_classify(socket);
+
+    /* Write the same chunk to all users */
+    guac_client_foreach_user(data->client, __write_chunk_callback,
+            data->chunk);
+
+    /* Reuse chunk for future writes unless still referenced elsewhere */
+    data->chunk = guac_socket_chunk_reclaim(data->chunk);
+
+}
+
+/**
+ * Socket write handler which encodes the given data into the pending chunk of
+ * the broadcast socket. The pending chunk is written to all connected users
+ * when the current instruction ends or when the socket is flushed, such that
+ * the data is copied only once regardless of the number of users.
  *
  * @param socket
  *     The socket to which the given data must be written.
@@ -131,25 +463,34 @@ static void* __write_chunk_callback(guac_user* user, void* data) {
  *     The number of bytes to attempt to write from the given buffer.
  *
  * @return
- *     The number of bytes written, or -1 if an error occurs. This handler will
- *     always succeed, and thus will always return the exact number of bytes
- *     specified by count.
+ *     The number of bytes written, or -1 if an error occurs. Errors occur only
+ *     if memory cannot be allocated for the pending chunk. Failures of
+ *     individual users are not reported, but will instead invoke
+ *     guac_user_stop() on the failing user when the chunk is broadcast.
  */
 static ssize_t __guac_socket_broadcast_write_handler(guac_socket* socket,
         const void* buf, size_t count) {
 
+    int retval = count;
     guac_socket_broadcast_data* data =
         (guac_socket_broadcast_data*) socket->data;
 
-    /* Build chunk */
-    __write_chunk chunk;
-    chunk.buffer = buf;
-    chunk.length = count;
+    /* Acquire exclusive access to buffer */
+    pthread_mutex_lock(&(data->buffer_lock));
+
+    /* Replace chunk if previously unable to allocate */
+    if (data->chunk == NULL)
+        data->chunk = guac_socket_chunk_alloc();
+
+    /* Encode provided data once for all users */
+    if (data->chunk == NULL
+            || guac_socket_chunk_append(data->chunk, buf, count))
+        retval = -1;
 
-    /* Broadcast chunk to all users */
-    guac_client_foreach_user(data->client, __write_chunk_callback, &chunk);
+    /* Relinquish exclusive access to buffer */
+    pthread_mutex_unlock(&(data->buffer_lock));
 
-    return count;
+    return retval;
 
 }
 
@@ -195,6 +536,15 @@ static ssize_t __guac_socket_broadcast_flush_handler(guac_socket* socket) {
     guac_socket_broadcast_data* data =
         (guac_socket_broadcast_data*) socket->data;
 
+    /* Broadcast any data written outside an instruction. If an instruction is
+     * currently being written, its data will be broadcast once complete. */
+    if (pthread_mutex_trylock(&(data->socket_lock)) == 0) {
+        pthread_mutex_lock(&(data->buffer_lock));
+        __guac_socket_broadcast_chunk(socket);
+        pthread_mutex_unlock(&(data->buffer_lock));
+        pthread_mutex_unlock(&(data->socket_lock));
+    }
+
     /* Flush all users */
     guac_client_foreach_user(data->client, __flush_callback, NULL);
 
@@ -203,34 +553,10 @@ static ssize_t __guac_socket_broadcast_flush_handler(guac_socket* socket) {
 }
 
 /**
- * Callback which is invoked by guac_client_foreach_user() to lock the given
- * user's socket in preparation for the beginning of a Guacamole protocol
- * instruction.
- *
- * @param user
- *     The user whose socket should be locked.
- *
- * @param data
- *     Arbitrary data passed to guac_client_foreach_user(). This is not needed
- *     by this callback, and should be left as NULL.
- *
- * @return
- *     Always NULL.
- */
-static void* __lock_callback(guac_user* user, void* data) {
-
-    /* Lock socket */
-    guac_socket_instruction_begin(user->socket);
-
-    return NULL;
-
-}
-
-/**
- * Socket lock handler which acquires the socket locks of all connected users.
- * Socket-level locks are acquired in preparation for the beginning of a new
- * Guacamole instruction to ensure that parallel writes are only interleaved at
- * instruction boundaries.
+ * Socket lock handler which acquires exclusive access to the broadcast socket
+ * in preparation for the beginning of a new Guacamole instruction. The sockets
+ * of connected users are not locked here, as each completed instruction is
+ * written to each user's socket atomically when the instruction ends.
  *
  * @param socket
  *     The broadcast socket to lock.
@@ -243,38 +569,11 @@ static void __guac_socket_broadcast_lock_handler(guac_socket* socket) {
     /* Acquire exclusive access to socket */
     pthread_mutex_lock(&(data->socket_lock));
 
-    /* Lock sockets of all users */
-    guac_client_foreach_user(data->client, __lock_callback, NULL);
-
 }
 
 /**
- * Callback which is invoked by guac_client_foreach_user() to unlock the given
- * user's socket at the end of a Guacamole protocol instruction.
- *
- * @param user
- *     The user whose socket should be unlocked.
- *
- * @param data
- *     Arbitrary data passed to guac_client_foreach_user(). This is not needed
- *     by this callback, and should be left as NULL.
- *
- * @return
- *     Always NULL.
- */
-static void* __unlock_callback(guac_user* user, void* data) {
-
-    /* Unlock socket */
-    guac_socket_instruction_end(user->socket);
-
-    return NULL;
-
-}
-
-/**
- * Socket unlock handler which releases the socket locks of all connected users.
- * Socket-level locks are released after a Guacamole instruction has finished
- * being written.
+ * Socket unlock handler which broadcasts the now-complete instruction to all
+ * connected users and relinquishes exclusive access to the broadcast socket.
  *
  * @param socket
  *     The broadcast socket to unlock.
@@ -284,8 +583,10 @@ static void __guac_socket_broadcast_unlock_handler(guac_socket* socket) {
     guac_socket_broadcast_data* data =
         (guac_socket_broadcast_data*) socket->data;
 
-    /* Unlock sockets of all users */
-    guac_client_foreach_user(data->client, __unlock_callback, NULL);
+    /* Write completed instruction to all users */
+    pthread_mutex_lock(&(data->buffer_lock));
+    __guac_socket_broadcast_chunk(socket);
+    pthread_mutex_unlock(&(data->buffer_lock));
 
     /* Relinquish exclusive access to socket */
     pthread_mutex_unlock(&(data->socket_lock));
@@ -335,8 +636,13 @@ static int __guac_socket_broadcast_free_handler(guac_socket* socket) {
     guac_socket_broadcast_data* data =
         (guac_socket_broadcast_data*) socket->data;
 
+    /* Release pending chunk */
+    if (data->chunk != NULL)
+        guac_socket_chunk_release(data->chunk);
+
     /* Destroy locks */
     pthread_mutex_destroy(&(data->socket_lock));
+    pthread_mutex_destroy(&(data->buffer_lock));
 
     free(data);
     return 0;
@@ -354,13 +660,16 @@ guac_socket* guac_socket_broadcast(guac_client* client) {
 
     /* Store client as socket data */
     data->client = client;
+    data->chunk = guac_socket_chunk_alloc();
+    memset(data->image_streams, 0, sizeof(data->image_streams));
     socket->data = data;
 
     pthread_mutexattr_init(&lock_attributes);
     pthread_mutexattr_setpshared(&lock_attributes, PTHREAD_PROCESS_SHARED);
 
-    /* Init lock */
+    /* Init locks */
     pthread_mutex_init(&(data->socket_lock), &lock_attributes);
+    pthread_mutex_init(&(data->buffer_lock), &lock_attributes);
     
     /* Set read/write handlers */
     socket->read_handler   = __guac_socket_broadcast_read_handler;
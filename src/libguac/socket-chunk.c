@@ -0,0 +1,137 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "config.h"
+
+#include "guacamole/error.h"
+#include "socket-chunk.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+guac_socket_chunk* guac_socket_chunk_alloc() {
+
+    guac_socket_chunk* chunk = malloc(sizeof(guac_socket_chunk));
+    if (chunk == NULL) {
+        guac_error = GUAC_STATUS_NO_MEMORY;
+        guac_error_message = "Could not allocate memory for socket chunk";
+        return NULL;
+    }
+
+    /* Allocate initial buffer */
+    chunk->buffer = malloc(GUAC_SOCKET_CHUNK_INITIAL_SIZE);
+    if (chunk->buffer == NULL) {
+        guac_error = GUAC_STATUS_NO_MEMORY;
+        guac_error_message = "Could not allocate memory for socket chunk";
+        free(chunk);
+        return NULL;
+    }
+
+    chunk->length = 0;
+    chunk->size = GUAC_SOCKET_CHUNK_INITIAL_SIZE;
+    chunk->type = GUAC_SOCKET_CHUNK_OTHER;
+    chunk->stream_index = -1;
+
+    /* The caller holds the only reference */
+    chunk->refcount = 1;
+    pthread_mutex_init(&(chunk->refcount_lock), NULL);
+
+    return chunk;
+
+}
+
+int guac_socket_chunk_append(guac_socket_chunk* chunk, const void* buf,
+        size_t count) {
+
+    /* Grow buffer geometrically if data will not fit */
+    if (chunk->length + count > chunk->size) {
+
+        size_t new_size = chunk->size * 2;
+        while (new_size < chunk->length + count)
+            new_size *= 2;
+
+        char* new_buffer = realloc(chunk->buffer, new_size);
+        if (new_buffer == NULL) {
+            guac_error = GUAC_STATUS_NO_MEMORY;
+            guac_error_message = "Could not grow socket chunk";
+            return 1;
+        }
+
+        chunk->buffer = new_buffer;
+        chunk->size = new_size;
+
+    }
+
+    memcpy(chunk->buffer + chunk->length, buf, count);
+    chunk->length += count;
+
+    return 0;
+
+}
+
+guac_socket_chunk* guac_socket_chunk_acquire(guac_socket_chunk* chunk) {
+
+    pthread_mutex_lock(&(chunk->refcount_lock));
+    chunk->refcount++;
+    pthread_mutex_unlock(&(chunk->refcount_lock));
+
+    return chunk;
+
+}
+
+void guac_socket_chunk_release(guac_socket_chunk* chunk) {
+
+    int refcount;
+
+    pthread_mutex_lock(&(chunk->refcount_lock));
+    refcount = --chunk->refcount;
+    pthread_mutex_unlock(&(chunk->refcount_lock));
+
+    /* Free chunk once the last reference is gone */
+    if (refcount == 0) {
+        pthread_mutex_destroy(&(chunk->refcount_lock));
+        free(chunk->buffer);
+        free(chunk);
+    }
+
+}
+
+guac_socket_chunk* guac_socket_chunk_reclaim(guac_socket_chunk* chunk) {
+
+    int refcount;
+
+    pthread_mutex_lock(&(chunk->refcount_lock));
+    refcount = chunk->refcount;
+    pthread_mutex_unlock(&(chunk->refcount_lock));
+
+    /* Reuse chunk if nothing else refers to it */
+    if (refcount == 1) {
+        chunk->length = 0;
+        chunk->type = GUAC_SOCKET_CHUNK_OTHER;
+        chunk->stream_index = -1;
+        return chunk;
+    }
+
+    /* Otherwise, leave the shared chunk intact and start anew */
+    guac_socket_chunk_release(chunk);
+    return guac_socket_chunk_alloc();
+
+}
+
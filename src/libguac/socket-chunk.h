@@ -0,0 +1,187 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef GUAC_SOCKET_CHUNK_H
+#define GUAC_SOCKET_CHUNK_H
+
+#include <pthread.h>
+#include <stddef.h>
+
+/**
+ * The number of bytes initially allocated for the buffer of each new
+ * guac_socket_chunk. Chunks grow beyond this size as needed.
+ */
+#define GUAC_SOCKET_CHUNK_INITIAL_SIZE 1024
+
+/**
+ * The kind of data contained within a guac_socket_chunk, describing whether
+ * that data may be dropped for a user which is not keeping up with the
+ * connection and later restored by resynchronizing that user.
+ */
+typedef enum guac_socket_chunk_type {
+
+    /**
+     * The chunk contains data which must always be delivered, such as audio,
+     * file transfers, or any data which could not be classified.
+     */
+    GUAC_SOCKET_CHUNK_OTHER,
+
+    /**
+     * The chunk contains a single display instruction, or a blob of an image
+     * stream, whose effect is restored when a user is resynchronized.
+     */
+    GUAC_SOCKET_CHUNK_DISPLAY,
+
+    /**
+     * The chunk contains a single "img" instruction, opening the image
+     * stream having the index stored within the chunk.
+     */
+    GUAC_SOCKET_CHUNK_IMAGE_BEGIN,
+
+    /**
+     * The chunk contains a single "end" instruction, closing the image stream
+     * having the index stored within the chunk.
+     */
+    GUAC_SOCKET_CHUNK_IMAGE_END
+
+} guac_socket_chunk_type;
+
+/**
+ * A reference-counted block of already-encoded Guacamole protocol data which
+ * may be shared by any number of sockets. A chunk is built up by appending
+ * data while only a single reference exists, and is then treated as
+ * immutable for as long as it is shared, allowing the same bytes to be
+ * written to many sockets without being copied for each.
+ */
+typedef struct guac_socket_chunk {
+
+    /**
+     * The encoded data within this chunk.
+     */
+    char* buffer;
+
+    /**
+     * The number of bytes of data currently stored within the buffer.
+     */
+    size_t length;
+
+    /**
+     * The number of bytes allocated for the buffer.
+     */
+    size_t size;
+
+    /**
+     * The kind of data contained within this chunk. Chunks are
+     * GUAC_SOCKET_CHUNK_OTHER unless classified otherwise by the broadcast
+     * socket.
+     */
+    guac_socket_chunk_type type;
+
+    /**
+     * The index of the image stream opened or closed by this chunk, if the
+     * type of this chunk is GUAC_SOCKET_CHUNK_IMAGE_BEGIN or
+     * GUAC_SOCKET_CHUNK_IMAGE_END.
+     */
+    int stream_index;
+
+    /**
+     * The number of references to this chunk which have not yet been
+     * released via guac_socket_chunk_release(). The chunk is freed when this
+     * reaches zero.
+     */
+    int refcount;
+
+    /**
+     * Lock which guards access to the reference count of this chunk.
+     */
+    pthread_mutex_t refcount_lock;
+
+} guac_socket_chunk;
+
+/**
+ * Allocates a new, empty guac_socket_chunk having a single reference, which
+ * is owned by the caller.
+ *
+ * @return
+ *     A newly-allocated guac_socket_chunk, or NULL if the chunk could not be
+ *     allocated.
+ */
+guac_socket_chunk* guac_socket_chunk_alloc();
+
+/**
+ * Appends the given data to the end of the given chunk, growing the chunk's
+ * buffer as necessary. As shared chunks are immutable, this function must
+ * only be invoked while the caller holds the only reference to the chunk.
+ *
+ * @param chunk
+ *     The chunk to append data to.
+ *
+ * @param buf
+ *     The data to append.
+ *
+ * @param count
+ *     The number of bytes within the given buffer.
+ *
+ * @return
+ *     Zero if the data was appended successfully, non-zero if the chunk's
+ *     buffer could not be grown to accommodate the data.
+ */
+int guac_socket_chunk_append(guac_socket_chunk* chunk, const void* buf,
+        size_t count);
+
+/**
+ * Acquires an additional reference to the given chunk, which must later be
+ * released with guac_socket_chunk_release(). While more than one reference
+ * exists, the chunk must not be modified.
+ *
+ * @param chunk
+ *     The chunk to acquire a reference to.
+ *
+ * @return
+ *     The given chunk.
+ */
+guac_socket_chunk* guac_socket_chunk_acquire(guac_socket_chunk* chunk);
+
+/**
+ * Releases a reference to the given chunk, freeing the chunk if no other
+ * references remain.
+ *
+ * @param chunk
+ *     The chunk to release a reference to.
+ */
+void guac_socket_chunk_release(guac_socket_chunk* chunk);
+
+/**
+ * Attempts to reclaim the given chunk for reuse. If the caller holds the only
+ * remaining reference to the chunk, the chunk is emptied such that new data
+ * may be appended, and the chunk is returned. If other references remain, the
+ * caller's reference is released and a newly-allocated chunk is returned
+ * instead.
+ *
+ * @param chunk
+ *     The chunk to reclaim.
+ *
+ * @return
+ *     An empty chunk to which only the caller holds a reference, or NULL if
+ *     a new chunk was needed but could not be allocated.
+ */
+guac_socket_chunk* guac_socket_chunk_reclaim(guac_socket_chunk* chunk);
+
+#endif
+
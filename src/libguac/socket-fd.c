@@ -249,6 +249,21 @@ static ssize_t guac_socket_fd_write_buffered(guac_socket* socket,
     const char* current = buf;
     guac_socket_fd_data* data = (guac_socket_fd_data*) socket->data;
 
+    /* Write blocks which could not fit within the buffer anyway directly,
+     * rather than copying them through the buffer piece by piece */
+    if (count >= sizeof(data->out_buf)) {
+
+        /* Preserve ordering of any previously-buffered data */
+        if (guac_socket_fd_flush(socket))
+            return -1;
+
+        if (guac_socket_fd_write(socket, buf, count))
+            return -1;
+
+        return original_count;
+
+    }
+
     /* Append to buffer, flush if necessary */
     while (count > 0) {
 
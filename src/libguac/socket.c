@@ -19,6 +19,7 @@
 
 #include "config.h"
 
+#include "base64.h"
 #include "guacamole/error.h"
 #include "guacamole/protocol.h"
 #include "guacamole/socket.h"
@@ -327,9 +328,40 @@ ssize_t guac_socket_write_base64(guac_socket* socket, const void* buf, size_t co
 
     int retval;
 
+    /* Encoded blocks are written in multiples of four bytes */
+    char output[GUAC_SOCKET_BASE64_BLOCK_SIZE];
+
     const unsigned char* char_buf = (const unsigned char*) buf;
     const unsigned char* end = char_buf + count;
 
+    /* Complete any partial triplet left over from a previous write */
+    while (socket->__ready > 0 && char_buf < end) {
+
+        retval = __guac_socket_write_base64_byte(socket, *(char_buf++));
+        if (retval < 0)
+            return retval;
+
+    }
+
+    /* Encode all remaining complete triplets in bulk */
+    while (end - char_buf >= 3) {
+
+        /* Encode as much as will fit in the output block */
+        size_t length = end - char_buf;
+        if (length > sizeof(output) / 4 * 3)
+            length = sizeof(output) / 4 * 3;
+
+        length = length / 3 * 3;
+
+        if (guac_socket_write(socket, output,
+                    guac_base64_encode(output, char_buf, length)))
+            return -1;
+
+        char_buf += length;
+
+    }
+
+    /* Buffer any trailing bytes until more data is written or flushed */
     while (char_buf < end) {
 
         retval = __guac_socket_write_base64_byte(socket, *(char_buf++));
@@ -0,0 +1,177 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <CUnit/CUnit.h>
+#include <guacamole/parser.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * The number of ASCII characters surrounding the multibyte character within
+ * each tested element. This is long enough that the multibyte character
+ * falls at every offset within any block of bytes which the parser may
+ * examine at once.
+ */
+#define TEST_ELEMENT_ASCII_LENGTH 80
+
+/**
+ * Multibyte UTF-8 characters of each possible length, which are inserted
+ * into the tested elements.
+ */
+static const char* test_multibyte_chars[] = {
+    "\xC3\xA9",         /* U+00E9 LATIN SMALL LETTER E WITH ACUTE */
+    "\xE2\x82\xAC",     /* U+20AC EURO SIGN */
+    "\xF0\x9F\x98\x80"  /* U+1F600 GRINNING FACE */
+};
+
+/**
+ * Parses the given instruction with guac_parser_append(), passing no more
+ * than the given number of bytes per call, and verifies that the instruction
+ * is parsed in its entirety as a "test" instruction having the given single
+ * argument.
+ *
+ * @param instruction
+ *     The instruction to parse. This buffer is modified by the parser.
+ *
+ * @param length
+ *     The length of the instruction, in bytes.
+ *
+ * @param chunk_size
+ *     The maximum number of bytes to pass to each guac_parser_append() call.
+ *
+ * @param expected
+ *     The expected value of the instruction's only argument.
+ */
+static void test_parse(char* instruction, int length, int chunk_size,
+        const char* expected) {
+
+    guac_parser* parser = guac_parser_alloc();
+    CU_ASSERT_PTR_NOT_NULL_FATAL(parser);
+
+    char* current = instruction;
+    int remaining = length;
+    int available = 0;
+
+    /* Offer data in chunks, offering more whenever a partial character
+     * prevents any progress */
+    while (remaining > 0 && parser->state != GUAC_PARSE_ERROR) {
+
+        available += chunk_size;
+        if (available > remaining)
+            available = remaining;
+
+        int parsed = guac_parser_append(parser, current, available);
+        if (parsed == 0 && available == remaining)
+            break;
+
+        current += parsed;
+        remaining -= parsed;
+        available -= parsed;
+
+    }
+
+    CU_ASSERT_EQUAL(remaining, 0);
+    CU_ASSERT_EQUAL_FATAL(parser->state, GUAC_PARSE_COMPLETE);
+    CU_ASSERT_STRING_EQUAL(parser->opcode, "test");
+    CU_ASSERT_EQUAL_FATAL(parser->argc, 1);
+    CU_ASSERT_STRING_EQUAL(parser->argv[0], expected);
+
+    guac_parser_free(parser);
+
+}
+
+/**
+ * Test which verifies that guac_parser_append() correctly parses elements
+ * consisting of long runs of ASCII characters surrounding a multibyte UTF-8
+ * character at every possible offset, regardless of how the instruction is
+ * split across calls.
+ */
+void test_parser__utf8_element() {
+
+    char element[TEST_ELEMENT_ASCII_LENGTH + 5];
+    char instruction[sizeof(element) + 32];
+    char copy[sizeof(instruction)];
+
+    int chunk_sizes[] = { 1, 3, 7, 16, 17, sizeof(instruction) };
+    int i, offset, chunk;
+
+    for (i = 0; i < sizeof(test_multibyte_chars) / sizeof(char*); i++) {
+
+        const char* multibyte = test_multibyte_chars[i];
+        int multibyte_length = strlen(multibyte);
+
+        for (offset = 0; offset <= TEST_ELEMENT_ASCII_LENGTH; offset++) {
+
+            /* Build element with multibyte character at given offset */
+            memset(element, 'A', TEST_ELEMENT_ASCII_LENGTH);
+            memmove(element + offset + multibyte_length, element + offset,
+                    TEST_ELEMENT_ASCII_LENGTH - offset);
+            memcpy(element + offset, multibyte, multibyte_length);
+            element[TEST_ELEMENT_ASCII_LENGTH + multibyte_length] = '\0';
+
+            /* Element length is in characters, not bytes */
+            int length = snprintf(instruction, sizeof(instruction),
+                    "4.test,%i.%s;", TEST_ELEMENT_ASCII_LENGTH + 1, element);
+
+            for (chunk = 0; chunk < sizeof(chunk_sizes) / sizeof(int);
+                    chunk++) {
+                memcpy(copy, instruction, length);
+                test_parse(copy, length, chunk_sizes[chunk], element);
+            }
+
+        }
+
+    }
+
+}
+
+/**
+ * Test which verifies that guac_parser_append() detects elements whose
+ * declared length does not match their content, even when the content is a
+ * long run of ASCII characters.
+ */
+void test_parser__element_length_mismatch() {
+
+    char instruction[] = "4.test,20.AAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAA;";
+
+    guac_parser* parser = guac_parser_alloc();
+    CU_ASSERT_PTR_NOT_NULL_FATAL(parser);
+
+    char* current = instruction;
+    int remaining = sizeof(instruction) - 1;
+
+    while (remaining > 0) {
+
+        int parsed = guac_parser_append(parser, current, remaining);
+        if (parsed == 0)
+            break;
+
+        current += parsed;
+        remaining -= parsed;
+
+    }
+
+    CU_ASSERT_EQUAL(parser->state, GUAC_PARSE_ERROR);
+
+    guac_parser_free(parser);
+
+}
+
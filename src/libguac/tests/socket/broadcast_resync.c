@@ -0,0 +1,240 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "user-output.h"
+
+#include <CUnit/CUnit.h>
+#include <guacamole/client.h>
+#include <guacamole/protocol.h>
+#include <guacamole/socket.h>
+#include <guacamole/stream.h>
+#include <guacamole/user.h>
+
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+
+/**
+ * The output queue limit of the client used by the test, in bytes. This is
+ * large enough to hold all audio data written by the test, but not all image
+ * data.
+ */
+#define TEST_QUEUE_LIMIT 4096
+
+/**
+ * The number of blobs written to each of the audio and image streams.
+ */
+#define TEST_BLOBS 32
+
+/**
+ * The maximum number of bytes of output captured from the test user.
+ */
+#define TEST_OUTPUT_SIZE 65536
+
+/**
+ * Lock which must be held while accessing any of the state shared between the
+ * test and the writer thread of the test user.
+ */
+static pthread_mutex_t test_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * Condition which is signalled whenever the state shared between the test
+ * and the writer thread of the test user changes.
+ */
+static pthread_cond_t test_modified = PTHREAD_COND_INITIALIZER;
+
+/**
+ * Non-zero while writes to the socket of the test user should block,
+ * simulating a user which is not keeping up with the connection.
+ */
+static int test_blocked;
+
+/**
+ * Non-zero once a write to the socket of the test user has blocked.
+ */
+static int test_waiting;
+
+/**
+ * The number of times the resync handler has been invoked.
+ */
+static int test_resyncs;
+
+/**
+ * All data written to the socket of the test user, null-terminated.
+ */
+static char test_output[TEST_OUTPUT_SIZE + 1];
+
+/**
+ * The number of bytes written to test_output.
+ */
+static int test_output_length;
+
+/**
+ * Write handler which captures all data written within test_output, blocking
+ * for as long as test_blocked is non-zero.
+ */
+static ssize_t test_write_handler(guac_socket* socket, const void* buf,
+        size_t count) {
+
+    pthread_mutex_lock(&test_lock);
+
+    test_waiting = 1;
+    pthread_cond_broadcast(&test_modified);
+
+    while (test_blocked)
+        pthread_cond_wait(&test_modified, &test_lock);
+
+    if (count > TEST_OUTPUT_SIZE - test_output_length)
+        count = TEST_OUTPUT_SIZE - test_output_length;
+
+    memcpy(test_output + test_output_length, buf, count);
+    test_output_length += count;
+    test_output[test_output_length] = '\0';
+
+    pthread_mutex_unlock(&test_lock);
+
+    return count;
+
+}
+
+/**
+ * Resync handler which records that it was invoked.
+ */
+static int test_resync_handler(guac_user* user) {
+
+    pthread_mutex_lock(&test_lock);
+    test_resyncs++;
+    pthread_cond_broadcast(&test_modified);
+    pthread_mutex_unlock(&test_lock);
+
+    return 0;
+
+}
+
+/**
+ * Returns the number of occurrences of the given string within test_output.
+ */
+static int test_count(const char* str) {
+
+    int count = 0;
+    const char* current = test_output;
+
+    while ((current = strstr(current, str)) != NULL) {
+        count++;
+        current += strlen(str);
+    }
+
+    return count;
+
+}
+
+/**
+ * Tests that a user whose output queue overflows has only display data
+ * dropped, that data belonging to other streams is delivered intact, and that
+ * an image stream whose remaining data was dropped is ended before the user
+ * is resynchronized.
+ */
+void test_socket__broadcast_resync() {
+
+    char data[64];
+    char expected[64];
+    int i;
+
+    memset(data, 'x', sizeof(data));
+
+    test_blocked = 1;
+    test_waiting = 0;
+    test_resyncs = 0;
+    test_output_length = 0;
+
+    guac_client* client = guac_client_alloc();
+    CU_ASSERT_PTR_NOT_NULL_FATAL(client);
+
+    client->resync_handler = test_resync_handler;
+    client->output_queue_limit = TEST_QUEUE_LIMIT;
+
+    guac_socket* socket = guac_socket_alloc();
+    socket->write_handler = test_write_handler;
+
+    guac_user* user = guac_user_alloc();
+    user->client = client;
+    user->socket = socket;
+
+    guac_user_output* output = guac_user_output_alloc(user);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(output);
+    guac_client_add_user(client, user, 0, NULL);
+
+    guac_stream* image = guac_client_alloc_stream(client);
+    guac_stream* audio = guac_client_alloc_stream(client);
+
+    /* Begin image, waiting until the user is stuck writing it */
+    guac_protocol_send_img(client->socket, image, GUAC_COMP_OVER,
+            GUAC_DEFAULT_LAYER, "image/png", 0, 0);
+
+    pthread_mutex_lock(&test_lock);
+    while (!test_waiting)
+        pthread_cond_wait(&test_modified, &test_lock);
+    pthread_mutex_unlock(&test_lock);
+
+    /* Write far more image data than the queue allows, interleaved with
+     * audio data which fits within the queue */
+    guac_protocol_send_audio(client->socket, audio, "audio/L16;rate=44100");
+
+    for (i = 0; i < TEST_BLOBS; i++) {
+        guac_protocol_send_blob(client->socket, image, data, sizeof(data));
+        guac_protocol_send_blob(client->socket, audio, data, sizeof(data));
+        guac_protocol_send_sync(client->socket, i);
+    }
+
+    guac_protocol_send_end(client->socket, audio);
+    guac_protocol_send_end(client->socket, image);
+    guac_socket_flush(client->socket);
+
+    /* Let the user catch up, waiting for resynchronization */
+    pthread_mutex_lock(&test_lock);
+    test_blocked = 0;
+    pthread_cond_broadcast(&test_modified);
+    while (test_resyncs == 0)
+        pthread_cond_wait(&test_modified, &test_lock);
+    pthread_mutex_unlock(&test_lock);
+
+    guac_client_remove_user(client, user);
+    guac_user_output_free(output);
+
+    CU_ASSERT_EQUAL(test_resyncs, 1);
+
+    /* All audio data must be delivered */
+    snprintf(expected, sizeof(expected), "4.blob,1.%i,", audio->index);
+    CU_ASSERT_EQUAL(test_count(expected), TEST_BLOBS);
+
+    snprintf(expected, sizeof(expected), "3.end,1.%i;", audio->index);
+    CU_ASSERT_EQUAL(test_count(expected), 1);
+
+    /* Image data must have been dropped, but the image must still end */
+    snprintf(expected, sizeof(expected), "4.blob,1.%i,", image->index);
+    CU_ASSERT(test_count(expected) < TEST_BLOBS);
+
+    snprintf(expected, sizeof(expected), "3.end,1.%i;", image->index);
+    CU_ASSERT_EQUAL(test_count(expected), 1);
+
+    guac_user_free(user);
+    guac_socket_free(socket);
+    guac_client_free(client);
+
+}
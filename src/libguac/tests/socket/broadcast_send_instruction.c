@@ -0,0 +1,163 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <CUnit/CUnit.h>
+#include <guacamole/client.h>
+#include <guacamole/protocol.h>
+#include <guacamole/socket.h>
+#include <guacamole/user.h>
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/**
+ * The number of users which should receive the broadcast instructions.
+ */
+#define TEST_USERS 2
+
+/**
+ * Writes a series of Guacamole instructions using the broadcast guac_socket
+ * of a new guac_client having one user for each of the given file
+ * descriptors. The instructions written correspond to the instructions
+ * verified by read_expected_instructions(). The given file descriptors are
+ * automatically closed as a result of calling this function.
+ *
+ * @param fds
+ *     The file descriptors of each user, TEST_USERS in total.
+ */
+static void write_instructions(int* fds) {
+
+    int i;
+    guac_user* users[TEST_USERS];
+
+    /* Allocate client, writing nothing on failure (test will fail in parent
+     * process due to failure to read) */
+    guac_client* client = guac_client_alloc();
+    if (client == NULL) {
+        for (i = 0; i < TEST_USERS; i++)
+            close(fds[i]);
+        return;
+    }
+
+    /* Join one user per file descriptor */
+    for (i = 0; i < TEST_USERS; i++) {
+        users[i] = guac_user_alloc();
+        users[i]->client = client;
+        users[i]->socket = guac_socket_open(fds[i]);
+        guac_client_add_user(client, users[i], 0, NULL);
+    }
+
+    /* Write instructions */
+    guac_protocol_send_name(client->socket, "broadcast");
+    guac_protocol_send_sync(client->socket, 12345);
+    guac_socket_flush(client->socket);
+
+    /* Remove and free all users */
+    for (i = 0; i < TEST_USERS; i++) {
+        guac_client_remove_user(client, users[i]);
+        guac_socket_free(users[i]->socket);
+        guac_user_free(users[i]);
+    }
+
+    guac_client_free(client);
+
+}
+
+/**
+ * Reads raw bytes from the given file descriptor until no further bytes
+ * remain, verifying that those bytes represent the series of Guacamole
+ * instructions expected to be written by write_instructions(). The given
+ * file descriptor is automatically closed as a result of calling this
+ * function.
+ *
+ * @param fd
+ *     The file descriptor to read data from.
+ */
+static void read_expected_instructions(int fd) {
+
+    char expected[] =
+        "4.name,9.broadcast;"
+        "4.sync,5.12345;";
+
+    int numread;
+    char buffer[1024];
+    int offset = 0;
+
+    /* Read everything available into buffer */
+    while ((numread = read(fd, &(buffer[offset]),
+                    sizeof(buffer) - offset)) > 0) {
+        offset += numread;
+    }
+
+    /* Verify length of read data */
+    CU_ASSERT_EQUAL(offset, strlen(expected));
+
+    /* Add NULL terminator */
+    buffer[offset] = '\0';
+
+    /* Read value should be equal to expected value */
+    CU_ASSERT_STRING_EQUAL(buffer, expected);
+
+    /* File descriptor is no longer needed */
+    close(fd);
+
+}
+
+/**
+ * Tests that the broadcast implementation of guac_socket writes each
+ * instruction, intact and in order, to the socket of every connected user. A
+ * child process is forked to write a series of instructions which are read
+ * and verified for each user by the parent process.
+ */
+void test_socket__broadcast_send_instruction() {
+
+    int i;
+    int read_fds[TEST_USERS];
+    int write_fds[TEST_USERS];
+
+    /* Create one pipe per user */
+    for (i = 0; i < TEST_USERS; i++) {
+        int fd[2];
+        CU_ASSERT_EQUAL_FATAL(pipe(fd), 0);
+        read_fds[i] = fd[0];
+        write_fds[i] = fd[1];
+    }
+
+    /* Fork into writer process (child) and reader process (parent) */
+    int childpid;
+    CU_ASSERT_NOT_EQUAL_FATAL((childpid = fork()), -1);
+
+    /* Attempt to write a series of instructions within the child process */
+    if (childpid == 0) {
+        for (i = 0; i < TEST_USERS; i++)
+            close(read_fds[i]);
+        write_instructions(write_fds);
+        exit(0);
+    }
+
+    /* Read and verify the expected instructions for each user */
+    for (i = 0; i < TEST_USERS; i++)
+        close(write_fds[i]);
+
+    for (i = 0; i < TEST_USERS; i++)
+        read_expected_instructions(read_fds[i]);
+
+}
+
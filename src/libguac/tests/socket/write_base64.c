@@ -0,0 +1,158 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <CUnit/CUnit.h>
+#include <guacamole/protocol.h>
+#include <guacamole/socket.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * The maximum number of bytes of test data to encode.
+ */
+#define TEST_DATA_LENGTH 20000
+
+/**
+ * Buffer which receives all data written to the test socket.
+ */
+static char written[TEST_DATA_LENGTH * 2];
+
+/**
+ * The number of bytes currently stored within the written buffer.
+ */
+static size_t written_length;
+
+/**
+ * Write handler which appends all data written to the given socket to the
+ * written buffer.
+ *
+ * @param socket
+ *     The socket being written to.
+ *
+ * @param buf
+ *     The data being written.
+ *
+ * @param count
+ *     The number of bytes being written.
+ *
+ * @return
+ *     The number of bytes written, or -1 if the written buffer is full.
+ */
+static ssize_t test_write_handler(guac_socket* socket,
+        const void* buf, size_t count) {
+
+    /* Fail if data will not fit (leaving room for null terminator) */
+    if (written_length + count >= sizeof(written))
+        return -1;
+
+    memcpy(written + written_length, buf, count);
+    written_length += count;
+
+    return count;
+
+}
+
+/**
+ * Encodes the given data as base64 using guac_socket_write_base64(), writing
+ * the data in pieces of the given size, and verifies that decoding the result
+ * produces the original data.
+ *
+ * @param socket
+ *     The test socket to write to.
+ *
+ * @param data
+ *     The data to encode.
+ *
+ * @param length
+ *     The number of bytes of data to encode.
+ *
+ * @param piece_length
+ *     The number of bytes to provide to each call to
+ *     guac_socket_write_base64().
+ */
+static void verify_round_trip(guac_socket* socket, const unsigned char* data,
+        size_t length, size_t piece_length) {
+
+    size_t offset;
+
+    written_length = 0;
+
+    /* Encode data in pieces of the requested size */
+    for (offset = 0; offset < length; offset += piece_length) {
+
+        size_t remaining = length - offset;
+        if (remaining > piece_length)
+            remaining = piece_length;
+
+        CU_ASSERT_EQUAL(guac_socket_write_base64(socket, data + offset,
+                    remaining), 0);
+
+    }
+
+    CU_ASSERT_EQUAL(guac_socket_flush_base64(socket), 0);
+
+    /* Encoded length must include padding */
+    CU_ASSERT_EQUAL(written_length, (length + 2) / 3 * 4);
+    written[written_length] = '\0';
+
+    /* Decoded data must match original */
+    CU_ASSERT_EQUAL(guac_protocol_decode_base64(written), length);
+    CU_ASSERT(memcmp(written, data, length) == 0);
+
+}
+
+/**
+ * Tests that guac_socket_write_base64() correctly encodes data of any length,
+ * regardless of how that data is split across calls.
+ */
+void test_socket__write_base64() {
+
+    size_t i;
+    unsigned char* data = malloc(TEST_DATA_LENGTH);
+
+    guac_socket* socket = guac_socket_alloc();
+    socket->write_handler = test_write_handler;
+
+    /* Verify known value */
+    written_length = 0;
+    CU_ASSERT_EQUAL(guac_socket_write_base64(socket, "GUACAMOLE", 9), 0);
+    CU_ASSERT_EQUAL(guac_socket_flush_base64(socket), 0);
+    CU_ASSERT_EQUAL(written_length, 12);
+    CU_ASSERT_NSTRING_EQUAL(written, "R1VBQ0FNT0xF", 12);
+
+    /* Generate test data covering all byte values */
+    for (i = 0; i < TEST_DATA_LENGTH; i++)
+        data[i] = (i * 7919) ^ (i >> 8);
+
+    /* Verify all short lengths, which exercise padding and bulk boundaries */
+    for (i = 0; i < 256; i++)
+        verify_round_trip(socket, data, i, i + 1);
+
+    /* Verify long data, written whole and in awkwardly-sized pieces */
+    verify_round_trip(socket, data, TEST_DATA_LENGTH, TEST_DATA_LENGTH);
+    verify_round_trip(socket, data, TEST_DATA_LENGTH - 1, 1);
+    verify_round_trip(socket, data, TEST_DATA_LENGTH - 2, 5);
+    verify_round_trip(socket, data, TEST_DATA_LENGTH, 4097);
+
+    guac_socket_free(socket);
+    free(data);
+
+}
+
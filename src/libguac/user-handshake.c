@@ -26,6 +26,7 @@
 #include "guacamole/socket.h"
 #include "guacamole/user.h"
 #include "user-handlers.h"
+#include "user-output.h"
 
 #include <pthread.h>
 #include <stdlib.h>
@@ -333,6 +334,12 @@ int guac_user_handle_connection(guac_user* user, int usec_timeout) {
         return 1;
     }
     
+    /* Queue all further output such that this user cannot stall others */
+    guac_user_output* output = guac_user_output_alloc(user);
+    if (output == NULL)
+        guac_user_log_guac_error(user, GUAC_LOG_WARNING, "Unable to queue "
+                "output for user. Output will be written directly.");
+
     /* Attempt to join user to connection. */
     if (guac_client_add_user(client, user, (parser->argc - 1), parser->argv + 1))
         guac_client_log(client, GUAC_LOG_ERROR, "User \"%s\" could NOT "
@@ -364,6 +371,10 @@ int guac_user_handle_connection(guac_user* user, int usec_timeout) {
                 "users remain)", user->user_id, client->connected_users);
 
     }
+
+    /* Write any remaining output now that the user has left */
+    if (output != NULL)
+        guac_user_output_free(output);
     
     /* Free mimetype character arrays. */
     guac_free_mimetypes((char **) user->info.audio_mimetypes);
@@ -0,0 +1,653 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "config.h"
+
+#include "guacamole/client.h"
+#include "guacamole/error.h"
+#include "guacamole/protocol.h"
+#include "guacamole/socket.h"
+#include "guacamole/stream.h"
+#include "guacamole/user.h"
+#include "socket-chunk.h"
+#include "user-output.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * Appends the given chunk to the end of the given output queue, signalling
+ * the writer thread. The queue takes ownership of the caller's reference to
+ * the chunk. This function must ONLY be called if the queue lock has already
+ * been acquired.
+ *
+ * @param output
+ *     The output queue to append the chunk to.
+ *
+ * @param chunk
+ *     The chunk to append.
+ *
+ * @param broadcast
+ *     Non-zero if the chunk was written to the broadcast socket of the user's
+ *     guac_client, zero if the chunk was written to the user directly.
+ */
+static void guac_user_output_enqueue(guac_user_output* output,
+        guac_socket_chunk* chunk, int broadcast) {
+
+    guac_user_output_entry* entry = malloc(sizeof(guac_user_output_entry));
+
+    /* Data cannot be queued if out of memory */
+    if (entry == NULL) {
+        guac_socket_chunk_release(chunk);
+        return;
+    }
+
+    entry->chunk = chunk;
+    entry->broadcast = broadcast;
+    entry->next = NULL;
+
+    /* Append to end of queue */
+    if (output->tail != NULL)
+        output->tail->next = entry;
+    else
+        output->head = entry;
+
+    output->tail = entry;
+    output->length += chunk->length;
+
+    pthread_cond_signal(&(output->queue_modified));
+
+}
+
+/**
+ * Appends all data written directly to the user since the last call to this
+ * function to the given output queue. This function must ONLY be called if
+ * the queue lock has already been acquired.
+ *
+ * @param output
+ *     The output queue whose pending data should be queued.
+ */
+static void guac_user_output_seal(guac_user_output* output) {
+
+    /* Nothing to do if no data is pending */
+    if (output->pending == NULL || output->pending->length == 0)
+        return;
+
+    /* The queue now owns the pending chunk */
+    guac_user_output_enqueue(output, output->pending, 0);
+    output->pending = NULL;
+
+}
+
+/**
+ * Returns whether the given chunk, written to the broadcast socket, contains
+ * only display data which may be dropped and later restored by
+ * resynchronizing the user.
+ *
+ * @param chunk
+ *     The chunk to test.
+ *
+ * @return
+ *     Non-zero if the chunk may be dropped, zero otherwise.
+ */
+static int guac_user_output_droppable(guac_socket_chunk* chunk) {
+    return chunk->type != GUAC_SOCKET_CHUNK_OTHER;
+}
+
+/**
+ * Removes all display data written to the broadcast socket from the given
+ * output queue, leaving data written directly to the user and all broadcast
+ * data which is not display data. This function must ONLY be called if the
+ * queue lock has already been acquired.
+ *
+ * @param output
+ *     The output queue to remove display data from.
+ */
+static void guac_user_output_drop(guac_user_output* output) {
+
+    guac_user_output_entry* previous = NULL;
+    guac_user_output_entry* current = output->head;
+
+    while (current != NULL) {
+
+        guac_user_output_entry* next = current->next;
+
+        /* Keep data written directly to the user and data which would not
+         * be restored by resynchronization */
+        if (!current->broadcast
+                || !guac_user_output_droppable(current->chunk)) {
+            previous = current;
+            current = next;
+            continue;
+        }
+
+        /* Unlink broadcast entry */
+        if (previous != NULL)
+            previous->next = next;
+        else
+            output->head = next;
+
+        if (output->tail == current)
+            output->tail = previous;
+
+        output->length -= current->chunk->length;
+        output->dropped_bytes += current->chunk->length;
+
+        guac_socket_chunk_release(current->chunk);
+        free(current);
+
+        current = next;
+
+    }
+
+}
+
+/**
+ * Records the image streams opened and closed by the given chunk, which has
+ * just been written to the user's original socket. This function must ONLY
+ * be called by the writer thread.
+ *
+ * @param output
+ *     The output queue whose chunk was written.
+ *
+ * @param chunk
+ *     The chunk which was written.
+ */
+static void guac_user_output_track_images(guac_user_output* output,
+        guac_socket_chunk* chunk) {
+
+    if (chunk->type == GUAC_SOCKET_CHUNK_IMAGE_BEGIN)
+        output->open_images[chunk->stream_index / 2] = 1;
+
+    else if (chunk->type == GUAC_SOCKET_CHUNK_IMAGE_END)
+        output->open_images[chunk->stream_index / 2] = 0;
+
+}
+
+/**
+ * Ends all image streams whose "img" instruction has been written to the
+ * user but whose remaining data has been dropped, such that the user does
+ * not wait for those images forever. This function must ONLY be called by
+ * the writer thread, and must not be called while the queue lock is held.
+ *
+ * @param output
+ *     The output queue whose open image streams should be ended.
+ */
+static void guac_user_output_end_images(guac_user_output* output) {
+
+    int i;
+
+    for (i = 0; i < GUAC_CLIENT_MAX_STREAMS; i++) {
+
+        if (!output->open_images[i])
+            continue;
+
+        guac_stream stream = { .index = i * 2 + 1 };
+        guac_protocol_send_end(output->queued_socket, &stream);
+        output->open_images[i] = 0;
+
+    }
+
+}
+
+/**
+ * The thread which drains the output queue of a user, writing each queued
+ * chunk to the user's original socket and resynchronizing the user as
+ * necessary after broadcast data has been dropped.
+ *
+ * @param data
+ *     The guac_user_output to drain.
+ *
+ * @return
+ *     Always NULL.
+ */
+static void* guac_user_output_writer_thread(void* data) {
+
+    guac_user_output* output = (guac_user_output*) data;
+    guac_user* user = output->user;
+
+    pthread_mutex_lock(&(output->queue_lock));
+
+    for (;;) {
+
+        /* Wait for something to do */
+        while (output->head == NULL && !output->resync && !output->stopping)
+            pthread_cond_wait(&(output->queue_modified), &(output->queue_lock));
+
+        /* Resynchronize user after dropping broadcast data, accepting new
+         * broadcast data from this point forward */
+        if (output->resync && !output->stopping) {
+
+            guac_user_resync_handler* handler = user->client->resync_handler;
+
+            output->resync = 0;
+            pthread_mutex_unlock(&(output->queue_lock));
+
+            guac_user_output_end_images(output);
+
+            if (handler(user))
+                guac_user_log(user, GUAC_LOG_WARNING, "Unable to "
+                        "resynchronize user after dropping queued output.");
+
+            pthread_mutex_lock(&(output->queue_lock));
+            continue;
+
+        }
+
+        /* Stop once queue is empty */
+        guac_user_output_entry* entry = output->head;
+        if (entry == NULL)
+            break;
+
+        /* Remove entry from queue */
+        output->head = entry->next;
+        if (output->head == NULL)
+            output->tail = NULL;
+
+        output->length -= entry->chunk->length;
+        pthread_mutex_unlock(&(output->queue_lock));
+
+        /* Write outside queue lock such that other threads never wait on
+         * this user's connection */
+        if (!output->failed
+                && guac_socket_write(output->socket, entry->chunk->buffer,
+                    entry->chunk->length)) {
+            output->failed = 1;
+            guac_user_stop(user);
+        }
+
+        if (entry->broadcast)
+            guac_user_output_track_images(output, entry->chunk);
+
+        guac_socket_chunk_release(entry->chunk);
+        free(entry);
+
+        pthread_mutex_lock(&(output->queue_lock));
+
+        /* Flush once the user has caught up */
+        if (output->head == NULL && !output->failed) {
+
+            pthread_mutex_unlock(&(output->queue_lock));
+
+            if (guac_socket_flush(output->socket)) {
+                output->failed = 1;
+                guac_user_stop(user);
+            }
+
+            pthread_mutex_lock(&(output->queue_lock));
+
+        }
+
+    }
+
+    pthread_mutex_unlock(&(output->queue_lock));
+
+    return NULL;
+
+}
+
+/**
+ * Reads from the user's original socket on behalf of the queued socket.
+ *
+ * @param socket
+ *     The queued socket being read from.
+ *
+ * @param buf
+ *     The buffer into which data should be read.
+ *
+ * @param count
+ *     The maximum number of bytes to read.
+ *
+ * @return
+ *     The number of bytes read, or -1 if an error occurs.
+ */
+static ssize_t guac_user_output_read_handler(guac_socket* socket,
+        void* buf, size_t count) {
+
+    guac_user_output* output = (guac_user_output*) socket->data;
+    return guac_socket_read(output->socket, buf, count);
+
+}
+
+/**
+ * Waits for data on the user's original socket on behalf of the queued
+ * socket.
+ *
+ * @param socket
+ *     The queued socket to wait for.
+ *
+ * @param usec_timeout
+ *     The maximum amount of time to wait for data, in microseconds, or -1 to
+ *     potentially wait forever.
+ *
+ * @return
+ *     A positive value on success, zero if the timeout elapsed and no data is
+ *     available, or a negative value if an error occurs.
+ */
+static int guac_user_output_select_handler(guac_socket* socket,
+        int usec_timeout) {
+
+    guac_user_output* output = (guac_user_output*) socket->data;
+    return guac_socket_select(output->socket, usec_timeout);
+
+}
+
+/**
+ * Appends the given data to the data pending for the user, queueing the
+ * pending data once it has grown to the size of a typical socket buffer. This
+ * handler never blocks on the user's connection.
+ *
+ * @param socket
+ *     The queued socket being written to.
+ *
+ * @param buf
+ *     The buffer containing the data to write.
+ *
+ * @param count
+ *     The number of bytes to write from the given buffer.
+ *
+ * @return
+ *     The number of bytes written, or -1 if an error occurs.
+ */
+static ssize_t guac_user_output_write_handler(guac_socket* socket,
+        const void* buf, size_t count) {
+
+    int retval = count;
+    guac_user_output* output = (guac_user_output*) socket->data;
+
+    pthread_mutex_lock(&(output->queue_lock));
+
+    /* Report failure if the connection is already known to be broken */
+    if (output->failed)
+        retval = -1;
+
+    else {
+
+        if (output->pending == NULL)
+            output->pending = guac_socket_chunk_alloc();
+
+        if (output->pending == NULL
+                || guac_socket_chunk_append(output->pending, buf, count))
+            retval = -1;
+
+        /* Avoid accumulating excessively large chunks */
+        else if (output->pending->length >= GUAC_SOCKET_OUTPUT_BUFFER_SIZE)
+            guac_user_output_seal(output);
+
+    }
+
+    pthread_mutex_unlock(&(output->queue_lock));
+
+    return retval;
+
+}
+
+/**
+ * Queues all pending data written directly to the user, such that the writer
+ * thread will write and flush that data as soon as possible. Unlike the flush
+ * handlers of other guac_socket implementations, this handler does not wait
+ * for the data to actually be written.
+ *
+ * @param socket
+ *     The queued socket to flush.
+ *
+ * @return
+ *     Zero if the flush operation succeeds, non-zero if the connection is
+ *     already known to be broken.
+ */
+static ssize_t guac_user_output_flush_handler(guac_socket* socket) {
+
+    int retval;
+    guac_user_output* output = (guac_user_output*) socket->data;
+
+    pthread_mutex_lock(&(output->queue_lock));
+    guac_user_output_seal(output);
+    retval = output->failed;
+    pthread_mutex_unlock(&(output->queue_lock));
+
+    return retval;
+
+}
+
+/**
+ * Acquires exclusive access to the queued socket.
+ *
+ * @param socket
+ *     The queued socket to which exclusive access is required.
+ */
+static void guac_user_output_lock_handler(guac_socket* socket) {
+
+    guac_user_output* output = (guac_user_output*) socket->data;
+    pthread_mutex_lock(&(output->socket_lock));
+
+}
+
+/**
+ * Relinquishes exclusive access to the queued socket.
+ *
+ * @param socket
+ *     The queued socket to which exclusive access is no longer required.
+ */
+static void guac_user_output_unlock_handler(guac_socket* socket) {
+
+    guac_user_output* output = (guac_user_output*) socket->data;
+    pthread_mutex_unlock(&(output->socket_lock));
+
+}
+
+guac_user_output* guac_user_output_alloc(guac_user* user) {
+
+    guac_user_output* output = malloc(sizeof(guac_user_output));
+    if (output == NULL) {
+        guac_error = GUAC_STATUS_NO_MEMORY;
+        guac_error_message = "Could not allocate memory for output queue";
+        return NULL;
+    }
+
+    /* Allocate socket which queues all written data */
+    guac_socket* queued_socket = guac_socket_alloc();
+    if (queued_socket == NULL) {
+        free(output);
+        return NULL;
+    }
+
+    output->user = user;
+    output->socket = user->socket;
+    output->queued_socket = queued_socket;
+    output->pending = NULL;
+    output->head = NULL;
+    output->tail = NULL;
+    output->limit = user->client->output_queue_limit;
+    output->length = 0;
+    output->drops = 0;
+    output->dropped_bytes = 0;
+    output->resync = 0;
+    output->discarding = 0;
+    output->stopping = 0;
+    output->failed = 0;
+    memset(output->open_images, 0, sizeof(output->open_images));
+
+    pthread_mutex_init(&(output->socket_lock), NULL);
+    pthread_mutex_init(&(output->queue_lock), NULL);
+    pthread_cond_init(&(output->queue_modified), NULL);
+
+    queued_socket->data           = output;
+    queued_socket->read_handler   = guac_user_output_read_handler;
+    queued_socket->write_handler  = guac_user_output_write_handler;
+    queued_socket->select_handler = guac_user_output_select_handler;
+    queued_socket->flush_handler  = guac_user_output_flush_handler;
+    queued_socket->lock_handler   = guac_user_output_lock_handler;
+    queued_socket->unlock_handler = guac_user_output_unlock_handler;
+
+    /* Start draining the queue */
+    if (pthread_create(&(output->writer_thread), NULL,
+                guac_user_output_writer_thread, output)) {
+        guac_error = GUAC_STATUS_SEE_ERRNO;
+        guac_error_message = "Unable to start output writer thread";
+        pthread_cond_destroy(&(output->queue_modified));
+        pthread_mutex_destroy(&(output->queue_lock));
+        pthread_mutex_destroy(&(output->socket_lock));
+        guac_socket_free(queued_socket);
+        free(output);
+        return NULL;
+    }
+
+    /* All further writes to the user are queued */
+    user->socket = queued_socket;
+    user->__output = output;
+
+    return output;
+
+}
+
+void guac_user_output_free(guac_user_output* output) {
+
+    guac_user* user = output->user;
+
+    /* Queue any remaining data and wait for it to be written */
+    pthread_mutex_lock(&(output->queue_lock));
+    guac_user_output_seal(output);
+    output->stopping = 1;
+    pthread_cond_signal(&(output->queue_modified));
+    pthread_mutex_unlock(&(output->queue_lock));
+
+    pthread_join(output->writer_thread, NULL);
+
+    /* Restore original socket */
+    user->socket = output->socket;
+    user->__output = NULL;
+
+    guac_socket_free(output->queued_socket);
+
+    /* Release anything written after the writer thread stopped */
+    if (output->pending != NULL)
+        guac_socket_chunk_release(output->pending);
+
+    while (output->head != NULL) {
+        guac_user_output_entry* next = output->head->next;
+        guac_socket_chunk_release(output->head->chunk);
+        free(output->head);
+        output->head = next;
+    }
+
+    pthread_cond_destroy(&(output->queue_modified));
+    pthread_mutex_destroy(&(output->queue_lock));
+    pthread_mutex_destroy(&(output->socket_lock));
+
+    free(output);
+
+}
+
+void guac_user_output_broadcast(guac_user_output* output,
+        guac_socket_chunk* chunk) {
+
+    guac_user* user = output->user;
+
+    /* Do not split any instruction currently being written directly to the
+     * user */
+    guac_socket_instruction_begin(output->queued_socket);
+    pthread_mutex_lock(&(output->queue_lock));
+
+    /* Ignore broadcast data while the user cannot accept it */
+    if (output->failed || output->discarding) {
+        output->dropped_bytes += chunk->length;
+        goto done;
+    }
+
+    /* Ignore display data until the user has been resynchronized */
+    if (output->resync && guac_user_output_droppable(chunk)) {
+        output->dropped_bytes += chunk->length;
+        goto done;
+    }
+
+    /* Preserve ordering of any data written directly to the user */
+    guac_user_output_seal(output);
+
+    /* Queue chunk if within limits */
+    if (output->length + chunk->length <= output->limit) {
+        guac_user_output_enqueue(output, guac_socket_chunk_acquire(chunk), 1);
+        goto done;
+    }
+
+    /* The user is not keeping up. Drop all queued display data, including
+     * the chunk provided if it is display data, and ignore further display
+     * data until the user has been resynchronized. Data which cannot be
+     * restored by resynchronization is kept. */
+    if (user->client->resync_handler != NULL) {
+
+        guac_user_output_drop(output);
+        output->drops++;
+
+        if (guac_user_output_droppable(chunk))
+            output->dropped_bytes += chunk->length;
+
+        else if (output->length + chunk->length <= output->limit)
+            guac_user_output_enqueue(output,
+                    guac_socket_chunk_acquire(chunk), 1);
+
+        /* The user cannot keep up even without display data */
+        else
+            goto disconnect;
+
+        guac_user_log(user, GUAC_LOG_DEBUG, "User is not keeping up with "
+                "the connection. Queued display output has been dropped and "
+                "will be resynchronized.");
+        output->resync = 1;
+        pthread_cond_signal(&(output->queue_modified));
+        goto done;
+
+    }
+
+disconnect:
+
+    /* Otherwise, the user cannot continue */
+    output->dropped_bytes += chunk->length;
+    output->discarding = 1;
+    guac_user_log(user, GUAC_LOG_WARNING, "User is not keeping up with "
+            "the connection and will be disconnected.");
+    guac_user_stop(user);
+
+done:
+    pthread_mutex_unlock(&(output->queue_lock));
+    guac_socket_instruction_end(output->queued_socket);
+
+}
+
+void guac_user_get_output_stats(guac_user* user,
+        guac_user_output_stats* stats) {
+
+    guac_user_output* output = user->__output;
+
+    /* No output is queued unless the user is connected */
+    if (output == NULL) {
+        stats->queue_length = 0;
+        stats->drops = 0;
+        stats->dropped_bytes = 0;
+        return;
+    }
+
+    pthread_mutex_lock(&(output->queue_lock));
+    stats->queue_length = output->length;
+    stats->drops = output->drops;
+    stats->dropped_bytes = output->dropped_bytes;
+    pthread_mutex_unlock(&(output->queue_lock));
+
+}
+
@@ -0,0 +1,236 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef GUAC_USER_OUTPUT_H
+#define GUAC_USER_OUTPUT_H
+
+#include "guacamole/client-constants.h"
+#include "guacamole/socket-types.h"
+#include "guacamole/user-types.h"
+#include "socket-chunk.h"
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * A single block of data awaiting transmission to a user.
+ */
+typedef struct guac_user_output_entry {
+
+    /**
+     * The chunk of data to be written. A reference to this chunk is held by
+     * the entry until the data has been written or discarded.
+     */
+    guac_socket_chunk* chunk;
+
+    /**
+     * Non-zero if this entry was written to the broadcast socket of the
+     * user's guac_client, and thus may be discarded if the user falls behind
+     * and the chunk contains only display data, zero if the entry was written
+     * specifically to this user.
+     */
+    int broadcast;
+
+    /**
+     * The next entry in the queue, or NULL if this is the last entry.
+     */
+    struct guac_user_output_entry* next;
+
+} guac_user_output_entry;
+
+/**
+ * The asynchronous output queue of a single user. All data written to the
+ * user, whether directly or via the broadcast socket of the user's
+ * guac_client, is appended to a bounded queue which is drained by a dedicated
+ * writer thread. A user whose connection stalls thus cannot block writes
+ * intended for other users.
+ */
+typedef struct guac_user_output {
+
+    /**
+     * The user whose output is being queued.
+     */
+    guac_user* user;
+
+    /**
+     * The user's original socket, to which all queued data is ultimately
+     * written by the writer thread.
+     */
+    guac_socket* socket;
+
+    /**
+     * The socket which replaces the user's original socket for as long as
+     * this output queue exists. Data written to this socket is queued rather
+     * than written immediately, while reads are delegated to the original
+     * socket.
+     */
+    guac_socket* queued_socket;
+
+    /**
+     * Lock which is acquired when an instruction is being written to the
+     * queued socket, and released when the instruction is finished being
+     * written.
+     */
+    pthread_mutex_t socket_lock;
+
+    /**
+     * Lock which guards access to the queue and all associated state.
+     */
+    pthread_mutex_t queue_lock;
+
+    /**
+     * Condition which is signalled whenever the writer thread may have work
+     * to do.
+     */
+    pthread_cond_t queue_modified;
+
+    /**
+     * Chunk containing data written directly to this user which has not yet
+     * been appended to the queue. Consecutive direct writes are accumulated
+     * here to avoid queueing many tiny entries.
+     */
+    guac_socket_chunk* pending;
+
+    /**
+     * The first entry in the queue, or NULL if the queue is empty.
+     */
+    guac_user_output_entry* head;
+
+    /**
+     * The last entry in the queue, or NULL if the queue is empty.
+     */
+    guac_user_output_entry* tail;
+
+    /**
+     * The maximum number of bytes which may be queued before data written
+     * to the broadcast socket is discarded (or the user is disconnected).
+     */
+    size_t limit;
+
+    /**
+     * The number of bytes currently queued.
+     */
+    size_t length;
+
+    /**
+     * The number of times that queued broadcast data has been dropped
+     * because the user was not keeping up with the connection.
+     */
+    int drops;
+
+    /**
+     * The total number of bytes of broadcast data dropped for the user.
+     */
+    uint64_t dropped_bytes;
+
+    /**
+     * Non-zero if queued display data has been discarded and the user's view
+     * of the connection must be resynchronized by the writer thread. Further
+     * display data written to the broadcast socket is discarded until
+     * resynchronization begins.
+     */
+    int resync;
+
+    /**
+     * Non-zero if all data written to the broadcast socket is being discarded
+     * rather than queued, because the user has been stopped for falling
+     * behind.
+     */
+    int discarding;
+
+    /**
+     * Non-zero for each client-level stream, indexed by the array index of
+     * that stream within the guac_client, whose "img" instruction has been
+     * written to the user's original socket but whose "end" instruction has
+     * not. Such streams must be ended when the rest of their data is dropped,
+     * as the user would otherwise wait for the image forever. This is
+     * accessed only by the writer thread.
+     */
+    char open_images[GUAC_CLIENT_MAX_STREAMS];
+
+    /**
+     * Non-zero if the writer thread should stop once the queue has been
+     * drained.
+     */
+    int stopping;
+
+    /**
+     * Non-zero if writing to the user's original socket has failed, in which
+     * case all further data is discarded.
+     */
+    int failed;
+
+    /**
+     * The writer thread which drains the queue.
+     */
+    pthread_t writer_thread;
+
+} guac_user_output;
+
+/**
+ * Allocates a new output queue for the given user, replacing the user's
+ * socket with a socket that queues all written data and starting the writer
+ * thread which drains that queue into the original socket. The original
+ * socket is restored when the queue is freed with guac_user_output_free().
+ *
+ * @param user
+ *     The user whose output should be queued.
+ *
+ * @return
+ *     A newly-allocated guac_user_output, or NULL if the queue or its writer
+ *     thread could not be created, in which case the user's socket is left
+ *     untouched.
+ */
+guac_user_output* guac_user_output_alloc(guac_user* user);
+
+/**
+ * Writes all remaining queued data, stops the writer thread, restores the
+ * user's original socket, and frees the given output queue. The user must no
+ * longer be part of the connection when this function is invoked, as the
+ * broadcast socket of the user's guac_client must not attempt to queue
+ * further data.
+ *
+ * @param output
+ *     The output queue to free.
+ */
+void guac_user_output_free(guac_user_output* output);
+
+/**
+ * Appends a chunk of data written to the broadcast socket of the user's
+ * guac_client to the given output queue. If the queue would exceed its limit,
+ * all queued display data (see guac_socket_chunk_type) is discarded and the
+ * user is resynchronized with the client's resync_handler. Other data, such as
+ * audio or file transfers, is never discarded. If no resync_handler is
+ * defined, or if the queue would still exceed its limit after discarding
+ * display data, the user is instead stopped with guac_user_stop(). This
+ * function never blocks on the user's connection.
+ *
+ * @param output
+ *     The output queue to append the chunk to.
+ *
+ * @param chunk
+ *     The chunk of broadcast data to append. A new reference to this chunk is
+ *     acquired if the chunk is queued.
+ */
+void guac_user_output_broadcast(guac_user_output* output,
+        guac_socket_chunk* chunk);
+
+#endif
+
@@ -32,5 +32,10 @@ guac_user_join_handler guac_kubernetes_user_join_handler;
  */
 guac_user_leave_handler guac_kubernetes_user_leave_handler;
 
+/**
+ * Handler for users whose dropped output must be resynchronized.
+ */
+guac_user_resync_handler guac_kubernetes_user_resync_handler;
+
 #endif
 
@@ -30,6 +30,7 @@
 
 #include "channels/common-svc.h"
 #include "channels/rdpdr/rdpdr.h"
+#include "fs.h"
 
 #include <winpr/stream.h>
 
@@ -54,12 +55,13 @@
  * @param entry_name
  *     The filename of the file being queried.
  *
- * @param entry_file_id
- *     The ID of the file being queried.
+ * @param info
+ *     The attributes, size and timestamps of the file being queried, as
+ *     retrieved via guac_rdp_fs_stat_dir_entry().
  */
 typedef void guac_rdpdr_directory_query_handler(guac_rdp_common_svc* svc,
         guac_rdpdr_device* device, guac_rdpdr_iorequest* iorequest,
-        const char* entry_name, int entry_file_id);
+        const char* entry_name, guac_rdp_fs_entry_info* info);
 
 /**
  * Processes a query request for FileDirectoryInformation. From the
@@ -523,39 +523,37 @@ void guac_rdpdr_fs_process_query_directory(guac_rdp_common_svc* svc,
         if (guac_rdp_fs_convert_path(file->absolute_path,
                     entry_name, entry_path) == 0) {
 
-            int entry_file_id;
+            guac_rdp_fs_entry_info info;
 
             /* Pattern defined and match fails, continue with next file */
             if (guac_rdp_fs_matches(entry_path, file->dir_pattern))
                 continue;
 
-            /* Open directory entry */
-            entry_file_id = guac_rdp_fs_open((guac_rdp_fs*) device->data,
-                    entry_path, FILE_READ_DATA, 0, FILE_OPEN, 0);
-
-            if (entry_file_id >= 0) {
+            /* Stat directory entry relative to the directory being listed */
+            if (guac_rdp_fs_stat_dir_entry((guac_rdp_fs*) device->data,
+                        iorequest->file_id, entry_name, &info) == 0) {
 
                 /* Dispatch to appropriate class-specific handler */
                 switch (fs_information_class) {
 
                     case FileDirectoryInformation:
                         guac_rdpdr_fs_process_query_directory_info(svc, device,
-                                iorequest, entry_name, entry_file_id);
+                                iorequest, entry_name, &info);
                         break;
 
                     case FileFullDirectoryInformation:
                         guac_rdpdr_fs_process_query_full_directory_info(svc,
-                                device, iorequest, entry_name, entry_file_id);
+                                device, iorequest, entry_name, &info);
                         break;
 
                     case FileBothDirectoryInformation:
                         guac_rdpdr_fs_process_query_both_directory_info(svc,
-                                device, iorequest, entry_name, entry_file_id);
+                                device, iorequest, entry_name, &info);
                         break;
 
                     case FileNamesInformation:
                         guac_rdpdr_fs_process_query_names_info(svc, device,
-                                iorequest, entry_name, entry_file_id);
+                                iorequest, entry_name, &info);
                         break;
 
                     default:
@@ -564,7 +562,6 @@ void guac_rdpdr_fs_process_query_directory(guac_rdp_common_svc* svc,
                                 fs_information_class);
                 }
 
-                guac_rdp_fs_close((guac_rdp_fs*) device->data, entry_file_id);
                 return;
 
             } /* end if file exists */
@@ -18,6 +18,7 @@
  */
 
 #include "common/json.h"
+#include "common/transfer.h"
 #include "download.h"
 #include "fs.h"
 #include "ls.h"
@@ -33,8 +34,89 @@
 #include <winpr/nt.h>
 #include <winpr/shell.h>
 
+#include <stdint.h>
 #include <stdlib.h>
 
+/**
+ * Read handler for the guac_common_transfer of a file download, reading from
+ * the downloaded file within the RDP filesystem.
+ *
+ * @param data
+ *     The guac_rdp_download_status of the download.
+ *
+ * @param offset
+ *     The offset within the file to read from, in bytes.
+ *
+ * @param buffer
+ *     The buffer to read data into.
+ *
+ * @param length
+ *     The maximum number of bytes to read.
+ *
+ * @return
+ *     The number of bytes read, zero on EOF, or a negative value on error.
+ */
+static int guac_rdp_download_read(void* data, uint64_t offset, char* buffer,
+        int length) {
+
+    guac_rdp_download_status* download_status =
+        (guac_rdp_download_status*) data;
+
+    return guac_rdp_fs_read(download_status->fs, download_status->file_id,
+            offset, buffer, length);
+
+}
+
+/**
+ * Allocates the transfer status of a new download of the given open file.
+ *
+ * @param fs
+ *     The filesystem containing the file.
+ *
+ * @param file_id
+ *     The file ID of the open file to be downloaded.
+ *
+ * @return
+ *     The transfer status of a new download, or NULL if allocation fails.
+ */
+static guac_rdp_download_status* guac_rdp_download_status_alloc(
+        guac_rdp_fs* fs, int file_id) {
+
+    guac_rdp_download_status* download_status =
+        malloc(sizeof(guac_rdp_download_status));
+    if (download_status == NULL)
+        return NULL;
+
+    download_status->fs = fs;
+    download_status->file_id = file_id;
+    download_status->transfer = guac_common_transfer_alloc(
+            guac_rdp_download_read, download_status,
+            GUAC_COMMON_TRANSFER_DEFAULT_WINDOW);
+
+    if (download_status->transfer == NULL) {
+        free(download_status);
+        return NULL;
+    }
+
+    return download_status;
+
+}
+
+/**
+ * Frees the given transfer status, closing the downloaded file.
+ *
+ * @param download_status
+ *     The transfer status to free.
+ */
+static void guac_rdp_download_status_free(
+        guac_rdp_download_status* download_status) {
+
+    guac_rdp_fs_close(download_status->fs, download_status->file_id);
+    guac_common_transfer_free(download_status->transfer);
+    free(download_status);
+
+}
+
 int guac_rdp_download_ack_handler(guac_user* user, guac_stream* stream,
         char* message, guac_protocol_status status) {
 
@@ -51,46 +133,14 @@ int guac_rdp_download_ack_handler(guac_user* user, guac_stream* stream,
         return 0;
     }
 
-    /* If successful, read data */
-    if (status == GUAC_PROTOCOL_STATUS_SUCCESS) {
-
-        /* Attempt read into buffer */
-        char buffer[4096];
-        int bytes_read = guac_rdp_fs_read(fs,
-                download_status->file_id,
-                download_status->offset, buffer, sizeof(buffer));
-
-        /* If bytes read, send as blob */
-        if (bytes_read > 0) {
-            download_status->offset += bytes_read;
-            guac_protocol_send_blob(user->socket, stream,
-                    buffer, bytes_read);
-        }
-
-        /* If EOF, send end */
-        else if (bytes_read == 0) {
-            guac_protocol_send_end(user->socket, stream);
-            guac_user_free_stream(user, stream);
-            free(download_status);
-        }
-
-        /* Otherwise, fail stream */
-        else {
-            guac_user_log(user, GUAC_LOG_ERROR,
-                    "Error reading file for download");
-            guac_protocol_send_end(user->socket, stream);
-            guac_user_free_stream(user, stream);
-            free(download_status);
-        }
-
-        guac_socket_flush(user->socket);
-
-    }
-
-    /* Otherwise, return stream to user */
-    else
+    /* Send further data, cleaning up once the transfer is over */
+    if (guac_common_transfer_ack(download_status->transfer, user, stream,
+                status) != GUAC_COMMON_TRANSFER_IN_PROGRESS) {
+        guac_rdp_download_status_free(download_status);
         guac_user_free_stream(user, stream);
+    }
 
+    guac_socket_flush(user->socket);
     return 0;
 
 }
@@ -130,6 +180,7 @@ int guac_rdp_download_get_handler(guac_user* user, guac_object* object,
         guac_rdp_ls_status* ls_status = malloc(sizeof(guac_rdp_ls_status));
         ls_status->fs = fs;
         ls_status->file_id = file_id;
+        ls_status->complete = 0;
         guac_strlcpy(ls_status->directory_name, name,
                 sizeof(ls_status->directory_name));
 
@@ -152,9 +203,12 @@ int guac_rdp_download_get_handler(guac_user* user, guac_object* object,
     else if (!fs->disable_download) {
 
         /* Create stream data */
-        guac_rdp_download_status* download_status = malloc(sizeof(guac_rdp_download_status));
-        download_status->file_id = file_id;
-        download_status->offset = 0;
+        guac_rdp_download_status* download_status =
+            guac_rdp_download_status_alloc(fs, file_id);
+        if (download_status == NULL) {
+            guac_rdp_fs_close(fs, file_id);
+            return 0;
+        }
 
         /* Allocate stream for body */
         guac_stream* stream = guac_user_alloc_stream(user);
@@ -206,13 +260,18 @@ void* guac_rdp_download_to_user(guac_user* user, void* data) {
     /* If file opened successfully, start stream */
     if (file_id >= 0) {
 
+        /* Create transfer status */
+        guac_rdp_download_status* download_status =
+            guac_rdp_download_status_alloc(filesystem, file_id);
+        if (download_status == NULL) {
+            guac_rdp_fs_close(filesystem, file_id);
+            return NULL;
+        }
+
         /* Associate stream with transfer status */
         guac_stream* stream = guac_user_alloc_stream(user);
-        guac_rdp_download_status* download_status = malloc(sizeof(guac_rdp_download_status));
         stream->data = download_status;
         stream->ack_handler = guac_rdp_download_ack_handler;
-        download_status->file_id = file_id;
-        download_status->offset = 0;
 
         guac_user_log(user, GUAC_LOG_DEBUG, "%s: Initiating download "
                 "of \"%s\"", __func__, path);
@@ -21,6 +21,8 @@
 #define GUAC_RDP_DOWNLOAD_H
 
 #include "common/json.h"
+#include "common/transfer.h"
+#include "fs.h"
 
 #include <guacamole/protocol.h>
 #include <guacamole/stream.h>
@@ -33,15 +35,21 @@
  */
 typedef struct guac_rdp_download_status {
 
+    /**
+     * The filesystem containing the file being downloaded.
+     */
+    guac_rdp_fs* fs;
+
     /**
      * The file ID of the file being downloaded.
      */
     int file_id;
 
     /**
-     * The current position within the file.
+     * The state of the outbound transfer of the file's contents, including
+     * the current position within the file.
      */
-    uint64_t offset;
+    guac_common_transfer* transfer;
 
 } guac_rdp_download_status;
 
@@ -35,6 +35,7 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <fnmatch.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -67,12 +68,22 @@ guac_rdp_fs* guac_rdp_fs_alloc(guac_client* client, const char* drive_path,
     fs->open_files = 0;
     fs->disable_download = disable_download;
     fs->disable_upload = disable_upload;
+    pthread_mutex_init(&(fs->lock), NULL);
+
+    /* No files are open initially */
+    for (int i = 0; i < GUAC_RDP_FS_MAX_FILES; i++) {
+        fs->files[i].fd = -1;
+        fs->files[i].dir = NULL;
+        fs->files[i].refs = 0;
+        fs->files[i].closing = 0;
+    }
 
     return fs;
 
 }
 
 void guac_rdp_fs_free(guac_rdp_fs* fs) {
+    pthread_mutex_destroy(&(fs->lock));
     guac_pool_free(fs->file_id_pool);
     free(fs->drive_path);
     free(fs);
@@ -209,7 +220,35 @@ int guac_rdp_fs_get_status(int err) {
 
 }
 
-int guac_rdp_fs_open(guac_rdp_fs* fs, const char* path,
+/**
+ * Opens the given file, as guac_rdp_fs_open(). The lock of the given
+ * filesystem must already be held.
+ *
+ * @param fs
+ *     The filesystem to use when opening the file.
+ *
+ * @param path
+ *     The absolute path to the file within the filesystem.
+ *
+ * @param access
+ *     A bitwise-OR of various RDPDR access flags, such as GENERIC_ALL or
+ *     GENERIC_WRITE.
+ *
+ * @param file_attributes
+ *     The attributes to apply to the file, if created.
+ *
+ * @param create_disposition
+ *     Any one of several RDPDR file creation dispositions, such as
+ *     FILE_CREATE or FILE_OPEN_IF.
+ *
+ * @param create_options
+ *     Any options to apply to the file creation process.
+ *
+ * @return
+ *     A new file ID, which will always be a positive value, or an error code
+ *     on failure.
+ */
+static int __guac_rdp_fs_open(guac_rdp_fs* fs, const char* path,
         int access, int file_attributes, int create_disposition,
         int create_options) {
 
@@ -369,6 +408,10 @@ int guac_rdp_fs_open(guac_rdp_fs* fs, const char* path,
     file->absolute_path = strdup(normalized_path);
     file->real_path = strdup(real_path);
     file->bytes_written = 0;
+    file->next_read_offset = 0;
+    file->read_ahead_offset = 0;
+    file->refs = 0;
+    file->closing = 0;
 
     guac_client_log(fs->client, GUAC_LOG_DEBUG,
             "%s: Opened \"%s\" as file_id=%i",
@@ -409,12 +452,121 @@ int guac_rdp_fs_open(guac_rdp_fs* fs, const char* path,
 
 }
 
+/**
+ * Closes the given file and releases its ID for reuse. The lock of the given
+ * filesystem must already be held, and no references to the file may remain.
+ *
+ * @param fs
+ *     The filesystem containing the file to release.
+ *
+ * @param file
+ *     The file to release.
+ */
+static void __guac_rdp_fs_release_file(guac_rdp_fs* fs,
+        guac_rdp_fs_file* file) {
+
+    guac_client_log(fs->client, GUAC_LOG_DEBUG,
+            "%s: Closed \"%s\" (file_id=%i)",
+            __func__, file->absolute_path, file->id);
+
+    /* Close directory, if open, which also closes the underlying file */
+    if (file->dir != NULL)
+        closedir(file->dir);
+    else
+        close(file->fd);
+
+    /* Fail any later use of the stale ID */
+    file->fd = -1;
+    file->dir = NULL;
+
+    /* Free name */
+    free(file->absolute_path);
+    free(file->real_path);
+
+    /* Free ID back to pool */
+    guac_pool_free_int(fs->file_id_pool, file->id);
+    fs->open_files--;
+
+}
+
+/**
+ * Acquires a reference to the open file having the given ID, such that the
+ * file is not closed, nor its ID reused, until that reference is released
+ * with __guac_rdp_fs_unref_file(). The lock of the given filesystem is held
+ * only while the reference is acquired.
+ *
+ * @param fs
+ *     The filesystem containing the desired file.
+ *
+ * @param file_id
+ *     The ID of the desired file, as returned by guac_rdp_fs_open().
+ *
+ * @return
+ *     The file having the given ID, or NULL if no such file is open.
+ */
+static guac_rdp_fs_file* __guac_rdp_fs_ref_file(guac_rdp_fs* fs,
+        int file_id) {
+
+    guac_rdp_fs_file* file = guac_rdp_fs_get_file(fs, file_id);
+    if (file == NULL)
+        return NULL;
+
+    pthread_mutex_lock(&(fs->lock));
+
+    /* Refuse files which are not open or are being closed */
+    if (file->fd == -1 || file->closing)
+        file = NULL;
+    else
+        file->refs++;
+
+    pthread_mutex_unlock(&(fs->lock));
+    return file;
+
+}
+
+/**
+ * Releases a reference acquired with __guac_rdp_fs_ref_file(). If the file
+ * has since been closed with guac_rdp_fs_close() and this was the last
+ * reference, the file is released.
+ *
+ * @param fs
+ *     The filesystem containing the file.
+ *
+ * @param file
+ *     The file whose reference should be released.
+ */
+static void __guac_rdp_fs_unref_file(guac_rdp_fs* fs,
+        guac_rdp_fs_file* file) {
+
+    pthread_mutex_lock(&(fs->lock));
+
+    if (--file->refs == 0 && file->closing)
+        __guac_rdp_fs_release_file(fs, file);
+
+    pthread_mutex_unlock(&(fs->lock));
+
+}
+
+int guac_rdp_fs_open(guac_rdp_fs* fs, const char* path,
+        int access, int file_attributes, int create_disposition,
+        int create_options) {
+
+    pthread_mutex_lock(&(fs->lock));
+    int file_id = __guac_rdp_fs_open(fs, path, access, file_attributes,
+            create_disposition, create_options);
+    pthread_mutex_unlock(&(fs->lock));
+
+    return file_id;
+
+}
+
 int guac_rdp_fs_read(guac_rdp_fs* fs, int file_id, uint64_t offset,
         void* buffer, int length) {
 
     int bytes_read;
+    int read_ahead = 0;
 
-    guac_rdp_fs_file* file = guac_rdp_fs_get_file(fs, file_id);
+    guac_rdp_fs_file* file = __guac_rdp_fs_ref_file(fs, file_id);
     if (file == NULL) {
         guac_client_log(fs->client, GUAC_LOG_DEBUG,
                 "%s: Read from bad file_id: %i", __func__, file_id);
@@ -422,13 +574,34 @@ int guac_rdp_fs_read(guac_rdp_fs* fs, int file_id, uint64_t offset,
     }
 
     /* Attempt read */
-    lseek(file->fd, offset, SEEK_SET);
-    bytes_read = read(file->fd, buffer, length);
+    bytes_read = pread(file->fd, buffer, length, offset);
 
     /* Translate errno on error */
-    if (bytes_read < 0)
-        return guac_rdp_fs_get_errorcode(errno);
+    if (bytes_read < 0) {
+        int error = errno;
+        __guac_rdp_fs_unref_file(fs, file);
+        return guac_rdp_fs_get_errorcode(error);
+    }
+
+    /* Keep the local filesystem reading ahead of sequential reads, renewing
+     * the advice once half of the previously-advised region is consumed */
+    uint64_t end = offset + bytes_read;
+    pthread_mutex_lock(&(fs->lock));
+
+    if (offset == file->next_read_offset && bytes_read > 0
+            && end + GUAC_RDP_FS_READ_AHEAD_SIZE / 2 > file->read_ahead_offset) {
+        file->read_ahead_offset = end + GUAC_RDP_FS_READ_AHEAD_SIZE;
+        read_ahead = 1;
+    }
 
+    file->next_read_offset = end;
+    pthread_mutex_unlock(&(fs->lock));
+
+    if (read_ahead)
+        posix_fadvise(file->fd, end, GUAC_RDP_FS_READ_AHEAD_SIZE,
+                POSIX_FADV_WILLNEED);
+
+    __guac_rdp_fs_unref_file(fs, file);
     return bytes_read;
 
 }
@@ -438,7 +611,7 @@ int guac_rdp_fs_write(guac_rdp_fs* fs, int file_id, uint64_t offset,
 
     int bytes_written;
 
-    guac_rdp_fs_file* file = guac_rdp_fs_get_file(fs, file_id);
+    guac_rdp_fs_file* file = __guac_rdp_fs_ref_file(fs, file_id);
     if (file == NULL) {
         guac_client_log(fs->client, GUAC_LOG_DEBUG,
                 "%s: Write to bad file_id: %i", __func__, file_id);
@@ -446,14 +619,20 @@ int guac_rdp_fs_write(guac_rdp_fs* fs, int file_id, uint64_t offset,
     }
 
     /* Attempt write */
-    lseek(file->fd, offset, SEEK_SET);
-    bytes_written = write(file->fd, buffer, length);
+    bytes_written = pwrite(file->fd, buffer, length, offset);
 
     /* Translate errno on error */
-    if (bytes_written < 0)
-        return guac_rdp_fs_get_errorcode(errno);
+    if (bytes_written < 0) {
+        int error = errno;
+        __guac_rdp_fs_unref_file(fs, file);
+        return guac_rdp_fs_get_errorcode(error);
+    }
 
+    pthread_mutex_lock(&(fs->lock));
     file->bytes_written += bytes_written;
+    pthread_mutex_unlock(&(fs->lock));
+
+    __guac_rdp_fs_unref_file(fs, file);
     return bytes_written;
 
 }
@@ -464,13 +643,6 @@ int guac_rdp_fs_rename(guac_rdp_fs* fs, int file_id,
     char real_path[GUAC_RDP_FS_MAX_PATH];
     char normalized_path[GUAC_RDP_FS_MAX_PATH];
 
-    guac_rdp_fs_file* file = guac_rdp_fs_get_file(fs, file_id);
-    if (file == NULL) {
-        guac_client_log(fs->client, GUAC_LOG_DEBUG,
-                "%s: Rename of bad file_id: %i", __func__, file_id);
-        return GUAC_RDP_FS_EINVAL;
-    }
-
     /* Normalize path, return no-such-file if invalid  */
     if (guac_rdp_fs_normalize_path(new_path, normalized_path)) {
         guac_client_log(fs->client, GUAC_LOG_DEBUG,
@@ -479,6 +651,13 @@ int guac_rdp_fs_rename(guac_rdp_fs* fs, int file_id,
         return GUAC_RDP_FS_ENOENT;
     }
 
+    guac_rdp_fs_file* file = __guac_rdp_fs_ref_file(fs, file_id);
+    if (file == NULL) {
+        guac_client_log(fs->client, GUAC_LOG_DEBUG,
+                "%s: Rename of bad file_id: %i", __func__, file_id);
+        return GUAC_RDP_FS_EINVAL;
+    }
+
     /* Translate normalized path to real path */
     __guac_rdp_fs_translate_path(fs, normalized_path, real_path);
 
@@ -488,12 +667,15 @@ int guac_rdp_fs_rename(guac_rdp_fs* fs, int file_id,
 
     /* Perform rename */
     if (rename(file->real_path, real_path)) {
+        int error = errno;
         guac_client_log(fs->client, GUAC_LOG_DEBUG,
                 "%s: rename() failed: \"%s\" -> \"%s\"",
                 __func__, file->real_path, real_path);
-        return guac_rdp_fs_get_errorcode(errno);
+        __guac_rdp_fs_unref_file(fs, file);
+        return guac_rdp_fs_get_errorcode(error);
     }
 
+    __guac_rdp_fs_unref_file(fs, file);
     return 0;
 
 }
@@ -501,7 +683,7 @@ int guac_rdp_fs_rename(guac_rdp_fs* fs, int file_id,
 int guac_rdp_fs_delete(guac_rdp_fs* fs, int file_id) {
 
     /* Get file */
-    guac_rdp_fs_file* file = guac_rdp_fs_get_file(fs, file_id);
+    guac_rdp_fs_file* file = __guac_rdp_fs_ref_file(fs, file_id);
     if (file == NULL) {
         guac_client_log(fs->client, GUAC_LOG_DEBUG,
                 "%s: Delete of bad file_id: %i", __func__, file_id);
@@ -511,19 +693,24 @@ int guac_rdp_fs_delete(guac_rdp_fs* fs, int file_id) {
     /* If directory, attempt removal */
     if (file->attributes & FILE_ATTRIBUTE_DIRECTORY) {
         if (rmdir(file->real_path)) {
+            int error = errno;
             guac_client_log(fs->client, GUAC_LOG_DEBUG,
                     "%s: rmdir() failed: \"%s\"", __func__, file->real_path);
-            return guac_rdp_fs_get_errorcode(errno);
+            __guac_rdp_fs_unref_file(fs, file);
+            return guac_rdp_fs_get_errorcode(error);
         }
     }
 
     /* Otherwise, attempt deletion */
     else if (unlink(file->real_path)) {
+        int error = errno;
         guac_client_log(fs->client, GUAC_LOG_DEBUG,
                 "%s: unlink() failed: \"%s\"", __func__, file->real_path);
-        return guac_rdp_fs_get_errorcode(errno);
+        __guac_rdp_fs_unref_file(fs, file);
+        return guac_rdp_fs_get_errorcode(error);
     }
 
+    __guac_rdp_fs_unref_file(fs, file);
     return 0;
 
 }
@@ -531,7 +718,7 @@ int guac_rdp_fs_delete(guac_rdp_fs* fs, int file_id) {
 int guac_rdp_fs_truncate(guac_rdp_fs* fs, int file_id, int length) {
 
     /* Get file */
-    guac_rdp_fs_file* file = guac_rdp_fs_get_file(fs, file_id);
+    guac_rdp_fs_file* file = __guac_rdp_fs_ref_file(fs, file_id);
     if (file == NULL) {
         guac_client_log(fs->client, GUAC_LOG_DEBUG,
                 "%s: Delete of bad file_id: %i", __func__, file_id);
@@ -540,12 +727,15 @@ int guac_rdp_fs_truncate(guac_rdp_fs* fs, int file_id, int length) {
 
     /* Attempt truncate */
     if (ftruncate(file->fd, length)) {
+        int error = errno;
         guac_client_log(fs->client, GUAC_LOG_DEBUG,
                 "%s: ftruncate() to %i bytes failed: \"%s\"",
                 __func__, length, file->real_path);
-        return guac_rdp_fs_get_errorcode(errno);
+        __guac_rdp_fs_unref_file(fs, file);
+        return guac_rdp_fs_get_errorcode(error);
     }
 
+    __guac_rdp_fs_unref_file(fs, file);
     return 0;
 
 }
@@ -560,54 +750,97 @@ void guac_rdp_fs_close(guac_rdp_fs* fs, int file_id) {
         return;
     }
 
-    file = &(fs->files[file_id]);
-
-    guac_client_log(fs->client, GUAC_LOG_DEBUG,
-            "%s: Closed \"%s\" (file_id=%i)",
-            __func__, file->absolute_path, file_id);
+    pthread_mutex_lock(&(fs->lock));
 
-    /* Close directory, if open */
-    if (file->dir != NULL)
-        closedir(file->dir);
-
-    /* Close file */
-    close(file->fd);
+    /* Ignore files which are not open or are already being closed */
+    if (file->fd == -1 || file->closing) {
+        guac_client_log(fs->client, GUAC_LOG_DEBUG,
+                "%s: Ignoring close for bad file_id: %i",
+                __func__, file_id);
+        pthread_mutex_unlock(&(fs->lock));
+        return;
+    }
 
-    /* Free name */
-    free(file->absolute_path);
-    free(file->real_path);
+    /* Release the file now, or once the last operation using it finishes */
+    file->closing = 1;
+    if (file->refs == 0)
+        __guac_rdp_fs_release_file(fs, file);
 
-    /* Free ID back to pool */
-    guac_pool_free_int(fs->file_id_pool, file_id);
-    fs->open_files--;
+    pthread_mutex_unlock(&(fs->lock));
 
 }
 
 const char* guac_rdp_fs_read_dir(guac_rdp_fs* fs, int file_id) {
 
-    guac_rdp_fs_file* file;
-
     struct dirent* result;
 
-    /* Only read if file ID is valid */
-    if (file_id < 0 || file_id >= GUAC_RDP_FS_MAX_FILES)
+    guac_rdp_fs_file* file = __guac_rdp_fs_ref_file(fs, file_id);
+    if (file == NULL)
         return NULL;
 
-    file = &(fs->files[file_id]);
-
-    /* Open directory if not yet open, stop if error */
-    if (file->dir == NULL) {
+    /* Open directory if not yet open, such that only one directory stream
+     * is ever created for the file */
+    pthread_mutex_lock(&(fs->lock));
+    if (file->dir == NULL)
         file->dir = fdopendir(file->fd);
-        if (file->dir == NULL)
-            return NULL;
-    }
+    DIR* dir = file->dir;
+    pthread_mutex_unlock(&(fs->lock));
 
     /* Read next entry, stop if error or no more entries */
-    if ((result = readdir(file->dir)) == NULL)
-        return NULL;
+    result = (dir != NULL) ? readdir(dir) : NULL;
+
+    __guac_rdp_fs_unref_file(fs, file);
 
     /* Return filename */
-    return result->d_name;
+    return (result != NULL) ? result->d_name : NULL;
+
+}
+
+int guac_rdp_fs_stat_dir_entry(guac_rdp_fs* fs, int file_id,
+        const char* name, guac_rdp_fs_entry_info* info) {
+
+    struct stat file_stat;
+
+    /* Entries are never paths */
+    if (strchr(name, '/') != NULL)
+        return GUAC_RDP_FS_EINVAL;
+
+    guac_rdp_fs_file* file = __guac_rdp_fs_ref_file(fs, file_id);
+    if (file == NULL) {
+        guac_client_log(fs->client, GUAC_LOG_DEBUG,
+                "%s: Stat within bad file_id: %i", __func__, file_id);
+        return GUAC_RDP_FS_EINVAL;
+    }
+
+    /* The parent of the root directory is the root directory itself, as
+     * with guac_rdp_fs_normalize_path() */
+    if (strcmp(name, "..") == 0 && strcmp(file->absolute_path, "\\") == 0)
+        name = ".";
+
+    /* Stat relative to the open directory, following symbolic links as
+     * guac_rdp_fs_open() would. The directory stream, if any, wraps the same
+     * file descriptor. */
+    if (fstatat(file->fd, name, &file_stat, 0)) {
+        int error = errno;
+        __guac_rdp_fs_unref_file(fs, file);
+        return guac_rdp_fs_get_errorcode(error);
+    }
+
+    __guac_rdp_fs_unref_file(fs, file);
+
+    /* Load size and times */
+    info->size  = file_stat.st_size;
+    info->ctime = WINDOWS_TIME(file_stat.st_ctime);
+    info->mtime = WINDOWS_TIME(file_stat.st_mtime);
+    info->atime = WINDOWS_TIME(file_stat.st_atime);
+
+    /* Set type */
+    if (S_ISDIR(file_stat.st_mode))
+        info->attributes = FILE_ATTRIBUTE_DIRECTORY;
+    else
+        info->attributes = FILE_ATTRIBUTE_NORMAL;
+
+    return 0;
 
 }
 
@@ -37,6 +37,7 @@
 #include <guacamole/user.h>
 
 #include <dirent.h>
+#include <pthread.h>
 #include <stdint.h>
 
 /**
@@ -54,6 +55,12 @@
  */
 #define GUAC_RDP_MAX_PATH_DEPTH 64
 
+/**
+ * The number of bytes following a sequential read which the local
+ * filesystem is advised to read ahead of time.
+ */
+#define GUAC_RDP_FS_READ_AHEAD_SIZE 1048576
+
 /**
  * Error code returned when no more file IDs can be allocated.
  */
@@ -114,6 +121,39 @@
  */
 #define WINDOWS_TIME(t) ((t + ((uint64_t) 11644473600)) * 10000000)
 
+/**
+ * Information describing a file on the virtual filesystem of the Guacamole
+ * drive which need not be open.
+ */
+typedef struct guac_rdp_fs_entry_info {
+
+    /**
+     * Bitwise OR of all associated Windows file attributes.
+     */
+    int attributes;
+
+    /**
+     * The size of the file, in bytes.
+     */
+    uint64_t size;
+
+    /**
+     * The time the file was created, as a Windows timestamp.
+     */
+    uint64_t ctime;
+
+    /**
+     * The time the file was last modified, as a Windows timestamp.
+     */
+    uint64_t mtime;
+
+    /**
+     * The time the file was last accessed, as a Windows timestamp.
+     */
+    uint64_t atime;
+
+} guac_rdp_fs_entry_info;
+
 /**
  * An arbitrary file on the virtual filesystem of the Guacamole drive.
  */
@@ -180,6 +220,32 @@ typedef struct guac_rdp_fs_file {
      */
     uint64_t bytes_written;
 
+    /**
+     * The offset immediately following the data returned by the most recent
+     * read, used to detect sequential reads.
+     */
+    uint64_t next_read_offset;
+
+    /**
+     * The offset immediately following the last region which the local
+     * filesystem was advised to read ahead of time.
+     */
+    uint64_t read_ahead_offset;
+
+    /**
+     * The number of operations currently using this file, each of which
+     * holds a reference acquired and released while the lock of the
+     * filesystem is held. The file is not actually closed, nor its ID
+     * released for reuse, until no references remain.
+     */
+    int refs;
+
+    /**
+     * Non-zero if guac_rdp_fs_close() has been invoked for this file, in
+     * which case no new references may be acquired, zero otherwise.
+     */
+    int closing;
+
 } guac_rdp_fs_file;
 
 /**
@@ -222,6 +288,19 @@ typedef struct guac_rdp_fs {
      */
     int disable_upload;
 
+    /**
+     * Lock which is held while files are opened or closed, while references
+     * to open files are acquired or released, and while the bookkeeping of
+     * an open file is updated. Files are accessed from several threads at
+     * once, including the RDPDR channel, the input threads of users, and the
+     * threads writing uploaded data in the background. Each operation on an
+     * open file holds a reference to that file (see the refs member of
+     * guac_rdp_fs_file) rather than this lock while performing I/O, such that
+     * no file is closed (and its ID reused) while another thread is still
+     * using it, yet I/O to different files is not serialized.
+     */
+    pthread_mutex_t lock;
+
 } guac_rdp_fs;
 
 /**
@@ -600,9 +679,40 @@ int guac_rdp_fs_convert_path(const char* parent, const char* rel_path,
  * @return
  *     The name of the next filename within the directory, or NULL if the last
  *     file in the directory has already been returned by a previous call.
+ *     As with readdir(), the returned name remains valid only until the next
+ *     call for the same file ID, or until that file is closed.
  */
 const char* guac_rdp_fs_read_dir(guac_rdp_fs* fs, int file_id);
 
+/**
+ * Retrieves information describing an entry within the directory having the
+ * given file ID, such as an entry just returned by guac_rdp_fs_read_dir(),
+ * without opening that entry. The entry is located relative to the already
+ * open directory, rather than by translating its full path, making this far
+ * cheaper than opening each entry of a large directory.
+ *
+ * @param fs
+ *     The filesystem containing the directory.
+ *
+ * @param file_id
+ *     The ID of the directory containing the entry, as returned by
+ *     guac_rdp_fs_open().
+ *
+ * @param name
+ *     The name of the entry within the directory.
+ *
+ * @param info
+ *     The guac_rdp_fs_entry_info structure to populate with information
+ *     describing the entry.
+ *
+ * @return
+ *     Zero on success, or an error code if an error occurs. All error codes
+ *     are negative values and correspond to GUAC_RDP_FS constants, such as
+ *     GUAC_RDP_FS_ENOENT.
+ */
+int guac_rdp_fs_stat_dir_entry(guac_rdp_fs* fs, int file_id,
+        const char* name, guac_rdp_fs_entry_info* info);
+
 /**
  * Returns the file having the given ID, or NULL if no such file exists.
  *
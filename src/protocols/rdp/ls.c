@@ -34,25 +34,38 @@
 int guac_rdp_ls_ack_handler(guac_user* user, guac_stream* stream,
         char* message, guac_protocol_status status) {
 
-    int blob_written = 0;
     const char* filename;
 
     guac_rdp_ls_status* ls_status = (guac_rdp_ls_status*) stream->data;
 
     /* If unsuccessful, free stream and abort */
     if (status != GUAC_PROTOCOL_STATUS_SUCCESS) {
-        guac_rdp_fs_close(ls_status->fs, ls_status->file_id);
+        if (!ls_status->complete)
+            guac_rdp_fs_close(ls_status->fs, ls_status->file_id);
         guac_user_free_stream(user, stream);
         free(ls_status);
         return 0;
     }
 
-    /* While directory entries remain */
-    while ((filename = guac_rdp_fs_read_dir(ls_status->fs,
-                    ls_status->file_id)) != NULL
-            && !blob_written) {
+    /* Each ack after the first acknowledges one blob */
+    guac_common_json_ack(&ls_status->json_state);
+
+    /* Write entries until the window of blobs in flight is full */
+    while (!ls_status->complete
+            && !guac_common_json_window_full(&ls_status->json_state)) {
 
         char absolute_path[GUAC_RDP_FS_MAX_PATH];
+        guac_rdp_fs_entry_info info;
+
+        /* Complete JSON and close directory once no entries remain */
+        filename = guac_rdp_fs_read_dir(ls_status->fs, ls_status->file_id);
+        if (filename == NULL) {
+            guac_common_json_end_object(user, stream, &ls_status->json_state);
+            guac_common_json_flush(user, stream, &ls_status->json_state);
+            guac_rdp_fs_close(ls_status->fs, ls_status->file_id);
+            ls_status->complete = 1;
+            break;
+        }
 
         /* Skip current and parent directory entries */
         if (strcmp(filename, ".") == 0 || strcmp(filename, "..") == 0)
@@ -69,50 +82,30 @@ int guac_rdp_ls_ack_handler(guac_user* user, guac_stream* stream,
             continue;
         }
 
-        /* Attempt to open file to determine type */
-        int file_id = guac_rdp_fs_open(ls_status->fs, absolute_path,
-                GENERIC_READ, 0, FILE_OPEN, 0);
-        if (file_id < 0)
+        /* Determine type of entry without opening it */
+        if (guac_rdp_fs_stat_dir_entry(ls_status->fs, ls_status->file_id,
+                    filename, &info))
             continue;
 
-        /* Get opened file */
-        guac_rdp_fs_file* file = guac_rdp_fs_get_file(ls_status->fs, file_id);
-        if (file == NULL) {
-            guac_user_log(user, GUAC_LOG_DEBUG, "%s: Successful open produced "
-                    "bad file_id: %i", __func__, file_id);
-            return 0;
-        }
-
         /* Determine mimetype */
         const char* mimetype;
-        if (file->attributes & FILE_ATTRIBUTE_DIRECTORY)
+        if (info.attributes & FILE_ATTRIBUTE_DIRECTORY)
             mimetype = GUAC_USER_STREAM_INDEX_MIMETYPE;
         else
             mimetype = "application/octet-stream";
 
         /* Write entry */
-        blob_written |= guac_common_json_write_property(user, stream,
+        guac_common_json_write_property(user, stream,
                 &ls_status->json_state, absolute_path, mimetype);
 
-        guac_rdp_fs_close(ls_status->fs, file_id);
-
     }
 
-    /* Complete JSON and cleanup at end of directory */
-    if (filename == NULL) {
-
-        /* Complete JSON object */
-        guac_common_json_end_object(user, stream, &ls_status->json_state);
-        guac_common_json_flush(user, stream, &ls_status->json_state);
-
-        /* Clean up resources */
-        guac_rdp_fs_close(ls_status->fs, ls_status->file_id);
+    /* End stream only once all blobs have been acknowledged, such that no
+     * acks are received for a stream which has since been freed */
+    if (ls_status->complete && ls_status->json_state.blobs_in_flight == 0) {
         free(ls_status);
-
-        /* Signal of stream */
         guac_protocol_send_end(user->socket, stream);
         guac_user_free_stream(user, stream);
-
     }
 
     guac_socket_flush(user->socket);
@@ -54,6 +54,13 @@ typedef struct guac_rdp_ls_status {
      */
     guac_common_json_state json_state;
 
+    /**
+     * Non-zero if all directory entries have been written and the directory
+     * has been closed, such that the stream only remains open until all
+     * blobs sent have been acknowledged, zero otherwise.
+     */
+    int complete;
+
 } guac_rdp_ls_status;
 
 /**
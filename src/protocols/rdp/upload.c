@@ -17,6 +17,7 @@
  * under the License.
  */
 
+#include "common/write_queue.h"
 #include "fs.h"
 #include "rdp.h"
 #include "upload.h"
@@ -29,6 +30,7 @@
 #include <guacamole/user.h>
 #include <winpr/nt.h>
 
+#include <stdint.h>
 #include <stdlib.h>
 
 /**
@@ -69,6 +71,157 @@ static void __generate_upload_path(const char* filename, char* path) {
 
 }
 
+/**
+ * Write handler for the guac_common_write_queue of a file upload, writing to
+ * the uploaded file within the RDP filesystem. This handler is invoked only
+ * from the thread of the write queue.
+ *
+ * @param data
+ *     The guac_rdp_upload_status of the upload.
+ *
+ * @param offset
+ *     The offset within the file to write to, in bytes.
+ *
+ * @param buffer
+ *     The data to write.
+ *
+ * @param length
+ *     The number of bytes to write.
+ *
+ * @return
+ *     The number of bytes written, or a negative value on error.
+ */
+static int guac_rdp_upload_write(void* data, uint64_t offset,
+        const char* buffer, int length) {
+
+    guac_rdp_upload_status* upload_status = (guac_rdp_upload_status*) data;
+
+    return guac_rdp_fs_write(upload_status->fs, upload_status->file_id,
+            offset, (void*) buffer, length);
+
+}
+
+/**
+ * Callback for guac_client_for_user() which sends the deferred
+ * acknowledgement of a blob of a file upload to the uploading user, if that
+ * user is still connected.
+ *
+ * @param user
+ *     The user uploading the file, or NULL if that user has left.
+ *
+ * @param data
+ *     The guac_rdp_upload_status of the upload.
+ *
+ * @return
+ *     Always NULL.
+ */
+static void* guac_rdp_upload_send_ack(guac_user* user, void* data) {
+
+    guac_rdp_upload_status* upload_status = (guac_rdp_upload_status*) data;
+
+    if (user == NULL)
+        return NULL;
+
+    if (upload_status->ack_error)
+        guac_protocol_send_ack(user->socket, upload_status->stream,
+                "FAIL (BAD WRITE)", GUAC_PROTOCOL_STATUS_CLIENT_FORBIDDEN);
+    else
+        guac_protocol_send_ack(user->socket, upload_status->stream,
+                "OK (DATA RECEIVED)", GUAC_PROTOCOL_STATUS_SUCCESS);
+
+    guac_socket_flush(user->socket);
+    return NULL;
+
+}
+
+/**
+ * Ack handler for the guac_common_write_queue of a file upload, sending the
+ * acknowledgement of a blob which was deferred because the queue was full.
+ * This handler is invoked only from the thread of the write queue.
+ *
+ * @param data
+ *     The guac_rdp_upload_status of the upload.
+ *
+ * @param error
+ *     Non-zero if a write has failed, zero otherwise.
+ */
+static void guac_rdp_upload_ack(void* data, int error) {
+
+    guac_rdp_upload_status* upload_status = (guac_rdp_upload_status*) data;
+
+    /* The user may have left while the ack was deferred */
+    upload_status->ack_error = error;
+    guac_client_for_user(upload_status->user->client, upload_status->user,
+            guac_rdp_upload_send_ack, upload_status);
+
+}
+
+/**
+ * Allocates the status of a new upload to the given open file, starting the
+ * background writes of its data.
+ *
+ * @param fs
+ *     The filesystem containing the file.
+ *
+ * @param file_id
+ *     The file ID of the open file being uploaded to.
+ *
+ * @param user
+ *     The user uploading the file.
+ *
+ * @param stream
+ *     The stream over which the file is being uploaded.
+ *
+ * @return
+ *     The status of a new upload, or NULL if allocation fails.
+ */
+static guac_rdp_upload_status* guac_rdp_upload_status_alloc(guac_rdp_fs* fs,
+        int file_id, guac_user* user, guac_stream* stream) {
+
+    guac_rdp_upload_status* upload_status =
+        malloc(sizeof(guac_rdp_upload_status));
+    if (upload_status == NULL)
+        return NULL;
+
+    upload_status->fs = fs;
+    upload_status->file_id = file_id;
+    upload_status->user = user;
+    upload_status->stream = stream;
+    upload_status->ack_error = 0;
+    upload_status->queue = guac_common_write_queue_alloc(
+            guac_rdp_upload_write, guac_rdp_upload_ack, upload_status);
+
+    if (upload_status->queue == NULL) {
+        free(upload_status);
+        return NULL;
+    }
+
+    return upload_status;
+
+}
+
+/**
+ * Frees the given upload status, waiting for all queued data to be written
+ * before closing the uploaded file.
+ *
+ * @param upload_status
+ *     The upload status to free.
+ *
+ * @return
+ *     Zero if all received data was written successfully, non-zero
+ *     otherwise.
+ */
+static int guac_rdp_upload_status_free(guac_rdp_upload_status* upload_status) {
+
+    int error = guac_common_write_queue_free(upload_status->queue);
+
+    guac_rdp_fs_close(upload_status->fs, upload_status->file_id);
+    free(upload_status);
+
+    return error;
+
+}
+
 int guac_rdp_upload_file_handler(guac_user* user, guac_stream* stream,
         char* mimetype, char* filename) {
 
@@ -113,9 +266,16 @@ int guac_rdp_upload_file_handler(guac_user* user, guac_stream* stream,
     }
 
     /* Init upload status */
-    guac_rdp_upload_status* upload_status = malloc(sizeof(guac_rdp_upload_status));
-    upload_status->offset = 0;
-    upload_status->file_id = file_id;
+    guac_rdp_upload_status* upload_status =
+        guac_rdp_upload_status_alloc(fs, file_id, user, stream);
+    if (upload_status == NULL) {
+        guac_rdp_fs_close(fs, file_id);
+        guac_protocol_send_ack(user->socket, stream, "FAIL (CANNOT OPEN)",
+                GUAC_PROTOCOL_STATUS_SERVER_ERROR);
+        guac_socket_flush(user->socket);
+        return 0;
+    }
+
     stream->data = upload_status;
     stream->blob_handler = guac_rdp_upload_blob_handler;
     stream->end_handler = guac_rdp_upload_end_handler;
@@ -130,7 +290,6 @@ int guac_rdp_upload_file_handler(guac_user* user, guac_stream* stream,
 int guac_rdp_upload_blob_handler(guac_user* user, guac_stream* stream,
         void* data, int length) {
 
-    int bytes_written;
     guac_rdp_upload_status* upload_status = (guac_rdp_upload_status*) stream->data;
 
     /* Get filesystem, return error if no filesystem */
@@ -144,29 +303,23 @@ int guac_rdp_upload_blob_handler(guac_user* user, guac_stream* stream,
         return 0;
     }
 
-    /* Write entire block */
-    while (length > 0) {
-
-        /* Attempt write */
-        bytes_written = guac_rdp_fs_write(fs, upload_status->file_id,
-                upload_status->offset, data, length);
-
-        /* On error, abort */
-        if (bytes_written < 0) {
-            guac_protocol_send_ack(user->socket, stream,
-                    "FAIL (BAD WRITE)",
-                    GUAC_PROTOCOL_STATUS_CLIENT_FORBIDDEN);
-            guac_socket_flush(user->socket);
-            return 0;
-        }
-
-        /* Update counters */
-        upload_status->offset += bytes_written;
-        data += bytes_written;
-        length -= bytes_written;
+    /* Queue entire block for writing, failing if any previously-queued data
+     * could not be written */
+    guac_common_write_queue_status status =
+        guac_common_write_queue_write(upload_status->queue, data, length);
 
+    if (status == GUAC_COMMON_WRITE_QUEUE_FAILED) {
+        guac_protocol_send_ack(user->socket, stream, "FAIL (BAD WRITE)",
+                GUAC_PROTOCOL_STATUS_CLIENT_FORBIDDEN);
+        guac_socket_flush(user->socket);
+        return 0;
     }
 
+    /* If the queue is full, the ack is sent by the queue once it has room,
+     * such that the user stops sending without this thread waiting */
+    if (status == GUAC_COMMON_WRITE_QUEUE_DEFERRED)
+        return 0;
+
     guac_protocol_send_ack(user->socket, stream, "OK (DATA RECEIVED)",
             GUAC_PROTOCOL_STATUS_SUCCESS);
     guac_socket_flush(user->socket);
@@ -189,15 +342,18 @@ int guac_rdp_upload_end_handler(guac_user* user, guac_stream* stream) {
         return 0;
     }
 
-    /* Close file */
-    guac_rdp_fs_close(fs, upload_status->file_id);
+    /* Finish writing and close file, reporting any failed writes */
+    if (guac_rdp_upload_status_free(upload_status)) {
+        guac_protocol_send_ack(user->socket, stream, "FAIL (BAD WRITE)",
+                GUAC_PROTOCOL_STATUS_CLIENT_FORBIDDEN);
+        guac_socket_flush(user->socket);
+        return 0;
+    }
 
     /* Acknowledge stream end */
     guac_protocol_send_ack(user->socket, stream, "OK (STREAM END)",
             GUAC_PROTOCOL_STATUS_SUCCESS);
     guac_socket_flush(user->socket);
-
-    free(upload_status);
     return 0;
 
 }
@@ -242,9 +398,15 @@ int guac_rdp_upload_put_handler(guac_user* user, guac_object* object,
     }
 
     /* Init upload stream data */
-    guac_rdp_upload_status* upload_status = malloc(sizeof(guac_rdp_upload_status));
-    upload_status->offset = 0;
-    upload_status->file_id = file_id;
+    guac_rdp_upload_status* upload_status =
+        guac_rdp_upload_status_alloc(fs, file_id, user, stream);
+    if (upload_status == NULL) {
+        guac_rdp_fs_close(fs, file_id);
+        guac_protocol_send_ack(user->socket, stream, "FAIL (CANNOT OPEN)",
+                GUAC_PROTOCOL_STATUS_SERVER_ERROR);
+        guac_socket_flush(user->socket);
+        return 0;
+    }
 
     /* Allocate stream, init for file upload */
     stream->data = upload_status;
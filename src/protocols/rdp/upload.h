@@ -21,6 +21,8 @@
 #define GUAC_RDP_UPLOAD_H
 
 #include "common/json.h"
+#include "common/write_queue.h"
+#include "fs.h"
 
 #include <guacamole/protocol.h>
 #include <guacamole/stream.h>
@@ -34,16 +36,39 @@
 typedef struct guac_rdp_upload_status {
 
     /**
-     * The overall offset within the file that the next write should
-     * occur at.
+     * The filesystem containing the file being written to.
      */
-    uint64_t offset;
+    guac_rdp_fs* fs;
 
     /**
      * The ID of the file being written to.
      */
     int file_id;
 
+    /**
+     * The user uploading the file.
+     */
+    guac_user* user;
+
+    /**
+     * The stream over which the file is being uploaded.
+     */
+    guac_stream* stream;
+
+    /**
+     * Whether the deferred ack currently being sent reports a failed write.
+     * This is only accessed by the thread of the write queue.
+     */
+    int ack_error;
+
+    /**
+     * The queue of received data not yet written to the file. Data is
+     * written to the file in the background, such that each blob can be
+     * acknowledged as soon as it has been queued, or, if the queue is full,
+     * as soon as it has room.
+     */
+    guac_common_write_queue* queue;
+
 } guac_rdp_upload_status;
 
 /**
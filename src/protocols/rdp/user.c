@@ -177,3 +177,18 @@ int guac_rdp_user_leave_handler(guac_user* user) {
     return 0;
 }
 
+int guac_rdp_user_resync_handler(guac_user* user) {
+
+    guac_rdp_client* rdp_client = (guac_rdp_client*) user->client->data;
+
+    /* Nothing to resynchronize if not yet connected */
+    if (rdp_client->display == NULL)
+        return 0;
+
+    /* Synchronize with current display */
+    guac_common_display_dup(rdp_client->display, user, user->socket);
+    guac_socket_flush(user->socket);
+
+    return 0;
+
+}
@@ -421,6 +421,9 @@ void* ssh_client_thread(void* data) {
         /* Timeout for polling socket activity */
         int timeout;
 
+        /* Slow reads while the client cannot keep up with flooding output */
+        guac_terminal_wait_for_client(ssh_client->term);
+
         pthread_mutex_lock(&(ssh_client->term_channel_lock));
 
         /* Stop reading at EOF */
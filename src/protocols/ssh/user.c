@@ -125,3 +125,18 @@ int guac_ssh_user_leave_handler(guac_user* user) {
     return 0;
 }
 
+int guac_ssh_user_resync_handler(guac_user* user) {
+
+    guac_ssh_client* ssh_client = (guac_ssh_client*) user->client->data;
+
+    /* Nothing to resynchronize if not yet connected */
+    if (ssh_client->term == NULL)
+        return 0;
+
+    /* Synchronize with current display */
+    guac_terminal_dup(ssh_client->term, user, user->socket);
+    guac_socket_flush(user->socket);
+
+    return 0;
+
+}
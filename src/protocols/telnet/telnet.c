@@ -640,6 +640,9 @@ void* guac_telnet_client_thread(void* data) {
         if (wait_result == 0)
             continue;
 
+        /* Slow reads while the client cannot keep up with flooding output */
+        guac_terminal_wait_for_client(telnet_client->term);
+
         int bytes_read = read(telnet_client->socket_fd, buffer, sizeof(buffer));
         if (bytes_read <= 0)
             break;
@@ -21,6 +21,7 @@
 
 #include "common/recording.h"
 #include "client.h"
+#include "convert.h"
 #include "user.h"
 #include "vnc.h"
 
@@ -35,6 +36,7 @@
 #endif
 
 #include <guacamole/client.h>
+#include <guacamole/error.h>
 
 #include <pthread.h>
 #include <stdlib.h>
@@ -60,8 +62,18 @@ int guac_client_init(guac_client* client) {
     /* Set handlers */
     client->join_handler = guac_vnc_user_join_handler;
     client->leave_handler = guac_vnc_user_leave_handler;
+    client->resync_handler = guac_vnc_user_resync_handler;
     client->free_handler = guac_vnc_client_free_handler;
 
+    /* Init pixel format conversion (anything allocated above is cleaned up
+     * by the free handler if this fails) */
+    vnc_client->converter = guac_vnc_converter_alloc();
+    if (vnc_client->converter == NULL) {
+        guac_error = GUAC_STATUS_NO_MEMORY;
+        guac_error_message = "Unable to allocate pixel format converter";
+        return 1;
+    }
+
     return 0;
 }
 
@@ -80,6 +92,10 @@ int guac_vnc_client_free_handler(guac_client* client) {
         /* Free memory that may not be free'd by libvncclient's
          * rfbClientCleanup() prior to libvncclient 0.9.12 */
 
+        /* An aliased framebuffer is freed along with the display */
+        if (vnc_client->framebuffer_aliased)
+            rfb_client->frameBuffer = NULL;
+
         if (rfb_client->frameBuffer != NULL) {
             free(rfb_client->frameBuffer);
             rfb_client->frameBuffer = NULL;
@@ -136,6 +152,10 @@ int guac_vnc_client_free_handler(guac_client* client) {
     if (vnc_client->display != NULL)
         guac_common_display_free(vnc_client->display);
 
+    /* Free pixel format conversion buffers */
+    if (vnc_client->converter != NULL)
+        guac_vnc_converter_free(vnc_client->converter);
+
 #ifdef ENABLE_PULSE
     /* If audio enabled, stop streaming */
     if (vnc_client->audio)
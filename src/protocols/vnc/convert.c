@@ -0,0 +1,474 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "config.h"
+
+#include "convert.h"
+
+#include <rfb/rfbclient.h>
+#include <rfb/rfbproto.h>
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+/**
+ * Translates a single pixel value to a CAIRO_FORMAT_RGB24 pixel exactly as
+ * described by the given pixel format, dividing each component by its
+ * maximum value. This is the slowest possible conversion, and is used only
+ * for pixel formats which are not handled by a specialized routine.
+ *
+ * @param format
+ *     The pixel format of the given value.
+ *
+ * @param swap_red_blue
+ *     Non-zero if the red and blue components should be swapped, zero
+ *     otherwise.
+ *
+ * @param v
+ *     The pixel value to translate.
+ *
+ * @return
+ *     The corresponding CAIRO_FORMAT_RGB24 pixel.
+ */
+static uint32_t guac_vnc_convert_pixel(const rfbPixelFormat* format,
+        int swap_red_blue, unsigned int v) {
+
+    unsigned char red   = (v >> format->redShift)   * 0x100 / (format->redMax   + 1);
+    unsigned char green = (v >> format->greenShift) * 0x100 / (format->greenMax + 1);
+    unsigned char blue  = (v >> format->blueShift)  * 0x100 / (format->blueMax  + 1);
+
+    if (swap_red_blue)
+        return (blue << 16) | (green << 8) | red;
+
+    return (red << 16) | (green << 8) | blue;
+
+}
+
+/**
+ * Converts a row of pixels of any pixel format using
+ * guac_vnc_convert_pixel(). See guac_vnc_convert_row.
+ */
+static void guac_vnc_convert_row_generic(const guac_vnc_converter* converter,
+        uint32_t* dst, const unsigned char* src, int width) {
+
+    int bpp = converter->format.bitsPerPixel / 8;
+
+    while (width-- > 0) {
+
+        unsigned int v;
+
+        switch (bpp) {
+            case 4:
+                v = *((uint32_t*) src);
+                break;
+
+            case 2:
+                v = *((uint16_t*) src);
+                break;
+
+            default:
+                v = *((uint8_t*) src);
+        }
+
+        *(dst++) = guac_vnc_convert_pixel(&converter->format,
+                converter->swap_red_blue, v);
+
+        src += bpp;
+
+    }
+
+}
+
+/**
+ * Converts a row of 8bpp pixels using the converter's lookup table. See
+ * guac_vnc_convert_row.
+ */
+static void guac_vnc_convert_row_lookup8(const guac_vnc_converter* converter,
+        uint32_t* dst, const unsigned char* src, int width) {
+
+    while (width-- > 0)
+        *(dst++) = converter->lookup[*(src++)];
+
+}
+
+/**
+ * Converts a single pixel value using the shifts and masks of the given
+ * converter.
+ *
+ * @param converter
+ *     The converter whose shifts and masks should be used.
+ *
+ * @param v
+ *     The pixel value to convert.
+ *
+ * @return
+ *     The corresponding CAIRO_FORMAT_RGB24 pixel.
+ */
+static uint32_t guac_vnc_convert_shift(const guac_vnc_converter* converter,
+        uint32_t v) {
+    return (((v << converter->left_shift[0]) >> converter->right_shift[0]) & converter->mask[0])
+         | (((v << converter->left_shift[1]) >> converter->right_shift[1]) & converter->mask[1])
+         | (((v << converter->left_shift[2]) >> converter->right_shift[2]) & converter->mask[2]);
+}
+
+#ifdef __SSE2__
+/**
+ * The shifts and masks of a guac_vnc_converter, loaded into SSE2 registers
+ * such that four pixels can be converted at once.
+ */
+typedef struct guac_vnc_convert_shift_sse2_params {
+
+    /**
+     * The left shift of each component, as required by _mm_sll_epi32().
+     */
+    __m128i left_shift[3];
+
+    /**
+     * The right shift of each component, as required by _mm_srl_epi32().
+     */
+    __m128i right_shift[3];
+
+    /**
+     * The mask of each component, repeated for each of four pixels.
+     */
+    __m128i mask[3];
+
+} guac_vnc_convert_shift_sse2_params;
+
+/**
+ * Loads the shifts and masks of the given converter into the given
+ * guac_vnc_convert_shift_sse2_params.
+ *
+ * @param converter
+ *     The converter whose shifts and masks should be loaded.
+ *
+ * @param params
+ *     The guac_vnc_convert_shift_sse2_params to populate.
+ */
+static void guac_vnc_convert_shift_sse2_init(
+        const guac_vnc_converter* converter,
+        guac_vnc_convert_shift_sse2_params* params) {
+
+    int i;
+    for (i = 0; i < 3; i++) {
+        params->left_shift[i]  = _mm_cvtsi32_si128(converter->left_shift[i]);
+        params->right_shift[i] = _mm_cvtsi32_si128(converter->right_shift[i]);
+        params->mask[i]        = _mm_set1_epi32(converter->mask[i]);
+    }
+
+}
+
+/**
+ * Converts four pixel values at once using the given shifts and masks.
+ *
+ * @param params
+ *     The shifts and masks to use, as loaded by
+ *     guac_vnc_convert_shift_sse2_init().
+ *
+ * @param v
+ *     The four 32-bit pixel values to convert.
+ *
+ * @return
+ *     The corresponding four CAIRO_FORMAT_RGB24 pixels.
+ */
+static __m128i guac_vnc_convert_shift_sse2(
+        const guac_vnc_convert_shift_sse2_params* params, __m128i v) {
+
+    __m128i result = _mm_setzero_si128();
+    int i;
+
+    for (i = 0; i < 3; i++) {
+        __m128i component = _mm_srl_epi32(
+                _mm_sll_epi32(v, params->left_shift[i]),
+                params->right_shift[i]);
+        result = _mm_or_si128(result,
+                _mm_and_si128(component, params->mask[i]));
+    }
+
+    return result;
+
+}
+#endif
+
+/**
+ * Converts a row of 16bpp pixels using the converter's shifts and masks. See
+ * guac_vnc_convert_row.
+ */
+static void guac_vnc_convert_row_shift16(const guac_vnc_converter* converter,
+        uint32_t* dst, const unsigned char* src, int width) {
+
+#ifdef __SSE2__
+    /* Convert eight pixels at a time */
+    guac_vnc_convert_shift_sse2_params params;
+    guac_vnc_convert_shift_sse2_init(converter, &params);
+
+    __m128i zero = _mm_setzero_si128();
+    for (; width >= 8; width -= 8) {
+
+        __m128i v = _mm_loadu_si128((const __m128i*) src);
+
+        _mm_storeu_si128((__m128i*) dst, guac_vnc_convert_shift_sse2(
+                    &params, _mm_unpacklo_epi16(v, zero)));
+        _mm_storeu_si128((__m128i*) (dst + 4), guac_vnc_convert_shift_sse2(
+                    &params, _mm_unpackhi_epi16(v, zero)));
+
+        src += 16;
+        dst += 8;
+
+    }
+#endif
+
+    while (width-- > 0) {
+        *(dst++) = guac_vnc_convert_shift(converter, *((uint16_t*) src));
+        src += 2;
+    }
+
+}
+
+/**
+ * Converts a row of 32bpp pixels using the converter's shifts and masks. See
+ * guac_vnc_convert_row.
+ */
+static void guac_vnc_convert_row_shift32(const guac_vnc_converter* converter,
+        uint32_t* dst, const unsigned char* src, int width) {
+
+#ifdef __SSE2__
+    /* Convert four pixels at a time */
+    guac_vnc_convert_shift_sse2_params params;
+    guac_vnc_convert_shift_sse2_init(converter, &params);
+
+    for (; width >= 4; width -= 4) {
+        _mm_storeu_si128((__m128i*) dst, guac_vnc_convert_shift_sse2(
+                    &params, _mm_loadu_si128((const __m128i*) src)));
+        src += 16;
+        dst += 4;
+    }
+#endif
+
+    while (width-- > 0) {
+        *(dst++) = guac_vnc_convert_shift(converter, *((uint32_t*) src));
+        src += 4;
+    }
+
+}
+
+/**
+ * Converts a row of 32bpp pixels which are already in CAIRO_FORMAT_RGB24,
+ * clearing only the unused upper byte of each pixel. See
+ * guac_vnc_convert_row.
+ */
+static void guac_vnc_convert_row_identity32(const guac_vnc_converter* converter,
+        uint32_t* dst, const unsigned char* src, int width) {
+
+#ifdef __SSE2__
+    /* Copy four pixels at a time */
+    __m128i mask = _mm_set1_epi32(0x00FFFFFF);
+    for (; width >= 4; width -= 4) {
+        _mm_storeu_si128((__m128i*) dst, _mm_and_si128(mask,
+                    _mm_loadu_si128((const __m128i*) src)));
+        src += 16;
+        dst += 4;
+    }
+#endif
+
+    while (width-- > 0) {
+        *(dst++) = *((uint32_t*) src) & 0x00FFFFFF;
+        src += 4;
+    }
+
+}
+
+/**
+ * Calculates the shift and mask which move a single component of a pixel
+ * value into its position within a CAIRO_FORMAT_RGB24 pixel, producing
+ * exactly the same result as guac_vnc_convert_pixel(). This is only possible
+ * if the maximum value of the component is one less than a power of two.
+ *
+ * @param converter
+ *     The converter to store the calculated shift and mask within.
+ *
+ * @param index
+ *     The index of the component within the shift and mask arrays of the
+ *     converter (0 for red, 1 for green, and 2 for blue).
+ *
+ * @param shift
+ *     The number of bits the component must be shifted right to be the
+ *     least-significant bits of the pixel value.
+ *
+ * @param max
+ *     The maximum value of the component.
+ *
+ * @param position
+ *     The position of the least-significant bit of the 8-bit component
+ *     within the CAIRO_FORMAT_RGB24 pixel.
+ *
+ * @return
+ *     Zero if the shift and mask were calculated successfully, non-zero if
+ *     the component cannot be converted using a shift and mask alone.
+ */
+static int guac_vnc_converter_init_shift(guac_vnc_converter* converter,
+        int index, int shift, unsigned int max, int position) {
+
+    int bits = 0;
+
+    /* Only components whose maximum is one less than a power of two can be
+     * scaled with a shift */
+    if ((max & (max + 1)) != 0)
+        return 1;
+
+    while (max >> bits)
+        bits++;
+
+    /* Only the most-significant 8 bits of larger components are used */
+    if (bits > 8) {
+        shift += bits - 8;
+        bits = 8;
+    }
+
+    if (shift >= 32)
+        return 1;
+
+    int net_shift = position + 8 - bits - shift;
+    converter->left_shift[index]  = net_shift > 0 ?  net_shift : 0;
+    converter->right_shift[index] = net_shift < 0 ? -net_shift : 0;
+    converter->mask[index] = ((1u << bits) - 1) << (position + 8 - bits);
+
+    return 0;
+
+}
+
+/**
+ * Selects the fastest conversion routine which produces correct results for
+ * the given pixel format, storing that format and any data required by the
+ * routine within the given converter.
+ *
+ * @param converter
+ *     The converter to update.
+ *
+ * @param format
+ *     The pixel format that the routine must convert from.
+ *
+ * @param swap_red_blue
+ *     Non-zero if the red and blue components of each pixel should be
+ *     swapped, zero otherwise.
+ */
+static void guac_vnc_converter_select(guac_vnc_converter* converter,
+        const rfbPixelFormat* format, int swap_red_blue) {
+
+    int red_position  = swap_red_blue ? 0 : 16;
+    int blue_position = swap_red_blue ? 16 : 0;
+    int i;
+
+    converter->format = *format;
+    converter->swap_red_blue = swap_red_blue;
+
+    /* Every possible 8bpp pixel can be translated in advance */
+    if (format->bitsPerPixel == 8) {
+        for (i = 0; i < 256; i++)
+            converter->lookup[i] = guac_vnc_convert_pixel(format,
+                    swap_red_blue, i);
+        converter->convert_row = guac_vnc_convert_row_lookup8;
+        return;
+    }
+
+    /* Fall back to exact translation of each pixel for pixel formats which
+     * cannot be converted using shifts and masks */
+    if ((format->bitsPerPixel != 16 && format->bitsPerPixel != 32)
+            || guac_vnc_converter_init_shift(converter, 0, format->redShift,
+                format->redMax, red_position)
+            || guac_vnc_converter_init_shift(converter, 1, format->greenShift,
+                format->greenMax, 8)
+            || guac_vnc_converter_init_shift(converter, 2, format->blueShift,
+                format->blueMax, blue_position)) {
+        converter->convert_row = guac_vnc_convert_row_generic;
+        return;
+    }
+
+    if (format->bitsPerPixel == 16)
+        converter->convert_row = guac_vnc_convert_row_shift16;
+
+    /* 32bpp pixels already matching Cairo need only be copied */
+    else if (converter->mask[0] == 0xFF0000 && converter->mask[1] == 0xFF00
+            && converter->mask[2] == 0xFF
+            && converter->left_shift[0] == 0 && converter->right_shift[0] == 0
+            && converter->left_shift[1] == 0 && converter->right_shift[1] == 0
+            && converter->left_shift[2] == 0 && converter->right_shift[2] == 0)
+        converter->convert_row = guac_vnc_convert_row_identity32;
+
+    else
+        converter->convert_row = guac_vnc_convert_row_shift32;
+
+}
+
+guac_vnc_converter* guac_vnc_converter_alloc() {
+    return calloc(1, sizeof(guac_vnc_converter));
+}
+
+void guac_vnc_converter_free(guac_vnc_converter* converter) {
+    free(converter->buffer);
+    free(converter);
+}
+
+unsigned char* guac_vnc_convert(guac_vnc_converter* converter,
+        const rfbPixelFormat* format, int swap_red_blue,
+        const unsigned char* data, int data_stride,
+        int width, int height, int stride) {
+
+    int y;
+
+    /* Select new conversion routine only if pixel format has changed */
+    if (converter->convert_row == NULL
+            || converter->swap_red_blue != swap_red_blue
+            || converter->format.bitsPerPixel != format->bitsPerPixel
+            || converter->format.redMax       != format->redMax
+            || converter->format.greenMax     != format->greenMax
+            || converter->format.blueMax      != format->blueMax
+            || converter->format.redShift     != format->redShift
+            || converter->format.greenShift   != format->greenShift
+            || converter->format.blueShift    != format->blueShift)
+        guac_vnc_converter_select(converter, format, swap_red_blue);
+
+    /* Grow scratch buffer as necessary */
+    size_t size = (size_t) height * stride;
+    if (size > converter->buffer_size) {
+
+        unsigned char* buffer = realloc(converter->buffer, size);
+        if (buffer == NULL)
+            return NULL;
+
+        converter->buffer = buffer;
+        converter->buffer_size = size;
+
+    }
+
+    /* Convert each row */
+    for (y = 0; y < height; y++)
+        converter->convert_row(converter,
+                (uint32_t*) (converter->buffer + y * stride),
+                data + y * data_stride, width);
+
+    return converter->buffer;
+
+}
+
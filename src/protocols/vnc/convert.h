@@ -0,0 +1,182 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef GUAC_VNC_CONVERT_H
+#define GUAC_VNC_CONVERT_H
+
+#include "config.h"
+
+#include <rfb/rfbclient.h>
+#include <rfb/rfbproto.h>
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct guac_vnc_converter guac_vnc_converter;
+
+/**
+ * Converts a single row of pixels from the VNC server's pixel format to
+ * Cairo's CAIRO_FORMAT_RGB24.
+ *
+ * @param converter
+ *     The converter describing the VNC server's pixel format.
+ *
+ * @param dst
+ *     The row of CAIRO_FORMAT_RGB24 pixels to write converted pixels to.
+ *
+ * @param src
+ *     The row of pixels to convert, in the VNC server's pixel format.
+ *
+ * @param width
+ *     The number of pixels in the row.
+ */
+typedef void guac_vnc_convert_row(const guac_vnc_converter* converter,
+        uint32_t* dst, const unsigned char* src, int width);
+
+/**
+ * Converts framebuffer data from the pixel format of a VNC server to Cairo's
+ * CAIRO_FORMAT_RGB24 using a conversion routine specialized for that pixel
+ * format, writing the result to a scratch buffer which is reused across
+ * conversions.
+ */
+struct guac_vnc_converter {
+
+    /**
+     * The pixel format that the current conversion routine was selected for.
+     */
+    rfbPixelFormat format;
+
+    /**
+     * Whether the red and blue components of each pixel are swapped by the
+     * current conversion routine.
+     */
+    int swap_red_blue;
+
+    /**
+     * The routine which converts each row of pixels, or NULL if no routine
+     * has yet been selected.
+     */
+    guac_vnc_convert_row* convert_row;
+
+    /**
+     * The number of bits that each pixel value must be shifted left to move
+     * the red, green, and blue components, respectively, into their
+     * positions within a CAIRO_FORMAT_RGB24 pixel, for conversion routines
+     * which convert pixels using only shifts and masks.
+     */
+    int left_shift[3];
+
+    /**
+     * The number of bits that each pixel value must be shifted right to move
+     * the red, green, and blue components, respectively, into their
+     * positions within a CAIRO_FORMAT_RGB24 pixel, for conversion routines
+     * which convert pixels using only shifts and masks. For each component,
+     * at most one of left_shift and right_shift is non-zero.
+     */
+    int right_shift[3];
+
+    /**
+     * The masks which isolate the red, green, and blue components,
+     * respectively, of each shifted pixel value, for conversion routines
+     * which convert pixels using only shifts and masks.
+     */
+    uint32_t mask[3];
+
+    /**
+     * The CAIRO_FORMAT_RGB24 value of every possible 8-bit pixel, for the
+     * conversion routine used by 8bpp pixel formats.
+     */
+    uint32_t lookup[256];
+
+    /**
+     * Scratch buffer receiving converted pixels, or NULL if no buffer has yet
+     * been allocated.
+     */
+    unsigned char* buffer;
+
+    /**
+     * The size of the scratch buffer, in bytes.
+     */
+    size_t buffer_size;
+
+};
+
+/**
+ * Allocates a new guac_vnc_converter. A conversion routine will be selected
+ * automatically upon the first call to guac_vnc_convert().
+ *
+ * @return
+ *     A newly-allocated guac_vnc_converter, or NULL if allocation fails.
+ */
+guac_vnc_converter* guac_vnc_converter_alloc();
+
+/**
+ * Frees the given guac_vnc_converter, including its scratch buffer.
+ *
+ * @param converter
+ *     The converter to free.
+ */
+void guac_vnc_converter_free(guac_vnc_converter* converter);
+
+/**
+ * Converts the given rectangle of VNC framebuffer data to Cairo's
+ * CAIRO_FORMAT_RGB24, selecting a new conversion routine if the pixel format
+ * has changed since the previous conversion. The returned buffer is owned by
+ * the converter and remains valid only until the next call to
+ * guac_vnc_convert() or guac_vnc_converter_free().
+ *
+ * @param converter
+ *     The converter to use.
+ *
+ * @param format
+ *     The pixel format of the VNC framebuffer data.
+ *
+ * @param swap_red_blue
+ *     Non-zero if the red and blue components of each pixel should be
+ *     swapped, zero otherwise.
+ *
+ * @param data
+ *     The first pixel of the rectangle to convert, in the given pixel format.
+ *
+ * @param data_stride
+ *     The number of bytes in each row of the framebuffer containing the
+ *     rectangle.
+ *
+ * @param width
+ *     The width of the rectangle, in pixels.
+ *
+ * @param height
+ *     The height of the rectangle, in pixels.
+ *
+ * @param stride
+ *     The number of bytes in each row of the returned buffer. This must be a
+ *     valid stride for CAIRO_FORMAT_RGB24 image data of the given width.
+ *
+ * @return
+ *     A buffer containing the converted rectangle as CAIRO_FORMAT_RGB24
+ *     image data with the given stride, or NULL if the scratch buffer could
+ *     not be allocated.
+ */
+unsigned char* guac_vnc_convert(guac_vnc_converter* converter,
+        const rfbPixelFormat* format, int swap_red_blue,
+        const unsigned char* data, int data_stride,
+        int width, int height, int stride);
+
+#endif
+
@@ -22,6 +22,7 @@
 #include "client.h"
 #include "common/iconv.h"
 #include "common/surface.h"
+#include "convert.h"
 #include "vnc.h"
 
 #include <cairo/cairo.h>
@@ -48,18 +49,14 @@ void guac_vnc_update(rfbClient* client, int x, int y, int w, int h) {
     guac_client* gc = rfbClientGetClientData(client, GUAC_VNC_CLIENT_KEY);
     guac_vnc_client* vnc_client = (guac_vnc_client*) gc->data;
 
-    int dx, dy;
-
     /* Cairo image buffer */
     int stride;
     unsigned char* buffer;
-    unsigned char* buffer_row_current;
     cairo_surface_t* surface;
 
     /* VNC framebuffer */
     unsigned int bpp;
     unsigned int fb_stride;
-    unsigned char* fb_row_current;
 
     /* Ignore extra update if already handled by copyrect */
     if (vnc_client->copy_rect_used) {
@@ -67,61 +64,29 @@ void guac_vnc_update(rfbClient* client, int x, int y, int w, int h) {
         return;
     }
 
-    /* Init Cairo buffer */
+    /* Image data has already been written directly to the default layer if
+     * the framebuffer is aliased */
+    if (vnc_client->framebuffer_aliased) {
+        guac_common_surface_invalidate(vnc_client->display->default_surface,
+                x, y, w, h);
+        return;
+    }
+
     stride = cairo_format_stride_for_width(CAIRO_FORMAT_RGB24, w);
-    buffer = malloc(h*stride);
-    buffer_row_current = buffer;
 
     bpp = client->format.bitsPerPixel/8;
     fb_stride = bpp * client->width;
-    fb_row_current = client->frameBuffer + (y * fb_stride) + (x * bpp);
-
-    /* Copy image data from VNC client to PNG */
-    for (dy = y; dy<y+h; dy++) {
-
-        unsigned int*  buffer_current;
-        unsigned char* fb_current;
-        
-        /* Get current buffer row, advance to next */
-        buffer_current      = (unsigned int*) buffer_row_current;
-        buffer_row_current += stride;
-
-        /* Get current framebuffer row, advance to next */
-        fb_current      = fb_row_current;
-        fb_row_current += fb_stride;
-
-        for (dx = x; dx<x+w; dx++) {
-
-            unsigned char red, green, blue;
-            unsigned int v;
-
-            switch (bpp) {
-                case 4:
-                    v = *((uint32_t*)  fb_current);
-                    break;
 
-                case 2:
-                    v = *((uint16_t*) fb_current);
-                    break;
-
-                default:
-                    v = *((uint8_t*)  fb_current);
-            }
-
-            /* Translate value to RGB */
-            red   = (v >> client->format.redShift)   * 0x100 / (client->format.redMax  + 1);
-            green = (v >> client->format.greenShift) * 0x100 / (client->format.greenMax+ 1);
-            blue  = (v >> client->format.blueShift)  * 0x100 / (client->format.blueMax + 1);
-
-            /* Output RGB */
-            if (vnc_client->settings->swap_red_blue)
-                *(buffer_current++) = (blue << 16) | (green << 8) | red;
-            else
-                *(buffer_current++) = (red  << 16) | (green << 8) | blue;
-
-            fb_current += bpp;
+    /* Convert image data from VNC client to Cairo's pixel format */
+    buffer = guac_vnc_convert(vnc_client->converter, &client->format,
+            vnc_client->settings->swap_red_blue,
+            client->frameBuffer + (y * fb_stride) + (x * bpp), fb_stride,
+            w, h, stride);
 
-        }
+    if (buffer == NULL) {
+        guac_client_log(gc, GUAC_LOG_WARNING, "Insufficient memory to "
+                "convert VNC framebuffer update.");
+        return;
     }
 
     /* Create surface from decoded buffer */
@@ -132,9 +97,8 @@ void guac_vnc_update(rfbClient* client, int x, int y, int w, int h) {
     guac_common_surface_draw(vnc_client->display->default_surface,
             x, y, surface);
 
-    /* Free surface */
+    /* Free surface (the buffer is reused by later updates) */
     cairo_surface_destroy(surface);
-    free(buffer);
 
 }
 
@@ -191,6 +155,60 @@ void guac_vnc_set_pixel_format(rfbClient* client, int color_depth) {
     }
 }
 
+/**
+ * Returns whether the host stores multi-byte integers in big-endian byte
+ * order.
+ *
+ * @return
+ *     Non-zero if the host is big-endian, zero if the host is little-endian.
+ */
+static int guac_vnc_host_is_big_endian() {
+
+    const uint16_t value = 1;
+    return *((const uint8_t*) &value) == 0;
+
+}
+
+int guac_vnc_alias_framebuffer(rfbClient* rfb_client) {
+
+    guac_client* gc = rfbClientGetClientData(rfb_client, GUAC_VNC_CLIENT_KEY);
+    guac_vnc_client* vnc_client = (guac_vnc_client*) gc->data;
+
+    /* Surface cannot be used before it exists */
+    if (vnc_client->display == NULL)
+        return 0;
+
+    guac_common_surface* surface = vnc_client->display->default_surface;
+
+    /* Pixels must be 32-bit RGB matching the surface exactly, in host byte
+     * order (the alpha channel is corrected by
+     * guac_common_surface_invalidate()) */
+    rfbPixelFormat* format = &rfb_client->format;
+    if (format->bitsPerPixel != 32
+            || !format->bigEndian != !guac_vnc_host_is_big_endian()
+            || format->redShift != 16 || format->redMax != 0xff
+            || format->greenShift != 8 || format->greenMax != 0xff
+            || format->blueShift != 0 || format->blueMax != 0xff
+            || vnc_client->settings->swap_red_blue)
+        return 0;
+
+    /* Rows of the framebuffer must be laid out identically */
+    if (surface->width != rfb_client->width
+            || surface->height != rfb_client->height
+            || surface->stride != rfb_client->width * 4)
+        return 0;
+
+    /* Free any framebuffer allocated by libvncclient */
+    if (!vnc_client->framebuffer_aliased)
+        free(rfb_client->frameBuffer);
+
+    rfb_client->frameBuffer = surface->buffer;
+    vnc_client->framebuffer_aliased = 1;
+
+    return 1;
+
+}
+
 rfbBool guac_vnc_malloc_framebuffer(rfbClient* rfb_client) {
 
     guac_client* gc = rfbClientGetClientData(rfb_client, GUAC_VNC_CLIENT_KEY);
@@ -201,6 +219,17 @@ rfbBool guac_vnc_malloc_framebuffer(rfbClient* rfb_client) {
         guac_common_surface_resize(vnc_client->display->default_surface,
                 rfb_client->width, rfb_client->height);
 
+    /* Decode directly into the surface if possible */
+    if (guac_vnc_alias_framebuffer(rfb_client))
+        return TRUE;
+
+    /* Any previous aliased framebuffer belongs to the surface and must not
+     * be freed by libvncclient */
+    if (vnc_client->framebuffer_aliased) {
+        rfb_client->frameBuffer = NULL;
+        vnc_client->framebuffer_aliased = 0;
+    }
+
     /* Use original, wrapped proc */
     return vnc_client->rfb_MallocFrameBuffer(rfb_client);
 }
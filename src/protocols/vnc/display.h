@@ -100,16 +100,39 @@ void guac_vnc_copyrect(rfbClient* client, int src_x, int src_y, int w, int h,
  */
 void guac_vnc_set_pixel_format(rfbClient* client, int color_depth);
 
+/**
+ * Replaces the framebuffer of the given VNC client with the buffer of the
+ * default surface of the display, such that libvncclient decodes updates
+ * directly into the surface and no pixels need be copied, if the pixel format
+ * of the VNC client is identical to that of the surface. The VNC client's
+ * previous framebuffer is freed. If the framebuffer is already that of the
+ * default surface, it is simply updated to point at the current buffer of the
+ * surface (which changes when the surface is resized).
+ *
+ * @param client
+ *     The VNC client whose framebuffer should be replaced.
+ *
+ * @return
+ *     Non-zero if the VNC client's framebuffer is now the buffer of the
+ *     default surface, zero if the pixel formats differ or the display has
+ *     not yet been allocated, in which case the VNC client's framebuffer is
+ *     left untouched.
+ */
+int guac_vnc_alias_framebuffer(rfbClient* client);
+
 /**
  * Overridden implementation of the rfb_MallocFrameBuffer function invoked by
  * libVNCServer when the display is being resized (or initially allocated).
+ * If possible, the framebuffer is replaced with the buffer of the default
+ * surface using guac_vnc_alias_framebuffer().
  *
  * @param client
  *     The VNC client associated with the VNC session whose display needs to be
  *     allocated or reallocated.
  *
  * @return
- *     The original value returned by rfb_MallocFrameBuffer().
+ *     The original value returned by rfb_MallocFrameBuffer(), or TRUE if the
+ *     framebuffer is now the buffer of the default surface.
  */
 rfbBool guac_vnc_malloc_framebuffer(rfbClient* rfb_client);
 
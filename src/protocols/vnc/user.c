@@ -134,3 +134,18 @@ int guac_vnc_user_leave_handler(guac_user* user) {
     return 0;
 }
 
+int guac_vnc_user_resync_handler(guac_user* user) {
+
+    guac_vnc_client* vnc_client = (guac_vnc_client*) user->client->data;
+
+    /* Nothing to resynchronize if not yet connected */
+    if (vnc_client->display == NULL)
+        return 0;
+
+    /* Synchronize with current display */
+    guac_common_display_dup(vnc_client->display, user, user->socket);
+    guac_socket_flush(user->socket);
+
+    return 0;
+
+}
@@ -439,6 +439,12 @@ void* guac_vnc_client_thread(void* data) {
      * heuristics) */
     guac_common_display_set_lossless(vnc_client->display, settings->lossless);
 
+    /* Decode updates directly into the display if possible (the framebuffer
+     * allocated during connection precedes the display) */
+    if (guac_vnc_alias_framebuffer(rfb_client))
+        guac_client_log(client, GUAC_LOG_DEBUG, "VNC framebuffer is shared "
+                "with display. Updates will not be copied.");
+
     /* If not read-only, set an appropriate cursor */
     if (settings->read_only == 0) {
         if (settings->remote_cursor)
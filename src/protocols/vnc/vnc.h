@@ -27,6 +27,7 @@
 #include "common/iconv.h"
 #include "common/recording.h"
 #include "common/surface.h"
+#include "convert.h"
 #include "settings.h"
 
 #include <guacamole/client.h>
@@ -79,6 +80,13 @@ typedef struct guac_vnc_client {
      */
     int copy_rect_used;
 
+    /**
+     * Whether the framebuffer of rfb_client is the buffer of the default
+     * surface of the display (see guac_vnc_alias_framebuffer()), in which
+     * case that framebuffer is owned by the surface and must not be freed.
+     */
+    int framebuffer_aliased;
+
     /**
      * Client settings, parsed from args.
      */
@@ -89,6 +97,12 @@ typedef struct guac_vnc_client {
      */
     guac_common_display* display;
 
+    /**
+     * Converter which translates framebuffer updates from the VNC server's
+     * pixel format to the format of the display.
+     */
+    guac_vnc_converter* converter;
+
     /**
      * Internal clipboard.
      */
@@ -0,0 +1,205 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "benchmark.h"
+#include "terminal/terminal.h"
+
+#include <guacamole/client.h>
+#include <guacamole/timestamp.h>
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+/**
+ * The approximate size of the output written to the terminal in each round,
+ * in bytes.
+ */
+#define BENCHMARK_OUTPUT_SIZE 1048576
+
+/**
+ * The number of times the generated output is written to the terminal.
+ */
+#define BENCHMARK_ROUNDS 16
+
+/**
+ * The number of rows of scrollback retained by the benchmarked terminal.
+ */
+#define BENCHMARK_SCROLLBACK 1000
+
+/**
+ * The width of the benchmarked terminal, in pixels.
+ */
+#define BENCHMARK_WIDTH 1024
+
+/**
+ * The height of the benchmarked terminal, in pixels.
+ */
+#define BENCHMARK_HEIGHT 768
+
+/**
+ * Returns a printable ASCII character chosen pseudo-randomly, such that
+ * generated output is not trivially compressible.
+ *
+ * @return
+ *     A pseudo-random printable ASCII character.
+ */
+static char guac_terminal_benchmark_char() {
+    return ' ' + rand() % 95;
+}
+
+/**
+ * Allocates a new terminal attached to a client having no users, such that
+ * all rendered output is discarded.
+ *
+ * @param client
+ *     The client to which the terminal should be attached.
+ *
+ * @return
+ *     A newly-allocated terminal, or NULL if the terminal could not be
+ *     created.
+ */
+static guac_terminal* guac_terminal_benchmark_create(guac_client* client) {
+    return guac_terminal_create(client, NULL, false, BENCHMARK_SCROLLBACK,
+            "monospace", 12, 96, BENCHMARK_WIDTH, BENCHMARK_HEIGHT, "", 127);
+}
+
+/**
+ * Writes the given output to a new terminal BENCHMARK_ROUNDS times, flushing
+ * the display after each round as a rendered frame would, and reports the
+ * resulting throughput.
+ *
+ * @param name
+ *     A human-readable name describing the benchmarked output.
+ *
+ * @param terminal
+ *     The terminal to write the output to.
+ *
+ * @param output
+ *     The output to write.
+ *
+ * @param length
+ *     The number of bytes of output to write.
+ */
+static void guac_terminal_benchmark_write(const char* name,
+        guac_terminal* terminal, const char* output, int length) {
+
+    int i;
+
+    guac_timestamp start = guac_timestamp_current();
+
+    for (i = 0; i < BENCHMARK_ROUNDS; i++) {
+
+        guac_terminal_write(terminal, output, length);
+
+        guac_terminal_lock(terminal);
+        guac_terminal_flush(terminal);
+        guac_terminal_unlock(terminal);
+
+    }
+
+    guac_terminal_benchmark_report(name, (double) length * BENCHMARK_ROUNDS,
+            start);
+
+}
+
+void guac_terminal_benchmark_lines() {
+
+    guac_client* client = guac_client_alloc();
+    guac_terminal* terminal = guac_terminal_benchmark_create(client);
+    if (terminal == NULL) {
+        fprintf(stderr, "guac_terminal_create(): Terminal not created\n");
+        guac_client_free(client);
+        return;
+    }
+
+    char* output = malloc(BENCHMARK_OUTPUT_SIZE);
+    int length = 0;
+    int line = 0;
+
+    srand(1);
+
+    /* Build lines of varying length, changing color every few lines */
+    while (length < BENCHMARK_OUTPUT_SIZE - 256) {
+
+        int i;
+        int line_length = 20 + rand() % 180;
+
+        if (line++ % 8 == 0)
+            length += sprintf(output + length, "\x1B[3%im", line % 8);
+
+        for (i = 0; i < line_length; i++)
+            output[length++] = guac_terminal_benchmark_char();
+
+        output[length++] = '\r';
+        output[length++] = '\n';
+
+    }
+
+    guac_terminal_benchmark_write("guac_terminal_write() (lines)",
+            terminal, output, length);
+
+    /* Stop the terminal's render thread before freeing the terminal */
+    guac_client_stop(client);
+    guac_terminal_free(terminal);
+    guac_client_free(client);
+    free(output);
+
+}
+
+void guac_terminal_benchmark_repaint() {
+
+    guac_client* client = guac_client_alloc();
+    guac_terminal* terminal = guac_terminal_benchmark_create(client);
+    if (terminal == NULL) {
+        fprintf(stderr, "guac_terminal_create(): Terminal not created\n");
+        guac_client_free(client);
+        return;
+    }
+
+    /* Fill all but the last cell, such that the display never scrolls */
+    int cells = terminal->term_width * terminal->term_height - 1;
+
+    char* output = malloc(BENCHMARK_OUTPUT_SIZE);
+    int length = 0;
+
+    srand(1);
+
+    /* Build repeated repaints of the entire display from its home position */
+    while (length < BENCHMARK_OUTPUT_SIZE - cells - 8) {
+
+        int i;
+
+        length += sprintf(output + length, "\x1B[H");
+
+        for (i = 0; i < cells; i++)
+            output[length++] = guac_terminal_benchmark_char();
+
+    }
+
+    guac_terminal_benchmark_write("guac_terminal_write() (repaint)",
+            terminal, output, length);
+
+    /* Stop the terminal's render thread before freeing the terminal */
+    guac_client_stop(client);
+    guac_terminal_free(terminal);
+    guac_client_free(client);
+    free(output);
+
+}
@@ -22,9 +22,589 @@
 #include "terminal/buffer.h"
 #include "terminal/common.h"
 
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 
+/**
+ * Returns whether the given colors are identical, including their palette
+ * indices.
+ */
+static int __guac_terminal_buffer_same_color(const guac_terminal_color* a,
+        const guac_terminal_color* b) {
+    return a->palette_index == b->palette_index
+        && a->red   == b->red
+        && a->green == b->green
+        && a->blue  == b->blue;
+}
+
+/**
+ * Returns whether the given sets of attributes are identical.
+ */
+static int __guac_terminal_buffer_same_attributes(
+        const guac_terminal_attributes* a, const guac_terminal_attributes* b) {
+    return a->bold        == b->bold
+        && a->half_bright == b->half_bright
+        && a->reverse     == b->reverse
+        && a->cursor      == b->cursor
+        && a->underscore  == b->underscore
+        && __guac_terminal_buffer_same_color(&a->foreground, &b->foreground)
+        && __guac_terminal_buffer_same_color(&a->background, &b->background);
+}
+
+/**
+ * Returns an arbitrary hash value for the given color.
+ */
+static uint32_t __guac_terminal_buffer_hash_color(
+        const guac_terminal_color* color) {
+    return ((uint32_t) color->palette_index << 24)
+        ^ ((uint32_t) color->red << 16)
+        ^ ((uint32_t) color->green << 8)
+        ^  (uint32_t) color->blue;
+}
+
+/**
+ * Returns an arbitrary hash value for the given set of attributes.
+ */
+static uint32_t __guac_terminal_buffer_hash_attributes(
+        const guac_terminal_attributes* attributes) {
+
+    uint32_t hash = attributes->bold
+                 | (attributes->half_bright << 1)
+                 | (attributes->reverse     << 2)
+                 | (attributes->cursor      << 3)
+                 | (attributes->underscore  << 4);
+
+    hash = hash * 0x9E3779B1
+         ^ __guac_terminal_buffer_hash_color(&attributes->foreground);
+    hash = hash * 0x9E3779B1
+         ^ __guac_terminal_buffer_hash_color(&attributes->background);
+
+    /* Spread high bits into the low bits used to select table entries */
+    hash ^= hash >> 16;
+    hash *= 0x85EBCA6B;
+    hash ^= hash >> 13;
+
+    return hash;
+
+}
+
+/**
+ * Adds the interned attributes having the given index to the hash table of
+ * the given buffer. The attributes must not already be present within the
+ * hash table.
+ */
+static void __guac_terminal_buffer_index_attributes(
+        guac_terminal_buffer* buffer, uint32_t index) {
+
+    uint32_t mask = buffer->attributes_available * 2 - 1;
+    uint32_t entry = __guac_terminal_buffer_hash_attributes(
+            &(buffer->attributes[index])) & mask;
+
+    /* Find first empty entry */
+    while (buffer->attributes_table[entry] != 0)
+        entry = (entry + 1) & mask;
+
+    buffer->attributes_table[entry] = index + 1;
+
+}
+
+/**
+ * Rebuilds the hash table of the given buffer from scratch, reallocating the
+ * table to fit the current number of available attributes.
+ */
+static void __guac_terminal_buffer_reindex_attributes(
+        guac_terminal_buffer* buffer) {
+
+    int i;
+
+    free(buffer->attributes_table);
+    buffer->attributes_table = calloc(buffer->attributes_available * 2,
+            sizeof(uint32_t));
+
+    for (i = 0; i < buffer->attributes_length; i++)
+        __guac_terminal_buffer_index_attributes(buffer, i);
+
+}
+
+/**
+ * The minimum number of consecutive identical characters which will be
+ * compressed as a single repeated run, rather than stored individually.
+ */
+#define GUAC_TERMINAL_BUFFER_MIN_RUN 4
+
+/**
+ * The maximum number of bytes required to compress a single character,
+ * including the header of the run containing that character.
+ */
+#define GUAC_TERMINAL_BUFFER_MAX_COMPRESSED_CHAR 16
+
+/**
+ * Writes the given value to the given output as a variable-length integer,
+ * seven bits at a time, returning a pointer to the byte following the
+ * value written.
+ */
+static unsigned char* __guac_terminal_buffer_write_varint(unsigned char* out,
+        uint32_t value) {
+
+    while (value >= 0x80) {
+        *(out++) = (value & 0x7F) | 0x80;
+        value >>= 7;
+    }
+
+    *(out++) = value;
+    return out;
+
+}
+
+/**
+ * Reads a variable-length integer previously written with
+ * __guac_terminal_buffer_write_varint(), returning a pointer to the byte
+ * following the value read.
+ */
+static const unsigned char* __guac_terminal_buffer_read_varint(
+        const unsigned char* in, uint32_t* value) {
+
+    uint32_t result = 0;
+    int shift = 0;
+
+    while (*in & 0x80) {
+        result |= (uint32_t) (*(in++) & 0x7F) << shift;
+        shift += 7;
+    }
+
+    *value = result | ((uint32_t) *(in++) << shift);
+    return in;
+
+}
+
+/**
+ * Returns whether the given stored characters are identical.
+ */
+static int __guac_terminal_buffer_same_char(const guac_terminal_buffer_char* a,
+        const guac_terminal_buffer_char* b) {
+    return a->value == b->value
+        && a->width == b->width
+        && a->attributes == b->attributes;
+}
+
+/**
+ * Returns the number of consecutive characters, starting at the given index
+ * and ending no later than the given limit, which are identical to the
+ * character at the given index.
+ */
+static int __guac_terminal_buffer_run_length(
+        const guac_terminal_buffer_char* characters, int start, int limit) {
+
+    int end = start + 1;
+    while (end < limit && __guac_terminal_buffer_same_char(
+                &characters[start], &characters[end]))
+        end++;
+
+    return end - start;
+
+}
+
+/**
+ * Compresses the contents of the given row into the scratch space of the
+ * given buffer. Each run of characters sharing the same attributes and
+ * width is stored as a header followed by the codepoints of those
+ * characters. Runs of identical characters store their codepoint only once.
+ *
+ * @return
+ *     The number of bytes of scratch space used.
+ */
+static int __guac_terminal_buffer_compress_row(guac_terminal_buffer* buffer,
+        guac_terminal_buffer_row* row) {
+
+    const guac_terminal_buffer_char* characters = row->characters;
+    int length = row->length;
+    int i = 0;
+
+    /* Ensure scratch space is sufficient for worst case */
+    int required = length * GUAC_TERMINAL_BUFFER_MAX_COMPRESSED_CHAR;
+    if (required > buffer->scratch_size) {
+        buffer->scratch_size = required;
+        buffer->scratch = realloc(buffer->scratch, required);
+    }
+
+    unsigned char* out = buffer->scratch;
+
+    while (i < length) {
+
+        const guac_terminal_buffer_char* first = &characters[i];
+        int end;
+
+        /* Store runs of identical characters as a single character */
+        int run = __guac_terminal_buffer_run_length(characters, i, length);
+        if (run >= GUAC_TERMINAL_BUFFER_MIN_RUN) {
+            out = __guac_terminal_buffer_write_varint(out, (run << 1) | 1);
+            out = __guac_terminal_buffer_write_varint(out, first->attributes);
+            out = __guac_terminal_buffer_write_varint(out, first->width);
+            out = __guac_terminal_buffer_write_varint(out, first->value + 1);
+            i += run;
+            continue;
+        }
+
+        /* Otherwise, store each character until the attributes or width
+         * change, or a run of identical characters begins, tracking the
+         * length of the run of identical characters ending at each
+         * character such that the row is scanned only once */
+        int same = 0;
+        for (end = i + 1; end < length; end++) {
+
+            if (characters[end].attributes != first->attributes
+                    || characters[end].width != first->width)
+                break;
+
+            if (same > 0 && __guac_terminal_buffer_same_char(
+                        &characters[end - 1], &characters[end]))
+                same++;
+            else
+                same = 1;
+
+            /* Stop at the start of any sufficiently long run */
+            if (same == GUAC_TERMINAL_BUFFER_MIN_RUN) {
+                end -= GUAC_TERMINAL_BUFFER_MIN_RUN - 1;
+                break;
+            }
+
+        }
+
+        out = __guac_terminal_buffer_write_varint(out, (end - i) << 1);
+        out = __guac_terminal_buffer_write_varint(out, first->attributes);
+        out = __guac_terminal_buffer_write_varint(out, first->width);
+
+        /* Codepoints are offset by one such that GUAC_CHAR_CONTINUATION is
+         * stored as zero */
+        for (; i < end; i++)
+            out = __guac_terminal_buffer_write_varint(out,
+                    characters[i].value + 1);
+
+    }
+
+    return out - buffer->scratch;
+
+}
+
+/**
+ * Decompresses the given row, restoring its characters array. The row must
+ * currently be compressed.
+ */
+static void __guac_terminal_buffer_thaw_row(guac_terminal_buffer_row* row) {
+
+    const unsigned char* in = row->compressed;
+    int i = 0;
+
+    row->available = row->length;
+    row->characters = malloc(sizeof(guac_terminal_buffer_char)
+            * row->available);
+
+    while (i < row->length) {
+
+        uint32_t header, attributes, width, value;
+        guac_terminal_buffer_char current;
+        int count;
+
+        in = __guac_terminal_buffer_read_varint(in, &header);
+        in = __guac_terminal_buffer_read_varint(in, &attributes);
+        in = __guac_terminal_buffer_read_varint(in, &width);
+
+        count = header >> 1;
+        current.attributes = attributes;
+        current.width = width;
+
+        /* Repeat single character for runs of identical characters */
+        if (header & 1) {
+            in = __guac_terminal_buffer_read_varint(in, &value);
+            current.value = (int) value - 1;
+            while (count-- > 0)
+                row->characters[i++] = current;
+        }
+
+        /* Otherwise, read each character */
+        else {
+            while (count-- > 0) {
+                in = __guac_terminal_buffer_read_varint(in, &value);
+                current.value = (int) value - 1;
+                row->characters[i++] = current;
+            }
+        }
+
+    }
+
+    free(row->compressed);
+    row->compressed = NULL;
+    row->compressed_length = 0;
+
+}
+
+/**
+ * Compresses the given row, freeing its characters array. If the row is
+ * empty, is already compressed, or would not be made smaller by
+ * compression, the row is left untouched.
+ */
+static void __guac_terminal_buffer_freeze_row(guac_terminal_buffer* buffer,
+        guac_terminal_buffer_row* row) {
+
+    if (row->compressed != NULL || row->length == 0)
+        return;
+
+    int size = __guac_terminal_buffer_compress_row(buffer, row);
+    if (size >= (int) sizeof(guac_terminal_buffer_char) * row->length)
+        return;
+
+    row->compressed = malloc(size);
+    row->compressed_length = size;
+    memcpy(row->compressed, buffer->scratch, size);
+
+    free(row->characters);
+    row->characters = NULL;
+    row->available = 0;
+
+}
+
+/**
+ * Compresses the row at the given index within the rows array of the given
+ * buffer if that row is currently part of the scrollback, but not within
+ * the GUAC_TERMINAL_BUFFER_HOT_ROWS rows immediately above the visible area.
+ */
+static void __guac_terminal_buffer_freeze_if_cold(
+        guac_terminal_buffer* buffer, int index, int height) {
+
+    /* Determine position of row relative to top of buffer, where the
+     * scrollback immediately precedes the top of the buffer */
+    int relative = (index - buffer->top) % buffer->available;
+    if (relative < 0)
+        relative += buffer->available;
+
+    if (relative >= height
+            && relative < buffer->available - GUAC_TERMINAL_BUFFER_HOT_ROWS)
+        __guac_terminal_buffer_freeze_row(buffer, &(buffer->rows[index]));
+
+}
+
+/**
+ * Returns a pointer to the byte following the codepoints of a run previously
+ * written by __guac_terminal_buffer_compress_row(), given the header of that
+ * run and a pointer to its first codepoint.
+ */
+static const unsigned char* __guac_terminal_buffer_skip_run(
+        const unsigned char* in, uint32_t header) {
+
+    /* Runs of identical characters store only one codepoint */
+    uint32_t count = (header & 1) ? 1 : header >> 1;
+
+    while (count > 0) {
+        if (!(*(in++) & 0x80))
+            count--;
+    }
+
+    return in;
+
+}
+
+/**
+ * Marks the attributes of every character within the given row as used
+ * within the given map of attribute indices, reading the compressed form of
+ * the row directly if the row is compressed.
+ */
+static void __guac_terminal_buffer_mark_attributes(
+        const guac_terminal_buffer_row* row, uint32_t* remap) {
+
+    int i;
+
+    /* Uncompressed rows can be read directly */
+    if (row->compressed == NULL) {
+        for (i = 0; i < row->length; i++)
+            remap[row->characters[i].attributes] = 1;
+        return;
+    }
+
+    /* Otherwise, read only the header and attributes of each run */
+    const unsigned char* in = row->compressed;
+    i = 0;
+
+    while (i < row->length) {
+
+        uint32_t header, attributes, width;
+
+        in = __guac_terminal_buffer_read_varint(in, &header);
+        in = __guac_terminal_buffer_read_varint(in, &attributes);
+        in = __guac_terminal_buffer_read_varint(in, &width);
+        in = __guac_terminal_buffer_skip_run(in, header);
+
+        remap[attributes] = 1;
+        i += header >> 1;
+
+    }
+
+}
+
+/**
+ * Replaces the attributes index of every character within the given row with
+ * the corresponding entry of the given map, less one. If the row is
+ * compressed, its compressed form is rewritten in place. This is possible as
+ * attributes are only ever renumbered to lower indices, which never require
+ * more bytes than the original indices.
+ */
+static void __guac_terminal_buffer_remap_attributes(
+        guac_terminal_buffer_row* row, const uint32_t* remap) {
+
+    int i;
+
+    /* Uncompressed rows can be updated directly */
+    if (row->compressed == NULL) {
+        for (i = 0; i < row->length; i++)
+            row->characters[i].attributes =
+                remap[row->characters[i].attributes] - 1;
+        return;
+    }
+
+    /* Otherwise, rewrite the attributes of each run, moving the remainder
+     * of each run down if the new attributes are shorter */
+    const unsigned char* in = row->compressed;
+    unsigned char* out = row->compressed;
+    i = 0;
+
+    while (i < row->length) {
+
+        uint32_t header, attributes, width;
+        const unsigned char* rest;
+
+        in = __guac_terminal_buffer_read_varint(in, &header);
+        out = __guac_terminal_buffer_write_varint(out, header);
+
+        in = __guac_terminal_buffer_read_varint(in, &attributes);
+        out = __guac_terminal_buffer_write_varint(out,
+                remap[attributes] - 1);
+
+        /* Copy width and codepoints unchanged */
+        rest = in;
+        in = __guac_terminal_buffer_read_varint(in, &width);
+        in = __guac_terminal_buffer_skip_run(in, header);
+        memmove(out, rest, in - rest);
+        out += in - rest;
+
+        i += header >> 1;
+
+    }
+
+    row->compressed_length = out - row->compressed;
+
+}
+
+/**
+ * Discards all interned attributes which are no longer referenced by any
+ * character within the given buffer, renumbering the remaining attributes
+ * and updating all stored characters accordingly. Compressed rows are
+ * updated without being decompressed. If memory for the renumbering cannot
+ * be allocated, the attributes are left untouched.
+ */
+static void __guac_terminal_buffer_compact_attributes(
+        guac_terminal_buffer* buffer) {
+
+    int i;
+    uint32_t length = 0;
+
+    /* Map of old attribute indices to new indices plus one (zero if
+     * unused) */
+    uint32_t* remap = calloc(buffer->attributes_length, sizeof(uint32_t));
+    if (remap == NULL)
+        return;
+
+    /* The default character is always retained */
+    remap[buffer->default_packed.attributes] = 1;
+
+    /* Mark all attributes still in use */
+    for (i = 0; i < buffer->available; i++)
+        __guac_terminal_buffer_mark_attributes(&(buffer->rows[i]), remap);
+
+    /* Assign new indices, moving retained attributes down */
+    for (i = 0; i < buffer->attributes_length; i++) {
+        if (remap[i]) {
+            buffer->attributes[length] = buffer->attributes[i];
+            remap[i] = ++length;
+        }
+    }
+
+    /* Update all stored characters */
+    buffer->default_packed.attributes =
+        remap[buffer->default_packed.attributes] - 1;
+
+    for (i = 0; i < buffer->available; i++)
+        __guac_terminal_buffer_remap_attributes(&(buffer->rows[i]), remap);
+
+    free(remap);
+
+    buffer->attributes_length = length;
+    __guac_terminal_buffer_reindex_attributes(buffer);
+
+}
+
+/**
+ * Returns the index of the given attributes within the attributes interned
+ * by the given buffer, interning the attributes if not already present.
+ */
+static uint32_t __guac_terminal_buffer_intern_attributes(
+        guac_terminal_buffer* buffer,
+        const guac_terminal_attributes* attributes) {
+
+    uint32_t mask = buffer->attributes_available * 2 - 1;
+    uint32_t entry = __guac_terminal_buffer_hash_attributes(attributes) & mask;
+
+    /* Search for existing attributes */
+    while (buffer->attributes_table[entry] != 0) {
+
+        uint32_t index = buffer->attributes_table[entry] - 1;
+        if (__guac_terminal_buffer_same_attributes(
+                    &(buffer->attributes[index]), attributes))
+            return index;
+
+        entry = (entry + 1) & mask;
+
+    }
+
+    /* Make room for new attributes if necessary */
+    if (buffer->attributes_length == buffer->attributes_available) {
+
+        /* Prefer discarding attributes which are no longer used over growing
+         * without bound */
+        if (buffer->attributes_available >= GUAC_TERMINAL_BUFFER_COMPACT_ATTRIBUTES)
+            __guac_terminal_buffer_compact_attributes(buffer);
+
+        /* Grow if still at least half full */
+        if (buffer->attributes_length >= buffer->attributes_available / 2) {
+            buffer->attributes_available *= 2;
+            buffer->attributes = realloc(buffer->attributes,
+                    sizeof(guac_terminal_attributes)
+                    * buffer->attributes_available);
+            __guac_terminal_buffer_reindex_attributes(buffer);
+        }
+
+    }
+
+    /* Store new attributes */
+    uint32_t index = buffer->attributes_length++;
+    buffer->attributes[index] = *attributes;
+    __guac_terminal_buffer_index_attributes(buffer, index);
+
+    return index;
+
+}
+
+/**
+ * Packs the given character for storage within the given buffer, interning
+ * its attributes if necessary.
+ */
+static void __guac_terminal_buffer_pack(guac_terminal_buffer* buffer,
+        const guac_terminal_char* character, guac_terminal_buffer_char* packed) {
+    packed->value = character->value;
+    packed->width = character->width;
+    packed->attributes = __guac_terminal_buffer_intern_attributes(buffer,
+            &character->attributes);
+}
+
 guac_terminal_buffer* guac_terminal_buffer_alloc(int rows, guac_terminal_char* default_character) {
 
     /* Allocate scrollback */
@@ -42,14 +622,36 @@ guac_terminal_buffer* guac_terminal_buffer_alloc(int rows, guac_terminal_char* d
     buffer->rows = malloc(sizeof(guac_terminal_buffer_row) *
             buffer->available);
 
-    /* Init scrollback rows */
+    /* Init interned attributes */
+    buffer->attributes_length = 0;
+    buffer->attributes_available = GUAC_TERMINAL_BUFFER_INITIAL_ATTRIBUTES;
+    buffer->attributes = malloc(sizeof(guac_terminal_attributes)
+            * buffer->attributes_available);
+    buffer->attributes_table = NULL;
+    __guac_terminal_buffer_reindex_attributes(buffer);
+
+    /* No rows are yet compressed */
+    buffer->thawed_length = 0;
+    buffer->thawed_available = 16;
+    buffer->thawed = malloc(sizeof(int) * buffer->thawed_available);
+    buffer->scratch = NULL;
+    buffer->scratch_size = 0;
+
+    /* Pack default character (no rows yet exist which could require
+     * compaction) */
+    __guac_terminal_buffer_pack(buffer, default_character,
+            &buffer->default_packed);
+
+    /* Init scrollback rows (storage for each row is allocated only when
+     * needed) */
     row = buffer->rows;
     for (i=0; i<rows; i++) {
 
-        /* Allocate row  */
-        row->available = 256;
+        row->available = 0;
         row->length = 0;
-        row->characters = malloc(sizeof(guac_terminal_char) * row->available);
+        row->characters = NULL;
+        row->compressed = NULL;
+        row->compressed_length = 0;
 
         /* Next row */
         row++;
@@ -68,9 +670,18 @@ void guac_terminal_buffer_free(guac_terminal_buffer* buffer) {
     /* Free all rows */
     for (i=0; i<buffer->available; i++) {
         free(row->characters);
+        free(row->compressed);
         row++;
     }
 
+    /* Free interned attributes */
+    free(buffer->attributes);
+    free(buffer->attributes_table);
+
+    /* Free compression state */
+    free(buffer->thawed);
+    free(buffer->scratch);
+
     /* Free actual buffer */
     free(buffer->rows);
     free(buffer);
@@ -80,7 +691,7 @@ void guac_terminal_buffer_free(guac_terminal_buffer* buffer) {
 guac_terminal_buffer_row* guac_terminal_buffer_get_row(guac_terminal_buffer* buffer, int row, int width) {
 
     int i;
-    guac_terminal_char* first;
+    guac_terminal_buffer_char* first;
     guac_terminal_buffer_row* buffer_row;
 
     /* Normalize row index into a scrollback buffer index */
@@ -91,19 +702,35 @@ guac_terminal_buffer_row* guac_terminal_buffer_get_row(guac_terminal_buffer* buf
     /* Get row */
     buffer_row = &(buffer->rows[index]);
 
+    /* Decompress row if necessary, noting that it may need to be compressed
+     * again later */
+    if (buffer_row->compressed != NULL) {
+
+        __guac_terminal_buffer_thaw_row(buffer_row);
+
+        if (buffer->thawed_length == buffer->thawed_available) {
+            buffer->thawed_available *= 2;
+            buffer->thawed = realloc(buffer->thawed,
+                    sizeof(int) * buffer->thawed_available);
+        }
+
+        buffer->thawed[buffer->thawed_length++] = index;
+
+    }
+
     /* If resizing is needed */
     if (width >= buffer_row->length) {
 
         /* Expand if necessary */
         if (width > buffer_row->available) {
             buffer_row->available = width*2;
-            buffer_row->characters = realloc(buffer_row->characters, sizeof(guac_terminal_char) * buffer_row->available);
+            buffer_row->characters = realloc(buffer_row->characters, sizeof(guac_terminal_buffer_char) * buffer_row->available);
         }
 
         /* Initialize new part of row */
         first = &(buffer_row->characters[buffer_row->length]);
         for (i=buffer_row->length; i<width; i++)
-            *(first++) = buffer->default_character;
+            *(first++) = buffer->default_packed;
 
         buffer_row->length = width;
 
@@ -114,14 +741,101 @@ guac_terminal_buffer_row* guac_terminal_buffer_get_row(guac_terminal_buffer* buf
 
 }
 
+void guac_terminal_buffer_get_char(guac_terminal_buffer* buffer,
+        guac_terminal_buffer_row* row, int column,
+        guac_terminal_char* character) {
+
+    /* Characters beyond end of row are implicitly the default */
+    if (column < 0 || column >= row->length) {
+        *character = buffer->default_character;
+        return;
+    }
+
+    guac_terminal_buffer_char* packed = &(row->characters[column]);
+
+    character->value = packed->value;
+    character->width = packed->width;
+    character->attributes = buffer->attributes[packed->attributes];
+
+}
+
+void guac_terminal_buffer_set_char(guac_terminal_buffer* buffer,
+        guac_terminal_buffer_row* row, int column,
+        guac_terminal_char* character) {
+
+    guac_terminal_buffer_char packed;
+    __guac_terminal_buffer_pack(buffer, character, &packed);
+
+    row->characters[column] = packed;
+
+}
+
+void guac_terminal_buffer_scroll_up(guac_terminal_buffer* buffer, int amount,
+        int height) {
+
+    int i;
+
+    /* Advance by scroll amount */
+    buffer->top += amount;
+    if (buffer->top >= buffer->available)
+        buffer->top -= buffer->available;
+
+    buffer->length += amount;
+    if (buffer->length > buffer->available)
+        buffer->length = buffer->available;
+
+    /* Discard the old contents of compressed rows which have just been
+     * recycled as the bottom of the visible area, rather than decompressing
+     * contents which the caller is about to clear anyway */
+    for (i = (amount < height ? height - amount : 0); i < height; i++) {
+
+        int index = (buffer->top + i) % buffer->available;
+        guac_terminal_buffer_row* row = &(buffer->rows[index]);
+
+        if (row->compressed != NULL) {
+            free(row->compressed);
+            row->compressed = NULL;
+            row->compressed_length = 0;
+            row->length = 0;
+        }
+
+    }
+
+    /* Compress rows which have just left the uncompressed region */
+    for (i = 1; i <= amount; i++) {
+
+        int index = (buffer->top - GUAC_TERMINAL_BUFFER_HOT_ROWS - i)
+            % buffer->available;
+        if (index < 0)
+            index += buffer->available;
+
+        __guac_terminal_buffer_freeze_if_cold(buffer, index, height);
+
+    }
+
+    /* Compress any rows which were decompressed on demand */
+    for (i = 0; i < buffer->thawed_length; i++)
+        __guac_terminal_buffer_freeze_if_cold(buffer, buffer->thawed[i],
+                height);
+
+    buffer->thawed_length = 0;
+
+}
+
 void guac_terminal_buffer_copy_columns(guac_terminal_buffer* buffer, int row,
         int start_column, int end_column, int offset) {
 
-    guac_terminal_char* src;
-    guac_terminal_char* dst;
+    guac_terminal_buffer_char* src;
+    guac_terminal_buffer_char* dst;
 
-    /* Get row */
-    guac_terminal_buffer_row* buffer_row = guac_terminal_buffer_get_row(buffer, row, end_column + offset + 1);
+    /* Get row, ensuring both source and destination are within bounds */
+    guac_terminal_buffer_row* buffer_row = guac_terminal_buffer_get_row(buffer, row,
+            (offset > 0 ? end_column + offset : end_column) + 1);
+
+    /* Do nothing if source or destination lie entirely outside the row */
+    if (end_column + offset < 0 || start_column + offset > buffer_row->length - 1
+            || end_column < 0 || start_column > buffer_row->length - 1)
+        return;
 
     /* Fit range within bounds */
     start_column = guac_terminal_fit_to_range(start_column,          0, buffer_row->length - 1);
@@ -134,7 +848,7 @@ void guac_terminal_buffer_copy_columns(guac_terminal_buffer* buffer, int row,
     dst = &(buffer_row->characters[start_column + offset]);
 
     /* Copy data */
-    memmove(dst, src, sizeof(guac_terminal_char) * (end_column - start_column + 1));
+    memmove(dst, src, sizeof(guac_terminal_buffer_char) * (end_column - start_column + 1));
 
 }
 
@@ -163,8 +877,10 @@ void guac_terminal_buffer_copy_rows(guac_terminal_buffer* buffer,
         guac_terminal_buffer_row* src_row = guac_terminal_buffer_get_row(buffer, current_row, 0);
         guac_terminal_buffer_row* dst_row = guac_terminal_buffer_get_row(buffer, current_row + offset, src_row->length);
 
-        /* Copy data */
-        memcpy(dst_row->characters, src_row->characters, sizeof(guac_terminal_char) * src_row->length);
+        /* Copy data (rows which have never been written may lack storage) */
+        if (src_row->length > 0)
+            memcpy(dst_row->characters, src_row->characters,
+                    sizeof(guac_terminal_buffer_char) * src_row->length);
         dst_row->length = src_row->length;
 
         /* Next current_row */
@@ -178,26 +894,33 @@ void guac_terminal_buffer_set_columns(guac_terminal_buffer* buffer, int row,
         int start_column, int end_column, guac_terminal_char* character) {
 
     int i, j;
-    guac_terminal_char* current;
+    guac_terminal_buffer_char* current;
 
     /* Do nothing if glyph is empty */
     if (character->width == 0)
         return;
 
+    /* Pack character for storage */
+    guac_terminal_buffer_char packed_char;
+    __guac_terminal_buffer_pack(buffer, character, &packed_char);
+
     /* Build continuation char (for multicolumn characters) */
-    guac_terminal_char continuation_char;
+    guac_terminal_buffer_char continuation_char = packed_char;
     continuation_char.value = GUAC_CHAR_CONTINUATION;
-    continuation_char.attributes = character->attributes;
     continuation_char.width = 0; /* Not applicable for GUAC_CHAR_CONTINUATION */
 
-    /* Get and expand row */
-    guac_terminal_buffer_row* buffer_row = guac_terminal_buffer_get_row(buffer, row, end_column+1);
+    /* Get and expand row, including any continuation characters of the
+     * final character stored */
+    int last_column = start_column
+        + (end_column - start_column) / character->width * character->width
+        + character->width - 1;
+    guac_terminal_buffer_row* buffer_row = guac_terminal_buffer_get_row(buffer, row, last_column+1);
 
     /* Set values */
     current = &(buffer_row->characters[start_column]);
     for (i = start_column; i <= end_column; i += character->width) {
 
-        *(current++) = *character;
+        *(current++) = packed_char;
 
         /* Store any required continuation characters */
         for (j=1; j < character->width; j++)
@@ -211,3 +934,36 @@ void guac_terminal_buffer_set_columns(guac_terminal_buffer* buffer, int row,
 
 }
 
+void guac_terminal_buffer_set_text(guac_terminal_buffer* buffer, int row,
+        int start_column, const char* text, int length,
+        guac_terminal_attributes* attributes) {
+
+    int i;
+    guac_terminal_buffer_char* current;
+    guac_terminal_buffer_char packed_char;
+
+    if (length <= 0)
+        return;
+
+    /* All characters share the same attributes and width */
+    packed_char.width = 1;
+    packed_char.attributes = __guac_terminal_buffer_intern_attributes(buffer,
+            attributes);
+
+    /* Get and expand row */
+    guac_terminal_buffer_row* buffer_row = guac_terminal_buffer_get_row(buffer,
+            row, start_column + length);
+
+    /* Set values */
+    current = &(buffer_row->characters[start_column]);
+    for (i = 0; i < length; i++) {
+        packed_char.value = (unsigned char) text[i];
+        *(current++) = packed_char;
+    }
+
+    /* Update length depending on row written */
+    if (row >= buffer->length)
+        buffer->length = row+1;
+
+}
+
@@ -22,6 +22,7 @@
 #include "common/surface.h"
 #include "terminal/common.h"
 #include "terminal/display.h"
+#include "terminal/glyph-cache.h"
 #include "terminal/palette.h"
 #include "terminal/types.h"
 
@@ -97,13 +98,31 @@ int __guac_terminal_set_colors(guac_terminal_display* display,
 }
 
 /**
- * Sends the given character to the terminal at the given row and column,
- * rendering the character immediately. This bypasses the guac_terminal_display
- * mechanism and is intended for flushing of updates only.
+ * Renders the given character using the current glyph colors, drawing the
+ * result to the given surface at the given pixel coordinates.
+ *
+ * @param display
+ *     The display whose font and glyph colors should be used.
+ *
+ * @param dst
+ *     The surface to draw the rendered character to.
+ *
+ * @param x
+ *     The X coordinate of the upper-left corner of the character within the
+ *     destination surface, in pixels.
+ *
+ * @param y
+ *     The Y coordinate of the upper-left corner of the character within the
+ *     destination surface, in pixels.
+ *
+ * @param codepoint
+ *     The Unicode codepoint of the character to render.
+ *
+ * @param width
+ *     The width of the character, in columns.
  */
-int __guac_terminal_set(guac_terminal_display* display, int row, int col, int codepoint) {
-
-    int width;
+static void __guac_terminal_render_glyph(guac_terminal_display* display,
+        guac_common_surface* dst, int x, int y, int codepoint, int width) {
 
     int bytes;
     char utf8[4];
@@ -122,15 +141,6 @@ int __guac_terminal_set(guac_terminal_display* display, int row, int col, int co
     int layout_width, layout_height;
     int ideal_layout_width, ideal_layout_height;
 
-    /* Calculate width in columns */
-    width = wcwidth(codepoint);
-    if (width < 0)
-        width = 1;
-
-    /* Do nothing if glyph is empty */
-    if (width == 0)
-        return 0;
-
     /* Convert to UTF-8 */
     bytes = guac_terminal_encode_utf8(codepoint, utf8);
 
@@ -187,17 +197,91 @@ int __guac_terminal_set(guac_terminal_display* display, int row, int col, int co
     pango_cairo_show_layout(cairo, layout);
 
     /* Draw */
-    guac_common_surface_draw(display->display_surface,
-        display->char_width * col,
-        display->char_height * row,
-        surface);
+    guac_common_surface_draw(dst, x, y, surface);
 
     /* Free all */
     g_object_unref(layout);
     cairo_destroy(cairo);
     cairo_surface_destroy(surface);
 
-    return 0;
+}
+
+/**
+ * Renders the given character at the given row and column of the terminal.
+ * This bypasses the guac_terminal_display mechanism and is intended for
+ * flushing of updates only. Wide characters are rendered directly to the
+ * display surface. Single-column characters are rendered into the glyph cache
+ * only once for each combination of colors, and the caller must then copy the
+ * glyph from the cache to the display surface using
+ * __guac_terminal_display_flush_glyphs().
+ *
+ * @param display
+ *     The display to render the character to.
+ *
+ * @param row
+ *     The row of the character.
+ *
+ * @param col
+ *     The column of the character.
+ *
+ * @param codepoint
+ *     The Unicode codepoint of the character.
+ *
+ * @param glyph_x
+ *     Pointer to an int which will receive the X coordinate of the glyph
+ *     within the glyph cache surface, if the glyph must be copied.
+ *
+ * @param glyph_y
+ *     Pointer to an int which will receive the Y coordinate of the glyph
+ *     within the glyph cache surface, if the glyph must be copied.
+ *
+ * @return
+ *     A positive value if the glyph must be copied from the glyph cache,
+ *     zero if the character has been fully rendered, or a negative value if
+ *     the glyph cache entry for the character is still needed by a pending
+ *     copy and nothing was rendered.
+ */
+static int __guac_terminal_set(guac_terminal_display* display, int row,
+        int col, int codepoint, int* glyph_x, int* glyph_y) {
+
+    int width;
+    int result;
+
+    int x = display->char_width * col;
+    int y = display->char_height * row;
+
+    guac_terminal_glyph_cache* glyph_cache = display->glyph_cache;
+
+    /* Calculate width in columns */
+    width = wcwidth(codepoint);
+    if (width < 0)
+        width = 1;
+
+    /* Do nothing if glyph is empty */
+    if (width == 0)
+        return 0;
+
+    /* Render wide characters directly, as the glyph cache stores only
+     * single-column glyphs */
+    if (width != 1) {
+        __guac_terminal_render_glyph(display, display->display_surface,
+                x, y, codepoint, width);
+        return 0;
+    }
+
+    /* Render glyph into cache only if not already present */
+    result = guac_terminal_glyph_cache_lookup(glyph_cache, codepoint,
+                &display->glyph_foreground, &display->glyph_background,
+                glyph_x, glyph_y);
+
+    if (result < 0)
+        return result;
+
+    if (result == 0)
+        __guac_terminal_render_glyph(display, glyph_cache->surface,
+                *glyph_x, *glyph_y, codepoint, 1);
+
+    return 1;
 
 }
 
@@ -240,10 +324,18 @@ guac_terminal_display* guac_terminal_display_alloc(guac_client* client,
     /* Initially nothing selected */
     display->text_selected = false;
 
+    /* Updates are not initially deferred */
+    display->deferred = false;
+    display->deferred_scroll = 0;
+
+    /* Glyphs are cached once the font (and thus glyph size) is known */
+    display->glyph_cache = guac_terminal_glyph_cache_alloc(client);
+
     /* Attempt to load font */
     if (guac_terminal_display_set_font(display, font_name, font_size, dpi)) {
         guac_client_abort(display->client, GUAC_PROTOCOL_STATUS_SERVER_ERROR,
                 "Unable to set initial font \"%s\"", font_name);
+        guac_terminal_glyph_cache_free(display->glyph_cache);
         free(display);
         return NULL;
     }
@@ -263,6 +355,9 @@ void guac_terminal_display_free(guac_terminal_display* display) {
     /* Free operations buffers */
     free(display->operations);
 
+    /* Free glyph cache */
+    guac_terminal_glyph_cache_free(display->glyph_cache);
+
     /* Free display */
     free(display);
 
@@ -331,6 +426,10 @@ void guac_terminal_display_copy_columns(guac_terminal_display* display, int row,
     guac_terminal_operation* src_current;
     guac_terminal_operation* current;
 
+    /* Ignore all changes while deferred */
+    if (display->deferred)
+        return;
+
     /* Ignore operations outside display bounds */
     if (row < 0 || row >= display->height)
         return;
@@ -372,6 +471,15 @@ void guac_terminal_display_copy_rows(guac_terminal_display* display,
     guac_terminal_operation* src_current_row;
     guac_terminal_operation* current_row;
 
+    /* While deferred, coalesce scrolling of the entire display, ignoring all
+     * other copies (the display will be redrawn in its entirety) */
+    if (display->deferred) {
+        if (offset < 0 && start_row + offset == 0
+                && end_row == display->height - 1)
+            display->deferred_scroll -= offset;
+        return;
+    }
+
     /* Fit range within bounds */
     start_row = guac_terminal_fit_to_range(start_row,          0, display->height - 1);
     end_row   = guac_terminal_fit_to_range(end_row,            0, display->height - 1);
@@ -416,8 +524,8 @@ void guac_terminal_display_set_columns(guac_terminal_display* display, int row,
     int i;
     guac_terminal_operation* current;
 
-    /* Do nothing if glyph is empty */
-    if (character->width == 0)
+    /* Do nothing if glyph is empty or all changes are deferred */
+    if (character->width == 0 || display->deferred)
         return;
 
     /* Ignore operations outside display bounds */
@@ -444,6 +552,83 @@ void guac_terminal_display_set_columns(guac_terminal_display* display, int row,
 
 }
 
+void guac_terminal_display_set_text(guac_terminal_display* display, int row,
+        int start_column, const char* text, int length,
+        guac_terminal_attributes* attributes) {
+
+    int i;
+    guac_terminal_operation* current;
+
+    /* All characters share the same attributes and width */
+    guac_terminal_char character = {
+        .attributes = *attributes,
+        .width      = 1
+    };
+
+    /* Ignore all changes while deferred */
+    if (display->deferred)
+        return;
+
+    /* Ignore operations outside display bounds */
+    if (row < 0 || row >= display->height)
+        return;
+
+    /* Drop characters before start or beyond end of row */
+    if (start_column < 0) {
+        text -= start_column;
+        length += start_column;
+        start_column = 0;
+    }
+
+    if (start_column + length > display->width)
+        length = display->width - start_column;
+
+    current = &(display->operations[row * display->width + start_column]);
+
+    /* Set each character */
+    for (i = 0; i < length; i++) {
+        /* Set operation */
+        character.value = (unsigned char) text[i];
+        current->type      = GUAC_CHAR_SET;
+        current->character = character;
+
+        /* Next character */
+        current++;
+    }
+
+}
+
+void guac_terminal_display_defer(guac_terminal_display* display) {
+
+    /* Do not reset coalesced scrolling if already deferred */
+    if (display->deferred)
+        return;
+
+    display->deferred = true;
+    display->deferred_scroll = 0;
+
+}
+
+int guac_terminal_display_resume(guac_terminal_display* display) {
+
+    /* Nothing to do if updates were not deferred */
+    if (!display->deferred)
+        return 0;
+
+    display->deferred = false;
+
+    /* Apply coalesced scrolling as a single copy, if any of the original
+     * display contents remain visible */
+    int scroll = display->deferred_scroll;
+    if (scroll > 0 && scroll < display->height)
+        guac_terminal_display_copy_rows(display, scroll, display->height - 1,
+                -scroll);
+
+    display->deferred_scroll = 0;
+    return 1;
+
+}
+
 void guac_terminal_display_resize(guac_terminal_display* display, int width, int height) {
 
     guac_terminal_operation* current;
@@ -767,9 +952,63 @@ void __guac_terminal_display_flush_clear(guac_terminal_display* display) {
 }
 
 
+/**
+ * Copies the glyphs of all pending GUAC_CHAR_SET operations within the given
+ * range from the glyph cache to the display surface, marking each of those
+ * operations as handled. All glyphs newly rendered into the glyph cache are
+ * sent in a single flush before the first copy, and each glyph is then sent
+ * as an actual copy, such that the glyph is not re-encoded as part of a
+ * larger image.
+ *
+ * @param display
+ *     The display whose pending glyphs should be copied.
+ *
+ * @param first
+ *     The first operation of the range.
+ *
+ * @param last
+ *     The operation immediately following the last operation of the range.
+ */
+static void __guac_terminal_display_flush_glyphs(
+        guac_terminal_display* display, guac_terminal_operation* first,
+        guac_terminal_operation* last) {
+
+    guac_terminal_glyph_cache* glyph_cache = display->glyph_cache;
+    guac_terminal_operation* current;
+
+    /* Send all newly-rendered glyphs at once */
+    guac_common_surface_flush(glyph_cache->surface);
+
+    for (current = first; current < last; current++) {
+
+        if (current->type != GUAC_CHAR_SET)
+            continue;
+
+        int index = current - display->operations;
+        int row = index / display->width;
+        int col = index % display->width;
+
+        /* Copy glyph from cache (located by __guac_terminal_set()) */
+        guac_common_surface_copy_immediate(glyph_cache->surface,
+                current->column, current->row,
+                display->char_width, display->char_height,
+                display->display_surface,
+                col * display->char_width, row * display->char_height);
+
+        /* Mark operation as handled */
+        current->type = GUAC_CHAR_NOP;
+
+    }
+
+    /* Glyphs of this batch may now be replaced */
+    guac_terminal_glyph_cache_release(glyph_cache);
+
+}
+
 void __guac_terminal_display_flush_set(guac_terminal_display* display) {
 
     guac_terminal_operation* current = display->operations;
+    guac_terminal_operation* batch = current;
     int row, col;
 
     /* For each operation */
@@ -780,6 +1019,8 @@ void __guac_terminal_display_flush_set(guac_terminal_display* display) {
             if (current->type == GUAC_CHAR_SET) {
 
                 int codepoint = current->character.value;
+                int glyph_x, glyph_y;
+                int result;
 
                 /* Use space if no glyph */
                 if (!guac_terminal_has_glyph(codepoint))
@@ -789,11 +1030,28 @@ void __guac_terminal_display_flush_set(guac_terminal_display* display) {
                 __guac_terminal_set_colors(display,
                         &(current->character.attributes));
 
-                /* Send character */
-                __guac_terminal_set(display, row, col, codepoint);
+                /* Render character, first copying all glyphs rendered so far
+                 * if the glyph cache entry is still needed by one of them */
+                result = __guac_terminal_set(display, row, col, codepoint,
+                        &glyph_x, &glyph_y);
+
+                if (result < 0) {
+                    __guac_terminal_display_flush_glyphs(display, batch,
+                            current);
+                    batch = current;
+                    result = __guac_terminal_set(display, row, col,
+                            codepoint, &glyph_x, &glyph_y);
+                }
 
-                /* Mark operation as handled */
-                current->type = GUAC_CHAR_NOP;
+                /* Defer copy of glyph until all glyphs are rendered */
+                if (result > 0) {
+                    current->row = glyph_y;
+                    current->column = glyph_x;
+                }
+
+                /* Mark operation as handled if no copy is needed */
+                else
+                    current->type = GUAC_CHAR_NOP;
 
             }
 
@@ -803,6 +1061,9 @@ void __guac_terminal_display_flush_set(guac_terminal_display* display) {
         }
     }
 
+    /* Copy all remaining glyphs */
+    __guac_terminal_display_flush_glyphs(display, batch, current);
+
 }
 
 void guac_terminal_display_flush(guac_terminal_display* display) {
@@ -820,6 +1081,9 @@ void guac_terminal_display_flush(guac_terminal_display* display) {
 void guac_terminal_display_dup(guac_terminal_display* display, guac_user* user,
         guac_socket* socket) {
 
+    /* Synchronize glyph cache, such that future glyphs may be copied */
+    guac_terminal_glyph_cache_dup(display->glyph_cache, user, socket);
+
     /* Create default surface */
     guac_common_surface_dup(display->display_surface, user, socket);
 
@@ -1011,6 +1275,10 @@ int guac_terminal_display_set_font(guac_terminal_display* display,
     display->font_desc = font_desc;
     pango_font_description_free(old_font_desc);
 
+    /* Previously-cached glyphs were rendered with the old font */
+    guac_terminal_glyph_cache_reset(display->glyph_cache,
+            display->char_width, display->char_height);
+
     /* Recalculate dimensions which will fit within current surface */
     int new_width = pixel_width / display->char_width;
     int new_height = pixel_height / display->char_height;
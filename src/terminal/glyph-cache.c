@@ -0,0 +1,212 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "config.h"
+
+#include "common/surface.h"
+#include "terminal/glyph-cache.h"
+#include "terminal/palette.h"
+
+#include <stdlib.h>
+
+#include <guacamole/client.h>
+#include <guacamole/layer.h>
+#include <guacamole/protocol.h>
+#include <guacamole/socket.h>
+#include <guacamole/user.h>
+
+/**
+ * Returns whether the red, green, and blue components of the given colors
+ * are identical. Unlike guac_terminal_colorcmp(), the palette index of each
+ * color is ignored, as it is irrelevant once the glyph has been rendered.
+ *
+ * @param a
+ *     The first color to compare.
+ *
+ * @param b
+ *     The second color to compare.
+ *
+ * @return
+ *     Non-zero if the given colors are visually identical, zero otherwise.
+ */
+static int guac_terminal_glyph_cache_same_color(const guac_terminal_color* a,
+        const guac_terminal_color* b) {
+    return a->red == b->red && a->green == b->green && a->blue == b->blue;
+}
+
+/**
+ * Maps the given glyph onto the index of the only cache entry which may
+ * contain that glyph.
+ *
+ * @param codepoint
+ *     The Unicode codepoint of the glyph.
+ *
+ * @param foreground
+ *     The foreground color of the glyph.
+ *
+ * @param background
+ *     The background color of the glyph.
+ *
+ * @return
+ *     The index of the cache entry which may contain the given glyph.
+ */
+static int guac_terminal_glyph_cache_hash(int codepoint,
+        const guac_terminal_color* foreground,
+        const guac_terminal_color* background) {
+
+    unsigned int hash = (unsigned int) codepoint;
+
+    /* Mix in colors such that the same character rendered in different
+     * colors does not map to the same entry */
+    hash = hash * 31 + ((foreground->red << 16) | (foreground->green << 8)
+            | foreground->blue);
+    hash = hash * 31 + ((background->red << 16) | (background->green << 8)
+            | background->blue);
+
+    /* Spread high bits into the low bits used to select the entry */
+    hash ^= hash >> 15;
+    hash *= 0x2C1B3C6D;
+    hash ^= hash >> 12;
+
+    return hash % GUAC_TERMINAL_GLYPH_CACHE_SIZE;
+
+}
+
+guac_terminal_glyph_cache* guac_terminal_glyph_cache_alloc(
+        guac_client* client) {
+
+    guac_terminal_glyph_cache* cache =
+        malloc(sizeof(guac_terminal_glyph_cache));
+
+    cache->client = client;
+    cache->buffer = guac_client_alloc_buffer(client);
+    cache->surface = guac_common_surface_alloc(client, client->socket,
+            cache->buffer, 0, 0);
+
+    /* Glyphs must never be subject to lossy compression */
+    guac_common_surface_set_lossless(cache->surface, 1);
+
+    /* Buffer remains empty until glyph dimensions are known */
+    cache->char_width = 0;
+    cache->char_height = 0;
+
+    guac_terminal_glyph_cache_reset(cache, 0, 0);
+    return cache;
+
+}
+
+void guac_terminal_glyph_cache_free(guac_terminal_glyph_cache* cache) {
+
+    guac_client* client = cache->client;
+
+    /* Destroy buffer within remotely-connected client */
+    guac_protocol_send_dispose(client->socket, cache->buffer);
+
+    /* Return buffer to pool */
+    guac_common_surface_free(cache->surface);
+    guac_client_free_buffer(client, cache->buffer);
+    free(cache);
+
+}
+
+void guac_terminal_glyph_cache_reset(guac_terminal_glyph_cache* cache,
+        int char_width, int char_height) {
+
+    int i;
+
+    /* Invalidate and unpin all entries */
+    for (i = 0; i < GUAC_TERMINAL_GLYPH_CACHE_SIZE; i++) {
+        cache->entries[i].codepoint = -1;
+        cache->entries[i].batch = 0;
+    }
+
+    cache->batch = 1;
+
+    /* Resize buffer only if glyph dimensions have changed */
+    if (char_width == cache->char_width
+            && char_height == cache->char_height)
+        return;
+
+    cache->char_width = char_width;
+    cache->char_height = char_height;
+
+    guac_common_surface_resize(cache->surface,
+            char_width  * GUAC_TERMINAL_GLYPH_CACHE_COLUMNS,
+            char_height * GUAC_TERMINAL_GLYPH_CACHE_ROWS);
+
+}
+
+int guac_terminal_glyph_cache_lookup(guac_terminal_glyph_cache* cache,
+        int codepoint, const guac_terminal_color* foreground,
+        const guac_terminal_color* background, int* x, int* y) {
+
+    int index = guac_terminal_glyph_cache_hash(codepoint,
+            foreground, background);
+
+    guac_terminal_glyph_cache_entry* entry = &(cache->entries[index]);
+
+    /* Determine location of glyph within buffer */
+    *x = (index % GUAC_TERMINAL_GLYPH_CACHE_COLUMNS) * cache->char_width;
+    *y = (index / GUAC_TERMINAL_GLYPH_CACHE_COLUMNS) * cache->char_height;
+
+    /* Glyph is already cached if entry matches exactly */
+    if (entry->codepoint == codepoint
+            && guac_terminal_glyph_cache_same_color(&entry->foreground,
+                foreground)
+            && guac_terminal_glyph_cache_same_color(&entry->background,
+                background)) {
+        entry->batch = cache->batch;
+        return 1;
+    }
+
+    /* Do not replace a glyph which may still be copied by the current
+     * batch */
+    if (entry->batch == cache->batch)
+        return -1;
+
+    /* Otherwise, claim entry for the new glyph (the caller will render the
+     * glyph in place of any previous contents) */
+    entry->codepoint = codepoint;
+    entry->foreground = *foreground;
+    entry->background = *background;
+    entry->batch = cache->batch;
+
+    return 0;
+
+}
+
+void guac_terminal_glyph_cache_release(guac_terminal_glyph_cache* cache) {
+
+    int i;
+
+    /* Start a new batch, unpinning entries explicitly only if the batch
+     * counter wraps around */
+    if (++cache->batch == 0) {
+        for (i = 0; i < GUAC_TERMINAL_GLYPH_CACHE_SIZE; i++)
+            cache->entries[i].batch = 0;
+        cache->batch = 1;
+    }
+
+}
+
+void guac_terminal_glyph_cache_dup(guac_terminal_glyph_cache* cache,
+        guac_user* user, guac_socket* socket) {
+    guac_common_surface_dup(cache->surface, user, socket);
+}
+
@@ -153,16 +153,19 @@ static int guac_terminal_find_char(guac_terminal* terminal,
     if (start_column < buffer_row->length) {
 
         /* Find beginning of character */
-        guac_terminal_char* start_char = &(buffer_row->characters[start_column]);
-        while (start_column > 0 && start_char->value == GUAC_CHAR_CONTINUATION) {
-            start_char--;
+        guac_terminal_char start_char;
+        guac_terminal_buffer_get_char(terminal->buffer, buffer_row,
+                start_column, &start_char);
+        while (start_column > 0 && start_char.value == GUAC_CHAR_CONTINUATION) {
             start_column--;
+            guac_terminal_buffer_get_char(terminal->buffer, buffer_row,
+                    start_column, &start_char);
         }
 
         /* Use width, if available */
-        if (start_char->value != GUAC_CHAR_CONTINUATION) {
+        if (start_char.value != GUAC_CHAR_CONTINUATION) {
             *column = start_column;
-            return start_char->width;
+            return start_char.width;
         }
 
     }
@@ -76,7 +76,8 @@ static void __guac_terminal_set_columns(guac_terminal* terminal, int row,
  */
 static void __guac_terminal_force_break(guac_terminal* terminal, int row, int edge) {
 
-    guac_terminal_buffer_row* buffer_row = guac_terminal_buffer_get_row(terminal->buffer, row, 0);
+    guac_terminal_buffer* buffer = terminal->buffer;
+    guac_terminal_buffer_row* buffer_row = guac_terminal_buffer_get_row(buffer, row, 0);
 
     /* Ensure character to left of edge is unbroken */
     if (edge > 0) {
@@ -84,26 +85,27 @@ static void __guac_terminal_force_break(guac_terminal* terminal, int row, int ed
         int end_column = edge - 1;
         int start_column = end_column;
 
-        guac_terminal_char* start_char = &(buffer_row->characters[start_column]);
+        guac_terminal_char start_char;
+        guac_terminal_buffer_get_char(buffer, buffer_row, start_column, &start_char);
 
         /* Determine start column */
-        while (start_column > 0 && start_char->value == GUAC_CHAR_CONTINUATION) {
-            start_char--;
+        while (start_column > 0 && start_char.value == GUAC_CHAR_CONTINUATION) {
             start_column--;
+            guac_terminal_buffer_get_char(buffer, buffer_row, start_column, &start_char);
         }
 
         /* Advance to start of broken character if necessary */
-        if (start_char->value != GUAC_CHAR_CONTINUATION && start_char->width < end_column - start_column + 1) {
-            start_column += start_char->width;
-            start_char += start_char->width;
+        if (start_char.value != GUAC_CHAR_CONTINUATION && start_char.width < end_column - start_column + 1) {
+            start_column += start_char.width;
+            guac_terminal_buffer_get_char(buffer, buffer_row, start_column, &start_char);
         }
 
         /* Clear character if broken */
-        if (start_char->value == GUAC_CHAR_CONTINUATION || start_char->width != end_column - start_column + 1) {
+        if (start_char.value == GUAC_CHAR_CONTINUATION || start_char.width != end_column - start_column + 1) {
 
             guac_terminal_char cleared_char;
             cleared_char.value = ' ';
-            cleared_char.attributes = start_char->attributes;
+            cleared_char.attributes = start_char.attributes;
             cleared_char.width = 1;
 
             __guac_terminal_set_columns(terminal, row, start_column, end_column, &cleared_char);
@@ -118,27 +120,29 @@ static void __guac_terminal_force_break(guac_terminal* terminal, int row, int ed
         int start_column = edge;
         int end_column = start_column;
 
-        guac_terminal_char* start_char = &(buffer_row->characters[start_column]);
-        guac_terminal_char* end_char = &(buffer_row->characters[end_column]);
+        guac_terminal_char start_char;
+        guac_terminal_char end_char;
+        guac_terminal_buffer_get_char(buffer, buffer_row, start_column, &start_char);
+        guac_terminal_buffer_get_char(buffer, buffer_row, end_column + 1, &end_char);
 
         /* Determine end column */
-        while (end_column+1 < buffer_row->length && (end_char+1)->value == GUAC_CHAR_CONTINUATION) {
-            end_char++;
+        while (end_column+1 < buffer_row->length && end_char.value == GUAC_CHAR_CONTINUATION) {
             end_column++;
+            guac_terminal_buffer_get_char(buffer, buffer_row, end_column + 1, &end_char);
         }
 
         /* Advance to start of broken character if necessary */
-        if (start_char->value != GUAC_CHAR_CONTINUATION && start_char->width < end_column - start_column + 1) {
-            start_column += start_char->width;
-            start_char += start_char->width;
+        if (start_char.value != GUAC_CHAR_CONTINUATION && start_char.width < end_column - start_column + 1) {
+            start_column += start_char.width;
+            guac_terminal_buffer_get_char(buffer, buffer_row, start_column, &start_char);
         }
 
         /* Clear character if broken */
-        if (start_char->value == GUAC_CHAR_CONTINUATION || start_char->width != end_column - start_column + 1) {
+        if (start_char.value == GUAC_CHAR_CONTINUATION || start_char.width != end_column - start_column + 1) {
 
             guac_terminal_char cleared_char;
             cleared_char.value = ' ';
-            cleared_char.attributes = start_char->attributes;
+            cleared_char.attributes = start_char.attributes;
             cleared_char.width = 1;
 
             __guac_terminal_set_columns(terminal, row, start_column, end_column, &cleared_char);
@@ -436,6 +440,12 @@ guac_terminal* guac_terminal_create(guac_client* client,
     /* No typescript by default */
     term->typescript = NULL;
 
+    /* Output is not initially flooding */
+    term->flooding = false;
+    term->flood_window_start = guac_timestamp_current();
+    term->flood_window_bytes = 0;
+    term->last_frame_end = term->flood_window_start;
+
     /* Init terminal lock */
     pthread_mutex_init(&(term->lock), NULL);
 
@@ -612,6 +622,28 @@ wait_complete:
 
 }
 
+/**
+ * Returns whether output received by the given terminal is currently
+ * flooding. The flooding flag is updated by guac_terminal_write() while the
+ * terminal lock is held, and is thus read here under that same lock. The
+ * terminal lock must NOT already be held by the current thread.
+ *
+ * @param terminal
+ *     The terminal to check.
+ *
+ * @return
+ *     true if output received by the terminal is flooding, false otherwise.
+ */
+static bool guac_terminal_is_flooding(guac_terminal* terminal) {
+
+    guac_terminal_lock(terminal);
+    bool flooding = terminal->flooding;
+    guac_terminal_unlock(terminal);
+
+    return flooding;
+
+}
+
 int guac_terminal_render_frame(guac_terminal* terminal) {
 
     guac_client* client = terminal->client;
@@ -622,6 +654,7 @@ int guac_terminal_render_frame(guac_terminal* terminal) {
     wait_result = guac_terminal_wait(terminal, 1000);
     if (wait_result || !terminal->started) {
 
+        int processing_lag = guac_client_get_processing_lag(client);
         guac_timestamp frame_start = guac_timestamp_current();
 
         do {
@@ -631,8 +664,18 @@ int guac_terminal_render_frame(guac_terminal* terminal) {
             int frame_remaining = frame_start + GUAC_TERMINAL_FRAME_DURATION
                                 - frame_end;
 
+            /* Calculate time that client needs to catch up */
+            int time_elapsed = frame_end - terminal->last_frame_end;
+            int required_wait = processing_lag - time_elapsed;
+
+            /* Skip intermediate frames of flooding output if client is
+             * lagging */
+            if (terminal->started && guac_terminal_is_flooding(terminal)
+                    && required_wait > GUAC_TERMINAL_FRAME_TIMEOUT)
+                wait_result = guac_terminal_wait(terminal, required_wait);
+
             /* Wait again if frame remaining */
-            if (frame_remaining > 0 || !terminal->started)
+            else if (frame_remaining > 0 || !terminal->started)
                 wait_result = guac_terminal_wait(terminal,
                         GUAC_TERMINAL_FRAME_TIMEOUT);
             else
@@ -646,12 +689,36 @@ int guac_terminal_render_frame(guac_terminal* terminal) {
         guac_terminal_flush(terminal);
         guac_terminal_unlock(terminal);
 
+        /* Record end of frame, excluding the time spent building the frame */
+        terminal->last_frame_end = frame_start;
+
     }
 
     return 0;
 
 }
 
+void guac_terminal_wait_for_client(guac_terminal* terminal) {
+
+    guac_client* client = terminal->client;
+    guac_timestamp wait_start = guac_timestamp_current();
+
+    /* Delay only while output is flooding and the client is lagging */
+    while (client->state == GUAC_CLIENT_RUNNING
+            && guac_terminal_is_flooding(terminal)
+            && guac_client_get_processing_lag(client) > GUAC_TERMINAL_MAX_LAG) {
+
+        /* Give up waiting if the client is not catching up */
+        if (guac_timestamp_current() - wait_start
+                >= GUAC_TERMINAL_MAX_BACKPRESSURE)
+            break;
+
+        guac_timestamp_msleep(GUAC_TERMINAL_FRAME_DURATION);
+
+    }
+
+}
+
 int guac_terminal_read_stdin(guac_terminal* terminal, char* c, int size) {
     int stdin_fd = terminal->stdin_pipe_fd[0];
     return read(stdin_fd, c, size);
@@ -774,9 +841,51 @@ int guac_terminal_set(guac_terminal* term, int row, int col, int codepoint) {
 
 }
 
+void guac_terminal_set_text(guac_terminal* term, int row, int col,
+        const char* text, int length) {
+
+    int end_column = col + length - 1;
+
+    if (length <= 0)
+        return;
+
+    guac_terminal_display_set_text(term->display, row + term->scroll_offset,
+            col, text, length, &term->current_attributes);
+
+    guac_terminal_buffer_set_text(term->buffer, row, col, text, length,
+            &term->current_attributes);
+
+    /* Clear selection if region is modified */
+    guac_terminal_select_touch(term, row, col, row, end_column);
+
+    /* If visible cursor in current row, preserve state */
+    if (row == term->visible_cursor_row
+            && term->visible_cursor_col >= col
+            && term->visible_cursor_col <= end_column) {
+
+        /* Create copy of character with cursor attribute set */
+        guac_terminal_char cursor_character = {
+            .value      = (unsigned char) text[term->visible_cursor_col - col],
+            .attributes = term->current_attributes,
+            .width      = 1
+        };
+        cursor_character.attributes.cursor = true;
+
+        __guac_terminal_set_columns(term, row,
+                term->visible_cursor_col, term->visible_cursor_col, &cursor_character);
+
+    }
+
+    /* Force breaks around destination region (every character within the
+     * region is a single column wide, and thus cannot be broken) */
+    __guac_terminal_force_break(term, row, col);
+    __guac_terminal_force_break(term, row, end_column + 1);
+
+}
+
 void guac_terminal_commit_cursor(guac_terminal* term) {
 
-    guac_terminal_char* guac_char;
+    guac_terminal_char guac_char;
 
     guac_terminal_buffer_row* row;
 
@@ -789,10 +898,11 @@ void guac_terminal_commit_cursor(guac_terminal* term) {
         /* Get old row with cursor */
         row = guac_terminal_buffer_get_row(term->buffer, term->visible_cursor_row, term->visible_cursor_col+1);
 
-        guac_char = &(row->characters[term->visible_cursor_col]);
-        guac_char->attributes.cursor = false;
+        guac_terminal_buffer_get_char(term->buffer, row, term->visible_cursor_col, &guac_char);
+        guac_char.attributes.cursor = false;
+        guac_terminal_buffer_set_char(term->buffer, row, term->visible_cursor_col, &guac_char);
         guac_terminal_display_set_columns(term->display, term->visible_cursor_row + term->scroll_offset,
-                term->visible_cursor_col, term->visible_cursor_col, guac_char);
+                term->visible_cursor_col, term->visible_cursor_col, &guac_char);
     }
 
     /* Set cursor if should be visible */
@@ -800,10 +910,11 @@ void guac_terminal_commit_cursor(guac_terminal* term) {
         /* Get new row with cursor */
         row = guac_terminal_buffer_get_row(term->buffer, term->cursor_row, term->cursor_col+1);
 
-        guac_char = &(row->characters[term->cursor_col]);
-        guac_char->attributes.cursor = true;
+        guac_terminal_buffer_get_char(term->buffer, row, term->cursor_col, &guac_char);
+        guac_char.attributes.cursor = true;
+        guac_terminal_buffer_set_char(term->buffer, row, term->cursor_col, &guac_char);
         guac_terminal_display_set_columns(term->display, term->cursor_row + term->scroll_offset,
-                term->cursor_col, term->cursor_col, guac_char);
+                term->cursor_col, term->cursor_col, &guac_char);
 
         term->visible_cursor_row = term->cursor_row;
         term->visible_cursor_col = term->cursor_col;
@@ -819,23 +930,77 @@ void guac_terminal_commit_cursor(guac_terminal* term) {
 
 }
 
+/**
+ * Updates the measured rate of output received by the given terminal,
+ * entering or leaving flood mode as necessary. While in flood mode, updates
+ * to the display are deferred until the end of the current frame.
+ *
+ * @param term
+ *     The terminal receiving output.
+ *
+ * @param length
+ *     The number of bytes of output received.
+ */
+static void __guac_terminal_track_flood(guac_terminal* term, int length) {
+
+    guac_timestamp now = guac_timestamp_current();
+    int elapsed = now - term->flood_window_start;
+
+    /* Begin a new window once the current window has elapsed, remaining in
+     * flood mode only if the rate of output over that window was
+     * sufficiently high */
+    if (elapsed >= GUAC_TERMINAL_FLOOD_WINDOW) {
+        term->flooding = term->flood_window_bytes >=
+            (int64_t) GUAC_TERMINAL_FLOOD_THRESHOLD * elapsed
+                    / GUAC_TERMINAL_FLOOD_WINDOW;
+        term->flood_window_start = now;
+        term->flood_window_bytes = 0;
+    }
+
+    /* Enter flood mode as soon as the threshold is reached */
+    term->flood_window_bytes += length;
+    if (term->flood_window_bytes >= GUAC_TERMINAL_FLOOD_THRESHOLD)
+        term->flooding = true;
+
+    /* Defer display updates until end of frame while flooding */
+    if (term->flooding)
+        guac_terminal_display_defer(term->display);
+
+}
+
 int guac_terminal_write(guac_terminal* term, const char* c, int size) {
 
     guac_terminal_lock(term);
+
+    /* Detect floods of output */
+    __guac_terminal_track_flood(term, size);
+
+    /* Write all data to typescript, if any */
+    if (term->typescript != NULL)
+        guac_terminal_typescript_write_data(term->typescript, c, size);
+
     while (size > 0) {
 
         /* Read and advance to next character */
         char current = *(c++);
         size--;
 
-        /* Write character to typescript, if any */
-        if (term->typescript != NULL)
-            guac_terminal_typescript_write(term->typescript, current);
+        /* Note whether character is handled as ordinary output */
+        bool echo = (term->char_handler == guac_terminal_echo);
 
         /* Handle character and its meaning */
         term->char_handler(term, current);
 
+        /* Handle any printable characters which immediately follow printable
+         * output in bulk */
+        if (echo && current >= 0x20 && current < 0x7F) {
+            int handled = guac_terminal_echo_text(term, c, size);
+            c += handled;
+            size -= handled;
+        }
+
     }
+
     guac_terminal_unlock(term);
 
     guac_terminal_notify(term);
@@ -853,13 +1018,8 @@ int guac_terminal_scroll_up(guac_terminal* term,
         guac_terminal_display_copy_rows(term->display, start_row + amount, end_row, -amount);
 
         /* Advance by scroll amount */
-        term->buffer->top += amount;
-        if (term->buffer->top >= term->buffer->available)
-            term->buffer->top -= term->buffer->available;
-
-        term->buffer->length += amount;
-        if (term->buffer->length > term->buffer->available)
-            term->buffer->length = term->buffer->available;
+        guac_terminal_buffer_scroll_up(term->buffer, amount,
+                term->term_height);
 
         /* Reset scrollbar bounds */
         guac_terminal_scrollbar_set_bounds(term->scrollbar,
@@ -1045,14 +1205,15 @@ void guac_terminal_scroll_display_down(guac_terminal* terminal,
                 dest_row, 0, terminal->display->width, &(terminal->default_char));
 
         /* Draw row */
-        guac_terminal_char* current = buffer_row->characters;
         for (column=0; column<buffer_row->length; column++) {
 
-            /* Only draw if not blank */
-            if (guac_terminal_is_visible(terminal, current))
-                guac_terminal_display_set_columns(terminal->display, dest_row, column, column, current);
+            guac_terminal_char current;
+            guac_terminal_buffer_get_char(terminal->buffer, buffer_row,
+                    column, &current);
 
-            current++;
+            /* Only draw if not blank */
+            if (guac_terminal_is_visible(terminal, &current))
+                guac_terminal_display_set_columns(terminal->display, dest_row, column, column, &current);
 
         }
 
@@ -1108,14 +1269,15 @@ void guac_terminal_scroll_display_up(guac_terminal* terminal,
                 dest_row, 0, terminal->display->width, &(terminal->default_char));
 
         /* Draw row */
-        guac_terminal_char* current = buffer_row->characters;
         for (column=0; column<buffer_row->length; column++) {
 
-            /* Only draw if not blank */
-            if (guac_terminal_is_visible(terminal, current))
-                guac_terminal_display_set_columns(terminal->display, dest_row, column, column, current);
+            guac_terminal_char current;
+            guac_terminal_buffer_get_char(terminal->buffer, buffer_row,
+                    column, &current);
 
-            current++;
+            /* Only draw if not blank */
+            if (guac_terminal_is_visible(terminal, &current))
+                guac_terminal_display_set_columns(terminal->display, dest_row, column, column, &current);
 
         }
 
@@ -1215,9 +1377,10 @@ static void __guac_terminal_redraw_rect(guac_terminal* term, int start_row, int
         for (col=start_col; col <= end_col && col < buffer_row->length; col++) {
 
             /* Only redraw if not blank */
-            guac_terminal_char* c = &(buffer_row->characters[col]);
-            if (guac_terminal_is_visible(term, c))
-                guac_terminal_display_set_columns(term->display, row, col, col, c);
+            guac_terminal_char c;
+            guac_terminal_buffer_get_char(term->buffer, buffer_row, col, &c);
+            if (guac_terminal_is_visible(term, &c))
+                guac_terminal_display_set_columns(term->display, row, col, col, &c);
 
         }
 
@@ -1225,12 +1388,32 @@ static void __guac_terminal_redraw_rect(guac_terminal* term, int start_row, int
 
 }
 
+/**
+ * Applies any display updates which were deferred while output was flooding,
+ * scrolling the display by the total amount it was scrolled while deferred
+ * and then redrawing every visible character from the terminal buffer. If
+ * display updates were not deferred, this function has no effect.
+ *
+ * @param term
+ *     The terminal whose display should be brought up to date.
+ */
+static void guac_terminal_resume_display(guac_terminal* term) {
+
+    if (guac_terminal_display_resume(term->display))
+        __guac_terminal_redraw_rect(term, 0, 0,
+                term->term_height - 1, term->term_width - 1);
+
+}
+
 /**
  * Internal terminal resize routine. Accepts width/height in CHARACTERS
  * (not pixels like the public function).
  */
 static void __guac_terminal_resize(guac_terminal* term, int width, int height) {
 
+    /* Apply any deferred display updates before the display changes size */
+    guac_terminal_resume_display(term);
+
     /* If height is decreasing, shift display up */
     if (height < term->term_height) {
 
@@ -1423,6 +1606,7 @@ void guac_terminal_flush(guac_terminal* terminal) {
     /* Flush display state */
     guac_terminal_select_redraw(terminal);
     guac_terminal_commit_cursor(terminal);
+    guac_terminal_resume_display(terminal);
     guac_terminal_display_flush(terminal->display);
     guac_terminal_scrollbar_flush(terminal->scrollbar);
 
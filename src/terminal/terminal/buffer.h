@@ -25,15 +25,83 @@
 
 #include "types.h"
 
+#include <stdint.h>
+
+/**
+ * The number of distinct sets of attributes which may be interned by a newly-
+ * allocated buffer before the table of interned attributes must grow.
+ */
+#define GUAC_TERMINAL_BUFFER_INITIAL_ATTRIBUTES 64
+
+/**
+ * The number of interned sets of attributes beyond which a buffer will first
+ * attempt to discard unused attributes before growing its table of interned
+ * attributes further.
+ */
+#define GUAC_TERMINAL_BUFFER_COMPACT_ATTRIBUTES 4096
+
+/**
+ * The number of scrollback rows immediately above the visible area of the
+ * terminal which are always kept uncompressed. Scrollback rows beyond these
+ * are compressed as they scroll out of this region, and are decompressed
+ * again only when accessed.
+ */
+#define GUAC_TERMINAL_BUFFER_HOT_ROWS 256
+
+/**
+ * A single character cell, as stored within a guac_terminal_buffer. Rather
+ * than storing the full guac_terminal_attributes of each character, the
+ * attributes of each stored character are interned within the buffer and
+ * referenced by index, such that each cell occupies only 8 bytes.
+ */
+typedef struct guac_terminal_buffer_char {
+
+    /**
+     * The Unicode codepoint of the character, or GUAC_CHAR_CONTINUATION if
+     * this character is part of another character which spans multiple
+     * columns.
+     */
+    signed int value : 24;
+
+    /**
+     * The number of columns this character occupies.
+     */
+    unsigned int width : 8;
+
+    /**
+     * The index of the attributes of this character within the attributes
+     * interned by the buffer.
+     */
+    uint32_t attributes;
+
+} guac_terminal_buffer_char;
+
 /**
  * A single variable-length row of terminal data.
  */
 typedef struct guac_terminal_buffer_row {
 
     /**
-     * Array of guac_terminal_char representing the contents of the row.
+     * Array of guac_terminal_buffer_char representing the contents of the
+     * row. This array is allocated only once the row is first written, and
+     * may be NULL if the row has never contained any characters or if the
+     * row is currently compressed.
      */
-    guac_terminal_char* characters;
+    guac_terminal_buffer_char* characters;
+
+    /**
+     * The compressed contents of the row, or NULL if the row is not
+     * compressed. While a row is compressed, its characters array is NULL,
+     * and its length remains the length of the row prior to compression.
+     * Compressed rows are decompressed automatically by
+     * guac_terminal_buffer_get_row().
+     */
+    unsigned char* compressed;
+
+    /**
+     * The size of the compressed contents of the row, in bytes.
+     */
+    int compressed_length;
 
     /**
      * The length of this row in characters. This is the number of initialized
@@ -62,6 +130,64 @@ typedef struct guac_terminal_buffer {
      */
     guac_terminal_char default_character;
 
+    /**
+     * The packed equivalent of default_character, assigned to
+     * newly-allocated cells.
+     */
+    guac_terminal_buffer_char default_packed;
+
+    /**
+     * All distinct sets of attributes used by stored characters, indexed by
+     * the attributes field of each guac_terminal_buffer_char.
+     */
+    guac_terminal_attributes* attributes;
+
+    /**
+     * The number of sets of attributes currently interned.
+     */
+    int attributes_length;
+
+    /**
+     * The number of elements in the attributes array. This is always a
+     * power of two.
+     */
+    int attributes_available;
+
+    /**
+     * Open-addressed hash table of the interned attributes, having twice as
+     * many entries as the attributes array. Each entry is one greater than
+     * the index of the corresponding attributes, or zero if the entry is
+     * empty.
+     */
+    uint32_t* attributes_table;
+
+    /**
+     * The indices of all rows within the rows array which were decompressed
+     * on demand since the last call to guac_terminal_buffer_scroll_up(), and
+     * which may need to be compressed again.
+     */
+    int* thawed;
+
+    /**
+     * The number of entries currently stored within the thawed array.
+     */
+    int thawed_length;
+
+    /**
+     * The number of elements in the thawed array.
+     */
+    int thawed_available;
+
+    /**
+     * Scratch space for compressing rows.
+     */
+    unsigned char* scratch;
+
+    /**
+     * The size of the scratch space, in bytes.
+     */
+    int scratch_size;
+
     /**
      * Array of buffer rows. This array functions as a ring buffer.
      * When a new row needs to be appended, the top reference is moved down
@@ -103,10 +229,81 @@ void guac_terminal_buffer_free(guac_terminal_buffer* buffer);
 
 /**
  * Returns the row at the given location. The row returned is guaranteed to be at least the given
- * width.
+ * width. If the row is compressed, it is decompressed first.
  */
 guac_terminal_buffer_row* guac_terminal_buffer_get_row(guac_terminal_buffer* buffer, int row, int width);
 
+/**
+ * Retrieves the character stored within the given column of the given row,
+ * unpacking its attributes. If the row is not long enough to contain the
+ * given column, the buffer's default character is retrieved instead.
+ *
+ * @param buffer
+ *     The buffer containing the given row.
+ *
+ * @param row
+ *     The row to retrieve the character from, as returned by
+ *     guac_terminal_buffer_get_row().
+ *
+ * @param column
+ *     The column of the character to retrieve.
+ *
+ * @param character
+ *     The guac_terminal_char to populate with the retrieved character.
+ */
+void guac_terminal_buffer_get_char(guac_terminal_buffer* buffer,
+        guac_terminal_buffer_row* row, int column,
+        guac_terminal_char* character);
+
+/**
+ * Replaces the character stored within the given column of the given row.
+ * Unlike guac_terminal_buffer_set_columns(), no continuation characters are
+ * written, and the length of the buffer is not updated. The row must
+ * already be long enough to contain the given column.
+ *
+ * @param buffer
+ *     The buffer containing the given row.
+ *
+ * @param row
+ *     The row to store the character within, as returned by
+ *     guac_terminal_buffer_get_row().
+ *
+ * @param column
+ *     The column of the character to replace.
+ *
+ * @param character
+ *     The character to store.
+ */
+void guac_terminal_buffer_set_char(guac_terminal_buffer* buffer,
+        guac_terminal_buffer_row* row, int column,
+        guac_terminal_char* character);
+
+/**
+ * Scrolls the contents of the buffer up by the given number of rows,
+ * advancing the top of the buffer and the number of rows stored. Any
+ * scrollback rows which leave the GUAC_TERMINAL_BUFFER_HOT_ROWS rows
+ * immediately above the visible area as a result, and any such rows
+ * decompressed on demand since the last scroll, are compressed. The
+ * previous contents of the rows which become the bottom of the visible area
+ * are undefined (typically the oldest scrollback, which may be discarded),
+ * and must be cleared by the caller.
+ *
+ * No row previously returned by guac_terminal_buffer_get_row() may be used
+ * after this function has been invoked.
+ *
+ * @param buffer
+ *     The buffer to scroll.
+ *
+ * @param amount
+ *     The number of rows to scroll by.
+ *
+ * @param height
+ *     The number of rows currently visible within the terminal, all of
+ *     which will be left uncompressed.
+ */
+void guac_terminal_buffer_scroll_up(guac_terminal_buffer* buffer, int amount,
+        int height);
+
 /**
  * Copies the given range of columns to a new location, offset from
  * the original by the given number of columns.
@@ -128,5 +325,34 @@ void guac_terminal_buffer_copy_rows(guac_terminal_buffer* buffer,
 void guac_terminal_buffer_set_columns(guac_terminal_buffer* buffer, int row,
         int start_column, int end_column, guac_terminal_char* character);
 
+/**
+ * Sets consecutive columns within the given row to the given printable ASCII
+ * characters, all sharing the given attributes. This is equivalent to
+ * invoking guac_terminal_buffer_set_columns() for each character, but
+ * interns the attributes and locates the row only once.
+ *
+ * @param buffer
+ *     The buffer to modify.
+ *
+ * @param row
+ *     The row to modify.
+ *
+ * @param start_column
+ *     The column receiving the first character.
+ *
+ * @param text
+ *     The printable ASCII characters to store. Each character occupies
+ *     exactly one column.
+ *
+ * @param length
+ *     The number of characters to store.
+ *
+ * @param attributes
+ *     The attributes to assign to every stored character.
+ */
+void guac_terminal_buffer_set_text(guac_terminal_buffer* buffer, int row,
+        int start_column, const char* text, int length,
+        guac_terminal_attributes* attributes);
+
 #endif
 
@@ -24,6 +24,7 @@
 #include "config.h"
 
 #include "common/surface.h"
+#include "glyph-cache.h"
 #include "palette.h"
 #include "types.h"
 
@@ -80,13 +81,15 @@ typedef struct guac_terminal_operation {
 
     /**
      * The row to copy a character from. This is only applicable to
-     * GUAC_CHAR_COPY.
+     * GUAC_CHAR_COPY. While a GUAC_CHAR_SET operation is being flushed, this
+     * is instead the Y coordinate of its glyph within the glyph cache.
      */
     int row;
 
     /**
      * The column to copy a character from. This is only applicable to
-     * GUAC_CHAR_COPY.
+     * GUAC_CHAR_COPY. While a GUAC_CHAR_SET operation is being flushed, this
+     * is instead the X coordinate of its glyph within the glyph cache.
      */
     int column;
 
@@ -171,11 +174,31 @@ typedef struct guac_terminal_display {
      */
     guac_common_surface* display_surface;
 
+    /**
+     * Cache of previously-rendered glyphs, from which repeated characters
+     * are copied rather than rendered again.
+     */
+    guac_terminal_glyph_cache* glyph_cache;
+
     /**
      * Layer which contains the actual terminal.
      */
     guac_layer* display_layer;
 
+    /**
+     * Whether updates to the display are currently being deferred. While
+     * deferred, all changes to characters are ignored and scrolling of the
+     * entire display is coalesced into deferred_scroll. The display must be
+     * redrawn in its entirety once guac_terminal_display_resume() is called.
+     */
+    bool deferred;
+
+    /**
+     * The total number of rows that the entire display has been scrolled up
+     * while updates have been deferred.
+     */
+    int deferred_scroll;
+
     /**
      * Sub-layer of display layer which highlights selected text.
      */
@@ -292,6 +315,61 @@ void guac_terminal_display_copy_rows(guac_terminal_display* display,
 void guac_terminal_display_set_columns(guac_terminal_display* display, int row,
         int start_column, int end_column, guac_terminal_char* character);
 
+/**
+ * Sets consecutive columns within the given row to the given printable ASCII
+ * characters, all sharing the given attributes. This is equivalent to
+ * invoking guac_terminal_display_set_columns() for each character.
+ *
+ * @param display
+ *     The display to modify.
+ *
+ * @param row
+ *     The row to modify.
+ *
+ * @param start_column
+ *     The column receiving the first character.
+ *
+ * @param text
+ *     The printable ASCII characters to set. Each character occupies exactly
+ *     one column.
+ *
+ * @param length
+ *     The number of characters to set.
+ *
+ * @param attributes
+ *     The attributes to assign to every character.
+ */
+void guac_terminal_display_set_text(guac_terminal_display* display, int row,
+        int start_column, const char* text, int length,
+        guac_terminal_attributes* attributes);
+
+/**
+ * Begins deferring updates to the given display. Until
+ * guac_terminal_display_resume() is invoked, all changes to characters are
+ * ignored, and any number of scrolls of the entire display are coalesced into
+ * a single copy. If updates are already being deferred, this function has no
+ * effect.
+ *
+ * @param display
+ *     The display whose updates should be deferred.
+ */
+void guac_terminal_display_defer(guac_terminal_display* display);
+
+/**
+ * Stops deferring updates to the given display, applying any coalesced
+ * scrolling of the entire display as a single copy. As all other changes made
+ * while updates were deferred have been ignored, the caller must then redraw
+ * every character of the display.
+ *
+ * @param display
+ *     The display whose updates should no longer be deferred.
+ *
+ * @return
+ *     Non-zero if updates to the display had been deferred and the entire
+ *     display must now be redrawn, zero otherwise.
+ */
+int guac_terminal_display_resume(guac_terminal_display* display);
+
 /**
  * Resize the terminal to the given dimensions.
  */
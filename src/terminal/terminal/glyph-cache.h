@@ -0,0 +1,244 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef GUAC_TERMINAL_GLYPH_CACHE_H
+#define GUAC_TERMINAL_GLYPH_CACHE_H
+
+#include "config.h"
+
+#include "common/surface.h"
+#include "palette.h"
+
+#include <guacamole/client.h>
+#include <guacamole/layer.h>
+#include <guacamole/socket.h>
+#include <guacamole/user.h>
+
+/**
+ * The number of glyphs stored along each row of the glyph cache's off-screen
+ * buffer.
+ */
+#define GUAC_TERMINAL_GLYPH_CACHE_COLUMNS 32
+
+/**
+ * The number of rows of glyphs stored within the glyph cache's off-screen
+ * buffer.
+ */
+#define GUAC_TERMINAL_GLYPH_CACHE_ROWS 16
+
+/**
+ * The total number of glyphs which may be stored within the glyph cache at
+ * any one time.
+ */
+#define GUAC_TERMINAL_GLYPH_CACHE_SIZE \
+    (GUAC_TERMINAL_GLYPH_CACHE_COLUMNS * GUAC_TERMINAL_GLYPH_CACHE_ROWS)
+
+/**
+ * A single glyph stored within the glyph cache, identified by its codepoint
+ * and the effective colors it was rendered with.
+ */
+typedef struct guac_terminal_glyph_cache_entry {
+
+    /**
+     * The Unicode codepoint of the rendered glyph, or -1 if this entry is
+     * unused.
+     */
+    int codepoint;
+
+    /**
+     * The foreground color the glyph was rendered with. Only the red, green,
+     * and blue components are significant.
+     */
+    guac_terminal_color foreground;
+
+    /**
+     * The background color the glyph was rendered with. Only the red, green,
+     * and blue components are significant.
+     */
+    guac_terminal_color background;
+
+    /**
+     * The batch during which this entry was last returned by
+     * guac_terminal_glyph_cache_lookup(). If equal to the current batch of
+     * the cache, a copy of this glyph may still be pending, and the entry
+     * must not be replaced until guac_terminal_glyph_cache_release() has
+     * been invoked.
+     */
+    unsigned int batch;
+
+} guac_terminal_glyph_cache_entry;
+
+/**
+ * A direct-mapped cache of previously-rendered single-column glyphs, stored
+ * within an off-screen Guacamole buffer such that drawing a cached glyph
+ * requires only a copy from that buffer, rather than rendering and encoding
+ * the glyph again.
+ */
+typedef struct guac_terminal_glyph_cache {
+
+    /**
+     * The client owning the off-screen buffer used by this cache.
+     */
+    guac_client* client;
+
+    /**
+     * The off-screen buffer containing all cached glyphs.
+     */
+    guac_layer* buffer;
+
+    /**
+     * The surface wrapping the off-screen buffer containing all cached
+     * glyphs.
+     */
+    guac_common_surface* surface;
+
+    /**
+     * The width of each cached glyph, in pixels.
+     */
+    int char_width;
+
+    /**
+     * The height of each cached glyph, in pixels.
+     */
+    int char_height;
+
+    /**
+     * The current batch of lookups. Entries returned by
+     * guac_terminal_glyph_cache_lookup() are pinned to this batch until
+     * guac_terminal_glyph_cache_release() is invoked.
+     */
+    unsigned int batch;
+
+    /**
+     * All entries within the cache. The glyph for the entry at index i is
+     * stored within the off-screen buffer at column
+     * (i % GUAC_TERMINAL_GLYPH_CACHE_COLUMNS) and row
+     * (i / GUAC_TERMINAL_GLYPH_CACHE_COLUMNS).
+     */
+    guac_terminal_glyph_cache_entry entries[GUAC_TERMINAL_GLYPH_CACHE_SIZE];
+
+} guac_terminal_glyph_cache;
+
+/**
+ * Allocates a new, empty glyph cache, including its off-screen buffer. The
+ * cache will not be usable until its glyph dimensions have been set with
+ * guac_terminal_glyph_cache_reset().
+ *
+ * @param client
+ *     The client which should own the off-screen buffer of the cache.
+ *
+ * @return
+ *     A newly-allocated glyph cache.
+ */
+guac_terminal_glyph_cache* guac_terminal_glyph_cache_alloc(
+        guac_client* client);
+
+/**
+ * Frees the given glyph cache, including its off-screen buffer.
+ *
+ * @param cache
+ *     The glyph cache to free.
+ */
+void guac_terminal_glyph_cache_free(guac_terminal_glyph_cache* cache);
+
+/**
+ * Removes all glyphs from the given cache and resizes its off-screen buffer
+ * to fit glyphs having the given dimensions. This must be invoked whenever
+ * the font used to render glyphs changes.
+ *
+ * @param cache
+ *     The glyph cache to reset.
+ *
+ * @param char_width
+ *     The width of each glyph, in pixels.
+ *
+ * @param char_height
+ *     The height of each glyph, in pixels.
+ */
+void guac_terminal_glyph_cache_reset(guac_terminal_glyph_cache* cache,
+        int char_width, int char_height);
+
+/**
+ * Locates the cache entry for the glyph having the given codepoint and
+ * colors. If the glyph is not yet cached, the entry it maps to is claimed
+ * for that glyph, replacing whatever glyph was previously stored there, and
+ * the caller must render the glyph into the cache's surface at the returned
+ * location. The entry is then pinned until guac_terminal_glyph_cache_release()
+ * is invoked, such that copies of many glyphs may be deferred until all
+ * newly-rendered glyphs have been sent. If the entry is already pinned by a
+ * different glyph, it is left untouched, and the caller must first send any
+ * pending copies and release the cache.
+ *
+ * @param cache
+ *     The glyph cache to search.
+ *
+ * @param codepoint
+ *     The Unicode codepoint of the glyph.
+ *
+ * @param foreground
+ *     The foreground color of the glyph.
+ *
+ * @param background
+ *     The background color of the glyph.
+ *
+ * @param x
+ *     Pointer to an int which will receive the X coordinate of the glyph
+ *     within the cache's surface, in pixels.
+ *
+ * @param y
+ *     Pointer to an int which will receive the Y coordinate of the glyph
+ *     within the cache's surface, in pixels.
+ *
+ * @return
+ *     A positive value if the glyph is already present within the cache,
+ *     zero if the glyph must be rendered by the caller, or a negative value
+ *     if the entry for the glyph is pinned by a different glyph.
+ */
+int guac_terminal_glyph_cache_lookup(guac_terminal_glyph_cache* cache,
+        int codepoint, const guac_terminal_color* foreground,
+        const guac_terminal_color* background, int* x, int* y);
+
+/**
+ * Unpins all entries returned by guac_terminal_glyph_cache_lookup() since
+ * the last call to this function. This must be invoked once the copies of
+ * all those glyphs have been sent.
+ *
+ * @param cache
+ *     The glyph cache to release.
+ */
+void guac_terminal_glyph_cache_release(guac_terminal_glyph_cache* cache);
+
+/**
+ * Synchronizes the off-screen buffer of the given glyph cache with the given
+ * user, such that glyphs already cached may be copied from that buffer.
+ *
+ * @param cache
+ *     The glyph cache to synchronize.
+ *
+ * @param user
+ *     The user to synchronize.
+ *
+ * @param socket
+ *     The socket over which the cached glyphs should be sent.
+ */
+void guac_terminal_glyph_cache_dup(guac_terminal_glyph_cache* cache,
+        guac_user* user, guac_socket* socket);
+
+#endif
+
@@ -36,6 +36,7 @@
 
 #include <guacamole/client.h>
 #include <guacamole/stream.h>
+#include <guacamole/timestamp.h>
 
 /**
  * The absolute maximum number of rows to allow within the display.
@@ -59,6 +60,33 @@
  */
 #define GUAC_TERMINAL_FRAME_TIMEOUT 10
 
+/**
+ * The duration of the window over which the rate of terminal output is
+ * measured to detect a flood of output, in milliseconds.
+ */
+#define GUAC_TERMINAL_FLOOD_WINDOW 250
+
+/**
+ * The number of bytes of output which must be received within a single
+ * GUAC_TERMINAL_FLOOD_WINDOW for that output to be considered a flood. While
+ * output is flooding, changes to the display are deferred until the end of
+ * each frame, with intermediate scrolling coalesced into a single copy.
+ */
+#define GUAC_TERMINAL_FLOOD_THRESHOLD 65536
+
+/**
+ * The maximum processing lag tolerated while output is flooding before reads
+ * of further output are delayed by guac_terminal_wait_for_client(), in
+ * milliseconds.
+ */
+#define GUAC_TERMINAL_MAX_LAG 100
+
+/**
+ * The maximum amount of time that a single call to
+ * guac_terminal_wait_for_client() will block, in milliseconds.
+ */
+#define GUAC_TERMINAL_MAX_BACKPRESSURE 1000
+
 /**
  * The maximum number of custom tab stops.
  */
@@ -189,6 +217,29 @@ struct guac_terminal {
      */
     pthread_cond_t modified_cond;
 
+    /**
+     * Whether output is currently being received at a rate high enough to be
+     * considered a flood (see GUAC_TERMINAL_FLOOD_THRESHOLD). This flag may
+     * only be accessed while the terminal lock is held.
+     */
+    bool flooding;
+
+    /**
+     * The time at which the current output rate measurement window began.
+     */
+    guac_timestamp flood_window_start;
+
+    /**
+     * The number of bytes of output received since flood_window_start.
+     */
+    int flood_window_bytes;
+
+    /**
+     * The time at which the most recent frame was rendered, excluding the
+     * time spent building that frame.
+     */
+    guac_timestamp last_frame_end;
+
     /**
      * Pipe which will be the source of user input. When a terminal code
      * generates synthesized user input, that data will be written to
@@ -628,6 +679,19 @@ void guac_terminal_free(guac_terminal* term);
  */
 int guac_terminal_render_frame(guac_terminal* terminal);
 
+/**
+ * Blocks while output received by the terminal is flooding and the users of
+ * the terminal are lagging behind the stream of frames, up to a maximum of
+ * GUAC_TERMINAL_MAX_BACKPRESSURE milliseconds. Protocol implementations
+ * should invoke this function prior to reading further output from the
+ * remote server, such that the server is slowed to a rate the client can
+ * handle.
+ *
+ * @param terminal
+ *     The terminal whose users may be lagging.
+ */
+void guac_terminal_wait_for_client(guac_terminal* terminal);
+
 /**
  * Reads from this terminal's STDIN. Input comes from key and mouse events
  * supplied by calls to guac_terminal_send_key(),
@@ -850,6 +914,31 @@ int guac_terminal_write(guac_terminal* term, const char* c, int size);
  */
 int guac_terminal_set(guac_terminal* term, int row, int col, int codepoint);
 
+/**
+ * Sets consecutive columns within the given row to the given printable ASCII
+ * characters, using the current attributes of the terminal. This is
+ * equivalent to invoking guac_terminal_set() for each character, but updates
+ * the terminal buffer and display in bulk. All characters must fit within
+ * the given row.
+ *
+ * @param term
+ *     The terminal to modify.
+ *
+ * @param row
+ *     The row to modify.
+ *
+ * @param col
+ *     The column receiving the first character.
+ *
+ * @param text
+ *     The printable ASCII characters to set.
+ *
+ * @param length
+ *     The number of characters to set.
+ */
+void guac_terminal_set_text(guac_terminal* term, int row, int col,
+        const char* text, int length);
+
 /**
  * Clears the given region within a single row.
  */
@@ -38,6 +38,31 @@
  */
 int guac_terminal_echo(guac_terminal* term, unsigned char c);
 
+/**
+ * Handles the longest run of printable ASCII characters at the beginning of
+ * the given data exactly as guac_terminal_echo() would handle each character
+ * individually, but writing the run to the terminal in bulk. If the terminal
+ * is not in a state where each such character would simply be displayed (a
+ * pipe stream is open, a character mapping is active, or insert mode is
+ * enabled), no characters are handled. This function must only be invoked
+ * when guac_terminal_echo() is the current character handler and has just
+ * handled a printable ASCII character.
+ *
+ * @param term
+ *     The terminal that received the given data.
+ *
+ * @param text
+ *     The data received by the given terminal.
+ *
+ * @param length
+ *     The number of bytes of data received.
+ *
+ * @return
+ *     The number of bytes handled, which may be zero.
+ */
+int guac_terminal_echo_text(guac_terminal* term, const char* text,
+        int length);
+
 /**
  * Handles any characters which follow an ANSI ESC (0x1B) character.
  *
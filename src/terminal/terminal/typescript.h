@@ -148,18 +148,20 @@ guac_terminal_typescript* guac_terminal_typescript_alloc(const char* path,
         const char* name, int create_path);
 
 /**
- * Writes a single byte of terminal data to the typescript, flushing and
- * writing a new timestamp if necessary.
+ * Writes an arbitrary number of bytes of terminal data to the typescript,
+ * flushing and writing new timestamps as necessary.
  *
  * @param typescript
- *     The typescript that the given byte of raw terminal data should be
- *     written to.
+ *     The typescript that the given raw terminal data should be written to.
  *
- * @param c
- *     The single byte of raw terminal data to write to the typescript.
+ * @param data
+ *     The raw terminal data to write to the typescript.
+ *
+ * @param length
+ *     The number of bytes of data to write.
  */
-void guac_terminal_typescript_write(guac_terminal_typescript* typescript,
-        char c);
+void guac_terminal_typescript_write_data(guac_terminal_typescript* typescript,
+        const char* data, int length);
 
 /**
  * Flushes any pending data to the typescript, writing a new timestamp to the
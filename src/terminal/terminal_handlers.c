@@ -296,6 +296,50 @@ int guac_terminal_echo(guac_terminal* term, unsigned char c) {
 
 }
 
+int guac_terminal_echo_text(guac_terminal* term, const char* text,
+        int length) {
+
+    int handled = 0;
+
+    /* Only plain output to the display can be handled in bulk */
+    if (term->pipe_stream != NULL
+            || term->char_mapping[term->active_char_set] != NULL
+            || term->insert_mode)
+        return 0;
+
+    /* Limit to leading run of printable ASCII */
+    while (handled < length && text[handled] >= 0x20 && text[handled] < 0x7F)
+        handled++;
+
+    length = handled;
+    while (length > 0) {
+
+        /* Wrap if necessary */
+        if (term->cursor_col >= term->term_width) {
+            term->cursor_col = 0;
+            guac_terminal_linefeed(term);
+        }
+
+        /* Write as much as fits within current row */
+        int count = term->term_width - term->cursor_col;
+        if (count > length)
+            count = length;
+
+        guac_terminal_set_text(term, term->cursor_row, term->cursor_col,
+                text, count);
+
+        /* Advance cursor */
+        term->cursor_col += count;
+
+        text += count;
+        length -= count;
+
+    }
+
+    return handled;
+
+}
+
 int guac_terminal_escape(guac_terminal* term, unsigned char c) {
 
     switch (c) {
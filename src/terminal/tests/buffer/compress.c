@@ -0,0 +1,476 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "terminal/buffer.h"
+#include "terminal/types.h"
+
+#include <CUnit/CUnit.h>
+
+#include <string.h>
+
+/**
+ * The number of rows visible within each test buffer.
+ */
+#define TEST_HEIGHT 24
+
+/**
+ * The number of columns written to each row of each test buffer.
+ */
+#define TEST_WIDTH 80
+
+/**
+ * The total number of rows within each test buffer, including scrollback.
+ * This leaves room for rows beyond GUAC_TERMINAL_BUFFER_HOT_ROWS which will
+ * be compressed.
+ */
+#define TEST_ROWS (GUAC_TERMINAL_BUFFER_HOT_ROWS + TEST_HEIGHT + 64)
+
+/**
+ * The number of rows which each test buffer must be scrolled by for all rows
+ * currently visible to be compressed.
+ */
+#define TEST_FREEZE_SCROLL (GUAC_TERMINAL_BUFFER_HOT_ROWS + TEST_HEIGHT)
+
+/**
+ * The codepoint of a character occupying two columns.
+ */
+#define TEST_WIDE_CHAR 0x4E00
+
+/**
+ * Initializes the given character with the given codepoint and width, and
+ * with attributes which are unique to the given color number.
+ *
+ * @param character
+ *     The character to initialize.
+ *
+ * @param value
+ *     The codepoint of the character.
+ *
+ * @param width
+ *     The number of columns occupied by the character.
+ *
+ * @param color
+ *     An arbitrary number between 0 and 65535 inclusive which determines the
+ *     foreground color of the character.
+ */
+static void make_char(guac_terminal_char* character, int value, int width,
+        int color) {
+
+    memset(character, 0, sizeof(guac_terminal_char));
+
+    character->value = value;
+    character->width = width;
+    character->attributes.foreground.red = color & 0xFF;
+    character->attributes.foreground.green = (color >> 8) & 0xFF;
+
+}
+
+/**
+ * Allocates a new buffer having the given number of rows, where the default
+ * character is a space with all attributes zeroed.
+ *
+ * @param rows
+ *     The total number of rows within the buffer, including scrollback.
+ *
+ * @return
+ *     A newly-allocated buffer.
+ */
+static guac_terminal_buffer* alloc_buffer(int rows) {
+
+    guac_terminal_char blank;
+    make_char(&blank, ' ', 1, 0);
+
+    return guac_terminal_buffer_alloc(rows, &blank);
+
+}
+
+/**
+ * Scrolls the given buffer up by the given number of rows, one row at a
+ * time, clearing each new bottom row as the terminal would.
+ *
+ * @param buffer
+ *     The buffer to scroll.
+ *
+ * @param amount
+ *     The number of rows to scroll by.
+ */
+static void scroll(guac_terminal_buffer* buffer, int amount) {
+
+    guac_terminal_char blank;
+    make_char(&blank, ' ', 1, 0);
+
+    while (amount-- > 0) {
+        guac_terminal_buffer_scroll_up(buffer, 1, TEST_HEIGHT);
+        guac_terminal_buffer_set_columns(buffer, TEST_HEIGHT - 1,
+                0, TEST_WIDTH - 1, &blank);
+    }
+
+}
+
+/**
+ * Returns whether the given row of the given buffer is currently
+ * compressed, without decompressing that row.
+ *
+ * @param buffer
+ *     The buffer containing the row.
+ *
+ * @param row
+ *     The row to test, relative to the top of the visible area. Scrollback
+ *     rows have negative indices.
+ *
+ * @return
+ *     Non-zero if the row is compressed, zero otherwise.
+ */
+static int is_compressed(guac_terminal_buffer* buffer, int row) {
+
+    int index = (buffer->top + row) % buffer->available;
+    if (index < 0)
+        index += buffer->available;
+
+    return buffer->rows[index].compressed != NULL;
+
+}
+
+/**
+ * Verifies that the character within the given column of the given row
+ * matches the given codepoint and color number, as would be produced by
+ * make_char(). The width is verified only if the character is not
+ * GUAC_CHAR_CONTINUATION.
+ *
+ * @param buffer
+ *     The buffer containing the row.
+ *
+ * @param row
+ *     The row to read, as returned by guac_terminal_buffer_get_row().
+ *
+ * @param column
+ *     The column of the character to verify.
+ *
+ * @param value
+ *     The expected codepoint.
+ *
+ * @param width
+ *     The expected width.
+ *
+ * @param color
+ *     The expected color number.
+ */
+static void verify_char(guac_terminal_buffer* buffer,
+        guac_terminal_buffer_row* row, int column, int value, int width,
+        int color) {
+
+    guac_terminal_char expected;
+    guac_terminal_char actual;
+
+    make_char(&expected, value, width, color);
+    guac_terminal_buffer_get_char(buffer, row, column, &actual);
+
+    CU_ASSERT_EQUAL(actual.value, expected.value);
+    CU_ASSERT_EQUAL(actual.attributes.foreground.red,
+            expected.attributes.foreground.red);
+    CU_ASSERT_EQUAL(actual.attributes.foreground.green,
+            expected.attributes.foreground.green);
+    CU_ASSERT_EQUAL(actual.attributes.background.red, 0);
+    CU_ASSERT_FALSE(actual.attributes.bold);
+
+    if (value != GUAC_CHAR_CONTINUATION)
+        CU_ASSERT_EQUAL(actual.width, expected.width);
+
+}
+
+/**
+ * Returns the codepoint stored within the given column, between columns 1200
+ * and 1299 inclusive, by test_buffer__compress_long_runs(). Distinct
+ * characters surround a run of four identical characters, just long enough
+ * to be stored as a run.
+ *
+ * @param column
+ *     The column of the character.
+ *
+ * @return
+ *     The codepoint of the character within the given column.
+ */
+static int run_value(int column) {
+
+    if (column >= 1248 && column < 1252)
+        return 'y';
+
+    return 'a' + column % 26;
+
+}
+
+/**
+ * Verifies that rows which were never written, and rows containing only the
+ * default character, read back as the default character once compressed.
+ */
+void test_buffer__compress_empty_rows() {
+
+    guac_terminal_buffer* buffer = alloc_buffer(TEST_ROWS);
+    int row, column;
+
+    /* Scroll rows which were never written into compressed scrollback,
+     * clearing each new bottom row to the default character */
+    scroll(buffer, TEST_FREEZE_SCROLL + TEST_HEIGHT);
+
+    for (row = -TEST_FREEZE_SCROLL - TEST_HEIGHT;
+            row < -GUAC_TERMINAL_BUFFER_HOT_ROWS; row++) {
+
+        /* The rows originally visible were never written and remain empty,
+         * while the rows cleared by each scroll are compressed */
+        CU_ASSERT_EQUAL(is_compressed(buffer, row),
+                row >= -TEST_FREEZE_SCROLL);
+
+        guac_terminal_buffer_row* buffer_row =
+            guac_terminal_buffer_get_row(buffer, row, 0);
+
+        for (column = 0; column < TEST_WIDTH; column++)
+            verify_char(buffer, buffer_row, column, ' ', 1, 0);
+
+    }
+
+    guac_terminal_buffer_free(buffer);
+
+}
+
+/**
+ * Verifies that wide characters and their continuation characters survive
+ * compression, including wide characters mixed with single-column
+ * characters of the same attributes.
+ */
+void test_buffer__compress_wide_chars() {
+
+    guac_terminal_buffer* buffer = alloc_buffer(TEST_ROWS);
+    guac_terminal_char character;
+    int column;
+
+    /* Alternate wide and single-column characters */
+    for (column = 0; column + 2 < TEST_WIDTH; column += 3) {
+        make_char(&character, TEST_WIDE_CHAR + column, 2, 1);
+        guac_terminal_buffer_set_columns(buffer, 0, column, column,
+                &character);
+        make_char(&character, 'a' + column % 26, 1, 1);
+        guac_terminal_buffer_set_columns(buffer, 0, column + 2, column + 2,
+                &character);
+    }
+
+    /* Fill an entire row with a repeated wide character */
+    make_char(&character, TEST_WIDE_CHAR, 2, 2);
+    guac_terminal_buffer_set_columns(buffer, 1, 0, TEST_WIDTH - 2,
+            &character);
+
+    scroll(buffer, TEST_FREEZE_SCROLL);
+    CU_ASSERT_TRUE(is_compressed(buffer, -TEST_FREEZE_SCROLL));
+    CU_ASSERT_TRUE(is_compressed(buffer, 1 - TEST_FREEZE_SCROLL));
+
+    guac_terminal_buffer_row* row =
+        guac_terminal_buffer_get_row(buffer, -TEST_FREEZE_SCROLL, 0);
+
+    for (column = 0; column + 2 < TEST_WIDTH; column += 3) {
+        verify_char(buffer, row, column, TEST_WIDE_CHAR + column, 2, 1);
+        verify_char(buffer, row, column + 1, GUAC_CHAR_CONTINUATION, 0, 1);
+        verify_char(buffer, row, column + 2, 'a' + column % 26, 1, 1);
+    }
+
+    row = guac_terminal_buffer_get_row(buffer, 1 - TEST_FREEZE_SCROLL, 0);
+
+    for (column = 0; column < TEST_WIDTH; column += 2) {
+        verify_char(buffer, row, column, TEST_WIDE_CHAR, 2, 2);
+        verify_char(buffer, row, column + 1, GUAC_CHAR_CONTINUATION, 0, 2);
+    }
+
+    guac_terminal_buffer_free(buffer);
+
+}
+
+/**
+ * Verifies that runs of identical characters long enough to require
+ * multi-byte lengths survive compression, along with the characters
+ * surrounding those runs.
+ */
+void test_buffer__compress_long_runs() {
+
+    guac_terminal_buffer* buffer = alloc_buffer(TEST_ROWS);
+    guac_terminal_char character;
+    int column;
+
+    /* 1000 identical characters, followed by 200 of another color */
+    make_char(&character, 'x', 1, 3);
+    guac_terminal_buffer_set_columns(buffer, 0, 0, 999, &character);
+    make_char(&character, 'x', 1, 4);
+    guac_terminal_buffer_set_columns(buffer, 0, 1000, 1199, &character);
+
+    /* Distinct characters surrounding a short run */
+    for (column = 1200; column < 1300; column++) {
+        make_char(&character, run_value(column), 1, 4);
+        guac_terminal_buffer_set_columns(buffer, 0, column, column,
+                &character);
+    }
+
+    scroll(buffer, TEST_FREEZE_SCROLL);
+    CU_ASSERT_TRUE(is_compressed(buffer, -TEST_FREEZE_SCROLL));
+
+    guac_terminal_buffer_row* row =
+        guac_terminal_buffer_get_row(buffer, -TEST_FREEZE_SCROLL, 0);
+    CU_ASSERT_EQUAL(row->length, 1300);
+
+    for (column = 0; column < 1000; column++)
+        verify_char(buffer, row, column, 'x', 1, 3);
+
+    for (column = 1000; column < 1200; column++)
+        verify_char(buffer, row, column, 'x', 1, 4);
+
+    for (column = 1200; column < 1300; column++)
+        verify_char(buffer, row, column, run_value(column), 1, 4);
+
+    guac_terminal_buffer_free(buffer);
+
+}
+
+/**
+ * Verifies that characters whose interned attributes have indices too large
+ * to be stored within a single byte survive compression.
+ */
+void test_buffer__compress_attribute_indices() {
+
+    guac_terminal_buffer* buffer = alloc_buffer(TEST_ROWS);
+    guac_terminal_char character;
+    int column;
+
+    /* Intern 300 distinct sets of attributes in a single row, alternating
+     * between short runs and runs of identical characters */
+    for (column = 0; column < 300 * 4; column++) {
+        make_char(&character, (column / 4) % 2 ? 'z' : 'a' + column % 26, 1,
+                column / 4);
+        guac_terminal_buffer_set_columns(buffer, 0, column, column,
+                &character);
+    }
+
+    CU_ASSERT_TRUE(buffer->attributes_length >= 300);
+
+    scroll(buffer, TEST_FREEZE_SCROLL);
+    CU_ASSERT_TRUE(is_compressed(buffer, -TEST_FREEZE_SCROLL));
+
+    guac_terminal_buffer_row* row =
+        guac_terminal_buffer_get_row(buffer, -TEST_FREEZE_SCROLL, 0);
+
+    for (column = 0; column < 300 * 4; column++)
+        verify_char(buffer, row, column,
+                (column / 4) % 2 ? 'z' : 'a' + column % 26, 1, column / 4);
+
+    guac_terminal_buffer_free(buffer);
+
+}
+
+/**
+ * Verifies that a compressed row which is decompressed and then modified is
+ * compressed again with those modifications intact.
+ */
+void test_buffer__compress_modified_rows() {
+
+    guac_terminal_buffer* buffer = alloc_buffer(TEST_ROWS);
+    guac_terminal_char character;
+    int column;
+
+    make_char(&character, 'a', 1, 5);
+    guac_terminal_buffer_set_columns(buffer, 0, 0, TEST_WIDTH - 1,
+            &character);
+
+    scroll(buffer, TEST_FREEZE_SCROLL);
+    CU_ASSERT_TRUE(is_compressed(buffer, -TEST_FREEZE_SCROLL));
+
+    /* Modify the row once decompressed, extending it beyond its original
+     * length */
+    make_char(&character, 'b', 1, 6);
+    guac_terminal_buffer_set_columns(buffer, -TEST_FREEZE_SCROLL, 10, 19,
+            &character);
+    make_char(&character, TEST_WIDE_CHAR, 2, 7);
+    guac_terminal_buffer_set_columns(buffer, -TEST_FREEZE_SCROLL,
+            TEST_WIDTH, TEST_WIDTH, &character);
+    CU_ASSERT_FALSE(is_compressed(buffer, -TEST_FREEZE_SCROLL));
+
+    /* The row is compressed again by the next scroll */
+    scroll(buffer, 1);
+    CU_ASSERT_TRUE(is_compressed(buffer, -1 - TEST_FREEZE_SCROLL));
+
+    guac_terminal_buffer_row* row =
+        guac_terminal_buffer_get_row(buffer, -1 - TEST_FREEZE_SCROLL, 0);
+    CU_ASSERT_EQUAL(row->length, TEST_WIDTH + 2);
+
+    for (column = 0; column < TEST_WIDTH; column++)
+        verify_char(buffer, row, column, column >= 10 && column < 20
+                ? 'b' : 'a', 1, column >= 10 && column < 20 ? 6 : 5);
+
+    verify_char(buffer, row, TEST_WIDTH, TEST_WIDE_CHAR, 2, 7);
+    verify_char(buffer, row, TEST_WIDTH + 1, GUAC_CHAR_CONTINUATION, 0, 7);
+
+    guac_terminal_buffer_free(buffer);
+
+}
+
+/**
+ * Verifies that the most recent rows of scrollback remain intact after the
+ * scrollback has wrapped around several times, recycling compressed rows as
+ * new rows.
+ */
+void test_buffer__compress_scrollback_wrap() {
+
+    guac_terminal_buffer* buffer = alloc_buffer(TEST_ROWS);
+    guac_terminal_char character;
+    int line, row, column;
+
+    int lines = TEST_ROWS * 3 + 7;
+
+    /* Write a distinct line to the bottom of the terminal before each
+     * scroll */
+    for (line = 0; line < lines; line++) {
+
+        for (column = 0; column < TEST_WIDTH; column++) {
+            make_char(&character, 'a' + (line + column / 8) % 26, 1, line);
+            guac_terminal_buffer_set_columns(buffer, TEST_HEIGHT - 1,
+                    column, column, &character);
+        }
+
+        scroll(buffer, 1);
+
+    }
+
+    CU_ASSERT_EQUAL(buffer->length, TEST_ROWS);
+
+    /* The row written before the Nth most recent scroll is now N rows above
+     * the bottom of the terminal */
+    for (row = TEST_HEIGHT - TEST_ROWS; row < TEST_HEIGHT - 1; row++) {
+
+        line = lines - (TEST_HEIGHT - 1 - row);
+
+        if (row < -GUAC_TERMINAL_BUFFER_HOT_ROWS)
+            CU_ASSERT_TRUE(is_compressed(buffer, row));
+
+        guac_terminal_buffer_row* buffer_row =
+            guac_terminal_buffer_get_row(buffer, row, 0);
+
+        for (column = 0; column < TEST_WIDTH; column++)
+            verify_char(buffer, buffer_row, column,
+                    'a' + (line + column / 8) % 26, 1, line);
+
+    }
+
+    guac_terminal_buffer_free(buffer);
+
+}
+
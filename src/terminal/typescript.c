@@ -26,6 +26,7 @@
 #include <errno.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 #include <unistd.h>
 
 #include <sys/types.h>
@@ -160,15 +161,27 @@ guac_terminal_typescript* guac_terminal_typescript_alloc(const char* path,
 
 }
 
-void guac_terminal_typescript_write(guac_terminal_typescript* typescript,
-        char c) {
+void guac_terminal_typescript_write_data(guac_terminal_typescript* typescript,
+        const char* data, int length) {
 
-    /* Flush buffer if no space is available */
-    if (typescript->length == sizeof(typescript->buffer))
-        guac_terminal_typescript_flush(typescript);
+    while (length > 0) {
 
-    /* Append single byte to buffer */
-    typescript->buffer[typescript->length++] = c;
+        /* Flush buffer if no space is available */
+        if (typescript->length == sizeof(typescript->buffer))
+            guac_terminal_typescript_flush(typescript);
+
+        /* Append as much data as will fit within buffer */
+        int chunk = sizeof(typescript->buffer) - typescript->length;
+        if (chunk > length)
+            chunk = length;
+
+        memcpy(typescript->buffer + typescript->length, data, chunk);
+        typescript->length += chunk;
+
+        data += chunk;
+        length -= chunk;
+
+    }
 
 }
 